@@ -30,6 +30,8 @@
 #include <ironautomata/intermediate.hpp>
 #include <ironautomata/optimize_edges.hpp>
 
+#include "peak_memory.hpp"
+
 #include <boost/lexical_cast.hpp>
 
 #ifdef __clang__
@@ -103,6 +105,8 @@ int main(int argc, char** argv)
 
     size_t chunk_size = 0;
     bool pattern = false;
+    size_t threads = 1;
+    bool report = false;
 
     po::options_description desc("Options:");
     desc.add_options()
@@ -113,6 +117,13 @@ int main(int argc, char** argv)
         ("pattern,p",
             po::bool_switch(&pattern),
             "interpret inputs as AC patterns")
+        ("threads,j",
+            po::value<size_t>(&threads),
+            "optimize edges with this many threads; "
+            "0 = one per hardware thread; default 1")
+        ("report,r",
+            po::bool_switch(&report),
+            "report time of each pass and peak memory to stderr")
         ;
 
     po::variables_map vm;
@@ -131,12 +142,16 @@ int main(int argc, char** argv)
     }
 
     ia::Intermediate::Automata a;
+    boost::chrono::steady_clock::time_point start =
+        boost::chrono::steady_clock::now();
     ia::Generator::aho_corasick_begin(a);
 
     string s;
+    size_t num_inputs = 0;
     while (cin) {
         getline(cin, s);
         if (! s.empty()) {
+            ++num_inputs;
             if (! pattern) {
                 ia::Generator::aho_corasick_add_length(a, s);
             }
@@ -147,11 +162,32 @@ int main(int argc, char** argv)
             }
         }
     }
+    if (report) {
+        cerr << "inputs              = " << num_inputs << endl;
+        cerr << "add_seconds         = " << seconds_since(start) << endl;
+    }
 
+    start = boost::chrono::steady_clock::now();
     ia::Generator::aho_corasick_finish(a);
+    if (report) {
+        cerr << "finish_seconds      = " << seconds_since(start) << endl;
+    }
 
-    ia::Intermediate::breadth_first(a, ia::Intermediate::optimize_edges);
+    start = boost::chrono::steady_clock::now();
+    ia::Intermediate::parallel_for_each_node(
+        a,
+        ia::Intermediate::optimize_edges,
+        threads
+    );
+    if (report) {
+        cerr << "optimize_seconds    = " << seconds_since(start) << endl;
+    }
+
+    start = boost::chrono::steady_clock::now();
     ia::Intermediate::deduplicate_outputs(a);
+    if (report) {
+        cerr << "deduplicate_seconds = " << seconds_since(start) << endl;
+    }
 
     if (pattern) {
         a.metadata()[c_output_type_key] = c_output_type_string;
@@ -160,6 +196,10 @@ int main(int argc, char** argv)
         a.metadata()[c_output_type_key] = c_output_type_length;
     }
 
-
+    start = boost::chrono::steady_clock::now();
     ia::Intermediate::write_automata(a, cout, chunk_size);
+    if (report) {
+        cerr << "write_seconds       = " << seconds_since(start) << endl;
+        cerr << "peak_memory         = " << peak_memory() << endl;
+    }
 }
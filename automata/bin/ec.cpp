@@ -30,6 +30,8 @@
 
 #include <ironautomata/eudoxus_compiler.hpp>
 
+#include "peak_memory.hpp"
+
 #include <boost/exception/all.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -42,6 +44,8 @@
 #pragma clang diagnostic pop
 #endif
 
+#include <vector>
+
 using namespace std;
 using namespace IronAutomata;
 
@@ -55,6 +59,9 @@ int main(int argc, char **argv)
     size_t id_width = 0;
     size_t align_to = 1;
     double high_node_weight = 1.0;
+    size_t split_low_edges_degree = 0;
+    vector<string> profiles_s;
+    EudoxusCompiler::configuration_t configuration;
 
     po::options_description desc("Options:");
     desc.add_options()
@@ -77,6 +84,33 @@ int main(int argc, char **argv)
             "> 1 favors low nodes; < 1 favors high nodes; 1.0 = smallest; "
             "default 1.0"
         )
+        ("split-low-edges,S", po::value<size_t>(&split_low_edges_degree),
+            "store edge labels of low nodes with at least this many edges "
+            "contiguously for vector lookup; uses more space; "
+            "default 0 = never"
+        )
+        ("profile,p",
+            po::value<vector<string> >(&profiles_s)->composing(),
+            "lay out nodes by node visits written by ee --profile for an "
+            "automata compiled with the same options; may be repeated to "
+            "sum the visits of several profiles"
+        )
+        ("hot-coverage", po::value<double>(&configuration.hot_coverage),
+            "with profile; hot nodes are the most visited nodes making up "
+            "this fraction of visits; default 0.9"
+        )
+        ("hot-high-node-weight",
+            po::value<double>(&configuration.hot_high_node_weight),
+            "with profile; high node weight for hot nodes; default 1.0"
+        )
+        ("hot-align", po::value<size_t>(&configuration.hot_align_to),
+            "with profile; keep hot nodes within lines of this size, "
+            "e.g., 64; default 1 = never"
+        )
+        ("threads,j", po::value<size_t>(&configuration.threads),
+            "analyze nodes with this many threads; 0 = one per hardware "
+            "thread; default 1"
+        )
         ;
 
     po::positional_options_description pd;
@@ -119,6 +153,43 @@ int main(int argc, char **argv)
         output.replace_extension(".e");
     }
 
+    for (size_t i = 0; i < profiles_s.size(); ++i) {
+        const string& profile_s = profiles_s[i];
+        EudoxusCompiler::profile_t profile;
+
+        fs::ifstream profile_stream(profile_s);
+        if (! profile_stream) {
+            cout << "Error: Could not open " << profile_s << " for reading."
+                 << endl;
+            return 1;
+        }
+        try {
+            profile = EudoxusCompiler::read_profile(profile_stream);
+        }
+        catch (const exception& e) {
+            cout << "Error: " << profile_s << ": " << e.what() << endl;
+            return 1;
+        }
+
+        if (i == 0) {
+            configuration.profile = profile;
+            continue;
+        }
+        if (profile.data_length != configuration.profile.data_length) {
+            cout << "Error: " << profile_s << ": Profile of a different "
+                 << "automata than " << profiles_s[0] << "." << endl;
+            return 1;
+        }
+        for (
+            EudoxusCompiler::profile_t::visits_t::const_iterator j =
+                profile.visits.begin();
+            j != profile.visits.end();
+            ++j
+        ) {
+            configuration.profile.visits[j->first] += j->second;
+        }
+    }
+
     fs::ifstream input_stream(input);
     if (! input_stream) {
         cout << "Error: Could not open " << input_s << " for reading."
@@ -136,6 +207,8 @@ int main(int argc, char **argv)
     Intermediate::Automata automata;
     bool success = false;
     try {
+        boost::chrono::steady_clock::time_point start =
+            boost::chrono::steady_clock::now();
         success = Intermediate::read_automata(
             automata,
             input_stream,
@@ -144,11 +217,12 @@ int main(int argc, char **argv)
         if (! success) {
             return 1;
         }
+        double read_seconds = seconds_since(start);
         EudoxusCompiler::result_t result;
-        EudoxusCompiler::configuration_t configuration;
         configuration.id_width = id_width;
         configuration.align_to = align_to;
         configuration.high_node_weight = high_node_weight;
+        configuration.split_low_edges_degree = split_low_edges_degree;
         try {
             result = EudoxusCompiler::compile(automata, configuration);
         }
@@ -162,6 +236,7 @@ int main(int argc, char **argv)
         cout << "id_width         = " << result.configuration.id_width << endl;
         cout << "align_to         = " << result.configuration.align_to << endl;
         cout << "high_node_weight = " << result.configuration.high_node_weight << endl;
+        cout << "split_low_edges  = " << result.configuration.split_low_edges_degree << endl;
         cout << "ids_used         = " << result.ids_used << endl;
         cout << "padding          = " << result.padding << endl;
         cout << "low_nodes        = " << result.low_nodes << endl;
@@ -170,6 +245,17 @@ int main(int argc, char **argv)
         cout << "high_nodes_bytes = " << result.high_nodes_bytes << endl;
         cout << "pc_nodes         = " << result.pc_nodes << endl;
         cout << "pc_nodes_bytes   = " << result.pc_nodes_bytes << endl;
+        if (result.configuration.profile.data_length > 0) {
+            cout << "hot_nodes        = " << result.hot_nodes << endl;
+            cout << "hot_nodes_bytes  = " << result.hot_nodes_bytes << endl;
+        }
+        cout << "read_seconds     = " << read_seconds << endl;
+        cout << "analyze_seconds  = " << result.analyze_seconds << endl;
+        if (result.configuration.profile.data_length > 0) {
+            cout << "layout_seconds   = " << result.layout_seconds << endl;
+        }
+        cout << "assemble_seconds = " << result.assemble_seconds << endl;
+        cout << "peak_memory      = " << peak_memory() << endl;
 
         static const int c_id_widths[] = {1, 2, 4, 8};
         for (int i = 0; i < 4; ++i) {
@@ -192,13 +278,16 @@ int main(int argc, char **argv)
     catch (const boost::exception& e) {
         cout << "Error: Exception:" << endl;
         cout << diagnostic_information(e) << endl;
+        success = false;
     }
     catch (const exception& e) {
         cout << "Error: Exception:" << endl;
         cout << e.what() << endl;
+        success = false;
     }
     catch (...) {
         cout << "Error: Unknown Exception" << endl;
+        success = false;
     }
 
     return (success ? 0 : 1);
@@ -20,7 +20,9 @@
  * @brief IronBee --- Eudoxus Benchmarker
  *
  * A command line executor for Eudoxus.  Runs automata against inputs and
- * records output and timing information.
+ * records output and timing information.  With --benchmark, instead runs a
+ * memory mapped input repeatedly and reports throughput and node visits for
+ * one or two automata.
  *
  * @author Christopher Alfeld <calfeld@qualys.com>
  */
@@ -44,6 +46,11 @@
 
 #include <fstream>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using namespace std;
 
 /**
@@ -215,6 +222,20 @@ ia_eudoxus_command_t c_output_callback(
     return IA_EUDOXUS_CMD_CONTINUE;
 }
 
+//! Eudoxus callback for benchmarking.  Increments size_t at @a data.
+ia_eudoxus_command_t c_count_callback(
+    ia_eudoxus_t*, // unused
+    const char*,   // unused
+    size_t,        // unused
+    const uint8_t*, // unused
+    void* data
+)
+{
+    ++*reinterpret_cast<size_t*>(data);
+
+    return IA_EUDOXUS_CMD_CONTINUE;
+}
+
 }
 
 //! Transform output into a string directly.
@@ -341,6 +362,295 @@ void output_eudoxus_result(const ia_eudoxus_t* eudoxus, ia_eudoxus_result_t rc)
     cout << "Eudoxus Reported " << rc_message << ": " << message << endl;
 }
 
+/**
+ * Memory mapped input for benchmarking.
+ *
+ * Mapping the input keeps I/O and copying out of the measured time.
+ */
+class Corpus
+{
+public:
+    //! Constructor.  Check valid() afterwards.
+    explicit
+    Corpus(const string& path) :
+        m_data(NULL),
+        m_length(0),
+        m_valid(false)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            m_length = st.st_size;
+            if (m_length == 0) {
+                m_valid = true;
+            }
+            else {
+                void* data = mmap(NULL, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data != MAP_FAILED) {
+                    m_data = reinterpret_cast<const uint8_t*>(data);
+                    m_valid = true;
+                }
+            }
+        }
+        close(fd);
+    }
+
+    //! Destructor.  Unmaps input.
+    ~Corpus()
+    {
+        if (m_data) {
+            munmap(const_cast<uint8_t*>(m_data), m_length);
+        }
+    }
+
+    //! True iff input was mapped.
+    bool valid() const
+    {
+        return m_valid;
+    }
+
+    //! Input.
+    const uint8_t* data() const
+    {
+        return m_data;
+    }
+
+    //! Length of input.
+    size_t length() const
+    {
+        return m_length;
+    }
+
+private:
+    // Not copyable.
+    Corpus(const Corpus&);
+    Corpus& operator=(const Corpus&);
+
+    const uint8_t* m_data;
+    size_t m_length;
+    bool m_valid;
+};
+
+//! Results of benchmarking a single automata.
+struct benchmark_result_t
+{
+    //! Seconds spent in measured runs.
+    double seconds;
+    //! Outputs generated per run.
+    size_t outputs;
+    //! Input bytes consumed per run; less than the corpus if it ended.
+    size_t consumed;
+    //! Visited nodes by type; see ia_eudoxus_profile_histogram().
+    uint64_t nodes[IA_EUDOXUS_NUM_NODE_TYPES];
+    //! Visits by type; see ia_eudoxus_profile_histogram().
+    uint64_t visits[IA_EUDOXUS_NUM_NODE_TYPES];
+};
+
+/**
+ * Run @a corpus through @a eudoxus once, counting outputs.
+ *
+ * If the automata ends before the end of @a corpus, the run succeeds but
+ * @a consumed is less than the length of @a corpus.
+ *
+ * @param[in]  eudoxus  Eudoxus.
+ * @param[in]  corpus   Input.
+ * @param[in]  final    If true, only generate output for final node.
+ * @param[out] outputs  Number of outputs generated.
+ * @param[out] consumed Number of input bytes consumed.
+ * @return IA_EUDOXUS_OK on success, other result code on failure.
+ */
+ia_eudoxus_result_t benchmark_run(
+    ia_eudoxus_t* eudoxus,
+    const Corpus& corpus,
+    bool          final,
+    size_t&       outputs,
+    size_t&       consumed
+)
+{
+    ia_eudoxus_state_t* state;
+    ia_eudoxus_result_t rc;
+
+    outputs = 0;
+    rc = ia_eudoxus_create_state(
+        &state,
+        eudoxus,
+        c_count_callback,
+        reinterpret_cast<void*>(&outputs)
+    );
+    if (rc != IA_EUDOXUS_OK) {
+        return rc;
+    }
+
+    if (final) {
+        rc = ia_eudoxus_execute_without_output(
+            state, corpus.data(), corpus.length()
+        );
+        if (rc == IA_EUDOXUS_OK) {
+            rc = ia_eudoxus_execute(state, NULL, 0);
+        }
+    }
+    else {
+        rc = ia_eudoxus_execute(state, corpus.data(), corpus.length());
+    }
+    consumed = corpus.length() - ia_eudoxus_remaining_bytes(state);
+    ia_eudoxus_destroy_state(state);
+
+    return rc == IA_EUDOXUS_END ? IA_EUDOXUS_OK : rc;
+}
+
+/**
+ * Benchmark automata at @a path against @a corpus.
+ *
+ * Does @a warmup untimed runs followed by @a runs timed runs and then a
+ * single profiled run to gather node visits.  Profiling is kept out of the
+ * timed runs as it slows execution considerably.
+ *
+ * @param[in]  path    Path to automata.
+ * @param[in]  corpus  Input.
+ * @param[in]  warmup  Number of untimed runs.
+ * @param[in]  runs    Number of timed runs.
+ * @param[in]  final   If true, only generate output for final node.
+ * @param[out] result  Results.
+ * @return true on success, false on failure; errors are written to cout.
+ */
+bool benchmark_automata(
+    const string&       path,
+    const Corpus&       corpus,
+    size_t              warmup,
+    size_t              runs,
+    bool                final,
+    benchmark_result_t& result
+)
+{
+    typedef boost::chrono::high_resolution_clock clock_t;
+    typedef boost::chrono::duration<double> seconds_t;
+
+    ia_eudoxus_result_t rc;
+    ia_eudoxus_t* eudoxus;
+
+    rc = ia_eudoxus_create_from_path(&eudoxus, path.c_str());
+    if (rc != IA_EUDOXUS_OK) {
+        output_eudoxus_result(NULL, rc);
+        return false;
+    }
+
+    result.seconds = 0;
+    for (size_t i = 0; i < warmup + runs; ++i) {
+        clock_t::time_point start = clock_t::now();
+        rc = benchmark_run(
+            eudoxus, corpus, final, result.outputs, result.consumed
+        );
+        if (rc != IA_EUDOXUS_OK) {
+            output_eudoxus_result(eudoxus, rc);
+            ia_eudoxus_destroy(eudoxus);
+            return false;
+        }
+        if (i >= warmup) {
+            result.seconds += seconds_t(clock_t::now() - start).count();
+        }
+    }
+
+    size_t outputs;
+    size_t consumed;
+    rc = ia_eudoxus_enable_profile(eudoxus);
+    if (rc == IA_EUDOXUS_OK) {
+        rc = benchmark_run(eudoxus, corpus, final, outputs, consumed);
+    }
+    if (rc == IA_EUDOXUS_OK) {
+        rc = ia_eudoxus_profile_histogram(
+            eudoxus,
+            result.nodes,
+            result.visits
+        );
+    }
+    if (rc != IA_EUDOXUS_OK) {
+        output_eudoxus_result(eudoxus, rc);
+        ia_eudoxus_destroy(eudoxus);
+        return false;
+    }
+
+    ia_eudoxus_destroy(eudoxus);
+
+    return true;
+}
+
+/**
+ * Throughput of @a result in bytes per second.
+ *
+ * Only consumed bytes count, so that an automata that ends early is not
+ * credited with the rest of the input.
+ *
+ * @param[in] runs   Number of timed runs.
+ * @param[in] result Results.
+ * @return Consumed bytes per second.
+ */
+double benchmark_throughput(
+    size_t                    runs,
+    const benchmark_result_t& result
+)
+{
+    return double(result.consumed) * runs / result.seconds;
+}
+
+/**
+ * Write benchmark results to cout.
+ *
+ * Throughput and latency are of the consumed bytes.  If the automata ended
+ * before the end of the input, this is reported.
+ *
+ * @param[in] path   Path to automata.
+ * @param[in] length Length of input.
+ * @param[in] runs   Number of timed runs.
+ * @param[in] result Results.
+ */
+void output_benchmark_result(
+    const string&             path,
+    size_t                    length,
+    size_t                    runs,
+    const benchmark_result_t& result
+)
+{
+    static const char* c_node_type_names[IA_EUDOXUS_NUM_NODE_TYPES] = {
+        "low", "high", "pc", "extended"
+    };
+
+    double bytes = double(result.consumed) * runs;
+    uint64_t total_visits = 0;
+    for (int i = 0; i < IA_EUDOXUS_NUM_NODE_TYPES; ++i) {
+        total_visits += result.visits[i];
+    }
+
+    cout << "Automata: " << path << endl;
+    cout << boost::format("  %-12s %d bytes x %d runs in %.3f ms\n")
+        % "Input:" % length % runs % (result.seconds * 1e3);
+    if (result.consumed < length) {
+        cout << boost::format("  %-12s automata ended after %d bytes\n")
+            % "Ended:" % result.consumed;
+    }
+    cout << boost::format("  %-12s %.2f MB/s\n")
+        % "Throughput:" % (benchmark_throughput(runs, result) / 1e6);
+    cout << boost::format("  %-12s %.3f ns/byte\n")
+        % "Latency:" % (result.seconds * 1e9 / bytes);
+    cout << boost::format("  %-12s %d per run, %.0f per second\n")
+        % "Outputs:" % result.outputs
+        % (double(result.outputs) * runs / result.seconds);
+    cout << boost::format("  %-12s %8s %12s %7s\n")
+        % "Node Type" % "Nodes" % "Visits" % "Share";
+    for (int i = 0; i < IA_EUDOXUS_NUM_NODE_TYPES; ++i) {
+        cout << boost::format("  %-12s %8d %12d %6.2f%%\n")
+            % c_node_type_names[i]
+            % result.nodes[i]
+            % result.visits[i]
+            % (
+                total_visits == 0 ?
+                0.0 : 100.0 * result.visits[i] / total_visits
+            );
+    }
+}
+
 //! Main.
 int main(int argc, char **argv)
 {
@@ -353,11 +663,15 @@ int main(int argc, char **argv)
     string automata_s;
     string output_type_s("auto");
     string record_s("list");
+    string profile_s;
     size_t block_size = 1024;
     size_t overlap_size = 128;
     bool no_output = false;
     bool final = false;
     bool list_output = false;
+    bool benchmark = false;
+    string compare_s;
+    size_t warmup = 1;
     size_t n = 1;
 
     po::options_description desc("Options:");
@@ -393,6 +707,18 @@ int main(int argc, char **argv)
         ("list-output,L", po::bool_switch(&list_output),
             "list all outputs of automata and exit"
         )
+        ("profile,p", po::value<string>(&profile_s),
+            "write node visit counts to this file; see ec --profile"
+        )
+        ("benchmark,b", po::bool_switch(&benchmark),
+            "map input and report throughput and node visits over num-runs"
+        )
+        ("warmup,w", po::value<size_t>(&warmup),
+            "untimed runs before benchmarking; default = 1"
+        )
+        ("compare,c", po::value<string>(&compare_s),
+            "second automata to benchmark against the same input"
+        )
         ;
 
     po::positional_options_description pd;
@@ -424,6 +750,63 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    if (benchmark) {
+        if (input_s.empty()) {
+            cout << "Benchmarking requires --input." << endl;
+            return 1;
+        }
+        if (n == 0) {
+            cout << "Benchmarking requires a finite number of runs." << endl;
+            return 1;
+        }
+
+        Corpus corpus(input_s);
+        if (! corpus.valid()) {
+            cout << "Error: Could not map " << input_s << " for reading."
+                 << endl;
+            return 1;
+        }
+        if (corpus.length() == 0) {
+            cout << "Error: " << input_s << " is empty." << endl;
+            return 1;
+        }
+
+        benchmark_result_t result;
+        if (! benchmark_automata(
+            automata_s, corpus, warmup, n, final, result
+        )) {
+            return 1;
+        }
+        output_benchmark_result(automata_s, corpus.length(), n, result);
+
+        if (! compare_s.empty()) {
+            benchmark_result_t compare_result;
+            if (! benchmark_automata(
+                compare_s, corpus, warmup, n, final, compare_result
+            )) {
+                return 1;
+            }
+            output_benchmark_result(
+                compare_s, corpus.length(), n, compare_result
+            );
+            cout << boost::format(
+                "Comparison: %s runs at %.3fx the throughput of %s\n"
+            ) % compare_s
+              % (
+                  benchmark_throughput(n, compare_result) /
+                  benchmark_throughput(n, result)
+              )
+              % automata_s;
+        }
+
+        return 0;
+    }
+
+    if (! compare_s.empty()) {
+        cout << "--compare requires --benchmark." << endl;
+        return 1;
+    }
+
     // for memory management only
     boost::scoped_ptr<istream> input_mem;
     boost::scoped_ptr<ostream> output_mem;
@@ -452,6 +835,14 @@ int main(int argc, char **argv)
     }
     cout << "Loaded automata in " << ti.elapsed_ms() << endl;
 
+    if (! profile_s.empty()) {
+        rc = ia_eudoxus_enable_profile(eudoxus);
+        if (rc != IA_EUDOXUS_OK) {
+            output_eudoxus_result(eudoxus, rc);
+            return 1;
+        }
+    }
+
     // Figure out output.
     output_transform_t output_transform;
     if (output_type_s == "auto") {
@@ -646,6 +1037,21 @@ int main(int argc, char **argv)
          << " output=" << ti.elapsed_ms(TimingInfo::OUTPUT)
          << endl;
 
+    if (! profile_s.empty()) {
+        FILE* profile = fopen(profile_s.c_str(), "w");
+        if (! profile) {
+            cout << "Error: Could not open " << profile_s << " for writing."
+                 << endl;
+            return 1;
+        }
+        rc = ia_eudoxus_write_profile(eudoxus, profile);
+        fclose(profile);
+        if (rc != IA_EUDOXUS_OK) {
+            output_eudoxus_result(eudoxus, rc);
+            return 1;
+        }
+    }
+
     ia_eudoxus_destroy(eudoxus);
 
     return 0;
@@ -29,6 +29,8 @@
 #include <ironautomata/optimize_edges.hpp>
 #include <ironautomata/translate_nonadvancing.hpp>
 
+#include "peak_memory.hpp"
+
 #ifdef __clang__
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunused-parameter"
@@ -51,6 +53,7 @@ int main(int argc, char **argv)
     bool do_translate_nonadvancing_conservative = false;
     bool do_translate_nonadvancing_aggressive = false;
     bool do_translate_nonadvancing_structural = false;
+    size_t threads = 1;
 
     po::options_description desc("Options:");
     desc.add_options()
@@ -70,6 +73,10 @@ int main(int argc, char **argv)
             "translate non-advancing edges, aggressive version")
         ("translate-nonadvancing-structural",
             "translate non-advancing edges, structural version [space]")
+        ("threads,j",
+            po::value<size_t>(&threads),
+            "optimize edges with this many threads; "
+            "0 = one per hardware thread; default 1")
         ;
 
     po::variables_map vm;
@@ -146,11 +153,19 @@ int main(int argc, char **argv)
     if (do_optimize_edges) {
         cerr << "Optimize Edges: ";
         cerr.flush();
-        Intermediate::breadth_first(automata, Intermediate::optimize_edges);
-        cerr << "done" << endl;
+        boost::chrono::steady_clock::time_point start =
+            boost::chrono::steady_clock::now();
+        Intermediate::parallel_for_each_node(
+            automata,
+            Intermediate::optimize_edges,
+            threads
+        );
+        cerr << "done in " << seconds_since(start) << "s" << endl;
     }
 
     Intermediate::write_automata(automata, cout);
 
+    cerr << "Peak Memory: " << peak_memory() << endl;
+
     return 0;
 }
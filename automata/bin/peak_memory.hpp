@@ -0,0 +1,52 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef _IA_BIN_PEAK_MEMORY_HPP_
+#define _IA_BIN_PEAK_MEMORY_HPP_
+
+/**
+ * @file
+ * @brief IronAutomata --- Resource reporting for command line tools.
+ */
+
+#include <ironautomata/timing.hpp>
+
+#include <sys/resource.h>
+
+/**
+ * Peak resident memory of this process in bytes.
+ *
+ * @return Peak resident memory or 0 if unknown.
+ */
+inline
+size_t peak_memory()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return usage.ru_maxrss * 1024;
+#endif
+}
+
+//! See IronAutomata::seconds_since().
+using IronAutomata::seconds_since;
+
+#endif
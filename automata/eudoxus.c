@@ -46,11 +46,41 @@
 #include <ironautomata/vls.h>
 
 #include <assert.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Number of states ia_eudoxus_execute_batch() advances in lockstep.
+ *
+ * This should be enough to cover the latency of a cache miss with the steps
+ * of the other states but no more, as every state in flight has its node in
+ * cache.
+ */
+#define IA_EUDOXUS_BATCH_WIDTH 8
+
+/**
+ * Default minimum automata length for ia_eudoxus_execute_batch() to
+ * interleave.
+ *
+ * Smaller automata mostly stay in cache, where switching between states
+ * costs more than it hides; their states are executed one after another.
+ *
+ * @sa ia_eudoxus_set_batch_min_length()
+ */
+#define IA_EUDOXUS_BATCH_MIN_LENGTH (8 * 1024 * 1024)
 
 struct ia_eudoxus_t
 {
@@ -59,6 +89,21 @@ struct ia_eudoxus_t
      */
     const ia_eudoxus_automata_t *automata;
 
+    /**
+     * Length of the mapping of @c automata or 0 if it is not mapped.
+     *
+     * If not mapped, @c automata is freed when the engine is destroyed;
+     * otherwise it is unmapped.
+     */
+    size_t mapped_length;
+
+    /**
+     * Visits of each node by index or NULL if not profiling.
+     *
+     * @sa ia_eudoxus_enable_profile()
+     */
+    uint32_t *profile;
+
     /**
      * Most recent error message.
      *
@@ -78,6 +123,13 @@ struct ia_eudoxus_t
      * otherwise.
      */
     bool free_error_message;
+
+    /**
+     * Minimum automata length for ia_eudoxus_execute_batch() to interleave.
+     *
+     * @sa ia_eudoxus_set_batch_min_length()
+     */
+    size_t batch_min_length;
 };
 
 struct ia_eudoxus_state_t
@@ -193,10 +245,16 @@ ia_eudoxus_result_t ia_eudoxus_create(
     }
 
     eudoxus->automata           = (ia_eudoxus_automata_t *)data;
+    eudoxus->mapped_length      = 0;
+    eudoxus->profile            = NULL;
     eudoxus->error_message      = NULL;
     eudoxus->free_error_message = false;
+    eudoxus->batch_min_length   = IA_EUDOXUS_BATCH_MIN_LENGTH;
 
-    if (eudoxus->automata->version != IA_EUDOXUS_VERSION) {
+    if (
+        eudoxus->automata->version != IA_EUDOXUS_VERSION &&
+        eudoxus->automata->version != IA_EUDOXUS_VERSION_NO_SPLIT
+    ) {
         rc = IA_EUDOXUS_EINCOMPAT;
         goto finish;
     }
@@ -258,6 +316,74 @@ ia_eudoxus_result_t ia_eudoxus_create_from_path(
     return ia_eudoxus_create_from_file(out_eudoxus, fp);
 }
 
+ia_eudoxus_result_t ia_eudoxus_create_from_path_mmap(
+    ia_eudoxus_t **out_eudoxus,
+    const char    *path
+)
+{
+    const ia_eudoxus_automata_t *automata;
+    ia_eudoxus_result_t          rc;
+    struct stat                  st;
+    size_t                       length;
+    void                        *data;
+    int                          fd;
+
+    if (out_eudoxus == NULL || path == NULL) {
+        return IA_EUDOXUS_EINVAL;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return IA_EUDOXUS_END;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return IA_EUDOXUS_EINVAL;
+    }
+    length = (size_t)st.st_size;
+    if (length < sizeof(ia_eudoxus_automata_t)) {
+        close(fd);
+        return IA_EUDOXUS_EINVAL;
+    }
+
+    /* The mapping stays valid after the descriptor is closed. */
+    data = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return IA_EUDOXUS_EALLOC;
+    }
+
+    /* Check that every index of the header is inside the file, as the
+     * engine trusts them. */
+    automata = (const ia_eudoxus_automata_t *)data;
+    if (
+        (
+            automata->version == IA_EUDOXUS_VERSION ||
+            automata->version == IA_EUDOXUS_VERSION_NO_SPLIT
+        ) &&
+        automata->is_big_endian == ia_eudoxus_is_big_endian() &&
+        (
+            automata->data_length > length ||
+            automata->start_index >= automata->data_length ||
+            automata->first_output > automata->data_length ||
+            automata->first_output_list > automata->data_length ||
+            automata->metadata_index > automata->data_length
+        )
+    ) {
+        munmap(data, length);
+        return IA_EUDOXUS_EINVAL;
+    }
+
+    rc = ia_eudoxus_create(out_eudoxus, (char *)data);
+    if (rc != IA_EUDOXUS_OK) {
+        munmap(data, length);
+        return rc;
+    }
+    (*out_eudoxus)->mapped_length = length;
+
+    return IA_EUDOXUS_OK;
+}
+
 void ia_eudoxus_destroy(
     ia_eudoxus_t *eudoxus
 )
@@ -268,9 +394,13 @@ void ia_eudoxus_destroy(
 
     /* Better to cast away const here than to not have const checks for
      * all uses. */
-    if (eudoxus->automata) {
+    if (eudoxus->automata && eudoxus->mapped_length > 0) {
+        munmap((void *)eudoxus->automata, eudoxus->mapped_length);
+    }
+    else if (eudoxus->automata) {
         free((void *)eudoxus->automata);
     }
+    free(eudoxus->profile);
     if (eudoxus->error_message != NULL && eudoxus->free_error_message) {
         free((void *)eudoxus->error_message);
     }
@@ -306,14 +436,15 @@ ia_eudoxus_result_t ia_eudoxus_create_state(
         return IA_EUDOXUS_EINVAL;
     }
 
-    state->eudoxus        = eudoxus;
-    state->callback       = callback;
-    state->callback_data  = callback_data;
-    state->input_location = NULL;
-    state->node           = (ia_eudoxus_node_t *)(
+    state->eudoxus         = eudoxus;
+    state->callback        = callback;
+    state->callback_data   = callback_data;
+    state->input_location  = NULL;
+    state->remaining_bytes = 0;
+    state->node            = (ia_eudoxus_node_t *)(
         (char *)eudoxus->automata + eudoxus->automata->start_index
     );
-    state->byte_index     = 0;
+    state->byte_index      = 0;
 
     *out_state = state;
 
@@ -405,6 +536,88 @@ void ia_eudoxus_set_error_printf(
     va_end(ap);
 }
 
+/**
+ * Prefetch the node at @a p.
+ */
+#if defined(__GNUC__)
+#define IA_EUDOXUS_PREFETCH(p) __builtin_prefetch((p), 0, 3)
+#else
+#define IA_EUDOXUS_PREFETCH(p)
+#endif
+
+/**
+ * Inline a function into each of its callers.
+ *
+ * Used for the step and next functions, which are called by both the single
+ * and the batch execute functions; compilers will not otherwise inline them
+ * into both, which costs the single execute function several percent.
+ */
+#if defined(__GNUC__)
+#define IA_EUDOXUS_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define IA_EUDOXUS_ALWAYS_INLINE inline
+#endif
+
+/**
+ * Find the edge of a low node with split edges labeled @a c.
+ *
+ * With SSE2 (or AVX2) the input is compared against 16 (or 32) labels at
+ * once.  This relies on the labels being padded to IA_EUDOXUS_LABEL_SIZE().
+ * Labels of a node are distinct, so the first match is the only one unless
+ * it is in the padding.
+ *
+ * @param[in] labels     Edge labels.
+ * @param[in] out_degree Number of edges.
+ * @param[in] c          Input byte.
+ * @return Index of the edge labeled @a c or @a out_degree if there is none.
+ */
+static inline
+size_t ia_eudoxus_find_label(
+    const uint8_t *labels,
+    size_t         out_degree,
+    uint8_t        c
+)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    const size_t size = IA_EUDOXUS_LABEL_SIZE(out_degree);
+    unsigned int mask;
+
+#if defined(__AVX2__)
+    const __m256i c32 = _mm256_set1_epi8((char)c);
+    for (; i + 32 <= size; i += 32) {
+        mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            _mm256_loadu_si256((const __m256i *)(labels + i)),
+            c32
+        ));
+        if (mask != 0) {
+            i += __builtin_ctz(mask);
+            return (i < out_degree) ? i : out_degree;
+        }
+    }
+#endif
+    const __m128i c16 = _mm_set1_epi8((char)c);
+    for (; i < size; i += 16) {
+        mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i *)(labels + i)),
+            c16
+        ));
+        if (mask != 0) {
+            i += __builtin_ctz(mask);
+            return (i < out_degree) ? i : out_degree;
+        }
+    }
+#else
+    while (i < out_degree && labels[i] != c) {
+        ++i;
+    }
+    return i;
+#endif
+
+    return out_degree;
+}
+
 /* Specific Subengine Code */
 
 #define IA_EUDOXUS(a) ia_eudoxus8_ ## a
@@ -473,6 +686,70 @@ ia_eudoxus_result_t ia_eudoxus_execute_without_output(
     return ia_eudoxus_execute_impl(state, input, input_length, false);
 }
 
+ia_eudoxus_result_t ia_eudoxus_execute_batch(
+    ia_eudoxus_state_t **states,
+    const uint8_t      **inputs,
+    const size_t        *input_lengths,
+    size_t               n,
+    size_t              *out_index
+)
+{
+    size_t index = 0;
+    bool   interleave;
+
+    if (states == NULL || inputs == NULL || input_lengths == NULL) {
+        return IA_EUDOXUS_EINVAL;
+    }
+    if (out_index == NULL) {
+        out_index = &index;
+    }
+    if (n == 0) {
+        return IA_EUDOXUS_OK;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        if (states[i] == NULL || states[i]->eudoxus != states[0]->eudoxus) {
+            return IA_EUDOXUS_EINVAL;
+        }
+    }
+
+    interleave = n > 1 &&
+        states[0]->eudoxus->automata->data_length >=
+            states[0]->eudoxus->batch_min_length;
+
+    switch (states[0]->eudoxus->automata->id_width) {
+    case 8:
+        return ia_eudoxus8_execute_batch(
+            states, inputs, input_lengths, n, out_index, interleave
+        );
+    case 4:
+        return ia_eudoxus4_execute_batch(
+            states, inputs, input_lengths, n, out_index, interleave
+        );
+    case 2:
+        return ia_eudoxus2_execute_batch(
+            states, inputs, input_lengths, n, out_index, interleave
+        );
+    case 1:
+        return ia_eudoxus1_execute_batch(
+            states, inputs, input_lengths, n, out_index, interleave
+        );
+    default:
+        return IA_EUDOXUS_EINCOMPAT;
+    }
+}
+
+size_t ia_eudoxus_remaining_bytes(
+    const ia_eudoxus_state_t *state
+)
+{
+    if (state == NULL) {
+        return 0;
+    }
+
+    return state->remaining_bytes;
+}
+
 ia_eudoxus_result_t ia_eudoxus_metadata(
     ia_eudoxus_t                   *eudoxus,
     ia_eudoxus_metadata_callback_t  callback,
@@ -617,3 +894,103 @@ ia_eudoxus_result_t ia_eudoxus_all_outputs(
 
     return IA_EUDOXUS_OK;
 }
+
+ia_eudoxus_result_t ia_eudoxus_set_batch_min_length(
+    ia_eudoxus_t *eudoxus,
+    size_t        length
+)
+{
+    if (eudoxus == NULL) {
+        return IA_EUDOXUS_EINVAL;
+    }
+
+    eudoxus->batch_min_length = length;
+
+    return IA_EUDOXUS_OK;
+}
+
+ia_eudoxus_result_t ia_eudoxus_enable_profile(
+    ia_eudoxus_t *eudoxus
+)
+{
+    if (eudoxus == NULL) {
+        return IA_EUDOXUS_EINVAL;
+    }
+
+    if (eudoxus->profile != NULL) {
+        return IA_EUDOXUS_OK;
+    }
+
+    eudoxus->profile = (uint32_t *)calloc(
+        eudoxus->automata->data_length,
+        sizeof(*eudoxus->profile)
+    );
+    if (eudoxus->profile == NULL) {
+        return IA_EUDOXUS_EALLOC;
+    }
+
+    return IA_EUDOXUS_OK;
+}
+
+ia_eudoxus_result_t ia_eudoxus_write_profile(
+    const ia_eudoxus_t *eudoxus,
+    FILE               *fp
+)
+{
+    if (eudoxus == NULL || fp == NULL || eudoxus->profile == NULL) {
+        return IA_EUDOXUS_EINVAL;
+    }
+
+    uint64_t length = eudoxus->automata->data_length;
+
+    fprintf(fp, "eudoxus-profile %" PRIu64 "\n", length);
+    for (uint64_t index = 0; index < length; ++index) {
+        if (eudoxus->profile[index] > 0) {
+            fprintf(
+                fp, "%" PRIu64 " %" PRIu32 "\n",
+                index, eudoxus->profile[index]
+            );
+        }
+    }
+
+    if (ferror(fp)) {
+        return IA_EUDOXUS_ERROR;
+    }
+
+    return IA_EUDOXUS_OK;
+}
+
+ia_eudoxus_result_t ia_eudoxus_profile_histogram(
+    const ia_eudoxus_t *eudoxus,
+    uint64_t            nodes[IA_EUDOXUS_NUM_NODE_TYPES],
+    uint64_t            visits[IA_EUDOXUS_NUM_NODE_TYPES]
+)
+{
+    if (eudoxus == NULL || eudoxus->profile == NULL) {
+        return IA_EUDOXUS_EINVAL;
+    }
+
+    if (nodes != NULL) {
+        memset(nodes, 0, IA_EUDOXUS_NUM_NODE_TYPES * sizeof(*nodes));
+    }
+    if (visits != NULL) {
+        memset(visits, 0, IA_EUDOXUS_NUM_NODE_TYPES * sizeof(*visits));
+    }
+
+    /* Profile indices are node indices, so each points at a node header. */
+    const uint8_t *data = (const uint8_t *)eudoxus->automata;
+    uint64_t length = eudoxus->automata->data_length;
+    for (uint64_t index = 0; index < length; ++index) {
+        if (eudoxus->profile[index] > 0) {
+            int type = IA_EUDOXUS_TYPE(data[index]);
+            if (nodes != NULL) {
+                ++nodes[type];
+            }
+            if (visits != NULL) {
+                visits[type] += eudoxus->profile[index];
+            }
+        }
+    }
+
+    return IA_EUDOXUS_OK;
+}
@@ -26,10 +26,13 @@
 
 #include <ironautomata/bits.h>
 #include <ironautomata/eudoxus_automata.h>
+#include <ironautomata/timing.hpp>
 
 #include <boost/bind.hpp>
+#include <boost/chrono.hpp>
 #include <boost/foreach.hpp>
 
+#include <algorithm>
 #include <queue>
 #include <set>
 
@@ -38,7 +41,7 @@ using namespace std;
 namespace IronAutomata {
 namespace EudoxusCompiler {
 
-#define CPP_EUDOXUS_VERSION 10
+#define CPP_EUDOXUS_VERSION 11
 #if CPP_EUDOXUS_VERSION != IA_EUDOXUS_VERSION
 #error "Mismatch between compiler version and automata version."
 #endif
@@ -47,6 +50,176 @@ const int EUDOXUS_VERSION = CPP_EUDOXUS_VERSION;
 
 namespace {
 
+//! Map of node to its index in the compiled automata.
+typedef map<Intermediate::node_p, size_t> node_index_map_t;
+
+/**
+ * Facts about a node that depend on neither id width nor placement.
+ *
+ * These are calculated once for every node, in parallel, and shared by
+ * every id width compile_minimal() tries.  There is one per node for the
+ * whole compilation, so fields are as narrow as their ranges allow: 12
+ * bytes plus the map entry, less than the node_index_map_t entry each id
+ * width needs anyway.
+ */
+struct node_facts_t
+{
+    //! Constructor.
+    node_facts_t() :
+        parents(0),
+        out_degree(0),
+        num_consecutive(0),
+        has_nonadvancing(false),
+        deterministic(true)
+    {
+        // nop
+    }
+
+    //! Number of distinct parents.  Bounded by number of nodes.
+    uint32_t parents;
+    //! Number of inputs with non-default targets.  At most 256.
+    uint16_t out_degree;
+    /**
+     * Number of inputs with same target as last input.
+     *
+     * Does not include default targets.  At most 255.
+     */
+    uint16_t num_consecutive;
+    //! True if there are non-advancing edges (not including default).
+    bool has_nonadvancing;
+    //! True if every input has at most 1 target.
+    bool deterministic;
+};
+
+//! Map of node to its facts.
+typedef map<Intermediate::node_p, node_facts_t> node_facts_map_t;
+
+//! True iff @a edge does not advance input.
+bool is_nonadvancing(const Intermediate::Edge& edge)
+{
+    return ! edge.advance();
+}
+
+/**
+ * Count @a node as parent of each of its distinct children.
+ *
+ * Also adds @a node to @a facts.  Not thread safe.
+ *
+ * @param[in, out] facts Facts of every node.
+ * @param[in]      node  Node.
+ */
+void count_parents(
+    node_facts_map_t&           facts,
+    const Intermediate::node_p& node
+)
+{
+    facts[node];
+
+    set<Intermediate::node_p> children;
+    BOOST_FOREACH(const Intermediate::Edge& edge, node->edges()) {
+        children.insert(edge.target());
+    }
+    if (node->default_target()) {
+        children.insert(node->default_target());
+    }
+    BOOST_FOREACH(const Intermediate::node_p& child, children) {
+        ++facts[child].parents;
+    }
+}
+
+/**
+ * Calculate the facts of @a node other than its parents.
+ *
+ * Safe to call concurrently for different nodes as @a facts is only read
+ * except for the entry of @a node, which must already exist.
+ *
+ * @param[in, out] facts Facts of every node.
+ * @param[in]      node  Node.
+ */
+void analyze_node(
+    node_facts_map_t&           facts,
+    const Intermediate::node_p& node
+)
+{
+    node_facts_map_t::iterator i = facts.find(node);
+    assert(i != facts.end());
+    node_facts_t& f = i->second;
+
+    f.has_nonadvancing = (
+        find_if(node->edges().begin(), node->edges().end(), is_nonadvancing)
+    ) != node->edges().end();
+
+    Intermediate::Node::targets_by_input_t targets_by_input =
+        node->build_targets_by_input();
+    f.deterministic = true;
+    f.out_degree = 0;
+    f.num_consecutive = 0;
+
+    Intermediate::node_p previous_target;
+    for (int c = 0; c < 256; ++c) {
+        const Intermediate::Node::target_info_list_t& targets
+             = targets_by_input[c];
+        if (targets.size() > 1) {
+            f.deterministic = false;
+        }
+        if (targets.empty()) {
+            continue;
+        }
+        const Intermediate::node_p& target = targets.front().first;
+        if (target != node->default_target()) {
+            ++f.out_degree;
+            if (previous_target && target == previous_target) {
+                ++f.num_consecutive;
+            }
+            previous_target = target;
+        }
+    }
+}
+
+/**
+ * Calculate the facts of every node of @a automata.
+ *
+ * Parents are counted in a single breadth first traversal; the remaining,
+ * more expensive, facts are calculated by @a num_threads threads.
+ *
+ * @param[in] automata    Automata to analyze.
+ * @param[in] num_threads Number of threads; see configuration_t::threads.
+ * @return Facts of every node.
+ */
+node_facts_map_t analyze_nodes(
+    const Intermediate::Automata& automata,
+    size_t                        num_threads
+)
+{
+    node_facts_map_t facts;
+
+    breadth_first(
+        automata,
+        boost::bind(count_parents, boost::ref(facts), _1)
+    );
+    Intermediate::parallel_for_each_node(
+        automata,
+        boost::bind(analyze_node, boost::ref(facts), _1),
+        num_threads
+    );
+
+    return facts; // RVO
+}
+
+/**
+ * Node layout derived from a profile.
+ *
+ * @sa configuration_t::profile
+ */
+struct layout_t
+{
+    //! Nodes in order of placement: visited nodes, most visited first.
+    vector<Intermediate::node_p> order;
+
+    //! Hot nodes.  See configuration_t::hot_coverage.
+    set<Intermediate::node_p> hot;
+};
+
 /**
  * Compiler for given @a id_width.
  *
@@ -63,10 +236,15 @@ public:
      *
      * @param[in] result        Where to store results.
      * @param[in] configuration Compiler configuration.
+     * @param[in] layout        Layout of visited nodes; empty if no
+     *                          profile.
+     * @param[in] facts         Facts of every node.
      */
     Compiler(
-        result_t& result,
-         configuration_t configuration
+        result_t&               result,
+        configuration_t         configuration,
+        const layout_t&         layout,
+        const node_facts_map_t& facts
     );
 
     /**
@@ -78,6 +256,12 @@ public:
         const Intermediate::Automata& automata
     );
 
+    //! Index of every node; valid after compile().
+    const node_index_map_t& node_map() const
+    {
+        return m_node_map;
+    }
+
 private:
     //! Subengine traits.
     typedef Eudoxus::subengine_traits<id_width> traits_t;
@@ -96,13 +280,6 @@ private:
 
     friend class BFSVisitor;
 
-    //! True iff @a edge does not advance input.
-    static
-    bool is_nonadvancing(const Intermediate::Edge& edge)
-    {
-        return ! edge.advance();
-    }
-
     /**
      * Answer questions about nodes.
      */
@@ -111,40 +288,41 @@ private:
         //! use_ali will be set if num_consecutive > c_ali_threshold.
         static const size_t c_ali_threshold = 32;
 
-        //! Constructor.
-        explicit
-        NodeOracle(const Intermediate::node_p& node)
+        /**
+         * Constructor.
+         *
+         * @param[in] node                   Node to answer questions about.
+         * @param[in] facts                  Facts of @a node.
+         * @param[in] split_low_edges_degree Minimum out degree of low
+         *                                   nodes with split edges; 0 for
+         *                                   none.
+         * @param[in] index                  Index the node will be placed
+         *                                   at.
+         * @param[in] with_targets           If true, fill in
+         *                                   targets_by_input; only needed
+         *                                   to emit the node.
+         */
+        NodeOracle(
+            const Intermediate::node_p& node,
+            const node_facts_t&         facts,
+            size_t                      split_low_edges_degree,
+            size_t                      index,
+            bool                        with_targets
+        ) :
+            has_nonadvancing(facts.has_nonadvancing),
+            deterministic(facts.deterministic),
+            out_degree(facts.out_degree),
+            num_consecutive(facts.num_consecutive)
         {
-            has_nonadvancing = (
-                find_if(node->edges().begin(), node->edges().end(), is_nonadvancing)
-            ) != node->edges().end();
-
-            targets_by_input = node->build_targets_by_input();
-            deterministic = true;
-            out_degree = 0;
-            num_consecutive = 0;
-
-            Intermediate::node_p previous_target;
-            for (int c = 0; c < 256; ++c) {
-                const Intermediate::Node::target_info_list_t& targets
-                     = targets_by_input[c];
-                if (targets.size() > 1) {
-                    deterministic = false;
-                }
-                if (targets.empty()) {
-                    continue;
-                }
-                const Intermediate::node_p& target = targets.front().first;
-                if (target != node->default_target()) {
-                    ++out_degree;
-                    if (previous_target && target == previous_target) {
-                        ++num_consecutive;
-                    }
-                    previous_target = target;
-                }
+            if (with_targets) {
+                targets_by_input = node->build_targets_by_input();
             }
 
             use_ali = (num_consecutive > c_ali_threshold);
+            split_low_edges = (
+                split_low_edges_degree > 0 &&
+                out_degree >= split_low_edges_degree
+            );
 
             low_node_cost = 0;
 
@@ -154,7 +332,9 @@ private:
             }
             if (! node->edges().empty()) {
                 low_node_cost += sizeof(uint8_t);
-                low_node_cost += sizeof(typename traits_t::low_edge_t) * out_degree;
+                if (! split_low_edges) {
+                    low_node_cost += sizeof(typename traits_t::low_edge_t) * out_degree;
+                }
             }
             if (node->default_target()) {
                 low_node_cost += sizeof(e_id_t);
@@ -162,6 +342,11 @@ private:
             if (has_nonadvancing) {
                 low_node_cost += (out_degree + 7) / 8;
             }
+            if (split_low_edges) {
+                low_node_cost += IA_EUDOXUS_LABEL_PADDING(index + low_node_cost);
+                low_node_cost += IA_EUDOXUS_LABEL_SIZE(out_degree);
+                low_node_cost += sizeof(e_id_t) * out_degree;
+            }
 
             high_node_cost = 0;
 
@@ -205,19 +390,108 @@ private:
         //! True if a high degree node should use an ALI.
         bool use_ali;
 
+        //! True if a low degree node should use split edges.
+        bool split_low_edges;
+
         //! Cost in bytes of representing with a low node.
         size_t low_node_cost;
         //! Cost in bytes of representing with a high node.
         size_t high_node_cost;
 
-        //! Targets by input map.
+        //! Targets by input map; empty unless constructed with_targets.
         Intermediate::Node::targets_by_input_t targets_by_input;
     };
 
     //! Set of nodes.
     typedef set<Intermediate::node_p> node_set_t;
-    //! Map of nodes to set of nodes: it's parents.
-    typedef map<Intermediate::node_p, node_set_t> parent_map_t;
+
+    //! Facts of @a node.
+    const node_facts_t& facts(const Intermediate::node_p& node) const
+    {
+        node_facts_map_t::const_iterator i = m_facts.find(node);
+        assert(i != m_facts.end());
+        return i->second;
+    }
+
+    //! True iff a demux node described by @a oracle should be low.
+    static
+    bool use_low_node(const NodeOracle& oracle, double high_node_weight)
+    {
+        return
+            oracle.high_node_cost * high_node_weight > oracle.low_node_cost;
+    }
+
+    /**
+     * Predict size of @a node if placed at the current end of the buffer.
+     *
+     * @param[in] node             Node to predict size of.
+     * @param[in] path_length      Path length if @a node is to be compiled
+     *                             into a PC node; otherwise 0.
+     * @param[in] high_node_weight Weight of high node cost.
+     * @return Size in bytes.
+     */
+    size_t node_size(
+        const Intermediate::node_p& node,
+        size_t                      path_length,
+        double                      high_node_weight
+    ) const
+    {
+        if (path_length > 0) {
+            size_t size = sizeof(e_pc_node_t) + path_length;
+            if (node->first_output()) {
+                size += sizeof(e_id_t);
+            }
+            if (node->default_target()) {
+                size += sizeof(e_id_t);
+            }
+            if (path_length > 4) {
+                size += sizeof(uint8_t);
+            }
+            return size;
+        }
+
+        NodeOracle oracle(
+            node,
+            facts(node),
+            m_configuration.split_low_edges_degree,
+            m_assembler.size(),
+            false
+        );
+        return
+            use_low_node(oracle, high_node_weight) ?
+            oracle.low_node_cost :
+            oracle.high_node_cost;
+    }
+
+    //! Add padding until the buffer size is 0 mod @a alignment.
+    void pad(size_t alignment)
+    {
+        size_t index = m_assembler.size();
+        size_t remainder = index % alignment;
+        size_t padding = (remainder == 0 ? 0 : alignment - remainder);
+        if (padding > 0) {
+            m_result.padding += padding;
+            for (size_t i = 0; i < padding; ++i) {
+                m_assembler.append_object(uint8_t(0xaa));
+            }
+        }
+    }
+
+    /**
+     * Place @a node at the end of the buffer.
+     *
+     * Compiles @a node and queues the nodes it refers to that are not yet
+     * queued.
+     *
+     * @param[in]     node    Node to place.
+     * @param[in,out] todo    Queue of nodes to place.
+     * @param[in,out] queued  Nodes that have been queued or placed.
+     */
+    void place_node(
+        const Intermediate::node_p&  node,
+        queue<Intermediate::node_p>& todo,
+        node_set_t&                  queued
+    );
 
     //! Compile @a node to @a end_of_path into a PC node.
     void pc_node(
@@ -290,10 +564,25 @@ private:
         m_result.pc_nodes_bytes += m_assembler.size() - old_size;
     }
 
-    //! Compile node into a demux (high or low) node.
-    void demux_node(const Intermediate::node_p& node)
+    /**
+     * Compile node into a demux (high or low) node.
+     *
+     * @param[in] node             Node to compile.
+     * @param[in] high_node_weight Weight of high node cost; see
+     *                             configuration_t::high_node_weight.
+     */
+    void demux_node(
+        const Intermediate::node_p& node,
+        double                      high_node_weight
+    )
     {
-        NodeOracle oracle(node);
+        NodeOracle oracle(
+            node,
+            facts(node),
+            m_configuration.split_low_edges_degree,
+            m_assembler.size(),
+            true
+        );
 
         if (! oracle.deterministic) {
             throw runtime_error(
@@ -306,10 +595,7 @@ private:
         size_t* nodes_counter = NULL;
         size_t cost_prediction = 0;
 
-        if (
-            oracle.high_node_cost * m_configuration.high_node_weight
-             > oracle.low_node_cost
-        ) {
+        if (use_low_node(oracle, high_node_weight)) {
             cost_prediction = oracle.low_node_cost;
             bytes_counter = &m_result.low_nodes_bytes;
             nodes_counter = &m_result.low_nodes;
@@ -365,6 +651,10 @@ private:
             if (oracle.out_degree > 0) {
                 header->header = ia_setbit8(header->header, 4 + IA_EUDOXUS_TYPE_WIDTH);
             }
+            if (oracle.split_low_edges) {
+                header->header = ia_setbit8(header->header, 5 + IA_EUDOXUS_TYPE_WIDTH);
+                m_split_edges = true;
+            }
         }
 
         if (node.first_output()) {
@@ -391,6 +681,19 @@ private:
             advance_index = m_assembler.index(advance);
         }
 
+        size_t labels_index = 0;
+        if (oracle.split_low_edges) {
+            size_t padding = IA_EUDOXUS_LABEL_PADDING(m_assembler.size());
+            for (size_t i = 0; i < padding; ++i) {
+                m_assembler.append_object(uint8_t(0xaa));
+            }
+            uint8_t* labels =
+                m_assembler.template append_array<uint8_t>(
+                    IA_EUDOXUS_LABEL_SIZE(oracle.out_degree)
+                );
+            labels_index = m_assembler.index(labels);
+        }
+
         size_t edge_i = 0;
         BOOST_FOREACH(const Intermediate::Edge& edge, node.edges()) {
             if (edge.epsilon()) {
@@ -407,15 +710,23 @@ private:
                         edge_i
                     );
                 }
-                ++edge_i;
 
-                e_low_edge_t* e_edge =
-                    m_assembler.append_object(e_low_edge_t());
-                e_edge->c = value;
-                register_node_ref(
-                    m_assembler.index(&(e_edge->next_node)),
-                    edge.target()
-                );
+                if (oracle.split_low_edges) {
+                    *m_assembler.template ptr<uint8_t>(
+                        labels_index + edge_i
+                    ) = value;
+                    append_node_ref(edge.target());
+                }
+                else {
+                    e_low_edge_t* e_edge =
+                        m_assembler.append_object(e_low_edge_t());
+                    e_edge->c = value;
+                    register_node_ref(
+                        m_assembler.index(&(e_edge->next_node)),
+                        edge.target()
+                    );
+                }
+                ++edge_i;
             }
         }
     }
@@ -735,21 +1046,6 @@ private:
             a->advance_on_default() == b->advance_on_default();
     }
 
-    //! Add all children of @a node to @a parents.
-    static
-    void calculate_parents(
-        parent_map_t&               parents,
-        const Intermediate::node_p& node
-    )
-    {
-        BOOST_FOREACH(const Intermediate::Edge& edge, node->edges()) {
-            parents[edge.target()].insert(node);
-        }
-        if (node->default_target()) {
-            parents[node->default_target()].insert(node);
-        }
-    }
-
     //! Logger to use.
     logger_t m_logger;
 
@@ -759,6 +1055,12 @@ private:
     //! Compiler Configuration.
     configuration_t m_configuration;
 
+    //! Layout of visited nodes.
+    const layout_t& m_layout;
+
+    //! Facts of every node.
+    const node_facts_map_t& m_facts;
+
     //! Assembler of m_result.buffer.
     BufferAssembler m_assembler;
 
@@ -766,7 +1068,7 @@ private:
     size_t m_e_automata_index;
 
     //! Type of m_node_map.
-    typedef map<Intermediate::node_p, size_t> node_map_t;
+    typedef node_index_map_t node_map_t;
     //! Type of m_output_map.
     typedef map<Intermediate::output_p, size_t> output_map_t;
 
@@ -792,21 +1094,122 @@ private:
 
     //! Maximum index of buffer based on id_width.
     const uint64_t m_max_index;
+
+    //! True if any low node has split edges.
+    bool m_split_edges;
 };
 
 template <size_t id_width>
 Compiler<id_width>::Compiler(
-    result_t&       result,
-    configuration_t configuration
+    result_t&               result,
+    configuration_t         configuration,
+    const layout_t&         layout,
+    const node_facts_map_t& facts
 ) :
     m_result(result),
     m_configuration(configuration),
+    m_layout(layout),
+    m_facts(facts),
     m_assembler(result.buffer),
-    m_max_index(numeric_limits<e_id_t>::max())
+    m_max_index(numeric_limits<e_id_t>::max()),
+    m_split_edges(false)
 {
     // nop
 }
 
+template <size_t id_width>
+void Compiler<id_width>::place_node(
+    const Intermediate::node_p&  node,
+    queue<Intermediate::node_p>& todo,
+    node_set_t&                  queued
+)
+{
+    bool hot = (m_layout.hot.count(node) > 0);
+    double high_node_weight = (
+        hot ?
+        m_configuration.hot_high_node_weight :
+        m_configuration.high_node_weight
+    );
+
+    Intermediate::node_p end_of_path = node;
+    Intermediate::node_p child = has_unique_child(end_of_path);
+    size_t path_length = 0;
+    while (
+        path_length <= 255 &&
+        child &&
+        ! child->first_output() &&
+        end_of_path->edges().front().advance() &&
+        has_unique_child(child) &&
+        same_defaults(end_of_path, child) &&
+        facts(child).parents == 1
+    ) {
+        end_of_path = child;
+        child = has_unique_child(child);
+        ++path_length;
+    }
+    bool use_pc = (path_length >= 2);
+
+    // Padding
+    pad(m_configuration.align_to);
+    if (hot && m_configuration.hot_align_to > 1) {
+        size_t line = m_configuration.hot_align_to;
+        size_t size = node_size(
+            node,
+            use_pc ? path_length : 0,
+            high_node_weight
+        );
+        if (size <= line && m_assembler.size() % line + size > line) {
+            pad(line);
+            pad(m_configuration.align_to);
+        }
+    }
+    assert(m_assembler.size() % m_configuration.align_to == 0);
+
+    // Record node location.
+    size_t old_size = m_assembler.size();
+    m_node_map[node] = old_size;
+
+    if (use_pc) {
+        // Path Compression
+        pc_node(node, end_of_path, path_length);
+        // Add end of path.
+        bool need_to_queue = queued.insert(end_of_path).second;
+        if (need_to_queue) {
+            todo.push(end_of_path);
+        }
+    }
+    else {
+        // Demux: High or Low
+        demux_node(node, high_node_weight);
+
+        // And add all children.
+        BOOST_FOREACH(const Intermediate::Edge& edge, node->edges()) {
+            const Intermediate::node_p& target = edge.target();
+            bool need_to_queue = queued.insert(target).second;
+            if (need_to_queue) {
+                todo.push(target);
+            }
+        }
+    }
+    if (node->default_target()) {
+        const Intermediate::node_p& target =
+            node->default_target();
+        bool need_to_queue = queued.insert(target).second;
+        if (need_to_queue) {
+            todo.push(target);
+        }
+    }
+
+    if (hot) {
+        ++m_result.hot_nodes;
+        m_result.hot_nodes_bytes += m_assembler.size() - old_size;
+    }
+
+    if (m_assembler.size() >= m_max_index) {
+        throw out_of_range("id_width too small");
+    }
+}
+
 template <size_t id_width>
 void Compiler<id_width>::compile(
     const Intermediate::Automata& automata
@@ -821,6 +1224,8 @@ void Compiler<id_width>::compile(
     m_result.high_nodes_bytes = 0;
     m_result.pc_nodes = 0;
     m_result.pc_nodes_bytes = 0;
+    m_result.hot_nodes = 0;
+    m_result.hot_nodes_bytes = 0;
 
     // Header
     ia_eudoxus_automata_t* e_automata =
@@ -840,93 +1245,27 @@ void Compiler<id_width>::compile(
     // Store index as it will likely move.
     m_e_automata_index = m_assembler.index(e_automata);
 
-    // Calculate Node Parents
-    parent_map_t parents;
-    breadth_first(
-        automata,
-        boost::bind(calculate_parents, boost::ref(parents), _1)
-    );
-
     // Adapted BFS... Complicated by path compression nodes.
     queue<Intermediate::node_p> todo;
     set<Intermediate::node_p>   queued;
 
-    todo.push(automata.start_node());
     queued.insert(automata.start_node());
+    place_node(automata.start_node(), todo, queued);
+
+    // Nodes in order of profile, if any.
+    BOOST_FOREACH(const Intermediate::node_p& node, m_layout.order) {
+        if (m_node_map.count(node) == 0) {
+            queued.insert(node);
+            place_node(node, todo, queued);
+        }
+    }
 
     while (! todo.empty()) {
         Intermediate::node_p node = todo.front();
         todo.pop();
 
-        // Padding
-        size_t index = m_assembler.size();
-        size_t alignment = index % m_configuration.align_to;
-        size_t padding = (
-            alignment == 0 ?
-            0 :
-            m_configuration.align_to - alignment
-        );
-        if (padding > 0) {
-            m_result.padding += padding;
-            for (size_t i = 0; i < padding; ++i) {
-                m_assembler.append_object(uint8_t(0xaa));
-            }
-        }
-        assert(m_assembler.size() % m_configuration.align_to == 0);
-
-        // Record node location.
-        m_node_map[node] = m_assembler.size();
-
-        Intermediate::node_p end_of_path = node;
-        Intermediate::node_p child = has_unique_child(end_of_path);
-        size_t path_length = 0;
-        while (
-            path_length <= 255 &&
-            child &&
-            ! child->first_output() &&
-            end_of_path->edges().front().advance() &&
-            has_unique_child(child) &&
-            same_defaults(end_of_path, child) &&
-            parents[child].size() == 1
-        ) {
-            end_of_path = child;
-            child = has_unique_child(child);
-            ++path_length;
-        }
-
-        if (path_length >= 2) {
-            // Path Compression
-            pc_node(node, end_of_path, path_length);
-            // Add end of path.
-            bool need_to_queue = queued.insert(end_of_path).second;
-            if (need_to_queue) {
-                todo.push(end_of_path);
-            }
-        }
-        else {
-            // Demux: High or Low
-            demux_node(node);
-
-            // And add all children.
-            BOOST_FOREACH(const Intermediate::Edge& edge, node->edges()) {
-                const Intermediate::node_p& target = edge.target();
-                bool need_to_queue = queued.insert(target).second;
-                if (need_to_queue) {
-                    todo.push(target);
-                }
-            }
-        }
-        if (node->default_target()) {
-            const Intermediate::node_p& target =
-                node->default_target();
-            bool need_to_queue = queued.insert(target).second;
-            if (need_to_queue) {
-                todo.push(target);
-            }
-        }
-
-        if (m_assembler.size() >= m_max_index) {
-            throw out_of_range("id_width too small");
+        if (m_node_map.count(node) == 0) {
+            place_node(node, todo, queued);
         }
     }
 
@@ -956,6 +1295,10 @@ void Compiler<id_width>::compile(
 
     // Recover pointer.
     e_automata = m_assembler.ptr<ia_eudoxus_automata_t>(m_e_automata_index);
+    // Older engines can load automata without split edges.
+    if (! m_split_edges) {
+        e_automata->version    = IA_EUDOXUS_VERSION_NO_SPLIT;
+    }
     e_automata->num_nodes      = m_node_map.size();
     e_automata->num_outputs    = m_output_map.size();
     e_automata->num_metadata   = automata.metadata().size();
@@ -967,9 +1310,86 @@ void Compiler<id_width>::compile(
     m_result.ids_used += m_node_id_map.size() + m_output_id_map.size();
 }
 
+/**
+ * Compile automata with a fixed id width.
+ *
+ * @param[in]  automata      Automata to compile.
+ * @param[in]  configuration Compiler configuration; id_width must not be 0.
+ * @param[in]  layout        Layout of visited nodes.
+ * @param[in]  facts         Facts of every node; see analyze_nodes().
+ * @param[out] node_map      If not NULL, where to store the index of every
+ *                           node.
+ * @return Compilation result.
+ */
+template <size_t id_width>
+result_t compile_fixed(
+    const Intermediate::Automata& automata,
+    const configuration_t&        configuration,
+    const layout_t&               layout,
+    const node_facts_map_t&       facts,
+    node_index_map_t*             node_map
+)
+{
+    result_t result;
+    result.configuration = configuration;
+
+    Compiler<id_width> compiler(result, configuration, layout, facts);
+    compiler.compile(automata);
+    if (node_map) {
+        *node_map = compiler.node_map();
+    }
+
+    return result; // RVO
+}
+
+//! As above, but chooses id width by @a configuration.
+result_t compile_fixed(
+    const Intermediate::Automata& automata,
+    const configuration_t&        configuration,
+    const layout_t&               layout,
+    const node_facts_map_t&       facts,
+    node_index_map_t*             node_map
+)
+{
+    switch (configuration.id_width) {
+    case 1:
+        return compile_fixed<1>(
+            automata, configuration, layout, facts, node_map
+        );
+    case 2:
+        return compile_fixed<2>(
+            automata, configuration, layout, facts, node_map
+        );
+    case 4:
+        return compile_fixed<4>(
+            automata, configuration, layout, facts, node_map
+        );
+    case 8:
+        return compile_fixed<8>(
+            automata, configuration, layout, facts, node_map
+        );
+    default:
+        throw logic_error("Unsupported id_width.");
+    }
+}
+
+/**
+ * Compile automata with the smallest possible id width.
+ *
+ * @param[in]  automata      Automata to compile.
+ * @param[in]  configuration Compiler configuration; id_width must be 0.
+ * @param[in]  layout        Layout of visited nodes.
+ * @param[in]  facts         Facts of every node; see analyze_nodes().
+ * @param[out] node_map      If not NULL, where to store the index of every
+ *                           node.
+ * @return Compilation result.
+ */
 result_t compile_minimal(
     const Intermediate::Automata& automata,
-    configuration_t               configuration
+    configuration_t               configuration,
+    const layout_t&               layout,
+    const node_facts_map_t&       facts,
+    node_index_map_t*             node_map
 )
 {
     static const size_t c_id_widths[] = {1, 2, 4, 8};
@@ -990,7 +1410,9 @@ result_t compile_minimal(
         bool success = true;
         try {
             configuration.id_width = c_id_widths[i];
-            result = compile(automata, configuration);
+            result = compile_fixed(
+                automata, configuration, layout, facts, node_map
+            );
         }
         catch (out_of_range) {
             // move on to next id_width.
@@ -1012,12 +1434,152 @@ result_t compile_minimal(
     return result; // RVO
 }
 
+//! Compile with fixed or smallest id width as @a configuration says.
+result_t compile_any(
+    const Intermediate::Automata& automata,
+    const configuration_t&        configuration,
+    const layout_t&               layout,
+    const node_facts_map_t&       facts,
+    node_index_map_t*             node_map
+)
+{
+    if (configuration.id_width == 0) {
+        return compile_minimal(
+            automata, configuration, layout, facts, node_map
+        );
+    }
+    return compile_fixed(automata, configuration, layout, facts, node_map);
+}
+
+//! Node visits and index in the profiled automata.
+typedef pair<uint64_t, size_t> node_visits_t;
+
+//! True iff @a a is visited more than @a b; ties broken by index.
+bool more_visited(const node_visits_t& a, const node_visits_t& b)
+{
+    if (a.first != b.first) {
+        return a.first > b.first;
+    }
+    return a.second < b.second;
+}
+
+/**
+ * Derive layout from profile of @a configuration.
+ *
+ * Compiles @a automata without the profile to recover the nodes at the
+ * profiled indices.
+ *
+ * @param[in] automata      Automata to compile.
+ * @param[in] configuration Compiler configuration with profile.
+ * @param[in] facts         Facts of every node; see analyze_nodes().
+ * @return Layout.
+ * @throw runtime_error if profile does not match.
+ */
+layout_t layout_from_profile(
+    const Intermediate::Automata& automata,
+    const configuration_t&        configuration,
+    const node_facts_map_t&       facts
+)
+{
+    static const char* c_mismatch =
+        "Profile does not match automata and configuration.";
+
+    const profile_t& profile = configuration.profile;
+    configuration_t reference_configuration = configuration;
+    reference_configuration.profile = profile_t();
+
+    node_index_map_t node_map;
+    result_t reference = compile_any(
+        automata,
+        reference_configuration,
+        layout_t(),
+        facts,
+        &node_map
+    );
+    if (reference.buffer.size() != profile.data_length) {
+        throw runtime_error(c_mismatch);
+    }
+
+    typedef map<size_t, Intermediate::node_p> node_at_t;
+    node_at_t node_at;
+    BOOST_FOREACH(const node_index_map_t::value_type& v, node_map) {
+        node_at[v.second] = v.first;
+    }
+
+    vector<node_visits_t> visited;
+    uint64_t total = 0;
+    BOOST_FOREACH(const profile_t::visits_t::value_type& v, profile.visits) {
+        if (node_at.count(v.first) == 0) {
+            throw runtime_error(c_mismatch);
+        }
+        visited.push_back(node_visits_t(v.second, v.first));
+        total += v.second;
+    }
+    sort(visited.begin(), visited.end(), more_visited);
+
+    layout_t layout;
+    uint64_t covered = 0;
+    BOOST_FOREACH(const node_visits_t& v, visited) {
+        const Intermediate::node_p& node = node_at[v.second];
+        layout.order.push_back(node);
+        if (covered < configuration.hot_coverage * total) {
+            layout.hot.insert(node);
+        }
+        covered += v.first;
+    }
+
+    // Unvisited nodes keep their relative order.
+    BOOST_FOREACH(const node_at_t::value_type& v, node_at) {
+        if (profile.visits.count(v.first) == 0) {
+            layout.order.push_back(v.second);
+        }
+    }
+
+    return layout; // RVO
+}
+
 } // Anonymous
 
+profile_t::profile_t() :
+    data_length(0)
+{
+    // nop
+}
+
+profile_t read_profile(istream& in)
+{
+    profile_t profile;
+    string magic;
+
+    in >> magic >> profile.data_length;
+    if (! in || magic != "eudoxus-profile") {
+        throw runtime_error("Invalid profile: missing header.");
+    }
+
+    size_t index;
+    uint64_t visits;
+    while (in >> index >> visits) {
+        if (index >= profile.data_length) {
+            throw runtime_error("Invalid profile: index out of range.");
+        }
+        profile.visits[index] = visits;
+    }
+    if (! in.eof()) {
+        throw runtime_error("Invalid profile: malformed line.");
+    }
+
+    return profile; // RVO
+}
+
 configuration_t::configuration_t() :
     id_width(0),
     align_to(1),
-    high_node_weight(1.0)
+    high_node_weight(1.0),
+    split_low_edges_degree(0),
+    hot_coverage(0.9),
+    hot_high_node_weight(1.0),
+    hot_align_to(1),
+    threads(1)
 {
     // nop
 }
@@ -1027,29 +1589,23 @@ result_t compile(
     configuration_t               configuration
 )
 {
-    if (configuration.id_width == 0) {
-        return compile_minimal(automata, configuration);
+    boost::chrono::steady_clock::time_point start =
+        boost::chrono::steady_clock::now();
+    node_facts_map_t facts = analyze_nodes(automata, configuration.threads);
+    double analyze_seconds = seconds_since(start);
+
+    start = boost::chrono::steady_clock::now();
+    layout_t layout;
+    if (configuration.profile.data_length > 0) {
+        layout = layout_from_profile(automata, configuration, facts);
     }
+    double layout_seconds = seconds_since(start);
 
-    result_t result;
-    result.configuration = configuration;
-
-    switch (configuration.id_width) {
-    case 1:
-        Compiler<1>(result, configuration).compile(automata);
-        break;
-    case 2:
-        Compiler<2>(result, configuration).compile(automata);
-        break;
-    case 4:
-        Compiler<4>(result, configuration).compile(automata);
-        break;
-    case 8:
-        Compiler<8>(result, configuration).compile(automata);
-        break;
-    default:
-        throw logic_error("Unsupported id_width.");
-    }
+    start = boost::chrono::steady_clock::now();
+    result_t result = compile_any(automata, configuration, layout, facts, NULL);
+    result.analyze_seconds  = analyze_seconds;
+    result.layout_seconds   = layout_seconds;
+    result.assemble_seconds = seconds_since(start);
 
     return result; // RVO
 }
@@ -53,7 +53,7 @@
  *
  * @sa IA_EUDOXUS(next) for details.
  */
-static
+static IA_EUDOXUS_ALWAYS_INLINE
 ia_eudoxus_result_t IA_EUDOXUS(next_low)(
     ia_eudoxus_state_t *state
 )
@@ -74,6 +74,7 @@ ia_eudoxus_result_t IA_EUDOXUS(next_low)(
     bool has_default        = IA_EUDOXUS_FLAG(state->node->header, 2);
     bool advance_on_default = IA_EUDOXUS_FLAG(state->node->header, 3);
     bool has_edges          = IA_EUDOXUS_FLAG(state->node->header, 4);
+    bool has_split_edges    = IA_EUDOXUS_FLAG(state->node->header, 5);
     const IA_EUDOXUS(low_node_t) *node
         = (const IA_EUDOXUS(low_node_t) *)(state->node);
     if (has_nonadvancing & ! has_edges) {
@@ -97,15 +98,34 @@ ia_eudoxus_result_t IA_EUDOXUS(next_low)(
         out_degree / 8,
         has_nonadvancing & has_edges
     );
-    const IA_EUDOXUS(low_edge_t) *edges = IA_VLS_FINAL(
-        vls,
-        const IA_EUDOXUS(low_edge_t)
-    );
 
     IA_EUDOXUS_ID_T next_node            = 0;
     bool            advance_on_next_node = true;
 
-    if (has_edges) {
+    if (has_edges && has_split_edges) {
+        const uint8_t *labels = IA_VLS_FINAL(vls, const uint8_t);
+        labels += IA_EUDOXUS_LABEL_PADDING(
+            labels - (const uint8_t *)(state->eudoxus->automata)
+        );
+        const IA_EUDOXUS_ID_T *targets = (const IA_EUDOXUS_ID_T *)(
+            labels + IA_EUDOXUS_LABEL_SIZE(out_degree)
+        );
+
+        size_t i = ia_eudoxus_find_label(labels, out_degree, c);
+
+        if (i != out_degree) {
+            next_node = targets[i];
+            if (has_nonadvancing) {
+                advance_on_next_node = ia_bitv(advance, i);
+            }
+        }
+    }
+    else if (has_edges) {
+        const IA_EUDOXUS(low_edge_t) *edges = IA_VLS_FINAL(
+            vls,
+            const IA_EUDOXUS(low_edge_t)
+        );
+
         int i = 0;
         while (i < out_degree && edges[i].c != c) {
             ++i;
@@ -149,7 +169,7 @@ ia_eudoxus_result_t IA_EUDOXUS(next_low)(
  *
  * @sa IA_EUDOXUS(next) for details.
  */
-static
+static IA_EUDOXUS_ALWAYS_INLINE
 ia_eudoxus_result_t IA_EUDOXUS(next_high)(
     ia_eudoxus_state_t *state
 )
@@ -259,7 +279,7 @@ ia_eudoxus_result_t IA_EUDOXUS(next_high)(
  *
  * @sa IA_EUDOXUS(next) for details.
  */
-static
+static IA_EUDOXUS_ALWAYS_INLINE
 ia_eudoxus_result_t IA_EUDOXUS(next_pc)(
     ia_eudoxus_state_t *state
 )
@@ -361,7 +381,7 @@ ia_eudoxus_result_t IA_EUDOXUS(next_pc)(
  * @param[in,out] state Current state.
  * @return See ia_eudoxus_execute() for return codes meanings.
  */
-static
+static IA_EUDOXUS_ALWAYS_INLINE
 ia_eudoxus_result_t IA_EUDOXUS(next)(
     ia_eudoxus_state_t *state
 )
@@ -522,6 +542,88 @@ ia_eudoxus_result_t IA_EUDOXUS(output)(
     return IA_EUDOXUS_OK;
 }
 
+/**
+ * Begin function.  Prepare @a state to process a block of input.
+ *
+ * If @a input is NULL, the outputs of the current node are rerun and the
+ * state resumes its previous input.
+ *
+ * @param[in, out] state        State of automata.
+ * @param[in]      input        Input to execute on.
+ * @param[in]      input_length Length of input.
+ * @return See ia_eudoxus_execute() for return codes meanings.
+ */
+static IA_EUDOXUS_ALWAYS_INLINE
+ia_eudoxus_result_t IA_EUDOXUS(begin)(
+    ia_eudoxus_state_t *state,
+    const uint8_t      *input,
+    size_t              input_length
+)
+{
+    if (input == NULL) {
+        /* Special case: Rerun output of current node and then resume based
+         * on state.
+         */
+        return IA_EUDOXUS(output)(state);
+    }
+
+    state->input_location  = input;
+    state->remaining_bytes = input_length;
+
+    return IA_EUDOXUS_OK;
+}
+
+/**
+ * Step function.  Take a single transition and generate its output.
+ *
+ * If the engine is being profiled, the visit of the current node is counted
+ * first.
+ *
+ * Must only be called if @a state has remaining input.
+ *
+ * @param[in, out] state       State of automata.
+ * @param[in]      with_output If true, generate output on transition.
+ * @return See ia_eudoxus_execute() for return codes meanings.
+ */
+static IA_EUDOXUS_ALWAYS_INLINE
+ia_eudoxus_result_t IA_EUDOXUS(step)(
+    ia_eudoxus_state_t *state,
+    bool                with_output
+)
+{
+    ia_eudoxus_result_t result = IA_EUDOXUS_OK;
+
+    /* Count visit if profiling. */
+    uint32_t *profile = state->eudoxus->profile;
+    if (profile != NULL) {
+        size_t index =
+            (const char *)state->node -
+            (const char *)state->eudoxus->automata;
+        if (profile[index] < UINT32_MAX) {
+            ++profile[index];
+        }
+    }
+
+    /* Update state, including state->remaining_bytes */
+    const uint8_t* old_input_location = state->input_location;
+    result = IA_EUDOXUS(next)(state);
+    if (result != IA_EUDOXUS_OK) {
+        return result;
+    }
+
+    /* Call callback. */
+    if (
+        with_output &&
+        state->callback != NULL &&
+        ( ! state->eudoxus->automata->no_advance_no_output ||
+          state->input_location != old_input_location )
+    ) {
+        result = IA_EUDOXUS(output)(state);
+    }
+
+    return result;
+}
+
 /**
  * Execute function.  Process a block of input.
  *
@@ -553,18 +655,9 @@ ia_eudoxus_result_t IA_EUDOXUS(execute)(
 
     ia_eudoxus_set_error(state->eudoxus, NULL);
 
-    if (input == NULL) {
-        /* Special case: Rerun output of current node and then resume based
-         * on state.
-         */
-        ia_eudoxus_result_t result = IA_EUDOXUS(output)(state);
-        if (result != IA_EUDOXUS_OK) {
-            return result;
-        }
-    }
-    else {
-        state->input_location  = input;
-        state->remaining_bytes = input_length;
+    ia_eudoxus_result_t result = IA_EUDOXUS(begin)(state, input, input_length);
+    if (result != IA_EUDOXUS_OK) {
+        return result;
     }
 
     if (state->input_location == NULL) {
@@ -573,26 +666,123 @@ ia_eudoxus_result_t IA_EUDOXUS(execute)(
     }
 
     while (state->remaining_bytes > 0) {
-        ia_eudoxus_result_t result = IA_EUDOXUS_OK;
+        result = IA_EUDOXUS(step)(state, with_output);
+        if (result != IA_EUDOXUS_OK) {
+            return result;
+        }
+    }
+
+    return IA_EUDOXUS_OK;
+}
+
+/**
+ * Batch execute function.  Process several blocks of input.
+ *
+ * This is the subengine specific version of ia_eudoxus_execute_batch() and
+ * has the same semantics.  All states are begun first.  If @a interleave is
+ * true, up to IA_EUDOXUS_BATCH_WIDTH states are then active at a time.  Each
+ * active state takes a step in turn and then prefetches its next node, which
+ * is loaded while the other states take their steps.  When a state runs out
+ * of input or reaches the end of the automata, the next pending state takes
+ * its place.  Otherwise, the states are executed one after another.
+ *
+ * @param[in, out] states        States of automata; must all be non-NULL
+ *                               and of the same engine.
+ * @param[in]      inputs        Input for each state.
+ * @param[in]      input_lengths Length of each input.
+ * @param[in]      n             Number of states; must be positive.
+ * @param[out]     out_index     Index of state that stopped execution.
+ * @param[in]      interleave    If true, advance states in lockstep.
+ * @return See ia_eudoxus_execute_batch() for return codes meanings.
+ */
+static
+ia_eudoxus_result_t IA_EUDOXUS(execute_batch)(
+    ia_eudoxus_state_t **states,
+    const uint8_t      **inputs,
+    const size_t        *input_lengths,
+    size_t               n,
+    size_t              *out_index,
+    bool                 interleave
+)
+{
+    assert(states    != NULL);
+    assert(n         >  0);
+    assert(out_index != NULL);
+
+    ia_eudoxus_state_t  *active[IA_EUDOXUS_BATCH_WIDTH];
+    size_t               active_index[IA_EUDOXUS_BATCH_WIDTH];
+    size_t               num_active = 0;
+    size_t               pending    = 0;
+    ia_eudoxus_result_t  result     = IA_EUDOXUS_OK;
+
+    ia_eudoxus_set_error(states[0]->eudoxus, NULL);
 
-        /* Update state, including state->remaining_bytes */
-        const uint8_t* old_input_location = state->input_location;
-        result = IA_EUDOXUS(next)(state);
+    for (size_t i = 0; i < n; ++i) {
+        assert(states[i]->node != NULL);
+
+        result = IA_EUDOXUS(begin)(states[i], inputs[i], input_lengths[i]);
         if (result != IA_EUDOXUS_OK) {
+            *out_index = i;
             return result;
         }
+    }
 
-        /* Call callback. */
-        if (
-            with_output &&
-            state->callback != NULL &&
-            ( ! state->eudoxus->automata->no_advance_no_output ||
-              state->input_location != old_input_location )
-        ) {
-            result = IA_EUDOXUS(output)(state);
-            if (result != IA_EUDOXUS_OK) {
+    if (! interleave) {
+        for (size_t i = 0; i < n; ++i) {
+            ia_eudoxus_state_t *state = states[i];
+
+            if (state->input_location == NULL) {
+                continue;
+            }
+            while (state->remaining_bytes > 0) {
+                result = IA_EUDOXUS(step)(state, true);
+                if (result == IA_EUDOXUS_END) {
+                    break;
+                }
+                if (result != IA_EUDOXUS_OK) {
+                    *out_index = i;
+                    return result;
+                }
+            }
+        }
+
+        return IA_EUDOXUS_OK;
+    }
+
+    while (num_active > 0 || pending < n) {
+        /* Fill free slots with pending states. */
+        while (num_active < IA_EUDOXUS_BATCH_WIDTH && pending < n) {
+            ia_eudoxus_state_t *state = states[pending];
+
+            if (state->input_location != NULL && state->remaining_bytes > 0) {
+                IA_EUDOXUS_PREFETCH(state->node);
+                active[num_active]       = state;
+                active_index[num_active] = pending;
+                ++num_active;
+            }
+            ++pending;
+        }
+
+        /* Step every active state once. */
+        size_t slot = 0;
+        while (slot < num_active) {
+            ia_eudoxus_state_t *state = active[slot];
+
+            result = IA_EUDOXUS(step)(state, true);
+            if (result != IA_EUDOXUS_OK && result != IA_EUDOXUS_END) {
+                *out_index = active_index[slot];
                 return result;
             }
+
+            if (result == IA_EUDOXUS_END || state->remaining_bytes == 0) {
+                --num_active;
+                active[slot]       = active[num_active];
+                active_index[slot] = active_index[num_active];
+            }
+            else {
+                IA_EUDOXUS_PREFETCH(state->node);
+                ++slot;
+            }
         }
     }
 
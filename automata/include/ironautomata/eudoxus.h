@@ -80,7 +80,8 @@ typedef enum ia_eudoxus_result_t ia_eudoxus_result_t;
  * A Eudoxus automata engine.
  *
  * An opaque data structure representing a Eudoxus engine.  It can be created
- * from file system (ia_eudoxus_create_from_path()), a FILE
+ * from file system (ia_eudoxus_create_from_path(), or
+ * ia_eudoxus_create_from_path_mmap() to map it), a FILE
  * (ia_eudoxus_create_from_file()), or a chunk of memory
  * (ia_eudoxus_create()).  When finished, it should be destroyed with
  * ia_eudoxus_destroy().  It can be used via ia_eudoxus_create_state().
@@ -154,6 +155,34 @@ ia_eudoxus_result_t ia_eudoxus_create_from_path(
     const char    *path
 );
 
+/**
+ * As above, but map the automata file read-only instead of reading it.
+ *
+ * The automata is executed directly from a shared, read-only mapping of the
+ * file at @a path.  Pages are loaded lazily on first use and shared by all
+ * processes mapping the same file, so loading is fast and large automata
+ * are kept in memory once regardless of how many processes use them.  The
+ * file must not be modified while the engine exists.
+ *
+ * In addition to the checks of ia_eudoxus_create(), the indices of the
+ * automata header are checked to be inside the file.
+ *
+ * @param[out] out_eudoxus Variable to hold pointer to created engine.
+ * @param[in]  path        Path to file on disk holding automata.
+ * @return
+ * - IA_EUDOXUS_END on failure to open file for reading.
+ * - IA_EUDOXUS_EINVAL if @a out_eudoxus or @a path is NULL, or the file is
+ *   too short for its header.
+ * - IA_EUDOXUS_EALLOC if the file could not be mapped.
+ * - Other codes as described in ia_eudoxus_create().
+ *
+ * @sa ia_eudoxus_t
+ */
+ia_eudoxus_result_t ia_eudoxus_create_from_path_mmap(
+    ia_eudoxus_t **out_eudoxus,
+    const char    *path
+);
+
 /**
  * Destroy engine @a eudoxus, releasing associated memory.
  *
@@ -379,6 +408,69 @@ ia_eudoxus_result_t ia_eudoxus_execute_without_output(
     size_t              input_length
 );
 
+/**
+ * Execute several independent inputs at once.
+ *
+ * This is equivalent to calling ia_eudoxus_execute() on @a states[i] with
+ * @a inputs[i] and @a input_lengths[i] for every i less than @a n, except
+ * that the states are advanced in lockstep: each takes one step in turn
+ * while the next node of the others is prefetched.  As execution of large
+ * automata is dominated by waiting on memory, this gives considerably higher
+ * throughput than executing the inputs one after another.  Automata small
+ * enough to mostly stay in cache gain nothing from this and their states are
+ * executed one after another; see ia_eudoxus_set_batch_min_length().
+ *
+ * Outputs of each state are generated in the same order as with
+ * ia_eudoxus_execute(), but outputs of different states are interleaved.
+ *
+ * A state that reaches the end of the automata, i.e., for which
+ * ia_eudoxus_execute() would return IA_EUDOXUS_END, is finished and the
+ * other states continue.  IA_EUDOXUS_END is never returned.
+ *
+ * Execution stops as soon as any state would cause ia_eudoxus_execute() to
+ * return an error, e.g., IA_EUDOXUS_STOP because a callback returned
+ * IA_EUDOXUS_CMD_STOP.  That result is returned and the index of the state
+ * is stored in @a out_index.  Every state keeps its position in its input
+ * and can be resumed by passing it to ia_eudoxus_execute() with a NULL
+ * input.
+ *
+ * @param[in, out] states        States to execute; all must be of the same
+ *                               engine.
+ * @param[in]      inputs        Input for each state.  A NULL input resumes
+ *                               the state as for ia_eudoxus_execute().
+ * @param[in]      input_lengths Length of each input.
+ * @param[in]      n             Number of states.
+ * @param[out]     out_index     Index of state that stopped execution.  May
+ *                               be NULL.
+ * @return
+ * - IA_EUDOXUS_OK if all inputs were executed or ended.
+ * - IA_EUDOXUS_EINVAL if @a states, @a inputs, or @a input_lengths is NULL,
+ *   if any state is NULL, or if the states are of different engines.
+ * - Any other result of ia_eudoxus_execute() except IA_EUDOXUS_END for the
+ *   state at @a out_index.
+ */
+ia_eudoxus_result_t ia_eudoxus_execute_batch(
+    ia_eudoxus_state_t **states,
+    const uint8_t      **inputs,
+    const size_t        *input_lengths,
+    size_t               n,
+    size_t              *out_index
+);
+
+/**
+ * Number of bytes of the most recent input not yet consumed by @a state.
+ *
+ * This is 0 once ia_eudoxus_execute() returns IA_EUDOXUS_OK.  After
+ * IA_EUDOXUS_END, it is the number of bytes left when the automata ended;
+ * after IA_EUDOXUS_STOP, the number of bytes left to resume with.
+ *
+ * @param[in] state State of automata.
+ * @return Unconsumed bytes of the current input; 0 if @a state is NULL.
+ */
+size_t ia_eudoxus_remaining_bytes(
+    const ia_eudoxus_state_t *state
+);
+
 /**
  * Set error for @a eudoxus to @a message (claim ownership version).
  *
@@ -533,6 +625,99 @@ ia_eudoxus_result_t ia_eudoxus_all_outputs(
     void                  *callback_data
 );
 
+/**
+ * Set the minimum automata length for ia_eudoxus_execute_batch() to
+ * interleave states of @a eudoxus.
+ *
+ * Below this length, batched states are executed one after another.  The
+ * default is 8MB.  A length of 0 always interleaves, which is mostly useful
+ * for testing.
+ *
+ * @param[in] eudoxus Engine to configure.
+ * @param[in] length  Minimum automata length in bytes.
+ * @return
+ * - IA_EUDOXUS_OK on success.
+ * - IA_EUDOXUS_EINVAL if @a eudoxus is NULL.
+ */
+ia_eudoxus_result_t ia_eudoxus_set_batch_min_length(
+    ia_eudoxus_t *eudoxus,
+    size_t        length
+);
+
+/**
+ * Enable profiling of node visits for @a eudoxus.
+ *
+ * Once enabled, every execution through any state of @a eudoxus counts the
+ * number of times each node is visited, i.e., the number of input bytes
+ * consumed or not consumed at it.  Counts saturate at @c UINT32_MAX.  The
+ * profile can be written with ia_eudoxus_write_profile() and given to the
+ * compiler to lay out frequently visited nodes together; see
+ * EudoxusCompiler::configuration_t::profile.
+ *
+ * Profiling uses 4 bytes of memory per byte of automata and slows execution.
+ * Counting is not synchronized: if states of @a eudoxus are executed
+ * concurrently, some visits may not be counted.
+ *
+ * Does nothing if profiling is already enabled.
+ *
+ * @param[in] eudoxus Engine to profile.
+ * @return
+ * - IA_EUDOXUS_OK on success.
+ * - IA_EUDOXUS_EINVAL if @a eudoxus is NULL.
+ * - IA_EUDOXUS_EALLOC on allocation error.
+ */
+ia_eudoxus_result_t ia_eudoxus_enable_profile(
+    ia_eudoxus_t *eudoxus
+);
+
+/**
+ * Write the profile of @a eudoxus to @a fp.
+ *
+ * The profile is text.  The first line is @c eudoxus-profile followed by the
+ * length of the automata in bytes.  Every following line is the index of a
+ * visited node followed by its number of visits.  Nodes that were never
+ * visited are omitted.
+ *
+ * @param[in] eudoxus Engine to write profile of.
+ * @param[in] fp      File to write profile to.
+ * @return
+ * - IA_EUDOXUS_OK on success.
+ * - IA_EUDOXUS_EINVAL if @a eudoxus or @a fp is NULL or profiling is not
+ *   enabled.
+ * - IA_EUDOXUS_ERROR on write error.
+ */
+ia_eudoxus_result_t ia_eudoxus_write_profile(
+    const ia_eudoxus_t *eudoxus,
+    FILE               *fp
+);
+
+/**
+ * Number of node types distinguished by ia_eudoxus_profile_histogram().
+ */
+#define IA_EUDOXUS_NUM_NODE_TYPES 4
+
+/**
+ * Summarize the profile of @a eudoxus by node type.
+ *
+ * For every node type, as ordered in ia_eudoxus_nodetype_t, stores the
+ * number of distinct nodes of that type that were visited in @a nodes and
+ * the total number of visits to them in @a visits.  This is intended for
+ * comparing automata compiled with different options against the same
+ * input.
+ *
+ * @param[in]  eudoxus Engine to summarize profile of.
+ * @param[out] nodes   Visited nodes by type.  May be NULL.
+ * @param[out] visits  Visits by type.  May be NULL.
+ * @return
+ * - IA_EUDOXUS_OK on success.
+ * - IA_EUDOXUS_EINVAL if @a eudoxus is NULL or profiling is not enabled.
+ */
+ia_eudoxus_result_t ia_eudoxus_profile_histogram(
+    const ia_eudoxus_t *eudoxus,
+    uint64_t            nodes[IA_EUDOXUS_NUM_NODE_TYPES],
+    uint64_t            visits[IA_EUDOXUS_NUM_NODE_TYPES]
+);
+
 /**
  * @} IronAutomataEudoxus
  */
@@ -53,8 +53,19 @@ extern "C" {
  *
  * This is checked by @c ia_eudoxus_create_ methods to insure that an automata
  * was generated for the current engine.
+ *
+ * Version 11 added low nodes with split edges.
+ */
+#define IA_EUDOXUS_VERSION 11
+
+/**
+ * Version of automata without low nodes with split edges.
+ *
+ * The compiler writes automata without split edges with this version, so
+ * that engines predating split edges, which reject any other version, can
+ * still load them.  The engine accepts both versions.
  */
-#define IA_EUDOXUS_VERSION 10
+#define IA_EUDOXUS_VERSION_NO_SPLIT 10
 
 /**
  * A Eudoxus Automata.
@@ -179,7 +190,8 @@ enum ia_eudoxus_nodetype_t
      * Low Degree Node.
      *
      * A low degree node stores its edges in a vector and uses linear search
-     * to determine which edge to follow.
+     * (or, with split edges, a vector compare) to determine which edge to
+     * follow.
      */
     IA_EUDOXUS_LOW = 0,
 
@@ -225,6 +237,31 @@ typedef enum ia_eudoxus_nodetype_t ia_eudoxus_nodetype_t;
 #define IA_EUDOXUS_FLAG(header, n) \
      (ia_bit8(header, (n) + IA_EUDOXUS_TYPE_WIDTH))
 
+/**
+ * Alignment of low node edge labels.
+ *
+ * Low nodes with split edges store their edge labels in a separate array
+ * that starts at an index (relative to the start of the automata) that is a
+ * multiple of this value and whose size is a multiple of this value.  This
+ * allows the engine to compare the input against all labels with vector
+ * instructions without reading past the node.
+ */
+#define IA_EUDOXUS_LABEL_ALIGN 16
+
+/**
+ * Padding needed before low node edge labels that would start at @a index.
+ */
+#define IA_EUDOXUS_LABEL_PADDING(index) \
+     ((IA_EUDOXUS_LABEL_ALIGN - (index) % IA_EUDOXUS_LABEL_ALIGN) % \
+      IA_EUDOXUS_LABEL_ALIGN)
+
+/**
+ * Size in bytes of the edge labels of a low node with @a out_degree edges.
+ */
+#define IA_EUDOXUS_LABEL_SIZE(out_degree) \
+     (((out_degree) + IA_EUDOXUS_LABEL_ALIGN - 1) / IA_EUDOXUS_LABEL_ALIGN * \
+      IA_EUDOXUS_LABEL_ALIGN)
+
 /**
  * A generic node.
  *
@@ -28,6 +28,9 @@
 #include <ironautomata/buffer.hpp>
 #include <ironautomata/intermediate.hpp>
 
+#include <iostream>
+#include <map>
+
 namespace IronAutomata {
 
 /**
@@ -41,6 +44,43 @@ namespace EudoxusCompiler {
  */
 extern const int EUDOXUS_VERSION;
 
+/**
+ * Profile of node visits.
+ *
+ * Gathered by executing an automata with profiling enabled; see
+ * ia_eudoxus_enable_profile() and ia_eudoxus_write_profile().
+ */
+struct profile_t
+{
+    //! Constructor; empty profile.
+    profile_t();
+
+    /**
+     * Length in bytes of the profiled automata.
+     *
+     * Used to check that the profile belongs to the automata being compiled.
+     * 0 indicates no profile.
+     */
+    size_t data_length;
+
+    //! Type of visits.
+    typedef std::map<size_t, uint64_t> visits_t;
+
+    //! Number of visits by node index in the profiled automata.
+    visits_t visits;
+};
+
+/**
+ * Read profile from @a in.
+ *
+ * See ia_eudoxus_write_profile() for the format.
+ *
+ * @param[in] in Stream to read from.
+ * @return Profile read.
+ * @throw runtime_error if @a in is not a valid profile.
+ */
+profile_t read_profile(std::istream& in);
+
 /**
  * Compiler configuration.
  */
@@ -52,6 +92,12 @@ struct configuration_t
      * - id_width = 0, i.e., minimal.
      * - align_to = 1, i.e., no alignment
      * - high_node_weight = 1.0, i.e., optimize space
+     * - split_low_edges_degree = 0, i.e., optimize space
+     * - no profile
+     * - hot_coverage = 0.9
+     * - hot_high_node_weight = 1.0, i.e., as for other nodes
+     * - hot_align_to = 1, i.e., no alignment
+     * - threads = 1
      */
     configuration_t();
 
@@ -107,6 +153,82 @@ struct configuration_t
      * for very low degree.
      */
     double high_node_weight;
+
+    /**
+     * Split Low Node Edges
+     *
+     * Low nodes with at least this many edges store the labels of their
+     * edges contiguously, aligned and padded to IA_EUDOXUS_LABEL_ALIGN
+     * bytes, followed by the targets.  This allows the engine to find the
+     * edge for an input with vector compares (SSE2 or AVX2) instead of a
+     * linear search at the cost of the alignment and padding space.  Since
+     * such low nodes are larger, more nodes may be compiled as high nodes.
+     *
+     * A value of 0 disables split edges.  As nodes of very low degree are
+     * searched quickly anyway but pay the full padding, values of about 8 or
+     * more are likely useful.
+     *
+     * Automata using split edges can not be executed by engines that
+     * predate them.
+     */
+    size_t split_low_edges_degree;
+
+    /**
+     * Profile of node visits.
+     *
+     * If not empty, nodes are laid out by profile instead of breadth first:
+     * the start node is followed by every visited node, most visited first,
+     * and then all other nodes in breadth first order.  Nodes that are
+     * visited often are thus placed close together, so that executing
+     * typical input touches fewer cache lines and pages.
+     *
+     * The profile must have been gathered with an automata compiled from the
+     * same intermediate automata with the same configuration except for the
+     * profile and hot settings; otherwise compile() throws runtime_error.
+     */
+    profile_t profile;
+
+    /**
+     * Fraction of visits that define hot nodes.
+     *
+     * Hot nodes are the most visited nodes that together account for this
+     * fraction of all visits in @c profile.  Ignored if there is no profile.
+     */
+    double hot_coverage;
+
+    /**
+     * High node weight for hot nodes.
+     *
+     * Used instead of @c high_node_weight for hot nodes.  High nodes can be
+     * faster to execute than low nodes of moderate degree, so values below 1
+     * may trade space for time where it matters most.  However, larger hot
+     * nodes also mean more cache misses; for automata of mostly low degree
+     * nodes, values below 1 are usually slower.
+     */
+    double hot_high_node_weight;
+
+    /**
+     * Cache line size for hot nodes.
+     *
+     * Hot nodes that would straddle a multiple of this value but fit in it
+     * are moved to the next multiple by padding.  If used, should be the
+     * cache line size of the target machine, e.g., 64.  As padding also
+     * spreads hot nodes over more cache lines, this is only useful for
+     * automata whose hot nodes often straddle lines.  A value of 1 disables
+     * this.
+     */
+    size_t hot_align_to;
+
+    /**
+     * Number of threads for per node analysis.
+     *
+     * Before any node is placed, the compiler analyzes every node, e.g., to
+     * find its out degree and whether its edges are deterministic.  This
+     * pass is shared by all id widths tried and divided among this many
+     * threads.  0 uses one thread per hardware thread.  Placement is
+     * inherently sequential and is not affected.
+     */
+    size_t threads;
 };
 
 /**
@@ -143,6 +265,21 @@ struct result_t
 
     //! Bytes of PC nodes.
     size_t pc_nodes_bytes;
+
+    //! Number of hot nodes.  0 if there is no profile.
+    size_t hot_nodes;
+
+    //! Bytes of hot nodes.
+    size_t hot_nodes_bytes;
+
+    //! Seconds spent analyzing nodes.  See configuration_t::threads.
+    double analyze_seconds;
+
+    //! Seconds spent deriving the layout from the profile; 0 if none.
+    double layout_seconds;
+
+    //! Seconds spent placing nodes, over all id widths tried.
+    double assemble_seconds;
 };
 
 /**
@@ -151,6 +288,7 @@ struct result_t
  * @param[in] automata      Automata to compile.
  * @param[in] configuration Compiler configuration.
  * @return Compilation result.
+ * @throw runtime_error if the profile of @a configuration does not match.
  */
 result_t compile(
     const Intermediate::Automata& automata,
@@ -67,6 +67,7 @@ struct IA_EUDOXUS(low_node_t)
      * flag2: has_default
      * flag3: advance_on_default
      * flag4: has_edges
+     * flag5: has_split_edges -- labels and targets in separate arrays
      */
     uint8_t header;
 
@@ -92,7 +93,19 @@ struct IA_EUDOXUS(low_node_t)
     /*
     IA_EUDOXUS_ID_T default_node          if has_defaults
     uint8_t         advance[out_degree/8] if has_nonadvancing & has_edges
-    low_edge_t      edges[]
+    low_edge_t      edges[]               if ! has_split_edges
+    */
+
+    /*
+     * Split edges.  The labels start at an index that is a multiple of
+     * IA_EUDOXUS_LABEL_ALIGN and are padded to IA_EUDOXUS_LABEL_SIZE(),
+     * i.e., a multiple of IA_EUDOXUS_LABEL_ALIGN.  The contents of the
+     * padding are undefined.
+     */
+    /*
+    uint8_t         padding[]             if has_split_edges
+    uint8_t         labels[]              if has_split_edges
+    IA_EUDOXUS_ID_T targets[out_degree]   if has_split_edges
     */
 } __attribute((packed));
 
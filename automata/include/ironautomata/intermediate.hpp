@@ -692,6 +692,29 @@ void breadth_first(
     boost::function<void(const node_p&)> callback
 );
 
+/**
+ * Call a callback for every node of an automata from several threads.
+ *
+ * The nodes are collected in breadth first order and then divided among
+ * @a num_threads threads.  @a callback must be safe to call concurrently
+ * for different nodes; in particular, it may modify the node it is called
+ * with but should only read other nodes, and no node may be modified by
+ * another thread.  Order of calls is unspecified.
+ *
+ * With a single thread, this is breadth_first().
+ *
+ * @param[in] automata    Automata to traverse.
+ * @param[in] callback    Callback to call for each node.
+ * @param[in] num_threads Number of threads; 0 for one per hardware thread.
+ * @throw runtime_error if @a callback throws in any thread; the message of
+ *        the first such exception is kept.
+ */
+void parallel_for_each_node(
+    const Automata&                      automata,
+    boost::function<void(const node_p&)> callback,
+    size_t                               num_threads
+);
+
 } // Intermediate
 } // IronAutomata
 
@@ -0,0 +1,48 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef _IA_TIMING_HPP_
+#define _IA_TIMING_HPP_
+
+/**
+ * @file
+ * @brief IronAutomata --- Timing
+ *
+ * Timing of passes, shared by the library and the command line tools.
+ */
+
+#include <boost/chrono.hpp>
+
+namespace IronAutomata {
+
+/**
+ * Seconds elapsed since @a start.
+ *
+ * @param[in] start Start time.
+ * @return Seconds since @a start.
+ */
+inline
+double seconds_since(const boost::chrono::steady_clock::time_point& start)
+{
+    return boost::chrono::duration<double>(
+        boost::chrono::steady_clock::now() - start
+    ).count();
+}
+
+} // IronAutomata
+
+#endif
@@ -30,6 +30,7 @@
 #include <boost/format.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
 
 #include <google/protobuf/io/gzip_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
@@ -1227,5 +1228,94 @@ void breadth_first(
     }
 }
 
+namespace {
+
+/**
+ * Body of a parallel_for_each_node() thread.
+ *
+ * Calls @a callback for every @a stride-th node starting at @a first.
+ *
+ * @param[in]  nodes    Nodes.
+ * @param[in]  first    Index of first node.
+ * @param[in]  stride   Distance between nodes.
+ * @param[in]  callback Callback.
+ * @param[out] error    Message of exception thrown by @a callback, if any.
+ */
+void for_each_node_stride(
+    const vector<node_p>&                       nodes,
+    size_t                                      first,
+    size_t                                      stride,
+    const boost::function<void(const node_p&)>& callback,
+    string&                                     error
+)
+{
+    try {
+        for (size_t i = first; i < nodes.size(); i += stride) {
+            callback(nodes[i]);
+        }
+    }
+    catch (const exception& e) {
+        error = e.what();
+        if (error.empty()) {
+            error = "Unknown error.";
+        }
+    }
+    catch (...) {
+        error = "Unknown error.";
+    }
+}
+
+//! Append @a node to @a nodes.
+void append_node(vector<node_p>& nodes, const node_p& node)
+{
+    nodes.push_back(node);
+}
+
+} // Anonymous
+
+void parallel_for_each_node(
+    const Automata&                      automata,
+    boost::function<void(const node_p&)> callback,
+    size_t                               num_threads
+)
+{
+    if (num_threads == 0) {
+        num_threads = max(boost::thread::hardware_concurrency(), 1U);
+    }
+
+    if (num_threads == 1) {
+        breadth_first(automata, callback);
+        return;
+    }
+
+    vector<node_p> nodes;
+    breadth_first(
+        automata,
+        boost::bind(append_node, boost::ref(nodes), _1)
+    );
+
+    // Striding spreads the expensive, high degree nodes near the start
+    // across all threads.
+    vector<string> errors(num_threads);
+    boost::thread_group threads;
+    for (size_t i = 0; i < num_threads; ++i) {
+        threads.create_thread(boost::bind(
+            for_each_node_stride,
+            boost::cref(nodes),
+            i,
+            num_threads,
+            boost::cref(callback),
+            boost::ref(errors[i])
+        ));
+    }
+    threads.join_all();
+
+    BOOST_FOREACH(const string& error, errors) {
+        if (! error.empty()) {
+            throw runtime_error(error);
+        }
+    }
+}
+
 } // Intermediate
 } // IronAutomata
@@ -83,6 +83,69 @@ class TestBasic < Test::Unit::TestCase
     ac_test(words, text, "wide_space", :space)
   end
 
+  def test_split_low_edges
+    words = []
+    ('a'..'z').each do |x|
+      words << "a#{x}#{x}"
+      words << "a#{x.upcase}#{x}"
+      words << "#{x}b"
+    end
+    text = words.join(" ") + " azZ aZz bb"
+
+    ac_test(words, text, "split_low_edges", false, ["-S", "1"])
+    ac_test(words, text, "split_low_edges_low", false, ["-S", "1", "-h", "4000"])
+    ac_test(words, text, "split_low_edges_fast", :fast, ["-S", "1", "-h", "4000"])
+  end
+
+  def eudoxus_version(eudoxus_path)
+    IO.binread(eudoxus_path, 1).unpack("C").first
+  end
+
+  def test_split_low_edges_version
+    words = ["ab", "ac", "ad"]
+
+    # Older engines can still load automata without split edges.
+    automata_test(words, ACGEN, "split_version", false, ["-S", "1", "-h", "4000"]) do |dir, eudoxus_path|
+      assert_equal(11, eudoxus_version(eudoxus_path))
+    end
+    automata_test(words, ACGEN, "no_split_version", false, ["-h", "4000"]) do |dir, eudoxus_path|
+      assert_equal(10, eudoxus_version(eudoxus_path))
+    end
+  end
+
+  def test_profile
+    n = 200
+
+    words = Set.new
+    while words.size < n
+      words << random_word(10)
+    end
+    words = words.to_a
+
+    text = words.join(" ")
+
+    automata_test(words, ACGEN, "profile") do |dir, eudoxus_path|
+      automata_path = File.join(dir, "initial_automata")
+      profile_path = File.join(dir, "profile")
+      ee(eudoxus_path, dir, text, "input", "output", "auto", ["-p", profile_path])
+
+      profiled_path = File.join(dir, "eudoxus_profiled")
+      result = system(EC, "-i", automata_path, "-o", profiled_path,
+        "-p", profile_path, "--hot-high-node-weight", "0.5",
+        "--hot-align", "64"
+      )
+      assert_block("EC with profile failed.") {result}
+      output_substrings = ee(profiled_path, dir, text)
+      assert_substrings_equal(substrings(words, text), output_substrings)
+
+      # Profile of a differently compiled automata.
+      result = system(EC, "-i", automata_path, "-o", profiled_path,
+        "-p", profile_path, "-w", "8"
+      )
+      assert_block("EC accepted mismatched profile.") {! result}
+    end
+  end
+
   def test_tails
     words = ["afoobar", "bfoobar", "cfoobar"]
     text = words.join(" ")
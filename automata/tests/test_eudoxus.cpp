@@ -0,0 +1,559 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/**
+ * @file
+ * @brief IronAutomata --- Eudoxus engine test.
+ *
+ * Executes automata compiled by the Eudoxus compiler.
+ */
+
+#include <ironautomata/eudoxus.h>
+#include <ironautomata/eudoxus_automata.h>
+#include <ironautomata/eudoxus_compiler.hpp>
+#include <ironautomata/generator/aho_corasick.hpp>
+#include <ironautomata/intermediate.hpp>
+
+#include <boost/make_shared.hpp>
+
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace IronAutomata;
+
+namespace {
+
+//! Compile an Aho-Corasick automata of @a words.
+buffer_t compile_words(const vector<string>& words)
+{
+    Intermediate::Automata automata;
+
+    Generator::aho_corasick_begin(automata);
+    for (size_t i = 0; i < words.size(); ++i) {
+        Generator::aho_corasick_add_length(automata, words[i]);
+    }
+    Generator::aho_corasick_finish(automata);
+
+    return EudoxusCompiler::compile(automata).buffer;
+}
+
+//! Callback counting outputs in @a callback_data, a size_t.
+ia_eudoxus_command_t count_outputs(
+    ia_eudoxus_t  *engine,
+    const char    *output,
+    size_t         output_length,
+    const uint8_t *input_location,
+    void          *callback_data
+)
+{
+    ++*reinterpret_cast<size_t *>(callback_data);
+    return IA_EUDOXUS_CMD_CONTINUE;
+}
+
+/**
+ * Compile an automata that ends after its first output.
+ *
+ * Bytes other than 'a' are skipped.  On 'a', it moves to a node with an
+ * output and no way out, so any further input ends execution.
+ */
+buffer_t compile_ending()
+{
+    Intermediate::Automata automata;
+    Intermediate::node_p start = boost::make_shared<Intermediate::Node>();
+    Intermediate::node_p found = boost::make_shared<Intermediate::Node>();
+    Intermediate::Edge edge(found);
+
+    edge.add('a');
+    start->edges().push_back(edge);
+    start->default_target() = start;
+    found->first_output() = boost::make_shared<Intermediate::Output>("a");
+    automata.start_node() = start;
+
+    return EudoxusCompiler::compile(automata).buffer;
+}
+
+//! Callback data of count_until().
+struct count_until_t
+{
+    //! Outputs so far.
+    size_t count;
+    //! Stop at this many outputs; 0 for never.
+    size_t stop_at;
+};
+
+//! Callback counting outputs in @a callback_data, a count_until_t.
+ia_eudoxus_command_t count_until(
+    ia_eudoxus_t  *engine,
+    const char    *output,
+    size_t         output_length,
+    const uint8_t *input_location,
+    void          *callback_data
+)
+{
+    count_until_t& data = *reinterpret_cast<count_until_t *>(callback_data);
+
+    ++data.count;
+    return data.count == data.stop_at ?
+        IA_EUDOXUS_CMD_STOP : IA_EUDOXUS_CMD_CONTINUE;
+}
+
+}
+
+class TestEudoxusMmap : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        vector<string> words;
+        words.push_back("foo");
+        words.push_back("bar");
+        words.push_back("foobar");
+        m_automata = compile_words(words);
+        m_eudoxus = NULL;
+    }
+
+    virtual void TearDown()
+    {
+        ia_eudoxus_destroy(m_eudoxus);
+        for (size_t i = 0; i < m_paths.size(); ++i) {
+            unlink(m_paths[i].c_str());
+        }
+    }
+
+    //! Header of @a automata.
+    static ia_eudoxus_automata_t& header(buffer_t& automata)
+    {
+        return *reinterpret_cast<ia_eudoxus_automata_t *>(&automata[0]);
+    }
+
+    //! Write the first @a length bytes of @a data and map them.
+    ia_eudoxus_result_t load(const buffer_t& data, size_t length)
+    {
+        char path[] = "/tmp/test_eudoxus.XXXXXX";
+        int fd = mkstemp(path);
+        if (fd == -1) {
+            throw runtime_error("Could not create temporary file.");
+        }
+        m_paths.push_back(path);
+        if (write(fd, &data[0], length) != ssize_t(length)) {
+            close(fd);
+            throw runtime_error("Could not write temporary file.");
+        }
+        close(fd);
+
+        ia_eudoxus_destroy(m_eudoxus);
+        m_eudoxus = NULL;
+        return ia_eudoxus_create_from_path_mmap(&m_eudoxus, path);
+    }
+
+    //! Map all of @a data.
+    ia_eudoxus_result_t load(const buffer_t& data)
+    {
+        return load(data, data.size());
+    }
+
+    //! Number of outputs of the mapped automata for @a input.
+    size_t execute(const string& input)
+    {
+        ia_eudoxus_state_t *state = NULL;
+        size_t count = 0;
+
+        EXPECT_EQ(
+            IA_EUDOXUS_OK,
+            ia_eudoxus_create_state(&state, m_eudoxus, count_outputs, &count)
+        );
+        EXPECT_EQ(
+            IA_EUDOXUS_OK,
+            ia_eudoxus_execute(
+                state,
+                reinterpret_cast<const uint8_t *>(input.data()),
+                input.length()
+            )
+        );
+        ia_eudoxus_destroy_state(state);
+
+        return count;
+    }
+
+    buffer_t       m_automata;
+    ia_eudoxus_t  *m_eudoxus;
+    vector<string> m_paths;
+};
+
+TEST_F(TestEudoxusMmap, Basic)
+{
+    ASSERT_EQ(IA_EUDOXUS_OK, load(m_automata));
+    ASSERT_TRUE(m_eudoxus != NULL);
+    EXPECT_EQ(4UL, execute("xxfoobarxxbar"));
+}
+
+TEST_F(TestEudoxusMmap, Missing)
+{
+    EXPECT_EQ(
+        IA_EUDOXUS_END,
+        ia_eudoxus_create_from_path_mmap(&m_eudoxus, "/nonexistent/eudoxus")
+    );
+    EXPECT_EQ(
+        IA_EUDOXUS_EINVAL,
+        ia_eudoxus_create_from_path_mmap(NULL, "/nonexistent/eudoxus")
+    );
+}
+
+TEST_F(TestEudoxusMmap, Truncated)
+{
+    // Too short for the header.
+    EXPECT_EQ(IA_EUDOXUS_EINVAL, load(m_automata, 4));
+    EXPECT_EQ(
+        IA_EUDOXUS_EINVAL,
+        load(m_automata, sizeof(ia_eudoxus_automata_t) - 1)
+    );
+
+    // Header is complete, but data_length is past the end of the file.
+    EXPECT_EQ(IA_EUDOXUS_EINVAL, load(m_automata, m_automata.size() - 1));
+    EXPECT_EQ(
+        IA_EUDOXUS_EINVAL,
+        load(m_automata, sizeof(ia_eudoxus_automata_t))
+    );
+    EXPECT_TRUE(m_eudoxus == NULL);
+}
+
+TEST_F(TestEudoxusMmap, BadVersion)
+{
+    buffer_t automata = m_automata;
+
+    header(automata).version = IA_EUDOXUS_VERSION + 1;
+    EXPECT_EQ(IA_EUDOXUS_EINCOMPAT, load(automata));
+    header(automata).version = IA_EUDOXUS_VERSION_NO_SPLIT - 1;
+    EXPECT_EQ(IA_EUDOXUS_EINCOMPAT, load(automata));
+
+    // Automata without split edges are written with the older version.
+    header(automata).version = IA_EUDOXUS_VERSION_NO_SPLIT;
+    EXPECT_EQ(IA_EUDOXUS_OK, load(automata));
+    EXPECT_EQ(4UL, execute("xxfoobarxxbar"));
+}
+
+TEST_F(TestEudoxusMmap, IndexOutOfRange)
+{
+    const uint64_t length = header(m_automata).data_length;
+    buffer_t automata;
+
+    ASSERT_EQ(m_automata.size(), length);
+
+    automata = m_automata;
+    header(automata).data_length = length + 1;
+    EXPECT_EQ(IA_EUDOXUS_EINVAL, load(automata));
+
+    // start_index can only be out of range for small automata.
+    if (length < 256) {
+        automata = m_automata;
+        header(automata).start_index = static_cast<uint8_t>(length);
+        EXPECT_EQ(IA_EUDOXUS_EINVAL, load(automata));
+    }
+
+    automata = m_automata;
+    header(automata).first_output = length + 1;
+    EXPECT_EQ(IA_EUDOXUS_EINVAL, load(automata));
+
+    automata = m_automata;
+    header(automata).first_output_list = length + 1;
+    EXPECT_EQ(IA_EUDOXUS_EINVAL, load(automata));
+
+    automata = m_automata;
+    header(automata).metadata_index = length + 1;
+    EXPECT_EQ(IA_EUDOXUS_EINVAL, load(automata));
+
+    EXPECT_TRUE(m_eudoxus == NULL);
+}
+
+/**
+ * Runs ia_eudoxus_execute_batch() and compares it with ia_eudoxus_execute().
+ *
+ * The automata are small, so batches are only interleaved if interleave()
+ * forces it.
+ */
+class TestEudoxusBatch : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        m_eudoxus = NULL;
+    }
+
+    virtual void TearDown()
+    {
+        ia_eudoxus_destroy(m_eudoxus);
+    }
+
+    //! Load @a automata.
+    void load(const buffer_t& automata)
+    {
+        char *data = reinterpret_cast<char *>(malloc(automata.size()));
+        ASSERT_TRUE(data != NULL);
+        memcpy(data, &automata[0], automata.size());
+
+        ia_eudoxus_destroy(m_eudoxus);
+        m_eudoxus = NULL;
+        ASSERT_EQ(IA_EUDOXUS_OK, ia_eudoxus_create(&m_eudoxus, data));
+    }
+
+    //! Interleave batches of any automata length if @a force.
+    void interleave(bool force)
+    {
+        ASSERT_EQ(
+            IA_EUDOXUS_OK,
+            ia_eudoxus_set_batch_min_length(
+                m_eudoxus,
+                force ? 0 : 8 * 1024 * 1024
+            )
+        );
+    }
+
+    //! Number of outputs for @a input executed on its own.
+    size_t execute(const string& input, ia_eudoxus_result_t expected)
+    {
+        ia_eudoxus_state_t *state = NULL;
+        size_t count = 0;
+
+        EXPECT_EQ(
+            IA_EUDOXUS_OK,
+            ia_eudoxus_create_state(&state, m_eudoxus, count_outputs, &count)
+        );
+        EXPECT_EQ(
+            expected,
+            ia_eudoxus_execute(
+                state,
+                reinterpret_cast<const uint8_t *>(input.data()),
+                input.length()
+            )
+        );
+        ia_eudoxus_destroy_state(state);
+
+        return count;
+    }
+
+    /**
+     * Execute @a inputs as a batch.
+     *
+     * @param[in]  inputs    Inputs.
+     * @param[in]  stop_at   Stop at this many outputs of each input; 0 for
+     *                       never.
+     * @param[out] counts    Outputs of each input.
+     * @param[out] out_index Index reported by ia_eudoxus_execute_batch().
+     * @return Result of ia_eudoxus_execute_batch().
+     */
+    ia_eudoxus_result_t execute_batch(
+        const vector<string>& inputs,
+        const vector<size_t>& stop_at,
+        vector<size_t>&       counts,
+        size_t&               out_index
+    )
+    {
+        const size_t n = inputs.size();
+        vector<count_until_t>        data(n);
+        vector<ia_eudoxus_state_t *> states(n);
+        vector<const uint8_t *>      input_data(n);
+        vector<size_t>               input_lengths(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            data[i].count   = 0;
+            data[i].stop_at = stop_at[i];
+            EXPECT_EQ(
+                IA_EUDOXUS_OK,
+                ia_eudoxus_create_state(
+                    &states[i], m_eudoxus, count_until, &data[i]
+                )
+            );
+            input_data[i] =
+                reinterpret_cast<const uint8_t *>(inputs[i].data());
+            input_lengths[i] = inputs[i].length();
+        }
+
+        out_index = n;
+        ia_eudoxus_result_t result = ia_eudoxus_execute_batch(
+            &states[0], &input_data[0], &input_lengths[0], n, &out_index
+        );
+
+        counts.clear();
+        for (size_t i = 0; i < n; ++i) {
+            counts.push_back(data[i].count);
+            ia_eudoxus_destroy_state(states[i]);
+        }
+
+        return result;
+    }
+
+    ia_eudoxus_t *m_eudoxus;
+};
+
+TEST_F(TestEudoxusBatch, End)
+{
+    load(compile_ending());
+
+    // More inputs than are active at once, ending at different points.
+    vector<string> inputs;
+    vector<ia_eudoxus_result_t> expected;
+    for (size_t i = 0; i < 20; ++i) {
+        string input(i, 'x');
+        if (i % 3 == 0) {
+            input += "a";
+            expected.push_back(IA_EUDOXUS_OK);
+        }
+        else if (i % 3 == 1) {
+            input += "a" + string(i, 'x');
+            expected.push_back(IA_EUDOXUS_END);
+        }
+        else {
+            expected.push_back(IA_EUDOXUS_OK);
+        }
+        inputs.push_back(input);
+    }
+
+    vector<size_t> expected_counts;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        expected_counts.push_back(execute(inputs[i], expected[i]));
+    }
+
+    for (int force = 0; force < 2; ++force) {
+        SCOPED_TRACE(force ? "interleaved" : "sequential");
+        interleave(force);
+
+        vector<size_t> counts;
+        size_t out_index;
+        EXPECT_EQ(
+            IA_EUDOXUS_OK,
+            execute_batch(
+                inputs, vector<size_t>(inputs.size(), 0), counts, out_index
+            )
+        );
+        EXPECT_EQ(expected_counts, counts);
+    }
+}
+
+TEST_F(TestEudoxusBatch, Stop)
+{
+    vector<string> words;
+    words.push_back("foo");
+    words.push_back("bar");
+    load(compile_words(words));
+
+    vector<string> inputs;
+    for (size_t i = 0; i < 12; ++i) {
+        inputs.push_back(string(i, 'x') + "foobarfoobar");
+    }
+    vector<size_t> stop_at(inputs.size(), 0);
+    stop_at[9] = 2;
+
+    for (int force = 0; force < 2; ++force) {
+        SCOPED_TRACE(force ? "interleaved" : "sequential");
+        interleave(force);
+
+        vector<size_t> counts;
+        size_t out_index;
+        EXPECT_EQ(
+            IA_EUDOXUS_STOP,
+            execute_batch(inputs, stop_at, counts, out_index)
+        );
+        EXPECT_EQ(9UL, out_index);
+        EXPECT_EQ(2UL, counts[9]);
+        if (! force) {
+            // Earlier inputs finish before the stopped one is started.
+            for (size_t i = 0; i < 9; ++i) {
+                EXPECT_EQ(4UL, counts[i]);
+            }
+            EXPECT_EQ(0UL, counts[10]);
+        }
+    }
+}
+
+TEST_F(TestEudoxusBatch, MixedLengths)
+{
+    vector<string> words;
+    words.push_back("foo");
+    words.push_back("bar");
+    words.push_back("foobar");
+    load(compile_words(words));
+
+    const string pattern = "xfoobarbarfoox";
+    vector<string> inputs;
+    for (size_t i = 0; i < 30; ++i) {
+        string input;
+        for (size_t j = 0; j < (i * 7) % 50; ++j) {
+            input += pattern[(i + j) % pattern.length()];
+        }
+        inputs.push_back(input);
+    }
+
+    vector<size_t> expected_counts;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        expected_counts.push_back(execute(inputs[i], IA_EUDOXUS_OK));
+    }
+
+    for (int force = 0; force < 2; ++force) {
+        SCOPED_TRACE(force ? "interleaved" : "sequential");
+        interleave(force);
+
+        vector<size_t> counts;
+        size_t out_index;
+        EXPECT_EQ(
+            IA_EUDOXUS_OK,
+            execute_batch(
+                inputs, vector<size_t>(inputs.size(), 0), counts, out_index
+            )
+        );
+        EXPECT_EQ(expected_counts, counts);
+    }
+}
+
+TEST(TestEudoxusCompiler, ThreadsDeterministic)
+{
+    // Enough words that every thread analyzes many nodes.
+    Intermediate::Automata automata;
+    Generator::aho_corasick_begin(automata);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < 2000; ++i) {
+        string word;
+        for (size_t j = 0; j < 3 + i % 9; ++j) {
+            seed = seed * 1103515245 + 12345;
+            word += char('a' + (seed >> 16) % 26);
+        }
+        Generator::aho_corasick_add_length(automata, word);
+    }
+    Generator::aho_corasick_finish(automata);
+
+    EudoxusCompiler::configuration_t configuration;
+    configuration.threads = 1;
+    buffer_t sequential = EudoxusCompiler::compile(
+        automata, configuration
+    ).buffer;
+    ASSERT_FALSE(sequential.empty());
+
+    configuration.threads = 4;
+    buffer_t parallel = EudoxusCompiler::compile(
+        automata, configuration
+    ).buffer;
+    ASSERT_EQ(sequential.size(), parallel.size());
+    EXPECT_EQ(0, memcmp(&sequential[0], &parallel[0], sequential.size()));
+}
@@ -359,3 +359,41 @@ TEST(TestOptimizeEdge, SingleDefault)
     ASSERT_TRUE(node->edges().empty());
     ASSERT_EQ(target_a, node->default_target());
 }
+
+TEST(TestOptimizeEdges, Parallel)
+{
+    Automata automata;
+    automata.start_node() = make_shared<Node>();
+    node_p target = make_shared<Node>();
+
+    // Every child has two edges to target that optimize to one.
+    for (int c = 0; c < 100; ++c) {
+        node_p child = make_shared<Node>();
+        Edge edge;
+        edge.target() = target;
+        edge.add('a');
+        child->edges().push_back(edge);
+        edge.remove('a');
+        edge.add('b');
+        child->edges().push_back(edge);
+
+        edge.clear();
+        edge.target() = child;
+        edge.add(c);
+        automata.start_node()->edges().push_back(edge);
+    }
+
+    parallel_for_each_node(automata, optimize_edges, 4);
+
+    ASSERT_EQ(100UL, automata.start_node()->edges().size());
+    for (
+        Node::edge_list_t::const_iterator i =
+            automata.start_node()->edges().begin();
+        i != automata.start_node()->edges().end();
+        ++i
+    ) {
+        ASSERT_EQ(1UL, i->target()->edges().size());
+        EXPECT_TRUE(i->target()->edges().front().matches('a'));
+        EXPECT_TRUE(i->target()->edges().front().matches('b'));
+    }
+}
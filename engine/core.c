@@ -141,6 +141,9 @@ static ib_core_cfg_t core_global_cfg;
     IB_ALPART_HTTP_RESPONSE_METADATA|IB_ALPART_HTTP_RESPONSE_HEADER | \
     IB_ALPART_HTTP_RESPONSE_BODY|IB_ALPART_HTTP_RESPONSE_TRAILER
 
+/** Default body bytes kept in memory per body (RequestBodyBufferLimit). */
+#define IB_CORE_BODY_BUFFER_LIMIT (1024 * 1024)
+
 
 /* Rule log parts amalgamation */
 #define IB_RULE_LOG_FLAGS_REQUEST                               \
@@ -534,6 +537,12 @@ static ib_status_t audit_api_write_log(ib_provider_inst_t *lpi)
         return IB_EINVAL;
     }
 
+    /* The core provider hands the log to the writer thread if there is
+     * one (AuditLogQueueSize). */
+    if ( (iface == &core_audit_iface) && (log->ib->auditlog_queue != NULL) ) {
+        return core_audit_enqueue(lpi, log);
+    }
+
     /* Open the log if required. This is thread safe. */
     if (iface->open != NULL) {
         rc = iface->open(lpi, log);
@@ -643,48 +652,48 @@ static IB_PROVIDER_API_TYPE(audit) audit_api = {
 static size_t ib_auditlog_gen_raw_stream(ib_auditlog_part_t *part,
                                          const uint8_t **chunk)
 {
-    ib_sdata_t *sdata;
+    ib_bodystore_iter_t *iter;
     size_t dlen;
+    ib_status_t rc;
 
+    /* The gen_data field holds the body store iterator once the part
+     * has started.  A -1 value means it is done.
+     */
     if (part->gen_data == NULL) {
-        ib_stream_t *stream = (ib_stream_t *)part->part_data;
+        const ib_bodystore_t *store = (const ib_bodystore_t *)part->part_data;
 
         /* No data. */
-        if (stream->slen == 0) {
+        if ( (store == NULL) || (ib_bodystore_length(store) == 0) ) {
             *chunk = NULL;
             part->gen_data = (void *)-1;
             return 0;
         }
 
-        sdata = (ib_sdata_t *)IB_LIST_FIRST(stream);
-        dlen = sdata->dlen;
-        *chunk = (const uint8_t *)sdata->data;
-
-        sdata = IB_LIST_NODE_NEXT(sdata);
-        if (sdata != NULL) {
-            part->gen_data = sdata;
-        }
-        else {
+        iter = ib_mpool_alloc(part->log->mp, sizeof(*iter));
+        if (iter == NULL) {
+            *chunk = NULL;
             part->gen_data = (void *)-1;
+            return 0;
         }
-
-        return dlen;
+        ib_bodystore_iter_init(iter, store);
+        part->gen_data = iter;
     }
     else if (part->gen_data == (void *)-1) {
         part->gen_data = NULL;
         return 0;
     }
 
-    sdata = (ib_sdata_t *)part->gen_data;
-    dlen = sdata->dlen;
-    *chunk = (const uint8_t *)sdata->data;
-
-    sdata = IB_LIST_NODE_NEXT(sdata);
-    if (sdata != NULL) {
-        part->gen_data = sdata;
-    }
-    else {
-        part->gen_data = (void *)-1;
+    iter = (ib_bodystore_iter_t *)part->gen_data;
+    rc = ib_bodystore_iter_next(iter, chunk, &dlen);
+    if (rc != IB_OK) {
+        if (rc != IB_ENOENT) {
+            ib_log_error(part->log->ib,
+                         "Failed to read body for audit log part %s: %s",
+                         part->name, ib_status_to_string(rc));
+        }
+        *chunk = NULL;
+        part->gen_data = NULL;
+        return 0;
     }
 
     return dlen;
@@ -2664,6 +2673,85 @@ static ib_status_t core_hook_logging(ib_engine_t *ib,
     return rc;
 }
 
+/**
+ * Append body data to a transaction body store, creating it if needed.
+ *
+ * Both bodies keep at most RequestBodyBufferLimit bytes in memory and spill
+ * the rest to RequestBodySpillDir.  RequestBodyLimit only bounds request
+ * bodies; response bodies are only kept for the audit log.
+ *
+ * @param[in] tx Transaction
+ * @param[in,out] pstore Body store of @a tx
+ * @param[in] txdata Body data
+ * @param[in] request Request body (apply RequestBodyLimit)?
+ *
+ * @returns Status code
+ */
+static ib_status_t core_body_append(ib_tx_t *tx,
+                                    ib_bodystore_t **pstore,
+                                    const ib_txdata_t *txdata,
+                                    bool request)
+{
+    assert(tx != NULL);
+    assert(pstore != NULL);
+    assert(txdata != NULL);
+
+    ib_core_body_stats_t *stats = &(tx->ib->body_stats);
+    uint64_t spilled;
+    uint64_t truncated;
+    ib_status_t rc;
+
+    if (*pstore == NULL) {
+        ib_core_cfg_t *corecfg = NULL;
+        ib_num_t limit = 0;
+
+        rc = ib_context_module_config(tx->ctx, ib_core_module(),
+                                      (void *)&corecfg);
+        if (rc != IB_OK) {
+            return rc;
+        }
+        if (request) {
+            limit = corecfg->body_limit;
+        }
+
+        rc = ib_bodystore_create(pstore, tx->mp,
+                                 corecfg->body_buffer_limit, limit,
+                                 corecfg->body_spill_dir);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+
+    spilled = ib_bodystore_spilled(*pstore);
+    truncated = ib_bodystore_truncated(*pstore);
+
+    /* Reference the server's buffer instead of copying it if possible. */
+    if (txdata->slice != NULL) {
+        rc = ib_bodystore_append_slice(*pstore, txdata->slice);
+    }
+    else {
+        rc = ib_bodystore_append(*pstore, txdata->data, txdata->dlen);
+    }
+    if (rc != IB_OK) {
+        ib_log_error_tx(tx, "Failed to store body data: %s",
+                        ib_status_to_string(rc));
+    }
+
+    if (ib_bodystore_spilled(*pstore) > spilled) {
+        if (spilled == 0) {
+            __sync_fetch_and_add(&(stats->bodies_spilled), 1);
+        }
+        __sync_fetch_and_add(&(stats->bytes_spilled),
+                             ib_bodystore_spilled(*pstore) - spilled);
+    }
+    if (ib_bodystore_truncated(*pstore) > truncated) {
+        __sync_fetch_and_add(&(stats->bytes_truncated),
+                             ib_bodystore_truncated(*pstore) - truncated);
+    }
+
+    return rc;
+}
+
 static ib_status_t core_hook_request_body_data(ib_engine_t *ib,
                                                ib_tx_t *tx,
                                                ib_state_event_type_t event,
@@ -2673,22 +2761,11 @@ static ib_status_t core_hook_request_body_data(ib_engine_t *ib,
     assert(ib != NULL);
     assert(tx != NULL);
 
-    void *data_copy;
-    ib_status_t rc;
-
     if (txdata == NULL) {
         return IB_OK;
     }
 
-    data_copy = ib_mpool_memdup(tx->mp, txdata->data, txdata->dlen);
-
-    // TODO: Add a limit to this: size and type
-    rc = ib_stream_push(tx->request_body,
-                        IB_STREAM_DATA,
-                        data_copy,
-                        txdata->dlen);
-
-    return rc;
+    return core_body_append(tx, &(tx->request_body), txdata, true);
 }
 
 static ib_status_t core_hook_response_body_data(ib_engine_t *ib,
@@ -2700,9 +2777,6 @@ static ib_status_t core_hook_response_body_data(ib_engine_t *ib,
     assert(ib != NULL);
     assert(tx != NULL);
 
-    void *data_copy;
-    ib_status_t rc;
-
     if (txdata == NULL) {
         return IB_OK;
     }
@@ -2711,15 +2785,26 @@ static ib_status_t core_hook_response_body_data(ib_engine_t *ib,
         return IB_OK;
     }
 
-    data_copy = ib_mpool_memdup(tx->mp, txdata->data, txdata->dlen);
+    return core_body_append(tx, &(tx->response_body), txdata, false);
+}
 
-    // TODO: Add a limit to this: size and type
-    rc = ib_stream_push(tx->response_body,
-                        IB_STREAM_DATA,
-                        data_copy,
-                        txdata->dlen);
+ib_status_t ib_core_body_stats(
+    const ib_engine_t    *ib,
+    ib_core_body_stats_t *stats)
+{
+    assert(ib != NULL);
+    assert(stats != NULL);
 
-    return rc;
+    const ib_core_body_stats_t *s = &(ib->body_stats);
+
+    stats->bodies_spilled =
+        __atomic_load_n(&(s->bodies_spilled), __ATOMIC_RELAXED);
+    stats->bytes_spilled =
+        __atomic_load_n(&(s->bytes_spilled), __ATOMIC_RELAXED);
+    stats->bytes_truncated =
+        __atomic_load_n(&(s->bytes_truncated), __ATOMIC_RELAXED);
+
+    return IB_OK;
 }
 
 ib_status_t ib_core_module_data(ib_module_t **core_module,
@@ -3682,6 +3767,78 @@ static ib_status_t core_dir_param1(ib_cfgparser_t *cp,
         rc = ib_context_set_string(ctx, "auditlog_sdir_fmt", p1_unescaped);
         return rc;
     }
+    else if ( (strcasecmp("AuditLogQueueSize", name) == 0) ||
+              (strcasecmp("AuditLogSegmentSize", name) == 0) )
+    {
+        ib_num_t num;
+
+        if (ctx != ib_context_main(ib)) {
+            ib_cfg_log_error(cp, "%s is only valid in the main context.",
+                             name);
+            return IB_EINVAL;
+        }
+        rc = ib_string_to_num(p1_unescaped, 0, &num);
+        if ( (rc != IB_OK) || (num < 0) ) {
+            ib_cfg_log_error(cp, "Invalid size: %s \"%s\"",
+                             name, p1_unescaped);
+            return IB_EINVAL;
+        }
+        ib_log_debug2(ib, "%s: \"%s\" ctx=%p", name, p1_unescaped, ctx);
+        if (strcasecmp("AuditLogQueueSize", name) == 0) {
+            rc = ib_context_set_num(ctx, "auditlog_queue_size", num);
+        }
+        else {
+            rc = ib_context_set_num(ctx, "auditlog_segment_size", num);
+        }
+        return rc;
+    }
+    else if ( (strcasecmp("RequestBodyBufferLimit", name) == 0) ||
+              (strcasecmp("RequestBodyLimit", name) == 0) )
+    {
+        ib_num_t num;
+
+        rc = ib_string_to_num(p1_unescaped, 0, &num);
+        if ( (rc != IB_OK) || (num < 0) ) {
+            ib_cfg_log_error(cp, "Invalid size: %s \"%s\"",
+                             name, p1_unescaped);
+            return IB_EINVAL;
+        }
+        ib_log_debug2(ib, "%s: \"%s\" ctx=%p", name, p1_unescaped, ctx);
+        if (strcasecmp("RequestBodyBufferLimit", name) == 0) {
+            rc = ib_context_set_num(ctx, "body_buffer_limit", num);
+        }
+        else {
+            rc = ib_context_set_num(ctx, "body_limit", num);
+        }
+        return rc;
+    }
+    else if (strcasecmp("RequestBodySpillDir", name) == 0) {
+        ib_log_debug2(ib, "%s: \"%s\" ctx=%p", name, p1_unescaped, ctx);
+        rc = ib_context_set_string(ctx, "body_spill_dir", p1_unescaped);
+        return rc;
+    }
+    else if (strcasecmp("AuditLogQueueFull", name) == 0) {
+        if (ctx != ib_context_main(ib)) {
+            ib_cfg_log_error(cp, "%s is only valid in the main context.",
+                             name);
+            return IB_EINVAL;
+        }
+        ib_log_debug2(ib, "%s: \"%s\" ctx=%p", name, p1_unescaped, ctx);
+        if (strcasecmp("Wait", p1_unescaped) == 0) {
+            rc = ib_context_set_num(ctx, "auditlog_queue_wait", 1);
+            return rc;
+        }
+        else if (strcasecmp("Drop", p1_unescaped) == 0) {
+            rc = ib_context_set_num(ctx, "auditlog_queue_wait", 0);
+            return rc;
+        }
+
+        ib_log_error(ib,
+                     "Failed to parse directive: %s \"%s\"",
+                     name,
+                     p1_unescaped);
+        return IB_EINVAL;
+    }
     /* Set the default block status for responding to blocked transactions. */
     else if (strcasecmp("DefaultBlockStatus", name) == 0) {
         int status;
@@ -3923,6 +4080,63 @@ static ib_status_t core_dir_loglevel(ib_cfgparser_t *cp,
     return IB_EINVAL;
 }
 
+/**
+ * Handle the TxRecycle directive.
+ *
+ * @param cp Config parser
+ * @param name Directive name
+ * @param onoff On/Off flag
+ * @param cbdata Callback data (unused)
+ *
+ * @returns Status code
+ */
+static ib_status_t core_dir_tx_recycle(ib_cfgparser_t *cp,
+                                       const char *name,
+                                       int onoff,
+                                       void *cbdata)
+{
+    assert(cp != NULL);
+    assert(cp->ib != NULL);
+    assert(name != NULL);
+
+    ib_engine_t *ib = cp->ib;
+    ib_context_t *ctx = cp->cur_ctx ? cp->cur_ctx : ib_context_main(ib);
+
+    if (ctx != ib_context_main(ib)) {
+        ib_cfg_log_error(cp, "%s is only valid in the main context.", name);
+        return IB_EINVAL;
+    }
+
+    ib_log_debug2(ib, "%s: %s", name, onoff ? "On" : "Off");
+    return ib_context_set_num(ctx, "tx_recycle", (onoff ? 1 : 0));
+}
+
+/**
+ * Handle the RuleEngineProfile directive.
+ *
+ * @param cp Config parser
+ * @param name Directive name
+ * @param onoff On/Off flag
+ * @param cbdata Callback data (unused)
+ *
+ * @returns Status code
+ */
+static ib_status_t core_dir_rule_profile(ib_cfgparser_t *cp,
+                                         const char *name,
+                                         int onoff,
+                                         void *cbdata)
+{
+    assert(cp != NULL);
+    assert(cp->ib != NULL);
+    assert(name != NULL);
+
+    ib_engine_t *ib = cp->ib;
+    ib_context_t *ctx = cp->cur_ctx ? cp->cur_ctx : ib_context_main(ib);
+
+    ib_log_debug2(ib, "%s: %s", name, onoff ? "On" : "Off");
+    return ib_context_set_num(ctx, "rule_profile", (onoff ? 1 : 0));
+}
+
 /**
  * Handle single parameter directives.
  *
@@ -4662,6 +4876,21 @@ static IB_DIRMAP_INIT_STRUCTURE(core_directive_map) = {
         core_dir_param1,
         NULL
     ),
+    IB_DIRMAP_INIT_PARAM1(
+        "AuditLogQueueSize",
+        core_dir_param1,
+        NULL
+    ),
+    IB_DIRMAP_INIT_PARAM1(
+        "AuditLogQueueFull",
+        core_dir_param1,
+        NULL
+    ),
+    IB_DIRMAP_INIT_PARAM1(
+        "AuditLogSegmentSize",
+        core_dir_param1,
+        NULL
+    ),
     IB_DIRMAP_INIT_OPFLAGS(
         "AuditLogParts",
         core_dir_auditlogparts,
@@ -4696,6 +4925,37 @@ static IB_DIRMAP_INIT_STRUCTURE(core_directive_map) = {
         core_loglevels_map
     ),
 
+    /* Rule profiling */
+    IB_DIRMAP_INIT_ONOFF(
+        "RuleEngineProfile",
+        core_dir_rule_profile,
+        NULL
+    ),
+
+    /* Transaction recycling */
+    IB_DIRMAP_INIT_ONOFF(
+        "TxRecycle",
+        core_dir_tx_recycle,
+        NULL
+    ),
+
+    /* Request body storage */
+    IB_DIRMAP_INIT_PARAM1(
+        "RequestBodyBufferLimit",
+        core_dir_param1,
+        NULL
+    ),
+    IB_DIRMAP_INIT_PARAM1(
+        "RequestBodyLimit",
+        core_dir_param1,
+        NULL
+    ),
+    IB_DIRMAP_INIT_PARAM1(
+        "RequestBodySpillDir",
+        core_dir_param1,
+        NULL
+    ),
+
     /* TX DPI Initializers */
     IB_DIRMAP_INIT_PARAM2(
         "InitVar",
@@ -4772,6 +5032,9 @@ static ib_status_t core_init(ib_engine_t *ib,
     corecfg->auditlog_dir         = "/var/log/ironbee";
     corecfg->auditlog_sdir_fmt    = "";
     corecfg->auditlog_index_fmt   = IB_LOGFORMAT_DEFAULT;
+    corecfg->auditlog_queue_size  = 0;
+    corecfg->auditlog_queue_wait  = 0;
+    corecfg->auditlog_segment_size = 0;
     corecfg->audit                = MODULE_NAME_STR;
     corecfg->data                 = MODULE_NAME_STR;
     corecfg->module_base_path     = X_MODULE_BASE_PATH;
@@ -4780,6 +5043,11 @@ static ib_status_t core_init(ib_engine_t *ib,
     corecfg->rule_log_level       = IB_LOG_INFO;
     corecfg->rule_debug_str       = "error";
     corecfg->rule_debug_level     = IB_RULE_DLOG_ERROR;
+    corecfg->rule_profile         = 0;
+    corecfg->tx_recycle           = 0;
+    corecfg->body_buffer_limit    = IB_CORE_BODY_BUFFER_LIMIT;
+    corecfg->body_limit           = 0;
+    corecfg->body_spill_dir       = "/tmp";
     corecfg->block_status         = 403;
     corecfg->inspection_engine_options = IB_IEOPT_DEFAULT;
 
@@ -5038,6 +5306,38 @@ static IB_CFGMAP_INIT_STRUCTURE(core_config_map) = {
         ib_core_cfg_t,
         rule_debug_level
     ),
+    IB_CFGMAP_INIT_ENTRY(
+        "rule_profile",
+        IB_FTYPE_NUM,
+        ib_core_cfg_t,
+        rule_profile
+    ),
+    IB_CFGMAP_INIT_ENTRY(
+        "tx_recycle",
+        IB_FTYPE_NUM,
+        ib_core_cfg_t,
+        tx_recycle
+    ),
+
+    /* Request body storage */
+    IB_CFGMAP_INIT_ENTRY(
+        "body_buffer_limit",
+        IB_FTYPE_NUM,
+        ib_core_cfg_t,
+        body_buffer_limit
+    ),
+    IB_CFGMAP_INIT_ENTRY(
+        "body_limit",
+        IB_FTYPE_NUM,
+        ib_core_cfg_t,
+        body_limit
+    ),
+    IB_CFGMAP_INIT_ENTRY(
+        "body_spill_dir",
+        IB_FTYPE_NULSTR,
+        ib_core_cfg_t,
+        body_spill_dir
+    ),
 
     /* Parser */
     IB_CFGMAP_INIT_ENTRY(
@@ -5104,6 +5404,24 @@ static IB_CFGMAP_INIT_STRUCTURE(core_config_map) = {
         ib_core_cfg_t,
         auditlog_index_fmt
     ),
+    IB_CFGMAP_INIT_ENTRY(
+        "auditlog_queue_size",
+        IB_FTYPE_NUM,
+        ib_core_cfg_t,
+        auditlog_queue_size
+    ),
+    IB_CFGMAP_INIT_ENTRY(
+        "auditlog_queue_wait",
+        IB_FTYPE_NUM,
+        ib_core_cfg_t,
+        auditlog_queue_wait
+    ),
+    IB_CFGMAP_INIT_ENTRY(
+        "auditlog_segment_size",
+        IB_FTYPE_NUM,
+        ib_core_cfg_t,
+        auditlog_segment_size
+    ),
     IB_CFGMAP_INIT_ENTRY(
         IB_PROVIDER_TYPE_AUDIT,
         IB_FTYPE_NULSTR,
@@ -5212,6 +5530,19 @@ static ib_status_t core_ctx_close(ib_engine_t  *ib,
         if (rc != IB_OK) {
             return rc;
         }
+
+        /* Create the audit log queue; each process starts its writer on
+         * first use. */
+        if ( (corecfg->auditlog_queue_size > 0) &&
+             (ib->auditlog_queue == NULL) )
+        {
+            rc = core_audit_queue_create(ib, corecfg);
+            if (rc != IB_OK) {
+                ib_log_alert(ib, "Failed to create audit log queue: %s",
+                             ib_status_to_string(rc));
+                return rc;
+            }
+        }
     }
 
     return IB_OK;
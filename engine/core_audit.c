@@ -30,6 +30,8 @@
 
 #include <ironbee/core.h>
 #include <ironbee/engine_types.h>
+#include <ironbee/lock.h>
+#include <ironbee/log.h>
 #include <ironbee/path.h>
 #include <ironbee/provider.h>
 #include <ironbee/rule_logger.h>
@@ -38,7 +40,13 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -60,20 +68,52 @@ typedef struct {
 static const char * const ib_pipe_shell = "/bin/sh";
 const size_t LOGFORMAT_MAX_LINE_LENGTH = 8192;
 
-ib_status_t core_audit_open_auditfile(ib_provider_inst_t *lpi,
-                                      ib_auditlog_t *log,
-                                      core_audit_cfg_t *cfg,
-                                      ib_core_cfg_t *corecfg)
+/* Audit log framing: header (boundary, version), part header (boundary,
+ * name, content type) and footer (boundary). */
+#define CORE_AUDIT_HEADER_FMT \
+    "MIME-Version: 1.0\r\n" \
+    "Content-Type: multipart/mixed; boundary=%s\r\n" \
+    "X-IronBee-AuditLog: type=multipart; version=%d\r\n" \
+    "\r\n" \
+    "This is a multi-part message in MIME format.\r\n" \
+    "\r\n"
+#define CORE_AUDIT_PART_FMT \
+    "\r\n--%s" \
+    "\r\nContent-Disposition: audit-log-part; name=\"%s\"" \
+    "\r\nContent-Transfer-Encoding: binary" \
+    "\r\nContent-Type: %s" \
+    "\r\n\r\n"
+#define CORE_AUDIT_FOOTER_FMT "\r\n--%s--\r\n"
+
+/**
+ * Generate the names of the audit log file of a transaction.
+ *
+ * Sets cfg->full_path, cfg->temp_path and cfg->fn (relative to the audit
+ * log base directory).
+ *
+ * @param[in] log Audit Log that will be written.
+ * @param[in,out] cfg The configuration.
+ * @param[in] corecfg The core configuration.
+ * @param[out] pdn Directory of the audit log file.
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_EALLOC on allocation failure.
+ * - IB_EINVAL if a name is too long.
+ */
+static ib_status_t core_audit_auditfile_name(ib_auditlog_t *log,
+                                             core_audit_cfg_t *cfg,
+                                             ib_core_cfg_t *corecfg,
+                                             char **pdn)
 {
     const int dtmp_sz = 64;
     const int dn_sz = 512;
-    char *dtmp = (char *)malloc(dtmp_sz);
-    char *dn = (char *)malloc(dn_sz);
+    char *dtmp = (char *)ib_mpool_alloc(cfg->tx->mp, dtmp_sz);
+    char *dn = (char *)ib_mpool_alloc(cfg->tx->mp, dn_sz);
     char *audit_filename;
     int audit_filename_sz;
     char *temp_filename;
     int temp_filename_sz;
-    int fd;
     const time_t log_seconds = IB_CLOCK_SECS(log->tx->t.logtime);
     int sys_rc;
     ib_status_t ib_rc;
@@ -82,12 +122,6 @@ ib_status_t core_audit_open_auditfile(ib_provider_inst_t *lpi,
 
     if (dtmp == NULL || dn == NULL) {
         ib_log_error(log->ib,  "Failed to allocate internal buffers.");
-        if (dtmp != NULL) {
-            free(dtmp);
-        }
-        if (dn != NULL) {
-            free(dn);
-        }
         return IB_EALLOC;
     }
 
@@ -117,16 +151,12 @@ ib_status_t core_audit_open_auditfile(ib_provider_inst_t *lpi,
         /// @todo Better error.
         ib_log_error(log->ib,
                      "Could not create audit log directory: too long");
-        free(dtmp);
-        free(dn);
         return IB_EINVAL;
     }
 
     /* Get the site */
     ib_rc = ib_context_site_get(log->ctx, &site);
     if (ib_rc != IB_OK) {
-        free(dtmp);
-        free(dn);
         return ib_rc;
     }
 
@@ -135,6 +165,9 @@ ib_status_t core_audit_open_auditfile(ib_provider_inst_t *lpi,
         audit_filename_sz = strlen(dn) + strlen(cfg->tx->id) +
             strlen(site->id_str) + 7;
         audit_filename = (char *)ib_mpool_alloc(cfg->tx->mp, audit_filename_sz);
+        if (audit_filename == NULL) {
+            return IB_EALLOC;
+        }
         sys_rc = snprintf(audit_filename,
                           audit_filename_sz,
                           "%s/%s_%s.log", dn, cfg->tx->id,site->id_str);
@@ -142,6 +175,9 @@ ib_status_t core_audit_open_auditfile(ib_provider_inst_t *lpi,
     else {
         audit_filename_sz = strlen(dn) + strlen(cfg->tx->id) + 6;
         audit_filename = (char *)ib_mpool_alloc(cfg->tx->mp, audit_filename_sz);
+        if (audit_filename == NULL) {
+            return IB_EALLOC;
+        }
         sys_rc = snprintf(audit_filename,
                           audit_filename_sz,
                           "%s/%s.log", dn, cfg->tx->id);
@@ -150,23 +186,15 @@ ib_status_t core_audit_open_auditfile(ib_provider_inst_t *lpi,
         /// @todo Better error.
         ib_log_error(log->ib,
                      "Could not create audit log filename: too long");
-        free(dtmp);
-        free(dn);
         return IB_EINVAL;
     }
 
-    ib_rc = ib_util_mkpath(dn, corecfg->auditlog_dmode);
-    if (ib_rc != IB_OK) {
-        ib_log_error(log->ib,
-                     "Could not create audit log dir: %s", dn);
-        free(dtmp);
-        free(dn);
-        return ib_rc;
-    }
-
     // Create temporary filename to use while writing the audit log
     temp_filename_sz = strlen(audit_filename) + 6;
     temp_filename = (char *)ib_mpool_alloc(cfg->tx->mp, temp_filename_sz);
+    if (temp_filename == NULL) {
+        return IB_EALLOC;
+    }
     sys_rc = snprintf(temp_filename,
                       temp_filename_sz,
                       "%s.part", audit_filename);
@@ -174,13 +202,42 @@ ib_status_t core_audit_open_auditfile(ib_provider_inst_t *lpi,
         /// @todo Better error.
         ib_log_error(log->ib,
                      "Could not create temporary audit log filename: too long");
-        free(dtmp);
-        free(dn);
         return IB_EINVAL;
     }
 
+    /* Track the relative audit log filename. */
+    cfg->fn = audit_filename + (strlen(corecfg->auditlog_dir) + 1);
+    cfg->full_path = audit_filename;
+    cfg->temp_path = temp_filename;
+    *pdn = dn;
+
+    return IB_OK;
+}
+
+ib_status_t core_audit_open_auditfile(ib_provider_inst_t *lpi,
+                                      ib_auditlog_t *log,
+                                      core_audit_cfg_t *cfg,
+                                      ib_core_cfg_t *corecfg)
+{
+    char *dn;
+    int fd;
+    int sys_rc;
+    ib_status_t ib_rc;
+
+    ib_rc = core_audit_auditfile_name(log, cfg, corecfg, &dn);
+    if (ib_rc != IB_OK) {
+        return ib_rc;
+    }
+
+    ib_rc = ib_util_mkpath(dn, corecfg->auditlog_dmode);
+    if (ib_rc != IB_OK) {
+        ib_log_error(log->ib,
+                     "Could not create audit log dir: %s", dn);
+        return ib_rc;
+    }
+
     /* Open the file.  Use open() & fdopen() to avoid chmod() */
-    fd = open(temp_filename,
+    fd = open(cfg->temp_path,
               (O_WRONLY|O_APPEND|O_CREAT|O_BINARY),
               corecfg->auditlog_fmode);
     if (fd >= 0) {
@@ -193,22 +250,12 @@ ib_status_t core_audit_open_auditfile(ib_provider_inst_t *lpi,
         sys_rc = errno;
         ib_log_error(log->ib,
                      "Failed to open audit log \"%s\": %s (%d)",
-                     temp_filename, strerror(sys_rc), sys_rc);
-        free(dtmp);
-        free(dn);
+                     cfg->temp_path, strerror(sys_rc), sys_rc);
         return IB_EINVAL;
     }
 
-    /* Track the relative audit log filename. */
-    cfg->fn = audit_filename + (strlen(corecfg->auditlog_dir) + 1);
-    cfg->full_path = audit_filename;
-    cfg->temp_path = temp_filename;
-
     /* Log it via the rule logger */
-    ib_rule_log_add_audit(cfg->tx->rule_exec, audit_filename);
-
-    free(dtmp);
-    free(dn);
+    ib_rule_log_add_audit(cfg->tx->rule_exec, cfg->full_path);
 
     return IB_OK;
 }
@@ -377,31 +424,27 @@ ib_status_t core_audit_open_auditindexfile(ib_provider_inst_t *lpi,
     return IB_OK;
 }
 
-ib_status_t core_audit_open(ib_provider_inst_t *lpi,
-                            ib_auditlog_t *log)
+/**
+ * Open the audit log index file and parse the index format, if required.
+ *
+ * @param[in] lpi Log provider interface.
+ * @param[in] log The log record.
+ * @param[in,out] cfg The configuration.
+ * @param[in,out] corecfg The core configuration.
+ *
+ * @returns IB_OK or other. See log file for details of failure.
+ */
+static ib_status_t core_audit_open_index(ib_provider_inst_t *lpi,
+                                         ib_auditlog_t *log,
+                                         core_audit_cfg_t *cfg,
+                                         ib_core_cfg_t *corecfg)
 {
-    core_audit_cfg_t *cfg = (core_audit_cfg_t *)log->cfg_data;
-    ib_core_cfg_t *corecfg;
     ib_status_t rc;
 
     /* Non const struct we will build and then assign to
      * corecfg->auditlog_index_hp. */
     ib_logformat_t *auditlog_index_hp;
 
-    assert(NULL != lpi);
-    assert(NULL != log);
-    assert(NULL != log->ctx);
-    assert(NULL != log->ctx->auditlog);
-
-    rc = ib_context_module_config(log->ctx, ib_core_module(),
-                                  (void *)&corecfg);
-    if (rc != IB_OK) {
-        ib_log_error(log->ib,  "Could not fetch core configuration: %s", ib_status_to_string(rc) );
-        return rc;
-    }
-
-    assert(NULL != corecfg);
-
     /* Copy the FILE* into the core_audit_cfg_t. */
     if (log->ctx->auditlog->index_fp != NULL) {
         cfg->index_fp = log->ctx->auditlog->index_fp;
@@ -422,17 +465,6 @@ ib_status_t core_audit_open(ib_provider_inst_t *lpi,
         }
     }
 
-    /* Open audit file that contains the record identified by the line
-     * written in index_fp. */
-    if (cfg->fp == NULL) {
-        rc = core_audit_open_auditfile(lpi, log, cfg, corecfg);
-
-        if (rc!=IB_OK) {
-            ib_log_error(log->ib,  "Failed to open audit log file.");
-            return rc;
-        }
-    }
-
     /* Set the Audit Log index format */
     if (corecfg->auditlog_index_hp == NULL) {
         rc = ib_logformat_create(log->ib->mp, &auditlog_index_hp);
@@ -457,6 +489,46 @@ ib_status_t core_audit_open(ib_provider_inst_t *lpi,
     return IB_OK;
 }
 
+ib_status_t core_audit_open(ib_provider_inst_t *lpi,
+                            ib_auditlog_t *log)
+{
+    core_audit_cfg_t *cfg = (core_audit_cfg_t *)log->cfg_data;
+    ib_core_cfg_t *corecfg;
+    ib_status_t rc;
+
+    assert(NULL != lpi);
+    assert(NULL != log);
+    assert(NULL != log->ctx);
+    assert(NULL != log->ctx->auditlog);
+
+    rc = ib_context_module_config(log->ctx, ib_core_module(),
+                                  (void *)&corecfg);
+    if (rc != IB_OK) {
+        ib_log_error(log->ib,  "Could not fetch core configuration: %s", ib_status_to_string(rc) );
+        return rc;
+    }
+
+    assert(NULL != corecfg);
+
+    rc = core_audit_open_index(lpi, log, cfg, corecfg);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    /* Open audit file that contains the record identified by the line
+     * written in index_fp. */
+    if (cfg->fp == NULL) {
+        rc = core_audit_open_auditfile(lpi, log, cfg, corecfg);
+
+        if (rc!=IB_OK) {
+            ib_log_error(log->ib,  "Failed to open audit log file.");
+            return rc;
+        }
+    }
+
+    return IB_OK;
+}
+
 ib_status_t core_audit_write_header(ib_provider_inst_t *lpi,
                                     ib_auditlog_t *log)
 {
@@ -464,12 +536,7 @@ ib_status_t core_audit_write_header(ib_provider_inst_t *lpi,
     char header[256];
     size_t hlen;
     int ret = snprintf(header, sizeof(header),
-                       "MIME-Version: 1.0\r\n"
-                       "Content-Type: multipart/mixed; boundary=%s\r\n"
-                       "X-IronBee-AuditLog: type=multipart; version=%d\r\n"
-                       "\r\n"
-                       "This is a multi-part message in MIME format.\r\n"
-                       "\r\n",
+                       CORE_AUDIT_HEADER_FMT,
                        cfg->boundary,
                        IB_AUDITLOG_VERSION);
     if ((size_t)ret >= sizeof(header)) {
@@ -499,11 +566,7 @@ ib_status_t core_audit_write_part(ib_provider_inst_t *lpi,
 
     /* Write the MIME boundary and part header */
     fprintf(cfg->fp,
-            "\r\n--%s"
-            "\r\nContent-Disposition: audit-log-part; name=\"%s\""
-            "\r\nContent-Transfer-Encoding: binary"
-            "\r\nContent-Type: %s"
-            "\r\n\r\n",
+            CORE_AUDIT_PART_FMT,
             cfg->boundary,
             part->name,
             part->content_type);
@@ -530,7 +593,7 @@ ib_status_t core_audit_write_footer(ib_provider_inst_t *lpi,
     core_audit_cfg_t *cfg = (core_audit_cfg_t *)log->cfg_data;
 
     if (cfg->parts_written > 0) {
-        fprintf(cfg->fp, "\r\n--%s--\r\n", cfg->boundary);
+        fprintf(cfg->fp, CORE_AUDIT_FOOTER_FMT, cfg->boundary);
     }
 
     return IB_OK;
@@ -700,7 +763,7 @@ ib_status_t core_audit_close(ib_provider_inst_t *lpi, ib_auditlog_t *log)
             goto cleanup;
         }
 
-        sys_rc = fwrite(line, len, 1, cfg->index_fp);
+        sys_rc = fwrite(line, len + 1, 1, cfg->index_fp);
 
         if (sys_rc < 0) {
             sys_rc = errno;
@@ -728,3 +791,928 @@ cleanup:
     }
     return ib_rc;
 }
+
+/* -- Audit Log Writer -- */
+
+/**
+ * Written in place of the log file field of index lines when audit logs
+ * go to segment files.  The writer replaces it with the segment file name
+ * and record offset, which are not known until the record is written.
+ */
+#define CORE_AUDIT_SEGMENT_MARK "\x1f"
+
+/** Largest record buffer a queue slot keeps for the next record. */
+#define CORE_AUDIT_SLOT_KEEP (256 * 1024)
+
+/** Most index files written to between flushes. */
+#define CORE_AUDIT_MAX_INDEX 16
+
+/**
+ * Audit log queue slot.
+ *
+ * A slot belongs to the request thread that claimed it until its sequence
+ * number is published, and then to the writer until it is released.  The
+ * buffer stays with the slot and is reused by later records.
+ */
+typedef struct {
+    size_t             seq;         /**< Sequence number */
+    ib_auditlog_cfg_t *auditlog;    /**< Index configuration or NULL */
+    char              *buf;         /**< Record, index line and names */
+    size_t             size;        /**< Allocated size of buf */
+    size_t             len;         /**< Used length of buf */
+    size_t             record_len;  /**< Length of the record at buf */
+    size_t             index_off;   /**< Offset of the index line */
+    size_t             index_len;   /**< Length of the index line or 0 */
+    size_t             dir_off;     /**< Offset of the directory name */
+    size_t             path_off;    /**< Offset of the audit log name */
+    size_t             temp_off;    /**< Offset of the temporary name */
+} core_audit_slot_t;
+
+/**
+ * Audit log queue.
+ *
+ * A bounded queue of slots in the style of D. Vyukov's MPMC queue, used
+ * with many request threads producing and one writer consuming.  Slot @e i
+ * has sequence number @e pos when free for the producer claiming position
+ * @e pos, @e pos + 1 when published for the writer, and @e pos + number of
+ * slots when released for the next round.
+ */
+struct ib_auditlog_queue_t {
+    ib_engine_t         *ib;           /**< Engine */
+    core_audit_slot_t   *slots;        /**< Slots */
+    size_t               mask;         /**< Number of slots - 1 */
+    size_t               head;         /**< Next position to claim */
+    size_t               tail;         /**< Next position to write */
+    bool                 wait;         /**< Wait for space or drop? */
+    pid_t                pid;          /**< Process running writer or 0 */
+    pthread_t            thread;       /**< Writer thread */
+    pthread_mutex_t      lock;         /**< Protects the waits */
+    pthread_cond_t       ready;        /**< A record was published */
+    pthread_cond_t       space;        /**< A slot was released */
+    int                  sleeping;     /**< Writer waits on ready? */
+    int                  waiting;      /**< Producers waiting on space */
+    bool                 stop;         /**< Stop when the queue is empty */
+    const char          *dir;          /**< Audit log base directory */
+    ib_num_t             dmode;        /**< Directory create mode */
+    ib_num_t             fmode;        /**< File create mode */
+    size_t               segment_size; /**< Segment size or 0 */
+    FILE                *segment_fp;   /**< Current segment */
+    size_t               segment_off;  /**< Bytes in current segment */
+    unsigned int         segment_num;  /**< Segments opened */
+    char                 segment_path[512]; /**< Current segment path */
+    const char          *segment_name; /**< Name relative to dir */
+    ib_auditlog_cfg_t   *index[CORE_AUDIT_MAX_INDEX]; /**< To flush */
+    size_t               num_index;    /**< Entries in index */
+    ib_core_auditlog_stats_t stats;    /**< Statistics */
+};
+
+/**
+ * Make room in a slot buffer.
+ *
+ * @param[in,out] slot Slot.
+ * @param[in] len Bytes needed after the used part.
+ *
+ * @returns true on success, false on allocation failure.
+ */
+static bool core_audit_slot_reserve(core_audit_slot_t *slot, size_t len)
+{
+    size_t size;
+    char *buf;
+
+    if (slot->size - slot->len >= len) {
+        return true;
+    }
+
+    size = (slot->size == 0) ? 4096 : slot->size;
+    while (size - slot->len < len) {
+        size *= 2;
+    }
+    buf = realloc(slot->buf, size);
+    if (buf == NULL) {
+        return false;
+    }
+    slot->buf = buf;
+    slot->size = size;
+
+    return true;
+}
+
+/**
+ * Append data to a slot buffer.
+ *
+ * @param[in,out] slot Slot.
+ * @param[in] data Data.
+ * @param[in] len Length of @a data.
+ *
+ * @returns true on success, false on allocation failure.
+ */
+static bool core_audit_slot_append(core_audit_slot_t *slot,
+                                   const void *data,
+                                   size_t len)
+{
+    if (! core_audit_slot_reserve(slot, len)) {
+        return false;
+    }
+    memcpy(slot->buf + slot->len, data, len);
+    slot->len += len;
+
+    return true;
+}
+
+/**
+ * Append formatted text to a slot buffer.
+ *
+ * @param[in,out] slot Slot.
+ * @param[in] fmt Format.
+ *
+ * @returns true on success, false on allocation failure.
+ */
+static bool core_audit_slot_printf(core_audit_slot_t *slot,
+                                   const char *fmt, ...)
+    PRINTF_ATTRIBUTE(2, 3);
+static bool core_audit_slot_printf(core_audit_slot_t *slot,
+                                   const char *fmt, ...)
+{
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if ( (len < 0) || (! core_audit_slot_reserve(slot, len + 1)) ) {
+        return false;
+    }
+
+    va_start(ap, fmt);
+    vsnprintf(slot->buf + slot->len, len + 1, fmt, ap);
+    va_end(ap);
+    slot->len += len;
+
+    return true;
+}
+
+/**
+ * Claim a slot for a record.
+ *
+ * @param[in] q Queue.
+ *
+ * @returns The slot, or NULL if the queue is full.
+ */
+static core_audit_slot_t *core_audit_queue_claim(ib_auditlog_queue_t *q)
+{
+    size_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+
+    for (;;) {
+        core_audit_slot_t *slot = &q->slots[pos & q->mask];
+        size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (__sync_bool_compare_and_swap(&q->head, pos, pos + 1)) {
+                return slot;
+            }
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+        }
+        else if (diff < 0) {
+            return NULL;
+        }
+        else {
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/**
+ * Claim a slot, waiting for space if configured to.
+ *
+ * @param[in] q Queue.
+ *
+ * @returns The slot, or NULL if the record is to be dropped.
+ */
+static core_audit_slot_t *core_audit_queue_get(ib_auditlog_queue_t *q)
+{
+    core_audit_slot_t *slot;
+
+    slot = core_audit_queue_claim(q);
+    if ( (slot != NULL) || (! q->wait) ) {
+        return slot;
+    }
+
+    __sync_fetch_and_add(&(q->stats.waited), 1);
+    pthread_mutex_lock(&q->lock);
+    ++q->waiting;
+    while ( ((slot = core_audit_queue_claim(q)) == NULL) && (! q->stop) ) {
+        pthread_cond_wait(&q->space, &q->lock);
+    }
+    --q->waiting;
+    pthread_mutex_unlock(&q->lock);
+
+    return slot;
+}
+
+/**
+ * Publish a claimed slot to the writer.
+ *
+ * @param[in] q Queue.
+ * @param[in] slot Slot.
+ */
+static void core_audit_queue_publish(ib_auditlog_queue_t *q,
+                                     core_audit_slot_t *slot)
+{
+    size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+    /* Sequentially consistent, as is the writer's store to sleeping before
+     * it checks for records, so one of them sees the other. */
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&q->sleeping, __ATOMIC_SEQ_CST) != 0) {
+        pthread_mutex_lock(&q->lock);
+        pthread_cond_signal(&q->ready);
+        pthread_mutex_unlock(&q->lock);
+    }
+}
+
+/**
+ * The slot at the tail of the queue, if it has been published.
+ *
+ * @param[in] q Queue.
+ *
+ * @returns The slot or NULL.
+ */
+static core_audit_slot_t *core_audit_queue_peek(ib_auditlog_queue_t *q)
+{
+    core_audit_slot_t *slot = &q->slots[q->tail & q->mask];
+
+    if (__atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) == q->tail + 1) {
+        return slot;
+    }
+    return NULL;
+}
+
+/**
+ * Release the slot at the tail of the queue for reuse.
+ *
+ * @param[in] q Queue.
+ * @param[in] slot Slot.
+ */
+static void core_audit_queue_release(ib_auditlog_queue_t *q,
+                                     core_audit_slot_t *slot)
+{
+    if (slot->size > CORE_AUDIT_SLOT_KEEP) {
+        free(slot->buf);
+        slot->buf = NULL;
+        slot->size = 0;
+    }
+    __atomic_store_n(&slot->seq, q->tail + q->mask + 1, __ATOMIC_RELEASE);
+    ++q->tail;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->waiting > 0) {
+        pthread_cond_broadcast(&q->space);
+    }
+    pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * Write a buffer to a file descriptor.
+ *
+ * @returns 0 on success or errno.
+ */
+static int core_audit_write_fd(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        buf += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/**
+ * Close the current segment and open the next one.
+ *
+ * @param[in] q Queue.
+ *
+ * @returns IB_OK or other. See log file for details of failure.
+ */
+static ib_status_t core_audit_segment_open(ib_auditlog_queue_t *q)
+{
+    char stamp[32];
+    struct tm tm;
+    time_t now = time(NULL);
+    ib_status_t rc;
+    int fd;
+    int sys_rc;
+
+    if (q->segment_fp != NULL) {
+        fclose(q->segment_fp);
+        q->segment_fp = NULL;
+    }
+
+    rc = ib_util_mkpath(q->dir, q->dmode);
+    if (rc != IB_OK) {
+        ib_log_error(q->ib, "Could not create audit log dir: %s", q->dir);
+        return rc;
+    }
+
+    gmtime_r(&now, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    sys_rc = snprintf(q->segment_path, sizeof(q->segment_path),
+                      "%s/ironbee-audit-%s-%d-%u.log",
+                      q->dir, stamp, (int)getpid(), ++q->segment_num);
+    if (sys_rc >= (int)sizeof(q->segment_path)) {
+        ib_log_error(q->ib,
+                     "Could not create audit log segment name: too long");
+        return IB_EINVAL;
+    }
+    q->segment_name = q->segment_path + strlen(q->dir) + 1;
+
+    /* Use open() & fdopen() to avoid chmod() */
+    fd = open(q->segment_path,
+              (O_WRONLY|O_APPEND|O_CREAT|O_BINARY),
+              q->fmode);
+    if (fd >= 0) {
+        q->segment_fp = fdopen(fd, "ab");
+        if (q->segment_fp == NULL) {
+            close(fd);
+        }
+    }
+    if ( (fd < 0) || (q->segment_fp == NULL) ) {
+        sys_rc = errno;
+        ib_log_error(q->ib,
+                     "Failed to open audit log segment \"%s\": %s (%d)",
+                     q->segment_path, strerror(sys_rc), sys_rc);
+        return IB_EINVAL;
+    }
+    q->segment_off = 0;
+
+    return IB_OK;
+}
+
+/**
+ * Write a record to its own file, renamed into place when complete.
+ *
+ * @param[in] q Queue.
+ * @param[in] slot Slot.
+ *
+ * @returns IB_OK or other. See log file for details of failure.
+ */
+static ib_status_t core_audit_write_file(ib_auditlog_queue_t *q,
+                                         const core_audit_slot_t *slot)
+{
+    const char *dn = slot->buf + slot->dir_off;
+    const char *path = slot->buf + slot->path_off;
+    const char *temp = slot->buf + slot->temp_off;
+    ib_status_t rc;
+    int fd;
+    int sys_rc;
+
+    rc = ib_util_mkpath(dn, q->dmode);
+    if (rc != IB_OK) {
+        ib_log_error(q->ib, "Could not create audit log dir: %s", dn);
+        return rc;
+    }
+
+    fd = open(temp, (O_WRONLY|O_APPEND|O_CREAT|O_BINARY), q->fmode);
+    if (fd < 0) {
+        sys_rc = errno;
+        ib_log_error(q->ib,
+                     "Failed to open audit log \"%s\": %s (%d)",
+                     temp, strerror(sys_rc), sys_rc);
+        return IB_EINVAL;
+    }
+    sys_rc = core_audit_write_fd(fd, slot->buf, slot->record_len);
+    close(fd);
+    if (sys_rc != 0) {
+        ib_log_error(q->ib,
+                     "Failed to write audit log \"%s\": %s (%d)",
+                     temp, strerror(sys_rc), sys_rc);
+        return IB_EUNKNOWN;
+    }
+
+    if (rename(temp, path) != 0) {
+        sys_rc = errno;
+        ib_log_error(q->ib,
+                     "Error renaming auditlog %s: %s (%d)",
+                     temp, strerror(sys_rc), sys_rc);
+        return IB_EOTHER;
+    }
+
+    return IB_OK;
+}
+
+/**
+ * Append a record to the current segment, starting a new one if the
+ * record does not fit.
+ *
+ * @param[in] q Queue.
+ * @param[in] slot Slot.
+ * @param[out] off Offset of the record in the segment.
+ *
+ * @returns IB_OK or other. See log file for details of failure.
+ */
+static ib_status_t core_audit_write_segment(ib_auditlog_queue_t *q,
+                                            const core_audit_slot_t *slot,
+                                            size_t *off)
+{
+    ib_status_t rc;
+
+    if ( (q->segment_fp == NULL) ||
+         ( (q->segment_off > 0) &&
+           (q->segment_off + slot->record_len > q->segment_size) ) )
+    {
+        rc = core_audit_segment_open(q);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+
+    if (fwrite(slot->buf, slot->record_len, 1, q->segment_fp) != 1) {
+        ib_log_error(q->ib,
+                     "Failed to write audit log segment \"%s\"",
+                     q->segment_path);
+        fclose(q->segment_fp);
+        q->segment_fp = NULL;
+        return IB_EUNKNOWN;
+    }
+    *off = q->segment_off;
+    q->segment_off += slot->record_len;
+
+    return IB_OK;
+}
+
+/**
+ * Flush the files written since the last flush.
+ *
+ * @param[in] q Queue.
+ */
+static void core_audit_queue_flush(ib_auditlog_queue_t *q)
+{
+    if (q->segment_fp != NULL) {
+        fflush(q->segment_fp);
+    }
+
+    for (size_t n = 0; n < q->num_index; ++n) {
+        ib_auditlog_cfg_t *auditlog = q->index[n];
+
+        ib_lock_lock(&auditlog->index_fp_lock);
+        if (auditlog->index_fp != NULL) {
+            fflush(auditlog->index_fp);
+        }
+        ib_lock_unlock(&auditlog->index_fp_lock);
+    }
+    q->num_index = 0;
+}
+
+/**
+ * Append the index line of a record to its index file.
+ *
+ * @param[in] q Queue.
+ * @param[in] slot Slot.
+ * @param[in] off Offset of the record in the current segment.
+ *
+ * @returns IB_OK or IB_EUNKNOWN.
+ */
+static ib_status_t core_audit_write_index(ib_auditlog_queue_t *q,
+                                          const core_audit_slot_t *slot,
+                                          size_t off)
+{
+    ib_auditlog_cfg_t *auditlog = slot->auditlog;
+    const char *line = slot->buf + slot->index_off;
+    size_t len = slot->index_len;
+    const char *mark = NULL;
+    bool ok = true;
+    size_t n;
+
+    if (q->segment_size > 0) {
+        mark = memchr(line, CORE_AUDIT_SEGMENT_MARK[0], len);
+    }
+
+    ib_lock_lock(&auditlog->index_fp_lock);
+    if (auditlog->index_fp == NULL) {
+        ib_lock_unlock(&auditlog->index_fp_lock);
+        return IB_OK;
+    }
+    if (mark == NULL) {
+        ok = (fwrite(line, len, 1, auditlog->index_fp) == 1);
+    }
+    else {
+        ok = (fwrite(line, mark - line, 1, auditlog->index_fp) == 1) &&
+             (fprintf(auditlog->index_fp, "%s@%zu",
+                      q->segment_name, off) > 0) &&
+             (fwrite(mark + 1, len - (mark - line) - 1, 1,
+                     auditlog->index_fp) == 1);
+    }
+    ib_lock_unlock(&auditlog->index_fp_lock);
+    if (! ok) {
+        ib_log_error(q->ib, "Could not write to audit log index");
+        return IB_EUNKNOWN;
+    }
+
+    /* Remember the index file for the flush at the end of the batch. */
+    for (n = 0; n < q->num_index; ++n) {
+        if (q->index[n] == auditlog) {
+            return IB_OK;
+        }
+    }
+    if (q->num_index == CORE_AUDIT_MAX_INDEX) {
+        core_audit_queue_flush(q);
+    }
+    q->index[q->num_index++] = auditlog;
+
+    return IB_OK;
+}
+
+/**
+ * Write a queued record and its index line.
+ *
+ * @param[in] q Queue.
+ * @param[in] slot Slot.
+ *
+ * @returns IB_OK or other. See log file for details of failure.
+ */
+static ib_status_t core_audit_write_record(ib_auditlog_queue_t *q,
+                                           const core_audit_slot_t *slot)
+{
+    size_t off = 0;
+    ib_status_t rc;
+
+    /* Serialization failed in the request thread. */
+    if (slot->record_len == 0) {
+        return IB_EALLOC;
+    }
+
+    if (q->segment_size > 0) {
+        rc = core_audit_write_segment(q, slot, &off);
+    }
+    else {
+        rc = core_audit_write_file(q, slot);
+    }
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    if ( (slot->auditlog != NULL) && (slot->index_len > 0) ) {
+        rc = core_audit_write_index(q, slot, off);
+    }
+
+    return rc;
+}
+
+/**
+ * Writer thread: write records in batches until stopped.
+ *
+ * @param[in] arg Queue.
+ *
+ * @returns NULL
+ */
+static void *core_audit_writer(void *arg)
+{
+    ib_auditlog_queue_t *q = (ib_auditlog_queue_t *)arg;
+    core_audit_slot_t *slot;
+
+    for (;;) {
+        size_t batch = 0;
+
+        /* Write everything queued, then flush once. */
+        while ((slot = core_audit_queue_peek(q)) != NULL) {
+            if (core_audit_write_record(q, slot) == IB_OK) {
+                __sync_fetch_and_add(&(q->stats.written), 1);
+            }
+            else {
+                __sync_fetch_and_add(&(q->stats.errors), 1);
+            }
+            core_audit_queue_release(q, slot);
+            ++batch;
+        }
+        if (batch > 0) {
+            core_audit_queue_flush(q);
+            __sync_fetch_and_add(&(q->stats.batches), 1);
+        }
+
+        pthread_mutex_lock(&q->lock);
+        __atomic_store_n(&q->sleeping, 1, __ATOMIC_SEQ_CST);
+        while ( (core_audit_queue_peek(q) == NULL) && (! q->stop) ) {
+            pthread_cond_wait(&q->ready, &q->lock);
+        }
+        __atomic_store_n(&q->sleeping, 0, __ATOMIC_SEQ_CST);
+        if ( (core_audit_queue_peek(q) == NULL) && q->stop ) {
+            pthread_mutex_unlock(&q->lock);
+            break;
+        }
+        pthread_mutex_unlock(&q->lock);
+    }
+
+    if (q->segment_fp != NULL) {
+        fclose(q->segment_fp);
+        q->segment_fp = NULL;
+    }
+
+    return NULL;
+}
+
+/**
+ * Serializes starting writer threads.
+ */
+static pthread_mutex_t core_audit_start_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Reset a queue inherited from the parent process across fork().
+ *
+ * Records the parent queued are the parent writer's to write, and its
+ * segment file and locks are not ours.  The inherited segment stream is
+ * abandoned rather than closed, so that data the parent had buffered is
+ * not written a second time.
+ *
+ * @param[in] q Queue.
+ */
+static void core_audit_queue_reset(ib_auditlog_queue_t *q)
+{
+    for (size_t n = 0; n <= q->mask; ++n) {
+        q->slots[n].seq = n;
+    }
+    q->head = 0;
+    q->tail = 0;
+    q->sleeping = 0;
+    q->waiting = 0;
+    q->stop = false;
+    q->segment_fp = NULL;
+    q->segment_off = 0;
+    q->num_index = 0;
+    memset(&q->stats, 0, sizeof(q->stats));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->ready, NULL);
+    pthread_cond_init(&q->space, NULL);
+}
+
+/**
+ * Start the writer thread of the calling process, if not yet running.
+ *
+ * Servers such as Apache httpd and nginx configure the engine and then
+ * fork their workers, which do not inherit the threads of the parent.
+ * The writer is therefore started by the first record queued in each
+ * process.
+ *
+ * @param[in] q Queue.
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_EUNKNOWN if the writer thread could not be started.
+ */
+static ib_status_t core_audit_queue_start(ib_auditlog_queue_t *q)
+{
+    pid_t pid = getpid();
+    ib_status_t rc = IB_OK;
+
+    if (__atomic_load_n(&q->pid, __ATOMIC_ACQUIRE) == pid) {
+        return IB_OK;
+    }
+
+    pthread_mutex_lock(&core_audit_start_lock);
+    if (q->pid != pid) {
+        if (q->pid != 0) {
+            core_audit_queue_reset(q);
+        }
+        if (pthread_create(&q->thread, NULL, core_audit_writer, q) != 0) {
+            ib_log_error(q->ib, "Failed to start audit log writer thread");
+            rc = IB_EUNKNOWN;
+        }
+        else {
+            __atomic_store_n(&q->pid, pid, __ATOMIC_RELEASE);
+            ib_log_debug(q->ib, "Audit log writer started in process %d",
+                         (int)pid);
+        }
+    }
+    pthread_mutex_unlock(&core_audit_start_lock);
+
+    return rc;
+}
+
+ib_status_t core_audit_queue_create(ib_engine_t *ib,
+                                    const ib_core_cfg_t *corecfg)
+{
+    assert(ib != NULL);
+    assert(corecfg != NULL);
+    assert(corecfg->auditlog_queue_size > 0);
+
+    ib_auditlog_queue_t *q;
+    size_t num = 1;
+
+    while (num < (size_t)corecfg->auditlog_queue_size) {
+        num *= 2;
+    }
+
+    q = calloc(1, sizeof(*q));
+    if (q == NULL) {
+        return IB_EALLOC;
+    }
+    q->slots = calloc(num, sizeof(*q->slots));
+    if (q->slots == NULL) {
+        free(q);
+        return IB_EALLOC;
+    }
+    for (size_t n = 0; n < num; ++n) {
+        q->slots[n].seq = n;
+    }
+
+    q->ib = ib;
+    q->mask = num - 1;
+    q->wait = (corecfg->auditlog_queue_wait != 0);
+    q->dir = corecfg->auditlog_dir;
+    q->dmode = corecfg->auditlog_dmode;
+    q->fmode = corecfg->auditlog_fmode;
+    q->segment_size = corecfg->auditlog_segment_size;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->ready, NULL);
+    pthread_cond_init(&q->space, NULL);
+
+    ib->auditlog_queue = q;
+    ib_log_debug(ib, "Audit log queue created: %zu slots", num);
+
+    return IB_OK;
+}
+
+void core_audit_queue_destroy(ib_engine_t *ib)
+{
+    assert(ib != NULL);
+
+    ib_auditlog_queue_t *q = ib->auditlog_queue;
+
+    if (q == NULL) {
+        return;
+    }
+
+    /* Only a writer started by this process is running here. */
+    if (q->pid == getpid()) {
+        pthread_mutex_lock(&q->lock);
+        q->stop = true;
+        pthread_cond_signal(&q->ready);
+        pthread_cond_broadcast(&q->space);
+        pthread_mutex_unlock(&q->lock);
+        pthread_join(q->thread, NULL);
+
+        ib_log_info(ib,
+                    "Audit log writer: queued=%" PRIu64 " written=%" PRIu64
+                    " dropped=%" PRIu64 " waited=%" PRIu64
+                    " errors=%" PRIu64 " batches=%" PRIu64,
+                    q->stats.queued, q->stats.written, q->stats.dropped,
+                    q->stats.waited, q->stats.errors, q->stats.batches);
+    }
+
+    for (size_t n = 0; n <= q->mask; ++n) {
+        free(q->slots[n].buf);
+    }
+    pthread_cond_destroy(&q->space);
+    pthread_cond_destroy(&q->ready);
+    pthread_mutex_destroy(&q->lock);
+    free(q->slots);
+    free(q);
+    ib->auditlog_queue = NULL;
+}
+
+ib_status_t core_audit_enqueue(ib_provider_inst_t *lpi, ib_auditlog_t *log)
+{
+    assert(lpi != NULL);
+    assert(log != NULL);
+    assert(log->ib->auditlog_queue != NULL);
+
+    ib_auditlog_queue_t *q = log->ib->auditlog_queue;
+    core_audit_cfg_t *cfg = (core_audit_cfg_t *)log->cfg_data;
+    ib_core_cfg_t *corecfg;
+    core_audit_slot_t *slot;
+    ib_list_node_t *node;
+    char *dn = NULL;
+    bool ok;
+    ib_status_t rc;
+
+    rc = ib_context_module_config(log->ctx, ib_core_module(),
+                                  (void *)&corecfg);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    rc = core_audit_open_index(lpi, log, cfg, corecfg);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    if (q->segment_size > 0) {
+        cfg->fn = CORE_AUDIT_SEGMENT_MARK;
+    }
+    else {
+        rc = core_audit_auditfile_name(log, cfg, corecfg, &dn);
+        if (rc != IB_OK) {
+            return rc;
+        }
+        ib_rule_log_add_audit(cfg->tx->rule_exec, cfg->full_path);
+    }
+
+    rc = core_audit_queue_start(q);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    slot = core_audit_queue_get(q);
+    if (slot == NULL) {
+        __sync_fetch_and_add(&(q->stats.dropped), 1);
+        ib_log_debug_tx(log->tx, "Audit log queue full: log dropped");
+        return IB_EAGAIN;
+    }
+
+    /* Serialize the record, its index line and its names into the slot. */
+    slot->auditlog = NULL;
+    slot->len = 0;
+    slot->index_len = 0;
+    ok = core_audit_slot_printf(slot, CORE_AUDIT_HEADER_FMT,
+                                cfg->boundary, IB_AUDITLOG_VERSION);
+    IB_LIST_LOOP(log->parts, node) {
+        ib_auditlog_part_t *part =
+            (ib_auditlog_part_t *)ib_list_node_data(node);
+        const uint8_t *chunk;
+        size_t chunk_size;
+
+        ok = ok && core_audit_slot_printf(slot, CORE_AUDIT_PART_FMT,
+                                          cfg->boundary,
+                                          part->name,
+                                          part->content_type);
+        while ((chunk_size = part->fn_gen(part, &chunk)) != 0) {
+            ok = ok && core_audit_slot_append(slot, chunk, chunk_size);
+            cfg->parts_written++;
+        }
+    }
+    if (cfg->parts_written > 0) {
+        ok = ok && core_audit_slot_printf(slot, CORE_AUDIT_FOOTER_FMT,
+                                          cfg->boundary);
+    }
+    slot->record_len = slot->len;
+
+    if ( ok && (cfg->index_fp != NULL) && (cfg->parts_written > 0) ) {
+        size_t len = 0;
+
+        ok = core_audit_slot_reserve(slot, LOGFORMAT_MAX_LINE_LENGTH + 2);
+        if (ok) {
+            rc = core_audit_get_index_line(lpi, log,
+                                           slot->buf + slot->len,
+                                           LOGFORMAT_MAX_LINE_LENGTH,
+                                           &len);
+            if ( (rc == IB_OK) || (rc == IB_ETRUNC) ) {
+                slot->buf[slot->len + len] = '\n';
+                slot->index_off = slot->len;
+                slot->index_len = len + 1;
+                slot->len += len + 1;
+                slot->auditlog = log->ctx->auditlog;
+            }
+        }
+    }
+
+    if (dn != NULL) {
+        slot->dir_off = slot->len;
+        ok = ok && core_audit_slot_append(slot, dn, strlen(dn) + 1);
+        slot->path_off = slot->len;
+        ok = ok && core_audit_slot_append(slot, cfg->full_path,
+                                          strlen(cfg->full_path) + 1);
+        slot->temp_off = slot->len;
+        ok = ok && core_audit_slot_append(slot, cfg->temp_path,
+                                          strlen(cfg->temp_path) + 1);
+    }
+
+    /* A claimed slot must be published; the writer skips empty ones. */
+    if (! ok) {
+        slot->record_len = 0;
+        ib_log_error_tx(log->tx, "Failed to allocate audit log buffer");
+    }
+    __sync_fetch_and_add(&(q->stats.queued), 1);
+    core_audit_queue_publish(q, slot);
+
+    return ok ? IB_OK : IB_EALLOC;
+}
+
+ib_status_t ib_core_auditlog_stats(
+    const ib_engine_t        *ib,
+    ib_core_auditlog_stats_t *stats)
+{
+    assert(ib != NULL);
+    assert(stats != NULL);
+
+    const ib_auditlog_queue_t *q = ib->auditlog_queue;
+
+    if (q == NULL) {
+        return IB_ENOENT;
+    }
+
+    stats->queued  = __atomic_load_n(&(q->stats.queued), __ATOMIC_RELAXED);
+    stats->written = __atomic_load_n(&(q->stats.written), __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&(q->stats.dropped), __ATOMIC_RELAXED);
+    stats->waited  = __atomic_load_n(&(q->stats.waited), __ATOMIC_RELAXED);
+    stats->errors  = __atomic_load_n(&(q->stats.errors), __ATOMIC_RELAXED);
+    stats->batches = __atomic_load_n(&(q->stats.batches), __ATOMIC_RELAXED);
+
+    return IB_OK;
+}
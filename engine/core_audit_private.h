@@ -131,4 +131,53 @@ ib_status_t core_audit_write_footer(ib_provider_inst_t *lpi,
 
 ib_status_t core_audit_close(ib_provider_inst_t *lpi, ib_auditlog_t *log);
 
+/* -- Audit Log Writer -- */
+
+/**
+ * Create the audit log queue.
+ *
+ * Audit logs written with core_audit_enqueue() are serialized by the
+ * request thread into a queue slot and written to disk, together with
+ * their index line, by a single writer thread.  The writer is started by
+ * the first log queued in each process, so that processes forked after
+ * configuration get their own.  The queue is stored in
+ * ib_engine_t::auditlog_queue.
+ *
+ * @param[in] ib Engine.
+ * @param[in] corecfg Main context core configuration.
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_EALLOC on allocation failure.
+ */
+ib_status_t core_audit_queue_create(ib_engine_t *ib,
+                                    const ib_core_cfg_t *corecfg);
+
+/**
+ * Write the queued audit logs, stop the writer thread and destroy the
+ * queue.
+ *
+ * Does nothing if the engine has no queue.  Must be called while the
+ * configuration contexts still exist.
+ *
+ * @param[in] ib Engine.
+ */
+void core_audit_queue_destroy(ib_engine_t *ib);
+
+/**
+ * Queue an audit log for the writer thread.
+ *
+ * Used instead of the open, write and close functions when the engine has
+ * an audit log queue.  If the queue is full the log is dropped, or if
+ * AuditLogQueueFull is Wait, the caller waits for space.
+ *
+ * @param[in] lpi Log provider interface.
+ * @param[in] log The log record.
+ * @returns
+ * - IB_OK on success.
+ * - IB_EAGAIN if the log was dropped.
+ * - Other on failure.  See log file for details of failure.
+ */
+ib_status_t core_audit_enqueue(ib_provider_inst_t *lpi, ib_auditlog_t *log);
+
 #endif // _IB_CORE_AUDIT_PRIVATE_H_
@@ -36,12 +36,16 @@
 
 #include <ironbee/context_selection.h>
 #include <ironbee/field.h>
+#include <ironbee/hash.h>
 #include <ironbee/mpool.h>
 #include <ironbee/string.h>
 #include <ironbee/util.h>
 
 #include <assert.h>
+#include <ctype.h>
 #include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <unistd.h>
 
 
@@ -79,6 +83,8 @@ typedef struct core_site_t {
     ib_list_t             *hosts;        /**< List of core_host_t* */
     ib_list_t             *services;     /**< List of core_service_t* */
     ib_list_t             *locations;    /**< List of core_location_t* */
+    struct core_trie_node_t *location_trie; /**< Trie of location paths */
+    const struct core_location_t *location_any; /**< First 'match any' */
 } core_site_t;
 
 /** Core context selection host name entity */
@@ -100,16 +106,48 @@ typedef struct core_service_t {
 typedef struct core_location_t {
     ib_site_location_t     location;     /**< Site location data */
     size_t                 path_len;     /**< Length of path string */
+    size_t                 index;        /**< Position in the site's list */
     bool                   match_any;    /** Is this a 'match any' location? */
 } core_location_t;
 
-/** Core site selection data */
-typedef struct core_site_selector_t {
-    const core_site_t     *site;         /**< Pointer to the site */
-    const core_service_t  *service;      /**< Service (IP/Port) */
-    const ib_list_t       *hosts;        /**< List of core_host_t* */
-    const ib_list_t       *locations;    /**< List of core_location_t* */
-} core_site_selector_t;
+/**
+ * Byte trie node
+ *
+ * Used for the reversed, lower cased wildcard host suffixes of all sites
+ * (data is a core_ranks_t*) and for the location paths of a site (data is
+ * the first core_location_t* with the path).
+ */
+typedef struct core_trie_node_t {
+    struct core_trie_node_t *child;      /**< First child */
+    struct core_trie_node_t *sibling;    /**< Next sibling */
+    void                  *data;         /**< Node data or NULL */
+    unsigned char          c;            /**< Byte leading to this node */
+} core_trie_node_t;
+
+/** Sorted list of site ranks (positions in the site list) */
+typedef struct core_ranks_t {
+    size_t                *ranks;        /**< Array of ranks */
+    size_t                 count;        /**< Number of ranks */
+    size_t                 size;         /**< Allocated size of ranks */
+} core_ranks_t;
+
+/**
+ * Core site selection index
+ *
+ * The first matching site in configuration order is selected, so every
+ * index maps to the ranks of the sites which can match.
+ */
+struct core_ctxsel_index_t {
+    core_site_t          **sites;        /**< Sites by rank */
+    size_t                 num_sites;    /**< Number of sites */
+    ib_hash_t             *hosts;        /**< Host name -> core_ranks_t* */
+    core_trie_node_t      *suffixes;     /**< Wildcard host suffixes */
+    core_ranks_t          *any_host;     /**< Sites matching any host */
+    ib_hash_t             *services;     /**< "IP port" -> core_ranks_t* */
+};
+
+/** Maximum length of a service key: IPv6 address, space, port and NUL */
+#define CORE_CTXSEL_KEY_MAX 80
 
 
 /**
@@ -140,180 +178,510 @@ static const core_location_t *core_ctxsel_matchany_location(
 }
 
 /**
- * Check for a matching host within a host list
+ * Find the child of a trie node
  *
- * This function takes a list of hosts, and attempts to find the first
- * host that matches the transaction.  This function is intended to aid in
- * the development of context selection functions, but it's use is optional.
- * It is used by the core site selector.
+ * @param[in] node Trie node
+ * @param[in] c Byte leading to the child
  *
- * @param[in] ib IronBee engine
- * @param[in] tx Transaction to match
- * @param[in] hosts List of ib_core_host_t
- * @param[out] match true if a match was found, else false
+ * @returns Child node or NULL
+ */
+static core_trie_node_t *core_trie_child(
+    const core_trie_node_t *node,
+    unsigned char c)
+{
+    core_trie_node_t *child;
+
+    for (child = node->child; child != NULL; child = child->sibling) {
+        if (child->c == c) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Find or create the trie node for a key
+ *
+ * @param[in] mp Memory pool to allocate nodes from
+ * @param[in] root Trie root
+ * @param[in] key Key
+ * @param[in] len Length of @a key
+ * @param[in] reverse Insert the key last byte first, lower cased?
+ * @param[out] pnode The key's node
  *
- * @returns IB_OK
+ * @returns IB_OK or IB_EALLOC
  */
-static ib_status_t core_ctxsel_match_host(
-    const ib_engine_t *ib,
-    const ib_tx_t *tx,
-    const ib_list_t *hosts,
-    bool *match)
+static ib_status_t core_trie_insert(
+    ib_mpool_t *mp,
+    core_trie_node_t *root,
+    const char *key,
+    size_t len,
+    bool reverse,
+    core_trie_node_t **pnode)
 {
-    assert(ib != NULL);
-    assert(tx != NULL);
-    assert(match != NULL);
+    core_trie_node_t *node = root;
 
-    const ib_list_node_t *node;
-    size_t len;
+    for (size_t n = 0; n < len; ++n) {
+        unsigned char c;
+        core_trie_node_t *child;
+
+        if (reverse) {
+            c = tolower((unsigned char)key[len - n - 1]);
+        }
+        else {
+            c = (unsigned char)key[n];
+        }
+
+        child = core_trie_child(node, c);
+        if (child == NULL) {
+            child = ib_mpool_calloc(mp, 1, sizeof(*child));
+            if (child == NULL) {
+                return IB_EALLOC;
+            }
+            child->c = c;
+            child->sibling = node->child;
+            node->child = child;
+        }
+        node = child;
+    }
+
+    *pnode = node;
+    return IB_OK;
+}
+
+/**
+ * Add a site rank to a rank list, creating the list if required
+ *
+ * Sites are added in configuration order, so the list stays sorted.
+ *
+ * @param[in] mp Memory pool
+ * @param[in,out] pranks Rank list (or NULL)
+ * @param[in] rank Rank to add
+ *
+ * @returns IB_OK or IB_EALLOC
+ */
+static ib_status_t core_ranks_add(
+    ib_mpool_t *mp,
+    core_ranks_t **pranks,
+    size_t rank)
+{
+    core_ranks_t *ranks = *pranks;
 
-    /* If no hosts in the list, we have an automatic match */
-    if (hosts == NULL) {
-        *match = true;
+    if (ranks == NULL) {
+        ranks = ib_mpool_calloc(mp, 1, sizeof(*ranks));
+        if (ranks == NULL) {
+            return IB_EALLOC;
+        }
+        *pranks = ranks;
+    }
+
+    /* A site may list the same host or service twice. */
+    if ( (ranks->count > 0) && (ranks->ranks[ranks->count - 1] == rank) ) {
         return IB_OK;
     }
 
-    /* Now, loop through the list of hostnames */
-    len = strlen(tx->hostname);
-    IB_LIST_LOOP_CONST(hosts, node) {
-        const core_host_t *core_host = (const core_host_t *)node->data;
-        const ib_site_host_t *host = &(core_host->host);
-
-        /* If this is a "match any" host entry? */
-        if (core_host->match_any) {
-            *match = true;
-            return IB_OK;
+    if (ranks->count == ranks->size) {
+        size_t size = (ranks->size == 0) ? 4 : (ranks->size * 2);
+        size_t *array = ib_mpool_alloc(mp, size * sizeof(*array));
+
+        if (array == NULL) {
+            return IB_EALLOC;
+        }
+        if (ranks->count > 0) {
+            memcpy(array, ranks->ranks, ranks->count * sizeof(*array));
         }
+        ranks->ranks = array;
+        ranks->size = size;
+    }
+    ranks->ranks[ranks->count++] = rank;
 
-        /* Check the suffix */
-        if ( (host->suffix != NULL) && (len >= core_host->suffix_len) ) {
-            const char *suffix = tx->hostname + len - core_host->suffix_len;
-            if (strcasecmp(host->suffix, suffix) == 0) {
-                *match = true;
-                return IB_OK;
-            }
+    return IB_OK;
+}
+
+/**
+ * Add a site rank to the rank list stored in a hash under a key
+ *
+ * @param[in] mp Memory pool
+ * @param[in] hash Hash of core_ranks_t
+ * @param[in] key Key (must outlive the hash)
+ * @param[in] rank Rank to add
+ *
+ * @returns IB_OK, IB_EALLOC or errors from ib_hash_set()
+ */
+static ib_status_t core_ranks_hash_add(
+    ib_mpool_t *mp,
+    ib_hash_t *hash,
+    const char *key,
+    size_t rank)
+{
+    core_ranks_t *ranks = NULL;
+    ib_status_t rc;
+
+    rc = ib_hash_get(hash, &ranks, key);
+    if ( (rc != IB_OK) && (rc != IB_ENOENT) ) {
+        return rc;
+    }
+    rc = core_ranks_add(mp, &ranks, rank);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    return ib_hash_set(hash, key, ranks);
+}
+
+/**
+ * Find the first rank not below a given rank in a rank list
+ *
+ * @param[in] ranks Rank list (or NULL)
+ * @param[in] from Lowest acceptable rank
+ * @param[in,out] best Lowest rank found so far; updated if @a ranks has a
+ *                lower one
+ */
+static void core_ranks_first(
+    const core_ranks_t *ranks,
+    size_t from,
+    size_t *best)
+{
+    size_t lo = 0;
+    size_t hi;
+
+    if (ranks == NULL) {
+        return;
+    }
+
+    hi = ranks->count;
+    while (lo < hi) {
+        size_t mid = lo + ((hi - lo) / 2);
+        if (ranks->ranks[mid] < from) {
+            lo = mid + 1;
         }
+        else {
+            hi = mid;
+        }
+    }
+    if ( (lo < ranks->count) && (ranks->ranks[lo] < *best) ) {
+        *best = ranks->ranks[lo];
+    }
+}
 
-        /* Finally, do a full hostname match */
-        if ( (core_host->hostname_len == len) &&
-             (strcasecmp(host->hostname, tx->hostname) == 0) )
+/**
+ * Build the service index key for an IP and port
+ *
+ * @param[in] ipstr IP address string (NULL for any)
+ * @param[in] port Port (negative for any)
+ * @param[out] buf Buffer
+ * @param[in] bufsize Size of @a buf
+ *
+ * @returns true if the key fit in @a buf
+ */
+static bool core_ctxsel_service_key(
+    const char *ipstr,
+    ib_num_t port,
+    char *buf,
+    size_t bufsize)
+{
+    int len;
+
+    if (port < 0) {
+        len = snprintf(buf, bufsize, "%s *", (ipstr != NULL) ? ipstr : "*");
+    }
+    else {
+        len = snprintf(buf, bufsize, "%s %" PRId64,
+                       (ipstr != NULL) ? ipstr : "*", port);
+    }
+    return (len >= 0) && ((size_t)len < bufsize);
+}
+
+/**
+ * Check for a matching service within a site
+ *
+ * @param[in] site Site
+ * @param[in] conn Connection to match
+ *
+ * @returns true if the site has no services or one matches @a conn
+ */
+static bool core_ctxsel_match_service(
+    const core_site_t *site,
+    const ib_conn_t *conn)
+{
+    const ib_list_node_t *node;
+
+    if (site->services == NULL) {
+        return true;
+    }
+
+    IB_LIST_LOOP_CONST(site->services, node) {
+        const core_service_t *service = (const core_service_t *)node->data;
+
+        if (service->match_any) {
+            return true;
+        }
+        if ( (service->service.port >= 0) &&
+             (service->service.port != conn->local_port) )
         {
-            *match = true;
-            return IB_OK;
+            continue;
+        }
+        if ( (service->service.ipstr != NULL) &&
+             (strcmp(service->service.ipstr, conn->local_ipstr) != 0) )
+        {
+            continue;
         }
+        return true;
     }
 
-    /* No matches */
-    *match = false;
-    return IB_OK;
+    return false;
 }
 
 /**
- * Check for a matching location within a location list
+ * Find the location of a site matching a transaction
  *
- * This function takes a list of locations, and attempts to find the first
- * location that matches the transaction.  This function is intended to aid in
- * the development of context selection functions, but it's use is optional.
- * It is used by the core site selector.
+ * The location is the first one in the site's list which is a "match any"
+ * location or whose path is a prefix of the transaction's path.  The path
+ * trie yields every location that is a prefix in one pass over the path.
  *
- * @param[in] ib IronBee engine
+ * @param[in] site Site
  * @param[in] tx Transaction to match
- * @param[in] locations List of ib_ctxsel_location_t
- * @param[out] match Pointer to matched location (or NULL)
  *
- * @returns IB_OK
+ * @returns Matching location or NULL
  */
-static ib_status_t core_ctxsel_match_location(
-    const ib_engine_t *ib,
-    const ib_tx_t *tx,
-    const ib_list_t *locations,
-    const core_location_t **match)
+static const core_location_t *core_ctxsel_match_location(
+    const core_site_t *site,
+    const ib_tx_t *tx)
 {
-    assert(ib != NULL);
-    assert(tx != NULL);
-    assert(locations != NULL);
-    assert(match != NULL);
+    const core_location_t *best = site->location_any;
+    const core_trie_node_t *node = site->location_trie;
+    const unsigned char *path = (const unsigned char *)tx->path;
 
-    const ib_list_node_t *node;
-    size_t len;
+    while (node != NULL) {
+        const core_location_t *location = (const core_location_t *)node->data;
 
-    /* Now, loop through the list of locations */
-    len = strlen(tx->path);
-    IB_LIST_LOOP_CONST(locations, node) {
-        const core_location_t *core_location =
-            (const core_location_t *)node->data;
-        const ib_site_location_t *location = &(core_location->location);
-
-        /* Is this a "match any" location? */
-        if (core_location->match_any) {
-            *match = core_location;
-            return IB_OK;
+        if ( (location != NULL) &&
+             ( (best == NULL) || (location->index < best->index) ) )
+        {
+            best = location;
+        }
+        if (*path == '\0') {
+            break;
         }
+        node = core_trie_child(node, *path);
+        ++path;
+    }
 
-        /* Check the path */
-        if ( (core_location->path_len <= len) &&
-             (strncmp(location->path, tx->path, core_location->path_len) == 0) )
-        {
-            *match = core_location;
-            return IB_OK;
+    return best;
+}
+
+/**
+ * Find the first site whose hosts match a hostname
+ *
+ * The candidates are the sites with the exact hostname, the sites with a
+ * wildcard suffix of the hostname (found walking the reversed suffix trie)
+ * and the sites which match any host.
+ *
+ * @param[in] index Selection index
+ * @param[in] hostname Host name
+ * @param[in] len Length of @a hostname
+ * @param[in] from Lowest acceptable rank
+ * @param[out] prank Rank of the site found
+ *
+ * @returns true if a site was found
+ */
+static bool core_ctxsel_next_host_site(
+    const core_ctxsel_index_t *index,
+    const char *hostname,
+    size_t len,
+    size_t from,
+    size_t *prank)
+{
+    const core_trie_node_t *node = index->suffixes;
+    core_ranks_t *ranks = NULL;
+    size_t best = SIZE_MAX;
+
+    if (ib_hash_get(index->hosts, &ranks, hostname) == IB_OK) {
+        core_ranks_first(ranks, from, &best);
+    }
+    core_ranks_first(index->any_host, from, &best);
+    core_ranks_first((const core_ranks_t *)node->data, from, &best);
+
+    for (size_t n = len; (n > 0) && (node != NULL); --n) {
+        node = core_trie_child(node, tolower((unsigned char)hostname[n - 1]));
+        if (node != NULL) {
+            core_ranks_first((const core_ranks_t *)node->data, from, &best);
         }
     }
 
-    /* No matches */
-    *match = NULL;
-    return IB_OK;
+    *prank = best;
+    return best != SIZE_MAX;
 }
 
 /**
- * Create a site selector object
+ * Find the first site whose services match a connection
  *
- * @param[in,out] core_data Core module data
- * @param[in] site Site object
- * @param[in] service Service object (can be NULL)
- * @param[out] selector New selector object (or NULL)
+ * @param[in] index Selection index
+ * @param[in] conn Connection to match
  *
- * @returns IB_OK or IB_EALLOC
+ * @returns Matching site or NULL
  */
-static ib_status_t core_create_site_selector(
-    ib_core_module_data_t *core_data,
-    const core_site_t *site,
-    const core_service_t *service,
-    core_site_selector_t **selector)
+static const core_site_t *core_ctxsel_service_site(
+    const core_ctxsel_index_t *index,
+    const ib_conn_t *conn)
 {
-    assert(core_data != NULL);
-    assert(site != NULL);
+    /* Room for an IPv6 address, a space and a port. */
+    char key[CORE_CTXSEL_KEY_MAX];
+    const char *ipstrs[] = { conn->local_ipstr, NULL };
+    const ib_num_t ports[] = { conn->local_port, -1 };
+    size_t best = SIZE_MAX;
+
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t p = 0; p < 2; ++p) {
+            core_ranks_t *ranks = NULL;
+
+            if (! core_ctxsel_service_key(ipstrs[i], ports[p],
+                                          key, sizeof(key)))
+            {
+                continue;
+            }
+            if (ib_hash_get(index->services, &ranks, key) == IB_OK) {
+                core_ranks_first(ranks, 0, &best);
+            }
+        }
+    }
 
+    return (best == SIZE_MAX) ? NULL : index->sites[best];
+}
+
+/**
+ * Add a site to the selection index
+ *
+ * @param[in] mp Memory pool
+ * @param[in,out] index Selection index
+ * @param[in,out] site Site (its location trie is built)
+ * @param[in] rank Rank of @a site
+ *
+ * @returns IB_OK or errors from the index functions
+ */
+static ib_status_t core_ctxsel_index_site(
+    ib_mpool_t *mp,
+    core_ctxsel_index_t *index,
+    core_site_t *site,
+    size_t rank)
+{
+    const ib_list_node_t *node;
+    char key[CORE_CTXSEL_KEY_MAX];
     ib_status_t rc;
-    core_site_selector_t *object;
 
-    /* Create & populate a site selector object */
-    object = ib_mpool_alloc(site->site.mp, sizeof(*object));
-    if (object == NULL) {
-        return IB_EALLOC;
+    index->sites[rank] = site;
+
+    /* Hosts: exact names, wildcard suffixes and "match any" */
+    if (site->hosts == NULL) {
+        rc = core_ranks_add(mp, &(index->any_host), rank);
+        if (rc != IB_OK) {
+            return rc;
+        }
     }
-    object->service = service;
-    object->hosts = site->hosts;
-    object->locations = site->locations;
-    object->site = site;
+    else {
+        IB_LIST_LOOP_CONST(site->hosts, node) {
+            const core_host_t *host = (const core_host_t *)node->data;
+
+            if (host->match_any) {
+                rc = core_ranks_add(mp, &(index->any_host), rank);
+                if (rc != IB_OK) {
+                    return rc;
+                }
+                continue;
+            }
 
-    /* Add it to the site selector list */
-    rc = ib_list_push(core_data->selector_list, object);
-    if (rc != IB_OK) {
-        return rc;
+            rc = core_ranks_hash_add(mp, index->hosts,
+                                     host->host.hostname, rank);
+            if (rc != IB_OK) {
+                return rc;
+            }
+
+            if (host->host.suffix != NULL) {
+                core_trie_node_t *tnode;
+
+                rc = core_trie_insert(mp, index->suffixes,
+                                      host->host.suffix, host->suffix_len,
+                                      true, &tnode);
+                if (rc != IB_OK) {
+                    return rc;
+                }
+                rc = core_ranks_add(mp, (core_ranks_t **)&(tnode->data),
+                                    rank);
+                if (rc != IB_OK) {
+                    return rc;
+                }
+            }
+        }
     }
 
-    if (selector != NULL) {
-        *selector = object;
+    /* Services: by IP and port, either of which may be "any" */
+    if (site->services == NULL) {
+        rc = core_ranks_hash_add(mp, index->services, "* *", rank);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+    else {
+        IB_LIST_LOOP_CONST(site->services, node) {
+            const core_service_t *service =
+                (const core_service_t *)node->data;
+            const char *skey;
+
+            if (! core_ctxsel_service_key(service->service.ipstr,
+                                          service->service.port,
+                                          key, sizeof(key)))
+            {
+                return IB_EINVAL;
+            }
+            skey = ib_mpool_strdup(mp, key);
+            if (skey == NULL) {
+                return IB_EALLOC;
+            }
+            rc = core_ranks_hash_add(mp, index->services, skey, rank);
+            if (rc != IB_OK) {
+                return rc;
+            }
+        }
+    }
+
+    /* Locations: the first "match any" and a trie of paths */
+    site->location_any = NULL;
+    site->location_trie = ib_mpool_calloc(mp, 1, sizeof(core_trie_node_t));
+    if (site->location_trie == NULL) {
+        return IB_EALLOC;
+    }
+    IB_LIST_LOOP_CONST(site->locations, node) {
+        const core_location_t *location = (const core_location_t *)node->data;
+        core_trie_node_t *tnode;
+
+        if (location->match_any) {
+            if (site->location_any == NULL) {
+                site->location_any = location;
+            }
+            continue;
+        }
+
+        rc = core_trie_insert(mp, site->location_trie,
+                              location->location.path, location->path_len,
+                              false, &tnode);
+        if (rc != IB_OK) {
+            return rc;
+        }
+        if (tnode->data == NULL) {
+            tnode->data = (void *)location;
+        }
     }
+
     return IB_OK;
 }
 
 /**
  * Finalize the core context selection.
  *
- * This functions creates the site selector list which is used during the site
- * selection process.  It walks through the list of sites / locations, and
- * creates corresponding site selector objects.
+ * This functions builds the selection index used during the site selection
+ * process.  Sites are ranked by their position in the site list, and hosts,
+ * services and locations are indexed so that a selection finds the first
+ * matching site in time proportional to the host name and path lengths
+ * rather than the number of sites.
  *
  * @param[in] ib IronBee engine
  * @param[in] common_cb_data Common callback data
@@ -332,6 +700,8 @@ static ib_status_t core_ctxsel_finalize(
 
     const ib_list_node_t *site_node;
     ib_core_module_data_t *core_data = (ib_core_module_data_t *)common_cb_data;
+    core_ctxsel_index_t *index;
+    size_t rank = 0;
     ib_status_t rc;
 
     /* Do nothing if we're not the current site selector */
@@ -339,6 +709,8 @@ static ib_status_t core_ctxsel_finalize(
         return IB_OK;
     }
 
+    core_data->selector_index = NULL;
+
     /* If there are no sites, do nothing */
     if (core_data->site_list == NULL) {
         ib_log_alert(ib, "No site list");
@@ -349,54 +721,51 @@ static ib_status_t core_ctxsel_finalize(
         return IB_OK;
     }
 
-    /* Create the site selector list */
-    if (core_data->selector_list == NULL) {
-        rc = ib_list_create(&(core_data->selector_list), ib->mp);
-        if (rc != IB_OK) {
-            ib_log_error(ib, "Failed to create core site selector list: %s",
-                         ib_status_to_string(rc));
-            return rc;
-        }
+    /* Create the selection index */
+    index = ib_mpool_calloc(ib->mp, 1, sizeof(*index));
+    if (index == NULL) {
+        return IB_EALLOC;
     }
-    else {
-        ib_list_clear(core_data->selector_list);
+    index->num_sites = ib_list_elements(core_data->site_list);
+    index->sites = ib_mpool_calloc(ib->mp, index->num_sites,
+                                   sizeof(*(index->sites)));
+    index->suffixes = ib_mpool_calloc(ib->mp, 1, sizeof(core_trie_node_t));
+    if ( (index->sites == NULL) || (index->suffixes == NULL) ) {
+        return IB_EALLOC;
+    }
+    rc = ib_hash_create_nocase(&(index->hosts), ib->mp);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_hash_create(&(index->services), ib->mp);
+    if (rc != IB_OK) {
+        return rc;
     }
 
-    /* Build the site selector list from the site / location list */
-
-    /* Walk through all of the sites, and it's locations & services */
+    /* Walk through all of the sites, and index their hosts, services and
+     * locations */
     IB_LIST_LOOP_CONST(core_data->site_list, site_node) {
-        const core_site_t *site = (const core_site_t *)site_node->data;
-        const ib_list_node_t *service_node;
-
-        /* If no services defined, just create a single selector with
-         * a default service */
-        if (site->services == NULL) {
-            rc = core_create_site_selector(core_data, site, NULL, NULL);
-            if (rc != IB_OK) {
-                return rc;
-            }
-            continue;
-        }
+        core_site_t *site = (core_site_t *)site_node->data;
 
-        /* Otherwise, loop through all of the services, create a single
-         * selector for each */
-        IB_LIST_LOOP_CONST(site->services, service_node) {
-            const core_service_t *service =
-                (const core_service_t *)service_node->data;
-            rc = core_create_site_selector(core_data, site, service, NULL);
-            if (rc != IB_OK) {
-                return rc;
-            }
+        rc = core_ctxsel_index_site(ib->mp, index, site, rank);
+        if (rc != IB_OK) {
+            ib_log_error(ib, "Failed to index site \"%s\": %s",
+                         site->site.name, ib_status_to_string(rc));
+            return rc;
         }
+        ++rank;
     }
 
+    core_data->selector_index = index;
     return IB_OK;
 }
 
 /**
  * Select the correct context for a connection / transaction.
  *
+ * The selected site is the first one, in configuration order, whose
+ * services, hosts and locations all match.
+ *
  * @param[in] ib Engine
  * @param[in] conn Pointer to connection
  * @param[in] tx Pointer to transaction / NULL
@@ -419,103 +788,69 @@ static ib_status_t core_ctxsel_select(
     assert(common_cb_data != NULL);
     assert(pctx != NULL);
 
-    const ib_list_node_t *node;
-    size_t ip_len;
-    ib_status_t rc;
     ib_core_module_data_t *core_data = (ib_core_module_data_t *)common_cb_data;
+    const core_ctxsel_index_t *index = core_data->selector_index;
+    const core_site_t *site = NULL;
+    ib_context_t *ctx;
+    const char *ctx_type;
+    size_t len;
+    size_t rank;
 
     /* Verify that we're the current selector */
     if (ib_ctxsel_module_is_active(ib, ib_core_module()) == false) {
         return IB_EINVAL;
     }
 
-    if (core_data->selector_list == NULL) {
-        ib_log_alert(ib, "No site selection list: Using main context");
+    if (index == NULL) {
+        ib_log_alert(ib, "No site selection index: Using main context");
         goto select_main_context;
     }
 
-    /* Get the length of the IP address string before the main loop */
-    ip_len = strlen(conn->local_ipstr);
-
     /*
-     * Walk through the list of site selectors, return when the first matching
-     * selector is found.  At any point in the loop if a non-match is found,
-     * we continue to the top of the loop, and try the next selector.
+     * If we're looking for a connection context, there is no hostname or
+     * location, so go with the first site with a matching service.
      */
-    IB_LIST_LOOP_CONST(core_data->selector_list, node) {
-        const core_site_selector_t *selector =
-            (const core_site_selector_t *)node->data;
-        const core_service_t *service = selector->service;
-        const core_site_t *site = selector->site;
-        const core_location_t *location;
-        ib_context_t *ctx;
-        const char *ctx_type;
-        bool match;
-
-        /*
-         * If there is no service or it's a "match any", match is automatic.
-         */
-        if ( (service != NULL) && (! service->match_any) ) {
-            /* Check that the port matches the service (if specified) */
-            if ( (service->service.port >= 0) &&
-                 (service->service.port != conn->local_port) ) {
-                continue;
-            }
-            /* Check that the host name matches the service (if specified) */
-            if ( (service->service.ipstr != NULL) &&
-                 (service->ip_len == ip_len) &&
-                 (strcmp(service->service.ipstr, conn->local_ipstr) != 0) )
-            {
-                continue;
-            }
+    if (tx == NULL) {
+        site = core_ctxsel_service_site(index, conn);
+        if (site == NULL) {
+            goto not_found;
         }
+        ctx = site->site.context;
+        ctx_type = "site";
+        goto found;
+    }
 
-        /*
-         * If we're looking for a connection context, there is no hostname or
-         * location, so go with this selector.
-         */
-        if (tx == NULL) {
-            ctx = selector->site->site.context;
-            ctx_type = "site";
-            goto found;
-        }
+    /*
+     * Walk through the sites whose hosts match, in order, and return when
+     * the first one whose services and locations also match is found.
+     */
+    len = strlen(tx->hostname);
+    rank = 0;
+    while (core_ctxsel_next_host_site(index, tx->hostname, len,
+                                      rank, &rank))
+    {
+        const core_location_t *location;
 
-        /* Check if the hostname matches */
-        rc = core_ctxsel_match_host(ib, tx, selector->hosts, &match);
-        if (rc != IB_OK) {
-            /* todo: What is the right thing to do here? */
-            continue;
-        }
-        if (! match) {
-            continue;
-        }
+        site = index->sites[rank];
+        ++rank;
 
-        /* Check if the location matches */
-        rc = core_ctxsel_match_location(ib, tx, selector->locations, &location);
-        if (rc != IB_OK) {
-            /* todo: What is the right thing to do here? */
+        if (! core_ctxsel_match_service(site, conn)) {
             continue;
         }
+        location = core_ctxsel_match_location(site, tx);
         if (location == NULL) {
             continue;
         }
 
-        /* Everything matches.  Use this selector's context */
+        /* Everything matches.  Use this site's location context */
         ctx = location->location.context;
         ctx_type = "location";
-
-  found:
-        ib_log_debug2(ib, "Selected %s context %p \"%s\" site=%s(%s)",
-                      ctx_type, ctx, ib_context_full_get(ctx),
-                      (site ? site->site.id_str : "none"),
-                      (site ? site->site.name : "none"));
-        *pctx = ctx;
-        return IB_OK;
+        goto found;
     }
 
+not_found:
     /*
-     * If we get here, we've exhausted the list of selectors, with no matching
-     * selector found
+     * If we get here, no site matches
      */
     if (tx == NULL) {
         ib_log_debug(ib, "No matching site found for connection:"
@@ -532,6 +867,13 @@ select_main_context:
     *pctx = ib_context_main(ib);
 
     return IB_OK;
+
+found:
+    ib_log_debug2(ib, "Selected %s context %p \"%s\" site=%s(%s)",
+                  ctx_type, ctx, ib_context_full_get(ctx),
+                  site->site.id_str, site->site.name);
+    *pctx = ctx;
+    return IB_OK;
 }
 
 /**
@@ -645,6 +987,7 @@ static ib_status_t core_ctxsel_location_create(
 
     /* Fill in the context selection specific parts */
     core_location->path_len = strlen(location_str);
+    core_location->index = ib_list_elements(core_site->locations);
     core_location->match_any = (strcmp(location_str, "/") == 0);
 
     /* And, add it to the locations list */
@@ -603,6 +603,7 @@ ib_status_t op_match_create(
         const char *p;   /* Current parameter. */
         const char *end; /* End of all copy. */
         const char *n;   /* Next space. */
+        ib_bytestr_t *member;
 
         end = copy + strlen(copy);
         p = copy;
@@ -613,7 +614,13 @@ ib_status_t op_match_create(
                 n = end;
             }
 
-            rc = ib_hash_set_ex(set, p, n - p, (void *)1);
+            /* The member itself is stored as the value so that the set
+             * can be listed by ib_core_operator_literals(). */
+            rc = ib_bytestr_alias_mem(&member, mp, (const uint8_t *)p, n - p);
+            if (rc != IB_OK) {
+                return IB_EALLOC;
+            }
+            rc = ib_hash_set_ex(set, p, n - p, member);
             if (rc != IB_OK) {
                 assert(rc == IB_EALLOC); /* Guaranteed by hash. */
                 return IB_EALLOC;
@@ -1872,6 +1879,94 @@ static ib_status_t op_nop_execute(const ib_rule_exec_t *rule_exec,
 /**
  * Initialize the core operators
  **/
+ib_status_t ib_core_operator_literals(const ib_operator_inst_t *op_inst,
+                                      ib_mpool_t *mp,
+                                      ib_core_literal_op_t *op,
+                                      bool *nocase,
+                                      ib_list_t *patterns)
+{
+    assert(op_inst != NULL);
+    assert(op_inst->op != NULL);
+    assert(mp != NULL);
+    assert(op != NULL);
+    assert(nocase != NULL);
+    assert(patterns != NULL);
+
+    const ib_operator_t *optype = op_inst->op;
+    ib_status_t          rc;
+
+    if ( (op_inst->flags & IB_OPINST_FLAG_EXPAND) != 0) {
+        return IB_DECLINED;
+    }
+
+    /* streq, istreq and contains: data is the NUL terminated pattern. */
+    if ( (optype->fn_execute == op_streq_execute) ||
+         (optype->fn_execute == op_contains_execute) )
+    {
+        const char   *str = (const char *)op_inst->data;
+        ib_bytestr_t *pattern;
+
+        if ( (str == NULL) || (*str == '\0') ) {
+            return IB_DECLINED;
+        }
+        rc = ib_bytestr_alias_nulstr(&pattern, mp, str);
+        if (rc != IB_OK) {
+            return rc;
+        }
+        rc = ib_list_push(patterns, pattern);
+        if (rc != IB_OK) {
+            return rc;
+        }
+
+        if (optype->fn_execute == op_contains_execute) {
+            *op = IB_CORE_LITERAL_CONTAINS;
+            *nocase = false;
+        }
+        else {
+            *op = IB_CORE_LITERAL_STREQ;
+            *nocase = (optype->cd_execute != NULL);
+        }
+        return IB_OK;
+    }
+
+    /* match and imatch: data is a hash whose values are the members. */
+    if (optype->fn_execute == op_match_execute) {
+        const ib_hash_t      *set = (const ib_hash_t *)op_inst->data;
+        ib_list_t            *members;
+        const ib_list_node_t *node;
+
+        rc = ib_list_create(&members, mp);
+        if (rc != IB_OK) {
+            return rc;
+        }
+        rc = ib_hash_get_all(set, members);
+        if (rc != IB_OK) {
+            return (rc == IB_ENOENT) ? IB_DECLINED : rc;
+        }
+
+        IB_LIST_LOOP_CONST(members, node) {
+            const ib_bytestr_t *member =
+                (const ib_bytestr_t *)ib_list_node_data_const(node);
+
+            if (ib_bytestr_length(member) == 0) {
+                return IB_DECLINED;
+            }
+        }
+        IB_LIST_LOOP_CONST(members, node) {
+            rc = ib_list_push(patterns, (void *)ib_list_node_data_const(node));
+            if (rc != IB_OK) {
+                return rc;
+            }
+        }
+
+        *op = IB_CORE_LITERAL_MATCH;
+        *nocase = (optype->cd_create != NULL);
+        return IB_OK;
+    }
+
+    return IB_DECLINED;
+}
+
 ib_status_t ib_core_operators_init(ib_engine_t *ib, ib_module_t *mod)
 {
     ib_status_t rc;
@@ -29,6 +29,7 @@
 
 #include <ironbee/context_selection.h>
 #include <ironbee/engine.h>
+#include <ironbee/operator.h>
 #include <ironbee/types.h>
 
 typedef struct {
@@ -39,10 +40,13 @@ typedef struct {
     bool             default_value; /**< The flag's default value? */
 } ib_tx_flag_map_t;
 
+/** Core context selection index (see core_context_selection.c) */
+typedef struct core_ctxsel_index_t core_ctxsel_index_t;
+
 /** Core-module-specific non-context-aware data accessed via module->data */
 typedef struct {
     ib_list_t            *site_list;      /**< List: ib_site_t */
-    ib_list_t            *selector_list;  /**< List: core_site_selector_t */
+    core_ctxsel_index_t  *selector_index; /**< Site selection index */
     ib_context_t         *cur_ctx;        /**< Current context */
     ib_site_t            *cur_site;       /**< Current site */
     ib_site_location_t   *cur_location;   /**< Current location */
@@ -121,6 +125,39 @@ ib_status_t ib_core_module_data(ib_module_t **core_module,
 ib_status_t ib_core_transformations_init(ib_engine_t *ib,
                                          ib_module_t *mod);
 
+/**
+ * Kind of literal comparison performed by a core string operator.
+ */
+typedef enum {
+    IB_CORE_LITERAL_STREQ,     /**< streq/istreq: value equals the pattern */
+    IB_CORE_LITERAL_MATCH,     /**< match/imatch: value is one of the set */
+    IB_CORE_LITERAL_CONTAINS   /**< contains: value contains the pattern */
+} ib_core_literal_op_t;
+
+/**
+ * Get the literal patterns of a core string operator instance.
+ *
+ * Used by the rule engine to merge the patterns of many rules into a
+ * single matcher.
+ *
+ * @param[in] op_inst Operator instance
+ * @param[in] mp Memory pool for @a patterns nodes
+ * @param[out] op Kind of comparison
+ * @param[out] nocase true if the comparison is case insensitive
+ * @param[in,out] patterns List to push patterns (const ib_bytestr_t *) onto
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_DECLINED if @a op_inst is not a literal string operator, or its
+ *   patterns must be expanded at runtime or are empty.
+ * - IB_EALLOC on allocation failure.
+ */
+ib_status_t ib_core_operator_literals(const ib_operator_inst_t *op_inst,
+                                      ib_mpool_t *mp,
+                                      ib_core_literal_op_t *op,
+                                      bool *nocase,
+                                      ib_list_t *patterns);
+
 /**
  * Initialize the core operators.
  *
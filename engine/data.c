@@ -60,8 +60,28 @@ static const char *IB_VARIABLE_EXPANSION_POSTFIX = "}";
 
 struct ib_data_t
 {
-    ib_mpool_t *mp;    /**< Memory pool. */
-    ib_hash_t  *hash;  /**< Hash of data fields. */
+    ib_mpool_t *mp;         /**< Memory pool. */
+    ib_hash_t  *hash;       /**< Hash of data fields. */
+    size_t      generation; /**< Bumped when a field is replaced/removed. */
+};
+
+/**
+ * Kind of lookup a selector performs.
+ */
+typedef enum {
+    DATA_SELECTOR_FIELD,    /**< Plain field: @c FOO */
+    DATA_SELECTOR_SUBFIELD, /**< Subfield of a list or dynamic: @c FOO:bar */
+    DATA_SELECTOR_FILTER    /**< Regex filter on a list: @c FOO:/bar/ */
+} data_selector_type_t;
+
+struct ib_data_selector_t
+{
+    data_selector_type_t  type;      /**< Kind of lookup. */
+    const char           *name;      /**< Parent (or plain) field name. */
+    size_t                nlen;      /**< Length of @a name. */
+    const char           *sub;       /**< Subfield name or filter pattern. */
+    size_t                sublen;    /**< Length of @a sub. */
+    pcre                 *filter;    /**< Compiled filter (FILTER only). */
 };
 
 /* Internal helper functions */
@@ -179,81 +199,52 @@ ib_status_t ib_data_get_subfields(
  * @param[in] parent_field The parent field whose member fields will
  *                         be filtered with @a pattern.
  *                         This must be an IB_FTYPE_LIST.
- * @param[in] pattern The regex to use to match member field names in
- *                    @a field_name.
- * @param[in] pattern_len The length of @a pattern.
+ * @param[in] pattern The compiled regex to use to match member field names
+ *                    in @a field_name.
  * @param[out] result_field The result field.
  *
  * @returns
  *  - IB_OK if a successful search is performed.
- *  - IB_EINVAL if field is not a list or the pattern cannot compile.
+ *  - IB_EINVAL if field is not a list.
  *  - IB_ENOENT if the field name is not found.
  */
 static
 ib_status_t ib_data_get_filtered_list(
     const ib_data_t           *data,
     const ib_field_t          *parent_field,
-    const char                *pattern,
-    size_t                     pattern_len,
+    const pcre                *pattern,
     ib_field_t               **result_field
 )
 {
     assert(data != NULL);
     assert(pattern != NULL);
     assert(parent_field != NULL);
-    assert(pattern_len > 0);
     assert(result_field != NULL);
 
     ib_status_t rc;
-    char *pattern_str = NULL; /* NULL terminated string to pass to pcre. */
-    pcre *pcre_pattern = NULL; /* PCRE pattern. */
-    const char *errptr = NULL; /* PCRE Error reporter. */
-    int erroffset; /* PCRE Error offset into subject reporter. */
     ib_list_t *list = NULL; /* Holds the value of field when fetched. */
     ib_list_node_t *list_node = NULL; /* A node in list. */
     ib_list_t *result_list = NULL; /* Holds matched list_node values. */
 
     /* Check that our input field is a list type. */
     if (parent_field->type != IB_FTYPE_LIST) {
-        rc = IB_EINVAL;
-        goto exit_label;
-    }
-
-    /* Allocate pattern_str to hold null terminated string. */
-    pattern_str = (char *)malloc(pattern_len+1);
-    if (pattern_str == NULL) {
-        rc = IB_EALLOC;
-        goto exit_label;
+        return IB_EINVAL;
     }
 
-    /* Build a string to hand to the pcre library. */
-    memcpy(pattern_str, pattern, pattern_len);
-    pattern_str[pattern_len] = '\0';
-
     rc = ib_field_value(parent_field, &list);
     if (rc != IB_OK) {
-        goto exit_label;
-    }
-
-    pcre_pattern = pcre_compile(pattern_str, 0, &errptr, &erroffset, NULL);
-    if (pcre_pattern == NULL) {
-        rc = IB_EINVAL;
-        goto exit_label;
-    }
-    if (errptr) {
-        rc = IB_EINVAL;
-        goto exit_label;
+        return rc;
     }
 
     rc = ib_list_create(&result_list, data->mp);
     if (rc != IB_OK) {
-        goto exit_label;
+        return rc;
     }
 
     IB_LIST_LOOP(list, list_node) {
         int pcre_rc;
         ib_field_t *list_field = (ib_field_t *)list_node->data;
-        pcre_rc = pcre_exec(pcre_pattern,
+        pcre_rc = pcre_exec(pattern,
                             NULL,
                             list_field->name,
                             list_field->nlen,
@@ -265,27 +256,221 @@ ib_status_t ib_data_get_filtered_list(
         if (pcre_rc == 0) {
             rc = ib_list_push(result_list, list_node->data);
             if (rc != IB_OK) {
-                goto exit_label;
+                return rc;
             }
         }
     }
 
-    rc = ib_field_create(result_field,
-                         data->mp,
-                         parent_field->name,
-                         parent_field->nlen,
-                         IB_FTYPE_LIST,
-                         result_list);
+    return ib_field_create(result_field,
+                           data->mp,
+                           parent_field->name,
+                           parent_field->nlen,
+                           IB_FTYPE_LIST,
+                           result_list);
+}
 
+/**
+ * Compile a list filter pattern.
+ *
+ * @param[in] pattern Pattern (not NUL terminated).
+ * @param[in] pattern_len Length of @a pattern.
+ * @param[out] compiled Compiled pattern; release with pcre_free().
+ *
+ * @returns
+ *  - IB_OK on success.
+ *  - IB_EALLOC on allocation errors.
+ *  - IB_EINVAL if the pattern cannot compile.
+ */
+static
+ib_status_t data_filter_compile(
+    const char  *pattern,
+    size_t       pattern_len,
+    pcre       **compiled
+)
+{
+    assert(pattern != NULL);
+    assert(pattern_len > 0);
+    assert(compiled != NULL);
 
-exit_label:
-    if (pattern_str) {
-        free(pattern_str);
+    char *pattern_str; /* NULL terminated string to pass to pcre. */
+    const char *errptr = NULL; /* PCRE Error reporter. */
+    int erroffset; /* PCRE Error offset into subject reporter. */
+
+    /* Allocate pattern_str to hold null terminated string. */
+    pattern_str = (char *)malloc(pattern_len+1);
+    if (pattern_str == NULL) {
+        return IB_EALLOC;
     }
-    if (pcre_pattern) {
-        pcre_free(pcre_pattern);
+
+    /* Build a string to hand to the pcre library. */
+    memcpy(pattern_str, pattern, pattern_len);
+    pattern_str[pattern_len] = '\0';
+
+    *compiled = pcre_compile(pattern_str, 0, &errptr, &erroffset, NULL);
+    free(pattern_str);
+    if (*compiled == NULL) {
+        return IB_EINVAL;
+    }
+
+    return IB_OK;
+}
+
+/**
+ * Parse a field name into @a selector.
+ *
+ * A name may be a plain field name (@c FOO), a subfield (@c FOO:bar) or
+ * a regex filter on a list (@c FOO:/bar/).  The filter pattern is not
+ * compiled; @a selector->filter is left NULL.
+ *
+ * @param[in] name Name to parse.
+ * @param[in] name_len Length of @a name.
+ * @param[out] selector Selector to fill in. Strings point into @a name.
+ *
+ * @returns
+ *  - IB_OK on success.
+ *  - IB_EINVAL if @a name contains a malformed filter.
+ */
+static
+ib_status_t data_selector_parse(
+    const char         *name,
+    size_t              name_len,
+    ib_data_selector_t *selector
+)
+{
+    assert(name != NULL);
+    assert(selector != NULL);
+
+    const char *filter_marker = memchr(name, DPI_LIST_FILTER_MARKER, name_len);
+    const char *filter_start;
+    const char *filter_end;
+
+    selector->filter = NULL;
+
+    /* Typical no-expansion fetch of a value. */
+    if (filter_marker == NULL) {
+        selector->type = DATA_SELECTOR_FIELD;
+        selector->name = name;
+        selector->nlen = name_len;
+        selector->sub = NULL;
+        selector->sublen = 0;
+        return IB_OK;
+    }
+
+    /*
+     * If there is a filter_marker then we are going to
+     * extract sub-values.
+     *
+     * A sub-value might be a pattern-match on a list: ARGV:/foo\d?/
+     * Or a sub field: ARGV:my_var
+     * Or a dynamic field: ARGV:my_var
+     */
+    selector->name = name;
+    selector->nlen = filter_marker - name;
+
+    filter_start = memchr(name, DPI_LIST_FILTER_PREFIX, name_len);
+    if ( filter_start && filter_start + 1 < name + name_len ) {
+        filter_end = memchr(filter_start+1,
+                            DPI_LIST_FILTER_SUFFIX,
+                            name_len - (filter_start+1-name));
+    }
+    else {
+        filter_end = NULL;
+    }
+
+    /* Does the expansions use a pattern match or not? */
+    if (filter_start && filter_end) {
+
+        /* Bad filter: FOO/: */
+        if (filter_marker != filter_start-1) {
+            return IB_EINVAL;
+        }
+
+        /* Bad filter: FOO:// */
+        if (filter_start == filter_end-1) {
+            return IB_EINVAL;
+        }
+
+        selector->type = DATA_SELECTOR_FILTER;
+        selector->sub = filter_start + 1;
+        selector->sublen = filter_end - filter_start - 1;
+    }
+
+    /* No pattern match. Just extract the sub-field. */
+    else {
+        selector->type = DATA_SELECTOR_SUBFIELD;
+        selector->sub = filter_marker + 1;
+        selector->sublen = name_len - (filter_marker+1-name);
+    }
+
+    return IB_OK;
+}
+
+/**
+ * Get the field(s) described by a parsed @a selector.
+ *
+ * @param[in] data Data.
+ * @param[in] selector Parsed selector.
+ * @param[in] filter Compiled filter (FILTER selectors only).
+ * @param[out] pf Result field.
+ *
+ * @returns Status code as for ib_data_get_ex().
+ */
+static
+ib_status_t data_selector_get(
+    const ib_data_t          *data,
+    const ib_data_selector_t *selector,
+    const pcre               *filter,
+    ib_field_t              **pf
+)
+{
+    assert(data != NULL);
+    assert(selector != NULL);
+
+    ib_status_t rc;
+    ib_field_t *parent_field;
+
+    if (selector->type == DATA_SELECTOR_FIELD) {
+        return ib_hash_get_ex(data->hash, pf, selector->name, selector->nlen);
+    }
+
+    /* If there is a filter mark (':') get the parent field. */
+    rc = ib_hash_get_ex(data->hash, &parent_field,
+                        selector->name, selector->nlen);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    if (selector->type == DATA_SELECTOR_FILTER) {
+        assert(filter != NULL);
+        return ib_data_get_filtered_list(data, parent_field, filter, pf);
+    }
+
+    /* Handle extracting a subfield for a list of a dynamic field. */
+    return ib_data_get_subfields(
+        data,
+        parent_field,
+        selector->sub,
+        selector->sublen,
+        pf
+    );
+}
+
+/**
+ * Release the compiled filter of a selector.
+ *
+ * @param[in] cbdata Selector (ib_data_selector_t *).
+ */
+static
+void data_selector_cleanup(
+    void *cbdata
+)
+{
+    ib_data_selector_t *selector = (ib_data_selector_t *)cbdata;
+
+    if (selector->filter != NULL) {
+        pcre_free(selector->filter);
+        selector->filter = NULL;
     }
-    return rc;
 }
 
 /**
@@ -382,6 +567,11 @@ ib_status_t ib_data_add_internal(
 
     /* Normal add. */
     else {
+        ib_field_t *existing;
+
+        if (ib_hash_get_ex(data->hash, &existing, name, nlen) == IB_OK) {
+            ++(data->generation);
+        }
         return ib_hash_set_ex(data->hash, name, nlen, field);
     }
 
@@ -441,6 +631,15 @@ ib_mpool_t *ib_data_pool(
     return data->mp;
 }
 
+size_t ib_data_generation(
+    const ib_data_t *data
+)
+{
+    assert(data != NULL);
+
+    return data->generation;
+}
+
 ib_status_t ib_data_add(
     ib_data_t  *data,
     ib_field_t *f
@@ -636,107 +835,90 @@ ib_status_t ib_data_get_ex(
     assert(data != NULL);
 
     ib_status_t rc;
-    char *name_str = NULL;
-
-    char *filter_marker = memchr(name, DPI_LIST_FILTER_MARKER, name_len);
-
-    /*
-     * If there is a filter_marker then we are going to
-     * extract sub-values.
-     *
-     * A sub-value might be a pattern-match on a list: ARGV:/foo\d?/
-     * Or a sub field: ARGV:my_var
-     * Or a dynamic field: ARGV:my_var
-     */
-    if ( filter_marker ) {
-
-        /* If there is a filter mark (':') get the parent field. */
-        ib_field_t *parent_field;
+    ib_data_selector_t selector;
+    pcre *filter = NULL;
 
-        char *filter_start = memchr(name, DPI_LIST_FILTER_PREFIX, name_len);
-        char *filter_end;
+    rc = data_selector_parse(name, name_len, &selector);
+    if (rc != IB_OK) {
+        return rc;
+    }
 
-        /* Fetch the field name, but the length is (filter_mark - name).
-         * That is, the string before the ':' we found. */
-        rc = ib_hash_get_ex(data->hash, &parent_field, name, filter_marker - name);
+    /* Ad hoc lookups compile their filter each time; use a selector
+     * created with ib_data_selector_create() for repeated lookups. */
+    if (selector.type == DATA_SELECTOR_FILTER) {
+        rc = data_filter_compile(selector.sub, selector.sublen, &filter);
         if (rc != IB_OK) {
             return rc;
         }
+    }
 
-        if ( filter_start && filter_start + 1 < name + name_len ) {
-            filter_end = memchr(filter_start+1,
-                                DPI_LIST_FILTER_SUFFIX,
-                                name_len - (filter_start+1-name));
-        }
-        else {
-            filter_end = NULL;
-        }
+    rc = data_selector_get(data, &selector, filter, pf);
 
+    if (filter != NULL) {
+        pcre_free(filter);
+    }
 
-        /* Does the expansions use a pattern match or not? */
-        if (filter_start && filter_end) {
+    return rc;
+}
 
-            /* Bad filter: FOO/: */
-            if (filter_marker != filter_start-1) {
-                rc = IB_EINVAL;
-                goto error_handler;
-            }
+ib_status_t ib_data_selector_create(
+    ib_mpool_t                *mp,
+    const char                *name,
+    size_t                     nlen,
+    const ib_data_selector_t **selector
+)
+{
+    assert(mp != NULL);
+    assert(name != NULL);
+    assert(selector != NULL);
 
-            /* Bad filter: FOO:/ */
-            if (filter_start == filter_end) {
-                rc = IB_EINVAL;
-                goto error_handler;
-            }
+    ib_status_t rc;
+    ib_data_selector_t *sel;
+    const char *name_copy;
 
-            /* Bad filter: FOO:// */
-            if (filter_start == filter_end-1) {
-                rc = IB_EINVAL;
-                goto error_handler;
-            }
+    name_copy = ib_mpool_memdup(mp, name, nlen);
+    if (name_copy == NULL && nlen > 0) {
+        return IB_EALLOC;
+    }
 
-            /* Validated that filter_start and filter_end are sane. */
-            rc = ib_data_get_filtered_list(
-                data,
-                parent_field,
-                filter_start+1,
-                filter_end - filter_start - 1,
-                pf
-            );
-        }
+    sel = ib_mpool_alloc(mp, sizeof(*sel));
+    if (sel == NULL) {
+        return IB_EALLOC;
+    }
 
-        /* No pattern match. Just extract the sub-field. */
-        else {
+    rc = data_selector_parse(name_copy, nlen, sel);
+    if (rc != IB_OK) {
+        return rc;
+    }
 
-            /* Handle extracting a subfield for a list of a dynamic field. */
-            rc = ib_data_get_subfields(
-                data,
-                parent_field,
-                filter_marker+1,
-                name_len - (filter_marker+1-name),
-                pf
-            );
+    if (sel->type == DATA_SELECTOR_FILTER) {
+        rc = data_filter_compile(sel->sub, sel->sublen, &sel->filter);
+        if (rc != IB_OK) {
+            return rc;
         }
-    }
 
-    /* Typical no-expansion fetch of a value. */
-    else {
-        rc = ib_hash_get_ex(data->hash, pf, name, name_len);
+        rc = ib_mpool_cleanup_register(mp, data_selector_cleanup, sel);
+        if (rc != IB_OK) {
+            pcre_free(sel->filter);
+            return rc;
+        }
     }
 
-    return rc;
+    *selector = sel;
 
-    /* Error handling routine. */
-error_handler:
-    name_str = malloc(name_len+1);
-    if ( name_str == NULL ) {
-        return IB_EALLOC;
-    }
+    return IB_OK;
+}
 
-    memcpy(name_str, name, name_len);
-    name_str[name_len] = '\0';
-    free(name_str);
+ib_status_t ib_data_get_selector(
+    const ib_data_t          *data,
+    const ib_data_selector_t *selector,
+    ib_field_t              **pf
+)
+{
+    assert(data != NULL);
+    assert(selector != NULL);
 
-    return rc;
+    return data_selector_get(data, selector, selector->filter, pf);
 }
 
 ib_status_t ib_data_get_all(
@@ -824,7 +1006,14 @@ ib_status_t ib_data_remove_ex(ib_data_t *data,
 {
     assert(data != NULL);
 
-    return ib_hash_remove_ex(data->hash, pf, name, nlen);
+    ib_status_t rc;
+
+    rc = ib_hash_remove_ex(data->hash, pf, name, nlen);
+    if (rc == IB_OK) {
+        ++(data->generation);
+    }
+
+    return rc;
 }
 
 ib_status_t ib_data_set(
@@ -835,6 +1024,8 @@ ib_status_t ib_data_set(
 )
 {
     assert(data != NULL);
+
+    ++(data->generation);
     return ib_hash_set_ex(data->hash, name, nlen, f);
 }
 
@@ -864,6 +1055,7 @@ ib_status_t ib_data_set_relative(
             }
             num += adjval;
             rc = ib_field_setv(f, ib_ftype_num_in(&num));
+            ++(data->generation);
             break;
         default:
             return IB_EINVAL;
@@ -29,6 +29,7 @@
 #include <ironbee/engine.h>
 #include "engine_private.h"
 
+#include "core_audit_private.h"
 #include "state_notify_private.h"
 
 #include <ironbee/array.h>
@@ -40,6 +41,7 @@
 #include <ironbee/module.h>
 #include <ironbee/mpool.h>
 #include <ironbee/provider.h>
+#include <ironbee/rule_engine.h>
 #include <ironbee/server.h>
 #include <ironbee/state_notify.h>
 #include <ironbee/string.h>
@@ -669,6 +671,12 @@ void ib_engine_destroy(ib_engine_t *ib)
 
     /// @todo Destroy filters
 
+    /* Report rule profiling data while logging still works. */
+    ib_rule_profile_log(ib);
+
+    /* Write queued audit logs while the contexts still exist. */
+    core_audit_queue_destroy(ib);
+
     ib_log_debug3(ib, "Destroying configuration contexts...");
     IB_LIST_LOOP_REVERSE(ib->contexts, node) {
         ib_context_t *ctx = (ib_context_t *)node->data;
@@ -862,6 +870,23 @@ ib_status_t ib_tx_generate_id(ib_tx_t *tx,
     return IB_OK;
 }
 
+/**
+ * Is transaction recycling (TxRecycle) enabled?
+ *
+ * @param[in] ib Engine.
+ *
+ * @returns true if finished transactions are kept for reuse.
+ */
+static bool tx_recycle_enabled(const ib_engine_t *ib)
+{
+    ib_core_cfg_t *corecfg = NULL;
+    ib_status_t rc;
+
+    rc = ib_context_module_config(ib->ctx, ib_core_module(),
+                                  (void *)&corecfg);
+    return (rc == IB_OK) && (corecfg->tx_recycle != 0);
+}
+
 ib_status_t ib_tx_create(ib_tx_t **ptx,
                          ib_conn_t *conn,
                          void *sctx)
@@ -886,23 +911,32 @@ ib_status_t ib_tx_create(ib_tx_t **ptx,
 
     assert(corecfg != NULL);
 
-    /* Create a sub-pool from the connection memory pool for each
-     * transaction and allocate from it
-     */
-    rc = ib_mpool_create(&pool, "tx", conn->mp);
-    if (rc != IB_OK) {
-        ib_log_alert(ib,
-            "Failed to create transaction memory pool: %s",
-            ib_status_to_string(rc)
-        );
-        rc = IB_EALLOC;
-        goto failed;
+    if (conn->tx_recycle != NULL) {
+        /* Reuse the shell of a finished transaction (see tx_recycle()). */
+        tx = conn->tx_recycle;
+        conn->tx_recycle = tx->next;
+        pool = tx->mp;
+        memset(tx, 0, sizeof(*tx));
     }
-    tx = (ib_tx_t *)ib_mpool_calloc(pool, 1, sizeof(*tx));
-    if (tx == NULL) {
-        ib_log_alert(ib, "Failed to allocate memory for transaction");
-        rc = IB_EALLOC;
-        goto failed;
+    else {
+        /* Create a sub-pool from the connection memory pool for each
+         * transaction and allocate from it
+         */
+        rc = ib_mpool_create(&pool, "tx", conn->mp);
+        if (rc != IB_OK) {
+            ib_log_alert(ib,
+                "Failed to create transaction memory pool: %s",
+                ib_status_to_string(rc)
+            );
+            rc = IB_EALLOC;
+            goto failed;
+        }
+        tx = (ib_tx_t *)ib_mpool_calloc(pool, 1, sizeof(*tx));
+        if (tx == NULL) {
+            ib_log_alert(ib, "Failed to allocate memory for transaction");
+            rc = IB_EALLOC;
+            goto failed;
+        }
     }
 
     /* Name the transaction pool */
@@ -955,15 +989,9 @@ ib_status_t ib_tx_create(ib_tx_t **ptx,
         goto failed;
     }
 
-    /* Create the body buffers. */
-    rc = ib_stream_create(&tx->request_body, tx->mp);
-    if (rc != IB_OK) {
-        goto failed;
-    }
-    rc = ib_stream_create(&tx->response_body, tx->mp);
-    if (rc != IB_OK) {
-        goto failed;
-    }
+    /* The body stores are created by the core module on the first body
+     * data, once the context of the transaction is known.
+     */
 
     /**
      * After this, we have generally succeeded and are now outputting
@@ -1036,6 +1064,43 @@ ib_status_t DLL_PUBLIC ib_tx_set_module_data(
   return rc;
 }
 
+/**
+ * Keep the memory pool of a finished transaction for the next transaction
+ * of its connection.
+ *
+ * The pool is cleared, which runs its cleanup functions and keeps its pages,
+ * and a zeroed transaction is allocated from it as the shell that
+ * ib_tx_create() picks up.  This skips creating a pool, and its pages stay
+ * with the connection.  Shells are destroyed with the connection pool.
+ *
+ * @param[in] tx Transaction to recycle.
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_EALLOC if the shell could not be allocated.
+ */
+static ib_status_t tx_recycle(ib_tx_t *tx)
+{
+    assert(tx != NULL);
+    assert(tx->conn != NULL);
+
+    ib_conn_t  *conn = tx->conn;
+    ib_mpool_t *mp = tx->mp;
+    ib_tx_t    *shell;
+
+    ib_mpool_clear(mp);
+
+    shell = (ib_tx_t *)ib_mpool_calloc(mp, 1, sizeof(*shell));
+    if (shell == NULL) {
+        return IB_EALLOC;
+    }
+    shell->mp = mp;
+    shell->next = conn->tx_recycle;
+    conn->tx_recycle = shell;
+
+    return IB_OK;
+}
+
 void ib_tx_destroy(ib_tx_t *tx)
 {
     /// @todo It should always be the first one in the list,
@@ -1079,6 +1144,14 @@ void ib_tx_destroy(ib_tx_t *tx)
     }
 
     /// @todo Probably need to update state???
+    if (tx_recycle_enabled(tx->ib)) {
+        ib_mpool_t *mp = tx->mp;
+
+        if (tx_recycle(tx) != IB_OK) {
+            ib_engine_pool_destroy(tx->ib, mp);
+        }
+        return;
+    }
     ib_engine_pool_destroy(tx->ib, tx->mp);
 }
 
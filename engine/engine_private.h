@@ -30,6 +30,7 @@
 
 #include <ironbee/array.h>
 #include <ironbee/context_selection.h>
+#include <ironbee/core.h>
 #include <ironbee/lock.h>
 #include <ironbee/log.h>
 #include <ironbee/collection_manager.h>
@@ -61,6 +62,11 @@ struct ib_auditlog_cfg_t {
     ib_context_t *owner;         /**< Owning context. Only owner should edit. */
 };
 
+/**
+ * Audit log writer queue (see core_audit.c).
+ */
+typedef struct ib_auditlog_queue_t ib_auditlog_queue_t;
+
 /**
  * Rule engine data
  */
@@ -141,6 +147,8 @@ struct ib_engine_t {
     ib_hash_t             *actions;         /**< Hash tracking rules */
     ib_rule_engine_t      *rule_engine;     /**< Rule engine data */
     ib_list_t             *collection_managers; /**< List of managers */
+    ib_auditlog_queue_t   *auditlog_queue;  /**< Audit log writer queue */
+    ib_core_body_stats_t   body_stats;      /**< Request body statistics */
     ib_log_logger_fn_t     logger_fn;       /**< Logger function. */
     void                  *logger_cbdata;   /**< Logger callback data. */
     ib_log_level_fn_t      loglevel_fn;     /**< Log level function. */
@@ -115,6 +115,7 @@ ib_status_t ib_operator_inst_create_ex(
     (*op_inst)->flags = flags;
     (*op_inst)->params = ib_mpool_strdup(mpool, parameters);
     (*op_inst)->fparam = NULL;
+    (*op_inst)->prefilter = NULL;
 
     if (op->fn_create != NULL) {
         rc = op->fn_create(ib, ctx, rule, mpool, parameters, *op_inst);
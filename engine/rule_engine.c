@@ -34,6 +34,7 @@
 #include <ironbee/bytestr.h>
 #include <ironbee/config.h>
 #include <ironbee/core.h>
+#include <ironbee/data.h>
 #include <ironbee/engine.h>
 #include <ironbee/escape.h>
 #include <ironbee/field.h>
@@ -41,6 +42,7 @@
 #include <ironbee/mpool.h>
 #include <ironbee/operator.h>
 #include <ironbee/rule_logger.h>
+#include <ironbee/string.h>
 #include <ironbee/transformation.h>
 #include <ironbee/util.h>
 
@@ -319,6 +321,40 @@ typedef struct {
 #define MAX_TFN_RECURSION    (5)       /**< Max tfn list recursion limit */
 #define MAX_CHAIN_RECURSION  (10)      /**< Max chain recursion limit */
 
+/**
+ * Maximum number of transformation results cached per transaction.  Once
+ * reached, further results are computed but not cached.
+ */
+#define MAX_TFN_CACHE_ENTRIES (4096)
+
+/**
+ * Per-transaction transformation result cache.
+ *
+ * Results are returned by identity, so a chain of transformations applied
+ * to the same field by different rules hits the cache at every step.
+ */
+struct ib_rule_tfn_cache_t {
+    ib_hash_t              *hash;        /**< tfn_cache_key_t -> ib_field_t */
+    size_t                  entries;     /**< Number of cached results */
+    size_t                  hits;        /**< Number of cache hits */
+    size_t                  misses;      /**< Number of cache misses */
+    size_t                  generation;  /**< tx->data generation cached */
+};
+
+/**
+ * Transformation cache key.
+ *
+ * The input field's value is part of the key so that a field modified in
+ * place (e.g. by setvar) is not matched against a stale result.
+ */
+typedef struct {
+    const ib_tfn_t         *tfn;         /**< Transformation */
+    const ib_field_t       *field;       /**< Input field */
+    const void             *value;       /**< Input value pointer */
+    const void             *data;        /**< Input byte string data */
+    ib_num_t                num;         /**< Input number / data length */
+} tfn_cache_key_t;
+
 /**
  * Test the validity of a phase number
  *
@@ -479,6 +515,25 @@ ib_status_t ib_rule_exec_create(ib_tx_t *tx,
                             ib_status_to_string(rc));
     }
 
+    /* Profiling counters are looked up per phase */
+    exec->profile = NULL;
+
+    /* Literal set results are cached on first use */
+    exec->literal_cache = NULL;
+
+    /* Create the transformation cache */
+    exec->tfn_cache = ib_mpool_calloc(tx->mp, 1, sizeof(*exec->tfn_cache));
+    if (exec->tfn_cache == NULL) {
+        return IB_EALLOC;
+    }
+    rc = ib_hash_create(&(exec->tfn_cache->hash), tx->mp);
+    if (rc != IB_OK) {
+        ib_rule_log_tx_error(tx, "Failed to create transformation cache: %s",
+                             ib_status_to_string(rc));
+        return rc;
+    }
+    exec->tfn_cache->generation = ib_data_generation(tx->data);
+
     /* No current rule, target, etc. */
     exec->rule = NULL;
     exec->target = NULL;
@@ -607,6 +662,27 @@ static ib_status_t rule_exec_set_target(ib_rule_exec_t *rule_exec,
     return IB_OK;
 }
 
+/**
+ * Get the profile counters of the executing rule.
+ *
+ * @param[in] rule_exec The rule execution object
+ *
+ * @returns Counters, or NULL if the rule is not being profiled.
+ */
+static inline ib_rule_profile_t *rule_exec_profile(
+    const ib_rule_exec_t *rule_exec)
+{
+    assert(rule_exec != NULL);
+    assert(rule_exec->rule != NULL);
+
+    ib_rule_profile_block_t *block = rule_exec->profile;
+
+    if ( (block == NULL) || (rule_exec->rule->profile_index >= block->count) ) {
+        return NULL;
+    }
+    return &(block->counters[rule_exec->rule->profile_index]);
+}
+
 /**
  * Push a value onto a rule execution object's value stack
  *
@@ -656,6 +732,176 @@ static void rule_exec_pop_value(ib_rule_exec_t *rule_exec,
     return;
 }
 
+/**
+ * Build the transformation cache key for @a tfn applied to @a value.
+ *
+ * Only non-dynamic numeric and string fields are cached: the value of a
+ * dynamic field may change without the field changing.
+ *
+ * @param[in] tfn Transformation
+ * @param[in] value Input field
+ * @param[out] key Cache key
+ *
+ * @returns true if the result of @a tfn on @a value may be cached.
+ */
+static bool tfn_cache_key(const ib_tfn_t *tfn,
+                          const ib_field_t *value,
+                          tfn_cache_key_t *key)
+{
+    assert(tfn != NULL);
+    assert(value != NULL);
+    assert(key != NULL);
+
+    ib_status_t rc;
+
+    if (ib_field_is_dynamic(value)) {
+        return false;
+    }
+
+    /* Zero any padding: the key is hashed as raw bytes */
+    memset(key, 0, sizeof(*key));
+    key->tfn = tfn;
+    key->field = value;
+
+    switch (value->type) {
+    case IB_FTYPE_NUM:
+        rc = ib_field_value(value, ib_ftype_num_out(&(key->num)));
+        break;
+    case IB_FTYPE_NULSTR:
+    {
+        const char *nulstr;
+        rc = ib_field_value(value, ib_ftype_nulstr_out(&nulstr));
+        key->value = nulstr;
+        break;
+    }
+    case IB_FTYPE_BYTESTR:
+    {
+        const ib_bytestr_t *bs;
+        rc = ib_field_value(value, ib_ftype_bytestr_out(&bs));
+        if ( (rc == IB_OK) && (bs != NULL) ) {
+            key->value = bs;
+            key->data = ib_bytestr_const_ptr(bs);
+            key->num = ib_bytestr_length(bs);
+        }
+        break;
+    }
+    default:
+        return false;
+    }
+
+    return (rc == IB_OK);
+}
+
+/**
+ * Flush the transaction's cache if data fields were replaced or removed.
+ *
+ * The key identifies the input by field and value pointers, which do not
+ * change when a field is replaced under the same name with shared value
+ * storage or adjusted in place, so cached results cannot be trusted once
+ * the transaction data generation changes.
+ *
+ * @param[in] rule_exec The rule execution object
+ */
+static void tfn_cache_validate(const ib_rule_exec_t *rule_exec)
+{
+    assert(rule_exec != NULL);
+
+    ib_rule_tfn_cache_t *cache = rule_exec->tfn_cache;
+    size_t               generation = ib_data_generation(rule_exec->tx->data);
+
+    if (cache->generation != generation) {
+        ib_hash_clear(cache->hash);
+        cache->entries = 0;
+        cache->generation = generation;
+    }
+}
+
+/**
+ * Lookup a transformation result in the transaction's cache.
+ *
+ * @param[in] rule_exec The rule execution object
+ * @param[in] key Cache key
+ *
+ * @returns The cached result, or NULL if not cached.
+ */
+static ib_field_t *tfn_cache_get(const ib_rule_exec_t *rule_exec,
+                                 const tfn_cache_key_t *key)
+{
+    assert(rule_exec != NULL);
+    assert(key != NULL);
+
+    ib_rule_tfn_cache_t *cache = rule_exec->tfn_cache;
+    ib_field_t          *out;
+    ib_status_t          rc;
+
+    tfn_cache_validate(rule_exec);
+    rc = ib_hash_get_ex(cache->hash, &out, key, sizeof(*key));
+    if (rc != IB_OK) {
+        ++(cache->misses);
+        return NULL;
+    }
+
+    ++(cache->hits);
+    return out;
+}
+
+/**
+ * Store a transformation result in the transaction's cache.
+ *
+ * Failure to cache is not an error; the result is simply not cached.
+ *
+ * @param[in] rule_exec The rule execution object
+ * @param[in] key Cache key
+ * @param[in] out Transformation result
+ */
+static void tfn_cache_set(const ib_rule_exec_t *rule_exec,
+                          const tfn_cache_key_t *key,
+                          ib_field_t *out)
+{
+    assert(rule_exec != NULL);
+    assert(key != NULL);
+    assert(out != NULL);
+
+    ib_rule_tfn_cache_t *cache = rule_exec->tfn_cache;
+    ib_mpool_t          *mp = rule_exec->tx->mp;
+    tfn_cache_key_t     *stored;
+    ib_status_t          rc;
+
+    tfn_cache_validate(rule_exec);
+    if (cache->entries >= MAX_TFN_CACHE_ENTRIES) {
+        return;
+    }
+
+    stored = ib_mpool_memdup(mp, key, sizeof(*key));
+    if (stored == NULL) {
+        return;
+    }
+    rc = ib_hash_set_ex(cache->hash, stored, sizeof(*stored), out);
+    if (rc == IB_OK) {
+        ++(cache->entries);
+    }
+}
+
+void ib_rule_tfn_cache_stats(const ib_rule_exec_t *rule_exec,
+                             size_t *entries,
+                             size_t *hits,
+                             size_t *misses)
+{
+    assert(rule_exec != NULL);
+
+    const ib_rule_tfn_cache_t *cache = rule_exec->tfn_cache;
+
+    if (entries != NULL) {
+        *entries = (cache == NULL) ? 0 : cache->entries;
+    }
+    if (hits != NULL) {
+        *hits = (cache == NULL) ? 0 : cache->hits;
+    }
+    if (misses != NULL) {
+        *misses = (cache == NULL) ? 0 : cache->misses;
+    }
+}
+
 /**
  * Execute a single transformation on a target.
  *
@@ -779,7 +1025,24 @@ static ib_status_t execute_tfn_single(const ib_rule_exec_t *rule_exec,
 
     /* OK, no unrolling required.  Just execute the transformation. */
     else {
-        ib_flags_t flags;
+        ib_flags_t      flags;
+        tfn_cache_key_t key;
+        bool            cacheable;
+
+        /* Another rule may already have done this work */
+        cacheable = tfn_cache_key(tfn, value, &key);
+        if (cacheable && (rule_exec->tfn_cache != NULL)) {
+            out = tfn_cache_get(rule_exec, &key);
+            if (out != NULL) {
+                ib_rule_log_trace(rule_exec,
+                                  "Using cached result of transformation "
+                                  "\"%s\" on \"%.*s\"",
+                                  tfn->name, (int)value->nlen, value->name);
+                *result = out;
+                return IB_OK;
+            }
+        }
+
         rc = ib_tfn_transform(rule_exec->ib, rule_exec->tx->mp,
                               tfn, value, &out, &flags);
         if (rc != IB_OK) {
@@ -795,6 +1058,10 @@ static ib_status_t execute_tfn_single(const ib_rule_exec_t *rule_exec,
                               "Transformation returned NULL");
             return IB_EINVAL;
         }
+
+        if (cacheable && (rule_exec->tfn_cache != NULL)) {
+            tfn_cache_set(rule_exec, &key, out);
+        }
     }
 
     /* The output of the final operator is the result */
@@ -1376,10 +1643,12 @@ static ib_status_t execute_operator(ib_rule_exec_t *rule_exec,
 
     /* No recursion required, handle it here */
     else {
-        ib_list_t  *actions;
-        ib_num_t    result = 0;
-        ib_status_t op_rc = IB_OK;
-        ib_status_t act_rc = IB_OK;
+        ib_list_t         *actions;
+        ib_num_t           result = 0;
+        ib_status_t        op_rc = IB_OK;
+        ib_status_t        act_rc = IB_OK;
+        ib_rule_profile_t *profile = rule_exec_profile(rule_exec);
+        uint64_t           start = 0;
 
         /* Fill in the FIELD* fields */
         rc = set_target_fields(rule_exec, value);
@@ -1390,9 +1659,18 @@ static ib_status_t execute_operator(ib_rule_exec_t *rule_exec,
         }
 
         /* Execute the operator */
-        /* @todo remove the cast-away of the constness of value */
-        op_rc = ib_operator_execute(rule_exec, opinst,
-                                    (ib_field_t *)value, &result);
+        if (profile != NULL) {
+            start = ib_clock_get_time_ns();
+        }
+        op_rc = ib_rule_literal_execute(rule_exec, value, &result);
+        if (op_rc == IB_DECLINED) {
+            /* @todo remove the cast-away of the constness of value */
+            op_rc = ib_operator_execute(rule_exec, opinst,
+                                        (ib_field_t *)value, &result);
+        }
+        if (profile != NULL) {
+            profile->operator_nsec += ib_clock_get_time_ns() - start;
+        }
         if (op_rc != IB_OK) {
             ib_rule_log_warn(rule_exec, "Operator returned an error: %s",
                              ib_status_to_string(op_rc));
@@ -1429,7 +1707,13 @@ static ib_status_t execute_operator(ib_rule_exec_t *rule_exec,
         }
 
         ib_rule_log_exec_add_result(rule_exec->exec_log, value, result);
+        if (profile != NULL) {
+            start = ib_clock_get_time_ns();
+        }
         act_rc = execute_action_list(rule_exec, result, actions);
+        if (profile != NULL) {
+            profile->action_nsec += ib_clock_get_time_ns() - start;
+        }
 
         /* Done. */
         clear_target_fields(rule_exec);
@@ -1462,6 +1746,7 @@ static ib_status_t execute_phase_rule_targets(ib_rule_exec_t *rule_exec)
     ib_operator_inst_t *opinst = rule_exec->rule->opinst;
     ib_status_t         rc = IB_OK;
     ib_list_node_t     *node = NULL;
+    ib_rule_profile_t  *profile = rule_exec_profile(rule_exec);
 
     /* Special case: External rules */
     if (ib_flags_all(rule->flags, IB_RULE_FLAG_EXTERNAL)) {
@@ -1514,7 +1799,7 @@ static ib_status_t execute_phase_rule_targets(ib_rule_exec_t *rule_exec)
         assert(fname != NULL);
         ib_field_t         *value = NULL;      /* Value from the DPI */
         const ib_field_t   *tfnvalue = NULL;   /* Value after tfns */
-        ib_status_t         getrc;             /* Status from ib_data_get() */
+        ib_status_t         getrc;             /* Status from data lookup */
         bool                pushed = true;
 
 
@@ -1522,7 +1807,7 @@ static ib_status_t execute_phase_rule_targets(ib_rule_exec_t *rule_exec)
         rule_exec_set_target(rule_exec, target);
 
         /* Get the field value */
-        getrc = ib_data_get(tx->data, fname, &value);
+        getrc = ib_data_get_selector(tx->data, target->selector, &value);
         if (getrc == IB_ENOENT) {
             bool allow  =
                 ib_flags_all(opinst->op->flags, IB_OP_FLAG_ALLOW_NULL);
@@ -1552,10 +1837,18 @@ static ib_status_t execute_phase_rule_targets(ib_rule_exec_t *rule_exec)
 
         /* Add the target to the log object */
         ib_rule_log_exec_add_target(rule_exec->exec_log, target, value);
+        if (profile != NULL) {
+            ++(profile->targets);
+        }
 
         /* Execute the target transformations */
         if (value != NULL) {
+            uint64_t start = (profile == NULL) ? 0 : ib_clock_get_time_ns();
+
             rc = execute_tfns(rule_exec, value, &tfnvalue);
+            if (profile != NULL) {
+                profile->tfn_nsec += ib_clock_get_time_ns() - start;
+            }
             if (rc != IB_OK) {
                 return rc;
             }
@@ -1660,6 +1953,7 @@ static ib_status_t execute_phase_rule(ib_rule_exec_t *rule_exec,
 {
     ib_status_t         rc = IB_OK;
     ib_status_t         trc;          /* Temporary status code */
+    ib_rule_profile_t  *profile;
 
     assert(rule_exec != NULL);
     assert(rule != NULL);
@@ -1691,6 +1985,18 @@ static ib_status_t execute_phase_rule(ib_rule_exec_t *rule_exec,
      * correct behavior should be.
      */
     trc = execute_phase_rule_targets(rule_exec);
+
+    profile = rule_exec_profile(rule_exec);
+    if (profile != NULL) {
+        ++(profile->invocations);
+        if (rule_exec->result != 0) {
+            ++(profile->true_results);
+        }
+        else {
+            ++(profile->false_results);
+        }
+    }
+
     if (trc != IB_OK) {
         rc = trc;
         goto cleanup;
@@ -2011,6 +2317,7 @@ static ib_status_t run_phase_rules(ib_engine_t *ib,
     /* Setup for rule execution */
     rule_exec->phase = meta->phase_num;
     rule_exec->is_stream = false;
+    rule_exec->profile = ib_rule_profile_block(tx);
     ib_list_clear(rule_exec->phase_rules);
 
     /* Invoke all of the rule injectors */
@@ -2100,6 +2407,15 @@ static ib_status_t run_phase_rules(ib_engine_t *ib,
 finish:
     ib_rule_log_tx_event_end(rule_exec, event);
 
+    if ( (event == handle_logging_event) && (rule_exec->tfn_cache != NULL) ) {
+        ib_rule_log_tx_debug(tx,
+                             "Transformation cache: %zd entries, "
+                             "%zd hits, %zd misses",
+                             rule_exec->tfn_cache->entries,
+                             rule_exec->tfn_cache->hits,
+                             rule_exec->tfn_cache->misses);
+    }
+
     /*
      * @todo Eat errors for now.  Unless something Really Bad(TM) has
      * occurred, return IB_OK to the engine.  A bigger discussion of if / how
@@ -2130,6 +2446,8 @@ static ib_status_t execute_stream_operator(ib_rule_exec_t *rule_exec,
     ib_num_t         result = 0;
     ib_status_t      op_rc;
     ib_status_t      act_rc;
+    ib_rule_profile_t *profile = rule_exec_profile(rule_exec);
+    uint64_t         start = 0;
 
     /* Add a target execution result to the log object */
     ib_rule_log_exec_add_stream_tgt(rule_exec->exec_log, value);
@@ -2143,7 +2461,15 @@ static ib_status_t execute_stream_operator(ib_rule_exec_t *rule_exec,
     }
 
     /* Execute the rule operator */
+    if (profile != NULL) {
+        ++(profile->invocations);
+        ++(profile->targets);
+        start = ib_clock_get_time_ns();
+    }
     op_rc = ib_operator_execute(rule_exec, rule->opinst, value, &result);
+    if (profile != NULL) {
+        profile->operator_nsec += ib_clock_get_time_ns() - start;
+    }
     if (op_rc != IB_OK) {
         ib_rule_log_error(rule_exec, "Operator returned an error: %s",
                           ib_status_to_string(op_rc));
@@ -2181,7 +2507,19 @@ static ib_status_t execute_stream_operator(ib_rule_exec_t *rule_exec,
     }
 
     ib_rule_log_exec_add_result(rule_exec->exec_log, value, result);
+    if (profile != NULL) {
+        if (result != 0) {
+            ++(profile->true_results);
+        }
+        else {
+            ++(profile->false_results);
+        }
+        start = ib_clock_get_time_ns();
+    }
     act_rc = execute_action_list(rule_exec, result, actions);
+    if (profile != NULL) {
+        profile->action_nsec += ib_clock_get_time_ns() - start;
+    }
 
     if (act_rc != IB_OK) {
         ib_rule_log_error(rule_exec,
@@ -2370,6 +2708,7 @@ static ib_status_t run_stream_rules(ib_engine_t *ib,
     /* Setup for rule execution */
     rule_exec->phase = meta->phase_num;
     rule_exec->is_stream = true;
+    rule_exec->profile = ib_rule_profile_block(tx);
     ib_list_clear(rule_exec->phase_rules);
 
     /* Invoke all of the rule injectors */
@@ -2649,6 +2988,7 @@ static ib_status_t init_ruleset(ib_engine_t *ib,
         ib_ruleset_phase_t *ruleset_phase =
             &(ctx_rules->ruleset.phases[phase_num]);
         ruleset_phase->phase_num = (ib_rule_phase_num_t)phase_num;
+        ruleset_phase->literal_rules = NULL;
         rc = find_phase_meta(phase_num, &(ruleset_phase->phase_meta));
         if (rc != IB_OK) {
             ib_log_error(ib,
@@ -2842,6 +3182,12 @@ static ib_status_t create_rule_engine(const ib_engine_t *ib,
         }
     }
 
+    /* Initialize rule profiling */
+    rc = ib_rule_profile_init(ib, mp, rule_engine);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
     *p_rule_engine = rule_engine;
     return IB_OK;
 }
@@ -3253,6 +3599,7 @@ ib_status_t ib_rule_engine_ctx_close(ib_engine_t *ib,
     ib_list_node_t *node;
     ib_flags_t      skip_flags;
     ib_context_t   *main_ctx = ib_context_main(ib);
+    ib_num_t        num;
     ib_status_t     rc;
 
     /* Don't enable rules for non-location contexts */
@@ -3505,6 +3852,33 @@ ib_status_t ib_rule_engine_ctx_close(ib_engine_t *ib,
                      ib_context_full_get(ctx));
     }
 
+    /* Step 8: Merge the literal string operators of each phase */
+    for (num = (ib_num_t)PHASE_NONE;
+         num < (ib_num_t)IB_RULE_PHASE_COUNT;
+         ++num)
+    {
+        ib_ruleset_phase_t *ruleset_phase = &(ctx->rules->ruleset.phases[num]);
+
+        /* Stream rules see the data in pieces; nothing to merge */
+        if ( (ruleset_phase->phase_meta == NULL) ||
+             ruleset_phase->phase_meta->is_stream )
+        {
+            continue;
+        }
+
+        rc = ib_rule_literal_compile(ib, ctx, ruleset_phase);
+        if (rc != IB_OK) {
+            ib_log_error(ib,
+                         "Failed to merge literal operators of phase "
+                         "%d/\"%s\" in context \"%s\": %s",
+                         ruleset_phase->phase_num,
+                         phase_name(ruleset_phase->phase_meta),
+                         ib_context_full_get(ctx),
+                         ib_status_to_string(rc));
+            return rc;
+        }
+    }
+
     ib_rule_log_flags_dump(ib, ctx);
 
     return IB_OK;
@@ -3626,6 +4000,14 @@ ib_status_t ib_rule_create(ib_engine_t *ib,
     rule->ctx = ctx;
     rule->opinst = NULL;
 
+    /* Assign the rule's profile counters */
+    rc = ib_rule_profile_add_rule(ib, rule);
+    if (rc != IB_OK) {
+        ib_log_error(ib, "Failed to add rule profile counters: %s",
+                     ib_status_to_string(rc));
+        return rc;
+    }
+
     /* Note if this is the main context */
     if (ctx == ib_context_main(ib)) {
         rule->flags |= IB_RULE_FLAG_MAIN_CTX;
@@ -3989,6 +4371,11 @@ ib_status_t ib_rule_register(ib_engine_t *ib,
         }
         tgt->field_name = "NULL";
         tgt->target_str = "NULL";
+        rc = ib_data_selector_create(ib_rule_mpool(ib), IB_S2SL("NULL"),
+                                     &(tgt->selector));
+        if (rc != IB_OK) {
+            return rc;
+        }
         rc = ib_list_create(&(tgt->tfn_list), ib_rule_mpool(ib));
         if (rc != IB_OK) {
             return rc;
@@ -4500,6 +4887,16 @@ ib_status_t ib_rule_create_target(ib_engine_t *ib,
         return IB_EALLOC;
     }
 
+    /* Parse the name and compile any filter once, at load time */
+    rc = ib_data_selector_create(ib_rule_mpool(ib),
+                                 name, strlen(name),
+                                 &((*target)->selector));
+    if (rc != IB_OK) {
+        ib_log_error(ib, "Error parsing target field name \"%s\": %s",
+                     name, ib_status_to_string(rc));
+        return rc;
+    }
+
     /* Copy the original */
     if (str == NULL) {
         (*target)->target_str = NULL;
@@ -27,10 +27,15 @@
  * @author Nick LeRoy <nleroy@qualys.com>
  */
 
+#include <ironbee/array.h>
 #include <ironbee/clock.h>
+#include <ironbee/data.h>
+#include <ironbee/hash.h>
 #include <ironbee/rule_engine.h>
 #include <ironbee/types.h>
 
+#include <pthread.h>
+
 /**
  * Context-specific rule object.  This is the type of the objects
  * stored in the 'rule_list' field of ib_ruleset_phase_t.
@@ -48,6 +53,7 @@ typedef struct {
     ib_rule_phase_num_t         phase_num;   /**< Phase number */
     const ib_rule_phase_meta_t *phase_meta;  /**< Rule phase meta-data */
     ib_list_t                  *rule_list;   /**< Rules to execute in phase */
+    ib_hash_t                  *literal_rules; /**< Rule -> literal slot */
 } ib_ruleset_phase_t;
 
 /**
@@ -84,9 +90,10 @@ struct ib_rule_context_t {
  * Rule target fields
  */
 struct ib_rule_target_t {
-    const char            *field_name;    /**< The field name */
-    const char            *target_str;    /**< The target string */
-    ib_list_t             *tfn_list;      /**< List of transformations */
+    const char               *field_name; /**< The field name */
+    const char               *target_str; /**< The target string */
+    const ib_data_selector_t *selector;   /**< Precompiled field selector */
+    ib_list_t                *tfn_list;   /**< List of transformations */
 };
 
 /**
@@ -98,6 +105,24 @@ struct ib_rule_engine_t {
     ib_hash_t            *external_drivers; /**< Drivers for external rules. */
     ib_list_t            *ownership_cbs;   /**< List of ownership callbacks */
     ib_list_t *injection_cbs[IB_RULE_PHASE_COUNT]; /**< Rule injection callbacks*/
+
+    /* Rule profiling */
+    ib_array_t           *profile_rules;    /**< Rules by profile index */
+    pthread_key_t         profile_key;      /**< Thread's counter block */
+    bool                  profile_key_valid;/**< Was profile_key created? */
+    ib_rule_profile_block_t *volatile profile_blocks; /**< All blocks */
+};
+
+/**
+ * Rule profiling counters of one thread.
+ *
+ * Blocks are never removed from ib_rule_engine_t::profile_blocks until the
+ * engine is destroyed, so the list may be walked without locking.
+ */
+struct ib_rule_profile_block_t {
+    ib_rule_profile_block_t *next;      /**< Next block */
+    size_t                   count;     /**< Number of counter sets */
+    ib_rule_profile_t        counters[];/**< Counters by rule profile index */
 };
 
 /**
@@ -132,6 +157,89 @@ ib_status_t ib_rule_engine_init(
     ib_engine_t                *ib,
     ib_module_t                *mod);
 
+/**
+ * Initialize rule profiling.
+ *
+ * @param[in] ib IronBee engine
+ * @param[in] mp Memory pool; profiling data is released when it is destroyed
+ * @param[in,out] rule_engine Rule engine
+ *
+ * @returns Status code
+ */
+ib_status_t ib_rule_profile_init(
+    const ib_engine_t          *ib,
+    ib_mpool_t                 *mp,
+    struct ib_rule_engine_t    *rule_engine);
+
+/**
+ * Assign a new rule its profile counter index.
+ *
+ * @param[in] ib IronBee engine
+ * @param[in,out] rule The new rule
+ *
+ * @returns Status code
+ */
+ib_status_t ib_rule_profile_add_rule(
+    ib_engine_t                *ib,
+    ib_rule_t                  *rule);
+
+/**
+ * Get the profiling counters of the calling thread for a transaction.
+ *
+ * @param[in] tx Transaction
+ *
+ * @returns Counter block, or NULL if profiling is disabled for the
+ * transaction's context or the block could not be created.
+ */
+ib_rule_profile_block_t *ib_rule_profile_block(
+    const ib_tx_t              *tx);
+
+/**
+ * Merge the literal string operators of a phase's rules.
+ *
+ * Rules whose operator is one of the core literal string operators
+ * (streq, istreq, contains, match, imatch) and whose targets and
+ * transformations are identical are grouped.  Each group of two or more
+ * rules gets a single matcher (hashes for equality, an Aho-Corasick
+ * automaton for contains) so one scan of a target value yields the result
+ * of every rule in the group.  Rules whose operator instance has a
+ * prefilter join the automaton of their group, which is built even if such
+ * a rule is alone in it.
+ *
+ * Must not be called for stream phases.
+ *
+ * @param[in] ib IronBee engine
+ * @param[in] ctx Context being closed
+ * @param[in,out] ruleset_phase Phase ruleset of @a ctx
+ *
+ * @returns Status code
+ */
+ib_status_t ib_rule_literal_compile(
+    ib_engine_t                *ib,
+    ib_context_t               *ctx,
+    ib_ruleset_phase_t         *ruleset_phase);
+
+/**
+ * Execute the executing rule's operator through its merged literal set.
+ *
+ * Results are cached per transaction, so only the first rule of a group
+ * to see a value scans it.
+ *
+ * @param[in,out] rule_exec Rule execution object
+ * @param[in] value Target value
+ * @param[out] result Operator result (not yet inverted)
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_DECLINED if the rule's operator was not merged, @a value can not
+ *   be handled or one of the operator's prefilter literals is in @a value;
+ *   the operator should be executed normally.
+ */
+ib_status_t ib_rule_literal_execute(
+    ib_rule_exec_t             *rule_exec,
+    const ib_field_t           *value,
+    ib_num_t                   *result);
+
 /**
  * Create a rule execution object
  *
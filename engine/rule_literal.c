@@ -0,0 +1,1011 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee --- Rule Engine Literal Operator Merging
+ *
+ * When a context is closed, the rules of each phase whose operator is a
+ * core literal string operator are grouped by their targets and
+ * transformations.  The patterns of a group are compiled into one set:
+ * hashes for the equality operators (streq, istreq, match, imatch) and an
+ * Aho-Corasick automaton for contains.  At runtime the first rule of a
+ * group to see a value scans it once, recording the result of every rule
+ * of the group in a per-transaction cache; the remaining rules only look
+ * up their result.  The cache is keyed by set and field and keeps a copy of
+ * the value scanned, so a value changed in place is scanned again.
+ *
+ * Rules whose operator instance has a prefilter (literals one of which is
+ * in every value the operator is true for, see ib_operator_inst_t) join
+ * the group's automaton too.  Their operator is only executed on values
+ * the automaton found one of their literals in.
+ */
+
+#include "ironbee_config_auto.h"
+
+#include <ironbee/rule_engine.h>
+#include "rule_engine_private.h"
+
+#include "core_private.h"
+#include "engine_private.h"
+
+#include <ironbee/bytestr.h>
+#include <ironbee/field.h>
+#include <ironbee/flags.h>
+#include <ironbee/hash.h>
+#include <ironbee/list.h>
+#include <ironbee/mpool.h>
+#include <ironbee/rule_capture.h>
+#include <ironbee/transformation.h>
+
+#include <assert.h>
+#include <string.h>
+
+/**
+ * Minimum number of rules sharing targets for their operators to be merged.
+ *
+ * Groups with a rule whose operator has a prefilter are built whatever their
+ * size: the prefilter saves executing the operator on most values.
+ */
+#define MIN_LITERAL_SET_RULES (2)
+
+/**
+ * No transition (see literal_ac_goto()).
+ */
+#define LITERAL_AC_NONE ((uint32_t)-1)
+
+/**
+ * Aho-Corasick automaton state.
+ *
+ * Edges are kept sorted by label so transitions are found by binary search.
+ */
+typedef struct {
+    uint8_t               *labels;    /**< Sorted edge labels */
+    uint32_t              *targets;   /**< Edge targets, parallel to labels */
+    uint32_t               num_edges; /**< Number of edges */
+    uint32_t               capacity;  /**< Allocated edges */
+    uint32_t               fail;      /**< Failure link */
+    uint32_t               output;    /**< Next state with slots on the
+                                       *   failure chain, or 0 for none */
+    ib_list_t             *slots;     /**< Slots of patterns ending here */
+} literal_ac_state_t;
+
+/**
+ * Aho-Corasick automaton.  State 0 is the root.
+ */
+typedef struct {
+    literal_ac_state_t    *states;    /**< States */
+    uint32_t               num_states;/**< Number of states */
+    uint32_t               capacity;  /**< Allocated states */
+} literal_ac_t;
+
+/**
+ * Merged literal patterns of a group of rules.
+ */
+typedef struct {
+    size_t                 num_slots;    /**< Number of rules in the set */
+    ib_hash_t             *equal;        /**< Pattern -> ib_list_t of slots */
+    ib_hash_t             *equal_nocase; /**< Same, case insensitive */
+    literal_ac_t           contains;     /**< Contains patterns */
+} literal_set_t;
+
+/**
+ * A rule's place in a literal set.
+ */
+typedef struct {
+    const ib_rule_t       *rule;         /**< The rule */
+    const literal_set_t   *set;          /**< Set the rule belongs to */
+    size_t                 index;        /**< Index in the set's results */
+    ib_core_literal_op_t   op;           /**< Operator kind */
+    bool                   prefilter;    /**< Operator prefilter only? */
+    const ib_bytestr_t    *pattern;      /**< First pattern (for capture) */
+} literal_slot_t;
+
+/**
+ * Rule waiting to be merged.
+ */
+typedef struct {
+    const ib_rule_t       *rule;         /**< The rule */
+    ib_core_literal_op_t   op;           /**< Operator kind */
+    bool                   nocase;       /**< Case insensitive? */
+    bool                   prefilter;    /**< Operator prefilter only? */
+    ib_list_t             *patterns;     /**< Patterns (ib_bytestr_t *) */
+} literal_candidate_t;
+
+/**
+ * Per-transaction cache key of a set's results.
+ */
+typedef struct {
+    const literal_set_t   *set;          /**< Literal set */
+    const ib_field_t      *field;        /**< Value field */
+} literal_cache_key_t;
+
+/**
+ * Per-transaction cache entry of a set's results.
+ */
+typedef struct {
+    uint8_t               *results;      /**< Results indexed by slot */
+    uint8_t               *data;         /**< Copy of the value scanned */
+    size_t                 length;       /**< Length of @a data */
+} literal_cache_entry_t;
+
+/**
+ * Find the transition of an automaton state on a byte.
+ *
+ * @param[in] state State
+ * @param[in] c Input byte
+ *
+ * @returns Target state, or LITERAL_AC_NONE.
+ */
+static inline uint32_t literal_ac_goto(const literal_ac_state_t *state,
+                                       uint8_t c)
+{
+    uint32_t lo = 0;
+    uint32_t hi = state->num_edges;
+
+    while (lo < hi) {
+        uint32_t mid = lo + ((hi - lo) / 2);
+
+        if (state->labels[mid] == c) {
+            return state->targets[mid];
+        }
+        else if (state->labels[mid] < c) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return LITERAL_AC_NONE;
+}
+
+/**
+ * Add a state to an automaton.
+ *
+ * @param[in] mp Memory pool
+ * @param[in,out] ac Automaton
+ * @param[out] id New state
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_EALLOC on allocation failure.
+ */
+static ib_status_t literal_ac_add_state(ib_mpool_t *mp,
+                                        literal_ac_t *ac,
+                                        uint32_t *id)
+{
+    if (ac->num_states == ac->capacity) {
+        uint32_t            capacity;
+        literal_ac_state_t *states;
+
+        capacity = (ac->capacity == 0) ? 64 : ac->capacity * 2;
+
+        states = ib_mpool_alloc(mp, capacity * sizeof(*states));
+        if (states == NULL) {
+            return IB_EALLOC;
+        }
+        if (ac->num_states > 0) {
+            memcpy(states, ac->states, ac->num_states * sizeof(*states));
+        }
+        ac->states = states;
+        ac->capacity = capacity;
+    }
+
+    memset(&(ac->states[ac->num_states]), 0, sizeof(ac->states[0]));
+    *id = ac->num_states;
+    ++(ac->num_states);
+
+    return IB_OK;
+}
+
+/**
+ * Add an edge to an automaton state, keeping the edges sorted.
+ *
+ * @param[in] mp Memory pool
+ * @param[in,out] state State
+ * @param[in] c Edge label
+ * @param[in] target Edge target
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_EALLOC on allocation failure.
+ */
+static ib_status_t literal_ac_add_edge(ib_mpool_t *mp,
+                                       literal_ac_state_t *state,
+                                       uint8_t c,
+                                       uint32_t target)
+{
+    uint32_t n;
+
+    if (state->num_edges == state->capacity) {
+        uint32_t  capacity = (state->capacity == 0) ? 2 : state->capacity * 2;
+        uint8_t  *labels;
+        uint32_t *targets;
+
+        labels = ib_mpool_alloc(mp, capacity * sizeof(*labels));
+        targets = ib_mpool_alloc(mp, capacity * sizeof(*targets));
+        if ( (labels == NULL) || (targets == NULL) ) {
+            return IB_EALLOC;
+        }
+        if (state->num_edges > 0) {
+            memcpy(labels, state->labels,
+                   state->num_edges * sizeof(*labels));
+            memcpy(targets, state->targets,
+                   state->num_edges * sizeof(*targets));
+        }
+        state->labels = labels;
+        state->targets = targets;
+        state->capacity = capacity;
+    }
+
+    n = state->num_edges;
+    while ( (n > 0) && (state->labels[n - 1] > c) ) {
+        state->labels[n] = state->labels[n - 1];
+        state->targets[n] = state->targets[n - 1];
+        --n;
+    }
+    state->labels[n] = c;
+    state->targets[n] = target;
+    ++(state->num_edges);
+
+    return IB_OK;
+}
+
+/**
+ * Add a pattern to an automaton.
+ *
+ * @param[in] mp Memory pool
+ * @param[in,out] ac Automaton
+ * @param[in] pattern Pattern (not empty)
+ * @param[in] slot Slot to report when @a pattern is found
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_EALLOC on allocation failure.
+ */
+static ib_status_t literal_ac_add_pattern(ib_mpool_t *mp,
+                                          literal_ac_t *ac,
+                                          const ib_bytestr_t *pattern,
+                                          const literal_slot_t *slot)
+{
+    const uint8_t *p = ib_bytestr_const_ptr(pattern);
+    size_t         len = ib_bytestr_length(pattern);
+    uint32_t       state = 0;
+    ib_status_t    rc;
+
+    assert(len > 0);
+
+    if (ac->num_states == 0) {
+        rc = literal_ac_add_state(mp, ac, &state);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        uint32_t next = literal_ac_goto(&(ac->states[state]), p[i]);
+
+        if (next == LITERAL_AC_NONE) {
+            rc = literal_ac_add_state(mp, ac, &next);
+            if (rc != IB_OK) {
+                return rc;
+            }
+            rc = literal_ac_add_edge(mp, &(ac->states[state]), p[i], next);
+            if (rc != IB_OK) {
+                return rc;
+            }
+        }
+        state = next;
+    }
+
+    if (ac->states[state].slots == NULL) {
+        rc = ib_list_create(&(ac->states[state].slots), mp);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+
+    return ib_list_push(ac->states[state].slots, (void *)slot);
+}
+
+/**
+ * Compute the failure and output links of an automaton.
+ *
+ * @param[in] mp Memory pool
+ * @param[in,out] ac Automaton
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_EALLOC on allocation failure.
+ */
+static ib_status_t literal_ac_link(ib_mpool_t *mp, literal_ac_t *ac)
+{
+    uint32_t *queue;
+    uint32_t  head = 0;
+    uint32_t  tail = 0;
+
+    if (ac->num_states == 0) {
+        return IB_OK;
+    }
+
+    queue = ib_mpool_alloc(mp, ac->num_states * sizeof(*queue));
+    if (queue == NULL) {
+        return IB_EALLOC;
+    }
+
+    /* Breadth first, so a state's failure target is linked before it. */
+    queue[tail++] = 0;
+    while (head < tail) {
+        const literal_ac_state_t *state = &(ac->states[queue[head++]]);
+
+        for (uint32_t e = 0; e < state->num_edges; ++e) {
+            uint8_t             c = state->labels[e];
+            literal_ac_state_t *child = &(ac->states[state->targets[e]]);
+            uint32_t            f = state->fail;
+            uint32_t            g;
+
+            while ( (f != 0) &&
+                    (literal_ac_goto(&(ac->states[f]), c) == LITERAL_AC_NONE) )
+            {
+                f = ac->states[f].fail;
+            }
+            g = literal_ac_goto(&(ac->states[f]), c);
+            if ( (g == LITERAL_AC_NONE) || (g == state->targets[e]) ) {
+                child->fail = 0;
+            }
+            else {
+                child->fail = g;
+            }
+            child->output = (ac->states[child->fail].slots != NULL)
+                ? child->fail : ac->states[child->fail].output;
+
+            queue[tail++] = state->targets[e];
+        }
+    }
+
+    return IB_OK;
+}
+
+/**
+ * Mark the slots of a list as matched.
+ *
+ * @param[in] slots List of slots (literal_slot_t *)
+ * @param[in,out] results Results, indexed by slot
+ */
+static void literal_mark(const ib_list_t *slots, uint8_t *results)
+{
+    const ib_list_node_t *node;
+
+    IB_LIST_LOOP_CONST(slots, node) {
+        const literal_slot_t *slot =
+            (const literal_slot_t *)ib_list_node_data_const(node);
+        results[slot->index] = 1;
+    }
+}
+
+/**
+ * Scan data with an automaton, marking the slots of all patterns found.
+ *
+ * @param[in] ac Automaton
+ * @param[in] data Data
+ * @param[in] len Length of @a data
+ * @param[in,out] results Results, indexed by slot
+ */
+static void literal_ac_scan(const literal_ac_t *ac,
+                            const uint8_t *data,
+                            size_t len,
+                            uint8_t *results)
+{
+    uint32_t state = 0;
+
+    if (ac->num_states == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        uint32_t next;
+        uint32_t out;
+
+        while ( ((next = literal_ac_goto(&(ac->states[state]), data[i]))
+                 == LITERAL_AC_NONE) &&
+                (state != 0) )
+        {
+            state = ac->states[state].fail;
+        }
+        state = (next == LITERAL_AC_NONE) ? 0 : next;
+
+        out = (ac->states[state].slots != NULL) ? state
+                                                : ac->states[state].output;
+        while (out != 0) {
+            literal_mark(ac->states[out].slots, results);
+            out = ac->states[out].output;
+        }
+    }
+}
+
+/**
+ * Add a pattern to an equality hash.
+ *
+ * @param[in] mp Memory pool
+ * @param[in] hash Hash (pattern -> ib_list_t of slots)
+ * @param[in] pattern Pattern
+ * @param[in] slot Slot to report when @a pattern is equal to a value
+ *
+ * @returns Status code
+ */
+static ib_status_t literal_hash_add_pattern(ib_mpool_t *mp,
+                                            ib_hash_t *hash,
+                                            const ib_bytestr_t *pattern,
+                                            const literal_slot_t *slot)
+{
+    ib_list_t   *slots;
+    ib_status_t  rc;
+
+    rc = ib_hash_get_ex(hash, &slots,
+                        ib_bytestr_const_ptr(pattern),
+                        ib_bytestr_length(pattern));
+    if (rc == IB_ENOENT) {
+        rc = ib_list_create(&slots, mp);
+        if (rc != IB_OK) {
+            return rc;
+        }
+        rc = ib_hash_set_ex(hash,
+                            ib_bytestr_const_ptr(pattern),
+                            ib_bytestr_length(pattern),
+                            slots);
+    }
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return ib_list_push(slots, (void *)slot);
+}
+
+/**
+ * Build the target signature of a rule.
+ *
+ * Rules with equal signatures see the same values.
+ *
+ * @param[in] mp Memory pool
+ * @param[in] rule Rule
+ *
+ * @returns Signature, or NULL on allocation failure.
+ */
+static const char *literal_signature(ib_mpool_t *mp, const ib_rule_t *rule)
+{
+    const ib_list_node_t *tnode;
+    size_t                len = 0;
+    char                 *sig;
+    char                 *p;
+
+    IB_LIST_LOOP_CONST(rule->target_fields, tnode) {
+        const ib_rule_target_t *target =
+            (const ib_rule_target_t *)ib_list_node_data_const(tnode);
+        const ib_list_node_t   *node;
+
+        len += strlen(target->field_name) + 1;
+        IB_LIST_LOOP_CONST(target->tfn_list, node) {
+            const ib_tfn_t *tfn =
+                (const ib_tfn_t *)ib_list_node_data_const(node);
+            len += strlen(tfn->name) + 1;
+        }
+    }
+
+    sig = ib_mpool_alloc(mp, len + 1);
+    if (sig == NULL) {
+        return NULL;
+    }
+
+    /* Field names and transformation names can't contain control
+     * characters, so use them as separators. */
+    p = sig;
+    IB_LIST_LOOP_CONST(rule->target_fields, tnode) {
+        const ib_rule_target_t *target =
+            (const ib_rule_target_t *)ib_list_node_data_const(tnode);
+        const ib_list_node_t   *node;
+
+        IB_LIST_LOOP_CONST(target->tfn_list, node) {
+            const ib_tfn_t *tfn =
+                (const ib_tfn_t *)ib_list_node_data_const(node);
+            size_t          n = strlen(tfn->name);
+
+            memcpy(p, tfn->name, n);
+            p += n;
+            *p++ = '\x1f';
+        }
+        len = strlen(target->field_name);
+        memcpy(p, target->field_name, len);
+        p += len;
+        *p++ = '\x1e';
+    }
+    *p = '\0';
+
+    return sig;
+}
+
+/**
+ * Get the merge candidate for a rule.
+ *
+ * @param[in] mp Memory pool
+ * @param[in] rule Rule
+ * @param[out] pcandidate Candidate
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_DECLINED if the rule's operator can't be merged.
+ * - IB_EALLOC on allocation failure.
+ */
+static ib_status_t literal_candidate(ib_mpool_t *mp,
+                                     const ib_rule_t *rule,
+                                     literal_candidate_t **pcandidate)
+{
+    literal_candidate_t *candidate;
+    ib_status_t          rc;
+
+    if ( (rule->opinst == NULL) ||
+         ib_flags_any(rule->flags,
+                      IB_RULE_FLAG_EXTERNAL | IB_RULE_FLAG_STREAM) ||
+         (IB_LIST_ELEMENTS(rule->target_fields) == 0) )
+    {
+        return IB_DECLINED;
+    }
+
+    candidate = ib_mpool_calloc(mp, 1, sizeof(*candidate));
+    if (candidate == NULL) {
+        return IB_EALLOC;
+    }
+    candidate->rule = rule;
+    rc = ib_list_create(&(candidate->patterns), mp);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    rc = ib_core_operator_literals(rule->opinst, mp,
+                                   &(candidate->op),
+                                   &(candidate->nocase),
+                                   candidate->patterns);
+    if ( (rc == IB_DECLINED) && (rule->opinst->prefilter != NULL) ) {
+        const ib_list_node_t *node;
+
+        /* Any of the literals may be found: "contains" semantics. */
+        candidate->op = IB_CORE_LITERAL_CONTAINS;
+        candidate->prefilter = true;
+        IB_LIST_LOOP_CONST(rule->opinst->prefilter, node) {
+            const ib_bytestr_t *pattern =
+                (const ib_bytestr_t *)ib_list_node_data_const(node);
+
+            if (ib_bytestr_length(pattern) == 0) {
+                return IB_DECLINED;
+            }
+            rc = ib_list_push(candidate->patterns, (void *)pattern);
+            if (rc != IB_OK) {
+                return rc;
+            }
+        }
+        if (IB_LIST_ELEMENTS(candidate->patterns) == 0) {
+            return IB_DECLINED;
+        }
+    }
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    *pcandidate = candidate;
+    return IB_OK;
+}
+
+/**
+ * Is a group of candidates worth building a literal set for?
+ *
+ * @param[in] group Candidates (literal_candidate_t *)
+ *
+ * @returns true if @a group has at least MIN_LITERAL_SET_RULES candidates
+ *          or a prefilter candidate.
+ */
+static bool literal_group_worth_set(const ib_list_t *group)
+{
+    const ib_list_node_t *node;
+
+    if (IB_LIST_ELEMENTS(group) >= MIN_LITERAL_SET_RULES) {
+        return true;
+    }
+    IB_LIST_LOOP_CONST(group, node) {
+        const literal_candidate_t *candidate =
+            (const literal_candidate_t *)ib_list_node_data_const(node);
+
+        if (candidate->prefilter) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Build a literal set from a group of candidates and register its slots.
+ *
+ * @param[in] mp Memory pool
+ * @param[in] group Candidates (literal_candidate_t *)
+ * @param[in,out] literal_rules Hash of rule -> slot
+ *
+ * @returns Status code
+ */
+static ib_status_t literal_set_build(ib_mpool_t *mp,
+                                     const ib_list_t *group,
+                                     ib_hash_t *literal_rules)
+{
+    literal_set_t        *set;
+    const ib_list_node_t *node;
+    ib_status_t           rc;
+
+    set = ib_mpool_calloc(mp, 1, sizeof(*set));
+    if (set == NULL) {
+        return IB_EALLOC;
+    }
+    rc = ib_hash_create(&(set->equal), mp);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_hash_create_nocase(&(set->equal_nocase), mp);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    IB_LIST_LOOP_CONST(group, node) {
+        const literal_candidate_t *candidate =
+            (const literal_candidate_t *)ib_list_node_data_const(node);
+        const ib_list_node_t      *pnode;
+        literal_slot_t            *slot;
+
+        slot = ib_mpool_alloc(mp, sizeof(*slot));
+        if (slot == NULL) {
+            return IB_EALLOC;
+        }
+        slot->rule = candidate->rule;
+        slot->set = set;
+        slot->index = set->num_slots++;
+        slot->op = candidate->op;
+        slot->prefilter = candidate->prefilter;
+        slot->pattern = (const ib_bytestr_t *)
+            ib_list_node_data_const(ib_list_first_const(candidate->patterns));
+
+        IB_LIST_LOOP_CONST(candidate->patterns, pnode) {
+            const ib_bytestr_t *pattern =
+                (const ib_bytestr_t *)ib_list_node_data_const(pnode);
+
+            if (candidate->op == IB_CORE_LITERAL_CONTAINS) {
+                rc = literal_ac_add_pattern(mp, &(set->contains),
+                                            pattern, slot);
+            }
+            else {
+                rc = literal_hash_add_pattern(
+                    mp,
+                    candidate->nocase ? set->equal_nocase : set->equal,
+                    pattern, slot);
+            }
+            if (rc != IB_OK) {
+                return rc;
+            }
+        }
+
+        /* The key is the rule pointer, stored in the slot. */
+        rc = ib_hash_set_ex(literal_rules,
+                            &(slot->rule), sizeof(slot->rule),
+                            slot);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+
+    return literal_ac_link(mp, &(set->contains));
+}
+
+ib_status_t ib_rule_literal_compile(ib_engine_t *ib,
+                                    ib_context_t *ctx,
+                                    ib_ruleset_phase_t *ruleset_phase)
+{
+    assert(ib != NULL);
+    assert(ctx != NULL);
+    assert(ruleset_phase != NULL);
+
+    ib_mpool_t           *mp = ctx->mp;
+    ib_hash_t            *groups;
+    ib_list_t            *signatures;
+    const ib_list_node_t *node;
+    ib_status_t           rc;
+
+    ruleset_phase->literal_rules = NULL;
+
+    if (IB_LIST_ELEMENTS(ruleset_phase->rule_list) == 0) {
+        return IB_OK;
+    }
+
+    rc = ib_hash_create(&groups, mp);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_list_create(&signatures, mp);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    /* Group the candidates by target signature. */
+    IB_LIST_LOOP_CONST(ruleset_phase->rule_list, node) {
+        const ib_rule_ctx_data_t *ctx_rule =
+            (const ib_rule_ctx_data_t *)ib_list_node_data_const(node);
+        literal_candidate_t      *candidate;
+        ib_list_t                *group;
+        const char               *sig;
+
+        rc = literal_candidate(mp, ctx_rule->rule, &candidate);
+        if (rc == IB_DECLINED) {
+            continue;
+        }
+        else if (rc != IB_OK) {
+            return rc;
+        }
+
+        sig = literal_signature(mp, ctx_rule->rule);
+        if (sig == NULL) {
+            return IB_EALLOC;
+        }
+
+        rc = ib_hash_get(groups, &group, sig);
+        if (rc == IB_ENOENT) {
+            rc = ib_list_create(&group, mp);
+            if (rc != IB_OK) {
+                return rc;
+            }
+            rc = ib_hash_set(groups, sig, group);
+            if (rc != IB_OK) {
+                return rc;
+            }
+            rc = ib_list_push(signatures, (void *)sig);
+        }
+        if (rc != IB_OK) {
+            return rc;
+        }
+
+        rc = ib_list_push(group, candidate);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+
+    /* Build a set for each group worth it. */
+    IB_LIST_LOOP_CONST(signatures, node) {
+        const char *sig = (const char *)ib_list_node_data_const(node);
+        ib_list_t  *group;
+
+        rc = ib_hash_get(groups, &group, sig);
+        if (rc != IB_OK) {
+            return rc;
+        }
+        if (! literal_group_worth_set(group)) {
+            continue;
+        }
+
+        if (ruleset_phase->literal_rules == NULL) {
+            rc = ib_hash_create(&(ruleset_phase->literal_rules), mp);
+            if (rc != IB_OK) {
+                return rc;
+            }
+        }
+
+        rc = literal_set_build(mp, group, ruleset_phase->literal_rules);
+        if (rc != IB_OK) {
+            return rc;
+        }
+
+        ib_log_debug(ib,
+                     "Merged literal operators of %zd rules in phase "
+                     "%d context \"%s\"",
+                     IB_LIST_ELEMENTS(group),
+                     ruleset_phase->phase_num,
+                     ib_context_full_get(ctx));
+    }
+
+    return IB_OK;
+}
+
+/**
+ * Get the results of a literal set for a value, scanning it if needed.
+ *
+ * Cached results are only used if the value still has the content it was
+ * scanned with; fields may be reused or their values rewritten in place.
+ *
+ * @param[in,out] rule_exec Rule execution object
+ * @param[in] set Literal set
+ * @param[in] field Value field
+ * @param[in] data Value data
+ * @param[in] len Length of @a data
+ *
+ * @returns Results indexed by slot, or NULL on allocation failure.
+ */
+static const uint8_t *literal_results(ib_rule_exec_t *rule_exec,
+                                      const literal_set_t *set,
+                                      const ib_field_t *field,
+                                      const uint8_t *data,
+                                      size_t len)
+{
+    ib_mpool_t            *mp = rule_exec->tx->mp;
+    literal_cache_key_t    key;
+    literal_cache_key_t   *stored;
+    literal_cache_entry_t *entry;
+    uint8_t               *results;
+    uint8_t               *copy;
+    ib_list_t             *slots;
+    ib_status_t            rc;
+
+    if (rule_exec->literal_cache == NULL) {
+        rc = ib_hash_create(&(rule_exec->literal_cache), mp);
+        if (rc != IB_OK) {
+            return NULL;
+        }
+    }
+
+    /* Zero any padding: the key is hashed as raw bytes */
+    memset(&key, 0, sizeof(key));
+    key.set = set;
+    key.field = field;
+
+    rc = ib_hash_get_ex(rule_exec->literal_cache, &entry, &key, sizeof(key));
+    if (rc != IB_OK) {
+        entry = NULL;
+    }
+    else if ( (entry->length == len) &&
+              ( (len == 0) || (memcmp(entry->data, data, len) == 0) ) )
+    {
+        return entry->results;
+    }
+
+    results = ib_mpool_calloc(mp, set->num_slots, sizeof(*results));
+    if (results == NULL) {
+        return NULL;
+    }
+
+    if (ib_hash_get_ex(set->equal, &slots, data, len) == IB_OK) {
+        literal_mark(slots, results);
+    }
+    if (ib_hash_get_ex(set->equal_nocase, &slots, data, len) == IB_OK) {
+        literal_mark(slots, results);
+    }
+    literal_ac_scan(&(set->contains), data, len, results);
+
+    /* Failure to cache is not an error; the value is scanned again. */
+    copy = (len == 0) ? NULL : ib_mpool_memdup(mp, data, len);
+    if ( (len != 0) && (copy == NULL) ) {
+        return results;
+    }
+    if (entry == NULL) {
+        entry = ib_mpool_alloc(mp, sizeof(*entry));
+        stored = ib_mpool_memdup(mp, &key, sizeof(key));
+        if ( (entry == NULL) || (stored == NULL) ) {
+            return results;
+        }
+        rc = ib_hash_set_ex(rule_exec->literal_cache,
+                            stored, sizeof(*stored), entry);
+        if (rc != IB_OK) {
+            return results;
+        }
+    }
+    entry->results = results;
+    entry->data = copy;
+    entry->length = len;
+
+    return results;
+}
+
+ib_status_t ib_rule_literal_execute(ib_rule_exec_t *rule_exec,
+                                    const ib_field_t *value,
+                                    ib_num_t *result)
+{
+    assert(rule_exec != NULL);
+    assert(rule_exec->rule != NULL);
+    assert(result != NULL);
+
+    const ib_ruleset_phase_t *ruleset_phase;
+    const literal_slot_t     *slot;
+    const uint8_t            *data;
+    const uint8_t            *results;
+    size_t                    len;
+    ib_status_t               rc;
+
+    if ( (rule_exec->tx == NULL) || (rule_exec->tx->ctx == NULL) ||
+         rule_exec->is_stream || (value == NULL) )
+    {
+        return IB_DECLINED;
+    }
+
+    ruleset_phase =
+        &(rule_exec->tx->ctx->rules->ruleset.phases[rule_exec->phase]);
+    if (ruleset_phase->literal_rules == NULL) {
+        return IB_DECLINED;
+    }
+    rc = ib_hash_get_ex(ruleset_phase->literal_rules, &slot,
+                        &(rule_exec->rule), sizeof(rule_exec->rule));
+    if (rc != IB_OK) {
+        return IB_DECLINED;
+    }
+
+    if (value->type == IB_FTYPE_NULSTR) {
+        const char *s;
+
+        rc = ib_field_value(value, ib_ftype_nulstr_out(&s));
+        if ( (rc != IB_OK) || (s == NULL) ) {
+            return IB_DECLINED;
+        }
+        data = (const uint8_t *)s;
+        len = strlen(s);
+    }
+    else if (value->type == IB_FTYPE_BYTESTR) {
+        const ib_bytestr_t *bs;
+
+        rc = ib_field_value(value, ib_ftype_bytestr_out(&bs));
+        if ( (rc != IB_OK) || (bs == NULL) ) {
+            return IB_DECLINED;
+        }
+        data = ib_bytestr_const_ptr(bs);
+        len = ib_bytestr_length(bs);
+    }
+    else {
+        return IB_DECLINED;
+    }
+
+    results = literal_results(rule_exec, slot->set, value, data, len);
+    if (results == NULL) {
+        return IB_DECLINED;
+    }
+    /* A prefilter literal was found: the operator decides. */
+    if (slot->prefilter) {
+        if (results[slot->index] != 0) {
+            return IB_DECLINED;
+        }
+        *result = 0;
+        return IB_OK;
+    }
+
+    *result = results[slot->index];
+
+    /* Capture as the merged operator would have. */
+    if (ib_rule_should_capture(rule_exec, *result)) {
+        if (slot->op == IB_CORE_LITERAL_STREQ) {
+            ib_rule_capture_clear(rule_exec);
+            /* @todo remove the cast-away of the constness of value */
+            ib_rule_capture_set_item(rule_exec, 0, (ib_field_t *)value);
+        }
+        else if (slot->op == IB_CORE_LITERAL_CONTAINS) {
+            ib_field_t *f;
+            const char *name;
+
+            ib_rule_capture_clear(rule_exec);
+            name = ib_rule_capture_name(rule_exec, 0);
+            rc = ib_field_create_bytestr_alias(
+                &f, rule_exec->tx->mp,
+                name, strlen(name),
+                (uint8_t *)ib_bytestr_const_ptr(slot->pattern),
+                ib_bytestr_length(slot->pattern));
+            if (rc != IB_OK) {
+                return rc;
+            }
+            ib_rule_capture_set_item(rule_exec, 0, f);
+        }
+    }
+
+    return IB_OK;
+}
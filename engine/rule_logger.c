@@ -577,6 +577,7 @@ ib_status_t ib_rule_log_exec_add_stream_tgt(ib_rule_log_exec_t *exec_log,
     target->field_name = fname;
     target->tfn_list = NULL;
     target->target_str = NULL;
+    target->selector = NULL;
 
     rc = ib_rule_log_exec_add_target(exec_log, target, field);
     if (rc != IB_OK) {
@@ -994,29 +995,29 @@ static void log_tx_response_header(
 static void log_tx_body(
     const ib_rule_exec_t *rule_exec,
     const char *label,
-    const ib_stream_t *body
+    const ib_bodystore_t *body
 )
 {
-    ib_sdata_t *sdata;
+    ib_bodystore_iter_t iter;
+    const uint8_t *data;
+    size_t dlen;
     ib_status_t rc;
 
     if (body == NULL) {
         return;
     }
-    rc = ib_stream_peek(body, &sdata);
-    if (rc != IB_OK) {
-        return;
-    }
-    if (sdata->type == IB_STREAM_DATA) {
+    ib_bodystore_iter_init(&iter, body);
+    rc = ib_bodystore_iter_next(&iter, &data, &dlen);
+    if (rc == IB_OK) {
         char *buf;
         ib_flags_t result;
 
-        ib_string_escape_json_ex(rule_exec->tx_log->mp,
-                                 sdata->data, sdata->dlen,
-                                 true, true, &buf, NULL, &result);
+        rc = ib_string_escape_json_ex(rule_exec->tx_log->mp,
+                                      data, dlen,
+                                      true, true, &buf, NULL, &result);
         if (rc == IB_OK) {
             rule_log_exec(rule_exec, "%s %zd %s",
-                          label, sdata->dlen, buf);
+                          label, dlen, buf);
         }
     }
     return;
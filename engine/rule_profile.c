@@ -0,0 +1,281 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee --- Rule Engine Profiling
+ *
+ * Each thread executing rules gets its own block of counters, found
+ * through a thread specific key, so counting never takes a lock.  Blocks
+ * are linked into a list owned by the rule engine which is walked to sum
+ * the counters of all threads.
+ */
+
+#include "ironbee_config_auto.h"
+
+#include <ironbee/rule_engine.h>
+#include "rule_engine_private.h"
+
+#include "engine_private.h"
+
+#include <ironbee/core.h>
+#include <ironbee/log.h>
+#include <ironbee/mpool.h>
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Release all profiling data of a rule engine.
+ *
+ * @param[in] cbdata Rule engine (ib_rule_engine_t *)
+ */
+static void rule_profile_cleanup(void *cbdata)
+{
+    ib_rule_engine_t        *rule_engine = (ib_rule_engine_t *)cbdata;
+    ib_rule_profile_block_t *block = rule_engine->profile_blocks;
+
+    rule_engine->profile_blocks = NULL;
+    while (block != NULL) {
+        ib_rule_profile_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    if (rule_engine->profile_key_valid) {
+        pthread_key_delete(rule_engine->profile_key);
+        rule_engine->profile_key_valid = false;
+    }
+}
+
+ib_status_t ib_rule_profile_init(const ib_engine_t *ib,
+                                 ib_mpool_t *mp,
+                                 ib_rule_engine_t *rule_engine)
+{
+    assert(ib != NULL);
+    assert(mp != NULL);
+    assert(rule_engine != NULL);
+
+    ib_status_t rc;
+
+    rule_engine->profile_blocks = NULL;
+    rule_engine->profile_key_valid = false;
+
+    rc = ib_array_create(&(rule_engine->profile_rules), mp, 64, 64);
+    if (rc != IB_OK) {
+        ib_log_error(ib,
+                     "Rule engine failed to create profile rule array: %s",
+                     ib_status_to_string(rc));
+        return rc;
+    }
+
+    if (pthread_key_create(&(rule_engine->profile_key), NULL) != 0) {
+        ib_log_error(ib, "Rule engine failed to create profile thread key");
+        return IB_EUNKNOWN;
+    }
+    rule_engine->profile_key_valid = true;
+
+    rc = ib_mpool_cleanup_register(mp, rule_profile_cleanup, rule_engine);
+    if (rc != IB_OK) {
+        rule_profile_cleanup(rule_engine);
+        return rc;
+    }
+
+    return IB_OK;
+}
+
+ib_status_t ib_rule_profile_add_rule(ib_engine_t *ib,
+                                     ib_rule_t *rule)
+{
+    assert(ib != NULL);
+    assert(ib->rule_engine != NULL);
+    assert(rule != NULL);
+
+    ib_array_t *rules = ib->rule_engine->profile_rules;
+
+    rule->profile_index = ib_array_elements(rules);
+
+    return ib_array_setn(rules, rule->profile_index, rule);
+}
+
+ib_rule_profile_block_t *ib_rule_profile_block(const ib_tx_t *tx)
+{
+    assert(tx != NULL);
+    assert(tx->ib != NULL);
+    assert(tx->ctx != NULL);
+
+    ib_rule_engine_t        *rule_engine = tx->ib->rule_engine;
+    ib_core_cfg_t           *corecfg = NULL;
+    ib_rule_profile_block_t *block;
+    size_t                   count;
+    ib_status_t              rc;
+
+    rc = ib_context_module_config(tx->ctx, ib_core_module(),
+                                  (void *)&corecfg);
+    if ( (rc != IB_OK) || (corecfg->rule_profile == 0) ) {
+        return NULL;
+    }
+    if (! rule_engine->profile_key_valid) {
+        return NULL;
+    }
+
+    count = ib_array_elements(rule_engine->profile_rules);
+    block = (ib_rule_profile_block_t *)
+        pthread_getspecific(rule_engine->profile_key);
+    if ( (block != NULL) && (block->count >= count) ) {
+        return block;
+    }
+
+    /* First use by this thread, or rules created since the thread's block
+     * was.  The old block stays in the list so its counts are kept. */
+    block = calloc(1, sizeof(*block) + (count * sizeof(block->counters[0])));
+    if (block == NULL) {
+        return NULL;
+    }
+    block->count = count;
+
+    if (pthread_setspecific(rule_engine->profile_key, block) != 0) {
+        free(block);
+        return NULL;
+    }
+
+    do {
+        block->next = rule_engine->profile_blocks;
+    } while (! __sync_bool_compare_and_swap(&(rule_engine->profile_blocks),
+                                            block->next, block));
+
+    return block;
+}
+
+size_t ib_rule_profile_snapshot(const ib_engine_t *ib,
+                                ib_rule_profile_t *profiles,
+                                size_t count)
+{
+    assert(ib != NULL);
+    assert(ib->rule_engine != NULL);
+    assert( (profiles != NULL) || (count == 0) );
+
+    ib_rule_engine_t              *rule_engine = ib->rule_engine;
+    const ib_rule_profile_block_t *block;
+    size_t                         num;
+    size_t                         n;
+
+    num = ib_array_elements(rule_engine->profile_rules);
+    if (count > num) {
+        count = num;
+    }
+
+    for (n = 0; n < count; ++n) {
+        memset(&profiles[n], 0, sizeof(profiles[n]));
+        ib_array_get(rule_engine->profile_rules, n, &(profiles[n].rule));
+    }
+
+    for (block = rule_engine->profile_blocks;
+         block != NULL;
+         block = block->next)
+    {
+        for (n = 0;  (n < count) && (n < block->count);  ++n) {
+            const ib_rule_profile_t *src = &(block->counters[n]);
+            ib_rule_profile_t       *dst = &(profiles[n]);
+
+            dst->invocations   += src->invocations;
+            dst->targets       += src->targets;
+            dst->true_results  += src->true_results;
+            dst->false_results += src->false_results;
+            dst->tfn_nsec      += src->tfn_nsec;
+            dst->operator_nsec += src->operator_nsec;
+            dst->action_nsec   += src->action_nsec;
+        }
+    }
+
+    return num;
+}
+
+/**
+ * Total time spent in a rule.
+ *
+ * @param[in] profile Profile counters
+ *
+ * @returns Total time in nanoseconds.
+ */
+static uint64_t rule_profile_total(const ib_rule_profile_t *profile)
+{
+    return profile->tfn_nsec + profile->operator_nsec + profile->action_nsec;
+}
+
+/**
+ * qsort() comparison function: most expensive rule first.
+ */
+static int rule_profile_cmp(const void *a, const void *b)
+{
+    uint64_t ta = rule_profile_total((const ib_rule_profile_t *)a);
+    uint64_t tb = rule_profile_total((const ib_rule_profile_t *)b);
+
+    if (ta == tb) {
+        return 0;
+    }
+    return (ta > tb) ? -1 : 1;
+}
+
+void ib_rule_profile_log(const ib_engine_t *ib)
+{
+    assert(ib != NULL);
+
+    ib_rule_profile_t *profiles;
+    size_t             num;
+    size_t             n;
+
+    if ( (ib->rule_engine == NULL) ||
+         (ib->rule_engine->profile_blocks == NULL) )
+    {
+        return;
+    }
+
+    num = ib_rule_profile_snapshot(ib, NULL, 0);
+    profiles = malloc(num * sizeof(*profiles));
+    if (profiles == NULL) {
+        ib_log_error(ib, "Failed to allocate rule profile snapshot");
+        return;
+    }
+    num = ib_rule_profile_snapshot(ib, profiles, num);
+
+    qsort(profiles, num, sizeof(*profiles), rule_profile_cmp);
+
+    ib_log_info(ib, "Rule profile (times in usec):");
+    for (n = 0; n < num; ++n) {
+        const ib_rule_profile_t *p = &profiles[n];
+
+        if (p->invocations == 0) {
+            continue;
+        }
+        ib_log_info(ib,
+                    "Rule profile \"%s\": "
+                    "invocations=%" PRIu64 " targets=%" PRIu64 " "
+                    "true=%" PRIu64 " false=%" PRIu64 " "
+                    "tfn=%" PRIu64 " operator=%" PRIu64 " action=%" PRIu64,
+                    ib_rule_id(p->rule),
+                    p->invocations, p->targets,
+                    p->true_results, p->false_results,
+                    p->tfn_nsec / 1000,
+                    p->operator_nsec / 1000,
+                    p->action_nsec / 1000);
+    }
+
+    free(profiles);
+}
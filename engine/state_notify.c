@@ -652,9 +652,18 @@ ib_status_t ib_state_notify_request_header_finished(ib_engine_t *ib,
     return rc;
 }
 
-ib_status_t ib_state_notify_request_body_data(ib_engine_t *ib,
-                                              ib_tx_t *tx,
-                                              ib_txdata_t *txdata)
+/**
+ * Notify the parser and the engine of request body data.
+ *
+ * @param[in] ib Engine handle
+ * @param[in] tx Transaction
+ * @param[in] txdata Transaction data, with its slice set or NULL
+ *
+ * @returns Status code
+ */
+static ib_status_t state_notify_request_body(ib_engine_t *ib,
+                                             ib_tx_t *tx,
+                                             ib_txdata_t *txdata)
 {
     assert(ib != NULL);
     assert(ib->cfg_state == CFG_FINISHED);
@@ -701,6 +710,33 @@ ib_status_t ib_state_notify_request_body_data(ib_engine_t *ib,
     return rc;
 }
 
+ib_status_t ib_state_notify_request_body_data(ib_engine_t *ib,
+                                              ib_tx_t *tx,
+                                              ib_txdata_t *txdata)
+{
+    assert(txdata != NULL);
+
+    /* Servers do not set the slice of their transaction data. */
+    ib_txdata_t data = { txdata->dlen, txdata->data, NULL };
+
+    return state_notify_request_body(ib, tx, &data);
+}
+
+ib_status_t ib_state_notify_request_body_slice(ib_engine_t *ib,
+                                               ib_tx_t *tx,
+                                               ib_slice_t *slice)
+{
+    assert(slice != NULL);
+
+    ib_txdata_t data = {
+        ib_slice_length(slice),
+        (uint8_t *)ib_slice_data(slice),
+        slice
+    };
+
+    return state_notify_request_body(ib, tx, &data);
+}
+
 ib_status_t ib_state_notify_request_finished(ib_engine_t *ib,
                                              ib_tx_t *tx)
 {
@@ -920,9 +956,18 @@ ib_status_t ib_state_notify_response_header_finished(ib_engine_t *ib,
     return rc;
 }
 
-ib_status_t ib_state_notify_response_body_data(ib_engine_t *ib,
-                                               ib_tx_t *tx,
-                                               ib_txdata_t *txdata)
+/**
+ * Notify the parser and the engine of response body data.
+ *
+ * @param[in] ib Engine handle
+ * @param[in] tx Transaction
+ * @param[in] txdata Transaction data, with its slice set or NULL
+ *
+ * @returns Status code
+ */
+static ib_status_t state_notify_response_body(ib_engine_t *ib,
+                                              ib_tx_t *tx,
+                                              ib_txdata_t *txdata)
 {
     assert(ib != NULL);
     assert(ib->cfg_state == CFG_FINISHED);
@@ -980,6 +1025,33 @@ ib_status_t ib_state_notify_response_body_data(ib_engine_t *ib,
     return rc;
 }
 
+ib_status_t ib_state_notify_response_body_data(ib_engine_t *ib,
+                                               ib_tx_t *tx,
+                                               ib_txdata_t *txdata)
+{
+    assert(txdata != NULL);
+
+    /* Servers do not set the slice of their transaction data. */
+    ib_txdata_t data = { txdata->dlen, txdata->data, NULL };
+
+    return state_notify_response_body(ib, tx, &data);
+}
+
+ib_status_t ib_state_notify_response_body_slice(ib_engine_t *ib,
+                                                ib_tx_t *tx,
+                                                ib_slice_t *slice)
+{
+    assert(slice != NULL);
+
+    ib_txdata_t data = {
+        ib_slice_length(slice),
+        (uint8_t *)ib_slice_data(slice),
+        slice
+    };
+
+    return state_notify_response_body(ib, tx, &data);
+}
+
 ib_status_t ib_state_notify_response_finished(ib_engine_t *ib,
                                               ib_tx_t *tx)
 {
@@ -39,12 +39,14 @@ def step(what, cmd, infile, outfile)
   end
 end
 
-if ARGV.length != 1
-  STDERR.puts "Usage: #{$0} <rules>"
+if ARGV.length < 1 || ARGV.length > 2
+  STDERR.puts "Usage: #{$0} <rules> [<config>]"
+  STDERR.puts "<config> is checked for FastFeed directives."
   exit 1
 end
 
 rules = ARGV[0]
+config = ARGV[1]
 manifest = rules + '.manifest'
 step(
   "Extracting rules from #{rules} to #{manifest}",
@@ -56,7 +58,7 @@ step(
 automata = rules + '.automata'
 step(
   "Generating AC automata from #{manifest} to #{automata}",
-  ['./generate'],
+  ['./generate', config].compact,
   manifest,
   automata
 )
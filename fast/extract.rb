@@ -2,6 +2,11 @@
 
 # This script looks at stdin for IronBee rules with fast: modifiers and pulls
 # the arguments and ids out into a manifest for building the fast automata.
+#
+# For Rule lines with a phase, the phase, targets, and transformations (t:
+# modifiers, comma separated, or - for none) are added, each preceded by a
+# tab, so that generate can check that the targets are fed to the automata in
+# that phase.  Tabs keep them apart from the id, which may contain spaces.
 
 # This script is currently heuristic.  It should be replaced with a backend to
 # an actual rule language parser.
@@ -9,10 +14,17 @@
 STDIN.each do |line|
   if line =~ /("|\s)id:(.+?)(\1|$)/
     id = $2
+    targets = line[/^\s*Rule\s+(\S+)/, 1]
+    phase = line[/(?:"|\s)phase:(\w+)/, 1]
+    extra = []
+    if targets && phase
+      tfns = line.scan(/(?:"|\s)t:(\w+)/).flatten
+      extra = [phase, targets, tfns.empty? ? '-' : tfns.join(',')]
+    end
     line.gsub(/("|\s)fast:(.+?)(\1|$)/).each do
       pattern = $2
       pattern.gsub!(/\s/, '\s')
-      puts [pattern, id].join(' ')
+      puts (["#{pattern} #{id}"] + extra).join("\t")
     end
   end
 end
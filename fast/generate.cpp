@@ -21,6 +21,17 @@
  *
  * This builds a fast automata file from a manifest.
  *
+ * Each manifest line is a pattern and rule id separated by a space,
+ * optionally followed by the phase, targets, and transformations of the rule,
+ * each preceded by a tab, as written by extract.rb.  For the latter, every
+ * target is checked against the data the fast module feeds in
+ * the phase: its defaults or, if an IronBee configuration is given, the
+ * @c FastFeed directives in it.  A fast rule whose targets are not fed, or
+ * are fed with different transformations, will rarely or never be
+ * selected, so a warning is written for it.  It is still added to the
+ * automata as the fast module refuses to load a fast rule that is not.
+ *
+
  * @author Christopher Alfeld <calfeld@qualys.com>
  */
 
@@ -30,20 +41,220 @@
 #include <ironautomata/intermediate.hpp>
 #include <ironautomata/optimize_edges.hpp>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/foreach.hpp>
 
+#include <cctype>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <set>
 
 using namespace std;
 
-int main(int argc, char **)
+namespace {
+
+//! Feed of a phase: field name to comma separated transformations.
+typedef map<string, string> feed_t;
+//! Feed of every phase by phase name.
+typedef map<string, feed_t> feeds_t;
+
+/**
+ * Default feeds of the fast module.
+ *
+ * Must match @c c_default_feeds in modules/fast.c.
+ *
+ * @return Default feeds.
+ */
+feeds_t default_feeds()
+{
+    feeds_t feeds;
+
+    feed_t& request_header = feeds["REQUEST_HEADER"];
+    request_header["REQUEST_METHOD"]     = "";
+    request_header["REQUEST_URI"]        = "";
+    request_header["REQUEST_PROTOCOL"]   = "";
+    request_header["REQUEST_HEADERS"]    = "";
+    request_header["REQUEST_URI_PARAMS"] = "";
+
+    feed_t& request = feeds["REQUEST"];
+    request["REQUEST_BODY_PARAMS"] = "";
+
+    feed_t& response_header = feeds["RESPONSE_HEADER"];
+    response_header["RESPONSE_PROTOCOL"] = "";
+    response_header["RESPONSE_STATUS"]   = "";
+    response_header["RESPONSE_MESSAGE"]  = "";
+    response_header["RESPONSE_HEADERS"]  = "";
+
+    feeds["RESPONSE"];
+
+    return feeds;
+}
+
+/**
+ * Split @a line into whitespace separated tokens.
+ *
+ * A token may be quoted with double quotes to include whitespace.
+ *
+ * @param[in] line Line to split.
+ * @return Tokens.
+ */
+vector<string> tokenize(const string& line)
+{
+    vector<string> tokens;
+    string::const_iterator i = line.begin();
+
+    for (;;) {
+        while (i != line.end() && isspace(static_cast<unsigned char>(*i))) {
+            ++i;
+        }
+        if (i == line.end()) {
+            break;
+        }
+        string token;
+        if (*i == '"') {
+            ++i;
+            while (i != line.end() && *i != '"') {
+                token += *i;
+                ++i;
+            }
+            if (i != line.end()) {
+                ++i;
+            }
+        }
+        else {
+            while (
+                i != line.end() &&
+                ! isspace(static_cast<unsigned char>(*i))
+            ) {
+                token += *i;
+                ++i;
+            }
+        }
+        tokens.push_back(token);
+    }
+
+    return tokens;
+}
+
+/**
+ * Apply the @c FastFeed directives of an IronBee configuration to @a feeds.
+ *
+ * As in the fast module, the first @c FastFeed of a phase replaces the
+ * default feed of that phase.  Included files are not followed.
+ *
+ * @param[in]      path  Path to configuration.
+ * @param[in, out] feeds Feeds to update.
+ * @return true on success; false if @a path could not be read or a
+ *         @c FastFeed directive is invalid; reason is written to cerr.
+ */
+bool read_feeds(const string& path, feeds_t& feeds)
+{
+    ifstream in(path.c_str());
+    if (! in) {
+        cerr << "Could not open " << path << " for reading." << endl;
+        return false;
+    }
+
+    set<string> configured;
+    string line;
+    while (getline(in, line)) {
+        vector<string> tokens = tokenize(line);
+        if (tokens.empty() || ! boost::iequals(tokens[0], "FastFeed")) {
+            continue;
+        }
+        if (tokens.size() < 4) {
+            cerr << "Invalid FastFeed: " << line << endl;
+            return false;
+        }
+
+        string phase = boost::to_upper_copy(tokens[1]);
+        feeds_t::iterator feed = feeds.find(phase);
+        if (feed == feeds.end()) {
+            cerr << "Invalid FastFeed phase: " << line << endl;
+            return false;
+        }
+        if (configured.insert(phase).second) {
+            feed->second.clear();
+        }
+
+        vector<string> tfns(tokens.begin() + 4, tokens.end());
+        feed->second[boost::to_upper_copy(tokens[2])] =
+            boost::to_lower_copy(boost::join(tfns, ","));
+    }
+
+    return true;
+}
+
+/**
+ * Check that the targets of a rule are fed in its phase.
+ *
+ * @param[in] feeds   Feeds.
+ * @param[in] phase   Phase of rule.
+ * @param[in] targets Targets of rule separated by @c |.  Each may have a
+ *                    @c :key and @c .tfn() transformations.
+ * @param[in] tfns    Transformations of rule separated by @c , or @c - if
+ *                    none.
+ * @return Empty string if every target is fed; otherwise, why not.
+ */
+string check_targets(
+    const feeds_t& feeds,
+    const string&  phase,
+    const string&  targets,
+    const string&  tfns
+)
+{
+    feeds_t::const_iterator feed = feeds.find(boost::to_upper_copy(phase));
+    if (feed == feeds.end()) {
+        return "phase " + phase + " is not fed";
+    }
+
+    vector<string> target_list;
+    boost::split(target_list, targets, boost::is_any_of("|"));
+    BOOST_FOREACH(const string& target, target_list) {
+        vector<string> parts;
+        boost::split(parts, target, boost::is_any_of("."));
+
+        // Transformations of target, in order, followed by those of rule.
+        vector<string> chain;
+        for (size_t i = 1; i < parts.size(); ++i) {
+            chain.push_back(parts[i].substr(0, parts[i].find('(')));
+        }
+        if (tfns != "-") {
+            chain.push_back(tfns);
+        }
+        string chain_s = boost::to_lower_copy(boost::join(chain, ","));
+
+        string field = boost::to_upper_copy(parts[0]);
+        feed_t::const_iterator fed = feed->second.find(field);
+        if (fed == feed->second.end()) {
+            fed = feed->second.find(field.substr(0, field.find(':')));
+        }
+        if (fed == feed->second.end()) {
+            return "target " + target + " is not fed in phase " + phase;
+        }
+        if (fed->second != chain_s) {
+            return "target " + target + " is fed with transformations '" +
+                fed->second + "' but rule uses '" + chain_s + "'";
+        }
+    }
+
+    return string();
+}
+
+}
+
+int main(int argc, char **argv)
 {
     namespace ia = IronAutomata;
 
-    if (argc != 1) {
-        cerr << "Usage: generate < input > output" << endl;
+    if (argc > 2) {
+        cerr << "Usage: generate [config] < input > output" << endl;
+        return 1;
+    }
+
+    feeds_t feeds = default_feeds();
+    if (argc == 2 && ! read_feeds(argv[1], feeds)) {
         return 1;
     }
 
@@ -54,6 +265,7 @@ int main(int argc, char **)
         ia::BufferAssembler index_assembler(index_data);
         typedef map<string, size_t> id_index_map_t;
         id_index_map_t id_index_map;
+        set<string> checked_ids;
         string line;
         string pattern;
         string id;
@@ -63,13 +275,37 @@ int main(int argc, char **)
             if (line.empty()) {
                 continue;
             }
-            size_t first_space = line.find_first_of(' ');
+            size_t first_tab = line.find_first_of('\t');
+            string rule = line.substr(0, first_tab);
+            size_t first_space = rule.find_first_of(' ');
             if (first_space == string::npos) {
                 cerr << "Invalid manifest line: " << line << endl;
                 return 1;
             }
-            pattern = line.substr(0, first_space);
-            id      = line.substr(first_space + 1, string::npos);
+            pattern = rule.substr(0, first_space);
+            id      = rule.substr(first_space + 1, string::npos);
+
+            if (first_tab != string::npos && checked_ids.insert(id).second) {
+                vector<string> fields;
+                boost::split(
+                    fields,
+                    line.substr(first_tab + 1, string::npos),
+                    boost::is_any_of("\t")
+                );
+                if (fields.size() != 3) {
+                    cerr << "Warning: Rule " << id << ": Expected phase, "
+                         << "targets, and transformations but found "
+                         << fields.size() << " fields; not checked." << endl;
+                }
+                else {
+                    string problem =
+                        check_targets(feeds, fields[0], fields[1], fields[2]);
+                    if (! problem.empty()) {
+                        cerr << "Warning: Rule " << id << ": " << problem
+                             << "; fast pattern may never match." << endl;
+                    }
+                }
+            }
 
             id_index_map_t::iterator iter = id_index_map.lower_bound(id);
             if (iter == id_index_map.end() || iter->first != id) {
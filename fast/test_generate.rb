@@ -0,0 +1,99 @@
+#!/usr/bin/env ruby
+
+# Tests extract.rb and the target checks of generate.
+#
+# Like build.rb, must be run in the same directory as 'generate'.
+
+require 'test/unit'
+require 'open3'
+require 'tempfile'
+
+class TestGenerate < Test::Unit::TestCase
+  HOME = File.expand_path(File.dirname(__FILE__))
+  EXTRACT = File.join(HOME, 'extract.rb')
+  GENERATE = File.expand_path('./generate')
+
+  def extract(rules)
+    out, status = Open3.capture2(EXTRACT, :stdin_data => rules)
+    assert(status.success?)
+    out
+  end
+
+  # Returns automata and warnings.
+  def generate(manifest, config = nil)
+    args = [GENERATE]
+    if config
+      file = Tempfile.new('fast_config')
+      file.write(config)
+      file.close
+      args << file.path
+    end
+    out, err, status = Open3.capture3(*args, :stdin_data => manifest)
+    assert(status.success?, err)
+    [out, err]
+  ensure
+    file.unlink if file
+  end
+
+  def test_extract
+    manifest = extract(
+      'Rule REQUEST_URI @rx foo "id:a b" phase:REQUEST_HEADER ' +
+      "t:lowercase t:trim \"fast:foo bar\"\n" +
+      "Action id:c \"fast:baz\"\n"
+    )
+    assert_equal(
+      "foo\\sbar a b\tREQUEST_HEADER\tREQUEST_URI\tlowercase,trim\n" +
+      "baz c\n",
+      manifest
+    )
+  end
+
+  def test_id_with_spaces
+    _, err = generate(extract(
+      'Rule REQUEST_COOKIES @rx foo "id:a b c" phase:REQUEST_HEADER ' +
+      '"fast:foo"'
+    ))
+    assert_match(/Rule a b c: target REQUEST_COOKIES is not fed/, err)
+  end
+
+  def test_fed
+    _, err = generate(extract(
+      'Rule REQUEST_HEADERS:Host @rx foo id:a phase:REQUEST_HEADER "fast:foo"'
+    ))
+    assert_equal('', err)
+  end
+
+  def test_not_fed
+    _, err = generate(extract(
+      'Rule REQUEST_COOKIES @rx foo id:a phase:REQUEST_HEADER "fast:foo"'
+    ))
+    assert_match(/Rule a: target REQUEST_COOKIES is not fed/, err)
+  end
+
+  def test_mismatch
+    _, err = generate(extract(
+      'Rule REQUEST_HEADERS @rx foo id:a phase:REQUEST_HEADER ' +
+      't:lowercase "fast:foo"'
+    ))
+    assert_match(/Rule a: target REQUEST_HEADERS is fed with transformations '' but rule uses 'lowercase'/, err)
+  end
+
+  def test_feed_replaces_default
+    rules = extract(
+      'Rule REQUEST_HEADERS @rx foo id:a phase:REQUEST_HEADER ' +
+      "t:lowercase \"fast:foo\"\n" +
+      'Rule REQUEST_URI @rx bar id:b phase:REQUEST_HEADER "fast:bar"'
+    )
+    _, err = generate(
+      rules,
+      "FastFeed REQUEST_HEADER REQUEST_HEADERS \":\" lowercase\n"
+    )
+    assert_no_match(/Rule a:/, err)
+    assert_match(/Rule b: target REQUEST_URI is not fed/, err)
+  end
+
+  def test_malformed
+    _, err = generate("foo a\tREQUEST_HEADER\n")
+    assert_match(/Rule a: Expected phase, targets, and transformations but found 1 fields; not checked/, err)
+  end
+end
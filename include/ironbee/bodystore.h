@@ -0,0 +1,187 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef _IB_BODYSTORE_H_
+#define _IB_BODYSTORE_H_
+
+/**
+ * @file
+ * @brief IronBee --- Body Store Routines
+ */
+
+#include <ironbee/build.h>
+#include <ironbee/mpool.h>
+#include <ironbee/slice.h>
+#include <ironbee/types.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup IronBeeUtilBodyStore Body Store
+ * @ingroup IronBeeUtil
+ *
+ * A body store holds the data of a message body with bounded memory.
+ *
+ * The first bytes of the body, up to a memory limit, are kept in memory.
+ * Further data is written to an unlinked temporary file.  Data beyond an
+ * overall limit is counted but not stored.  The stored data is read back
+ * in order, a chunk at a time, with an iterator.
+ *
+ * @{
+ */
+
+typedef struct ib_bodystore_t ib_bodystore_t;
+typedef struct ib_bodystore_chunk_t ib_bodystore_chunk_t;
+typedef struct ib_bodystore_iter_t ib_bodystore_iter_t;
+
+/** Size of the buffer used to read spilled data back. */
+#define IB_BODYSTORE_READ_SIZE 65536
+
+/**
+ * Body store iterator.
+ *
+ * Declared here so that it can be allocated by the caller; use
+ * ib_bodystore_iter_init() and ib_bodystore_iter_next().
+ */
+struct ib_bodystore_iter_t {
+    const ib_bodystore_t       *store;  /**< Body store */
+    const ib_bodystore_chunk_t *chunk;  /**< Next memory chunk */
+    uint64_t                    offset; /**< Next offset in the file */
+};
+
+/**
+ * Create a body store.
+ *
+ * @param[out] pstore Address which new body store is written
+ * @param[in] mp Memory pool; the temporary file is closed when it is
+ *            cleared or destroyed
+ * @param[in] mem_limit Bytes kept in memory (0 for no limit)
+ * @param[in] limit Bytes stored in total (0 for no limit)
+ * @param[in] dir Directory of the temporary file (NULL for /tmp)
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_bodystore_create(ib_bodystore_t **pstore,
+                                           ib_mpool_t *mp,
+                                           size_t mem_limit,
+                                           size_t limit,
+                                           const char *dir);
+
+/**
+ * Append data to a body store.
+ *
+ * Data that does not fit in memory is written to the temporary file,
+ * which is created on first use.  Data past the overall limit is dropped
+ * and counted as truncated.
+ *
+ * @param[in,out] store Body store
+ * @param[in] data Data
+ * @param[in] dlen Length of @a data
+ *
+ * @returns Status code:
+ *   - IB_OK on success, including when data was truncated.
+ *   - IB_EALLOC on memory error.
+ *   - IB_EOTHER if the temporary file could not be created or written.
+ */
+ib_status_t DLL_PUBLIC ib_bodystore_append(ib_bodystore_t *store,
+                                           const void *data,
+                                           size_t dlen);
+
+/**
+ * Append the data of a slice to a body store.
+ *
+ * As ib_bodystore_append(), but the data kept in memory is not copied:
+ * the store takes a reference to @a slice until its memory pool is
+ * cleared or destroyed.  Data written to the temporary file is copied.
+ *
+ * @param[in,out] store Body store
+ * @param[in] slice Slice
+ *
+ * @returns Status code; see ib_bodystore_append().
+ */
+ib_status_t DLL_PUBLIC ib_bodystore_append_slice(ib_bodystore_t *store,
+                                                 ib_slice_t *slice);
+
+/**
+ * Number of bytes stored, in memory and in the temporary file.
+ *
+ * @param[in] store Body store
+ *
+ * @returns Bytes stored
+ */
+uint64_t DLL_PUBLIC ib_bodystore_length(const ib_bodystore_t *store);
+
+/**
+ * Number of bytes written to the temporary file.
+ *
+ * @param[in] store Body store
+ *
+ * @returns Bytes spilled
+ */
+uint64_t DLL_PUBLIC ib_bodystore_spilled(const ib_bodystore_t *store);
+
+/**
+ * Number of bytes dropped because of the overall limit.
+ *
+ * @param[in] store Body store
+ *
+ * @returns Bytes truncated
+ */
+uint64_t DLL_PUBLIC ib_bodystore_truncated(const ib_bodystore_t *store);
+
+/**
+ * Start iterating over the data of a body store.
+ *
+ * @param[out] iter Iterator
+ * @param[in] store Body store
+ */
+void DLL_PUBLIC ib_bodystore_iter_init(ib_bodystore_iter_t *iter,
+                                       const ib_bodystore_t *store);
+
+/**
+ * Get the next chunk of a body store.
+ *
+ * Chunks kept in memory are returned as they were appended.  Spilled data
+ * is read into a buffer of the store, so a chunk of spilled data is only
+ * valid until the next call for any iterator of the same store.
+ *
+ * @param[in,out] iter Iterator
+ * @param[out] data Chunk data
+ * @param[out] dlen Length of @a data
+ *
+ * @returns Status code:
+ *   - IB_OK on success.
+ *   - IB_ENOENT when there is no more data.
+ *   - IB_EALLOC on memory error.
+ *   - IB_EOTHER if the temporary file could not be read.
+ */
+ib_status_t DLL_PUBLIC ib_bodystore_iter_next(ib_bodystore_iter_t *iter,
+                                              const uint8_t **data,
+                                              size_t *dlen);
+
+/** @} IronBeeUtilBodyStore */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _IB_BODYSTORE_H_ */
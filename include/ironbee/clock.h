@@ -191,6 +191,15 @@ ib_clock_type_t DLL_PUBLIC ib_clock_type(void);
  */
 ib_time_t DLL_PUBLIC ib_clock_get_time(void);
 
+/**
+ * Get the clock time in nanoseconds.
+ * This is ib_clock_get_time() with nanosecond resolution, for measuring
+ * short intervals such as single operator executions.
+ * @note This is not monotonic nor wall time on all platforms.
+ * @returns Nanosecond time value
+ */
+uint64_t DLL_PUBLIC ib_clock_get_time_ns(void);
+
 /**
  * IronBee types version of @c gettimeofday() called with
  * NULL timezone parameter.  The returned time is relative to epoch.
@@ -86,6 +86,9 @@ struct ib_core_cfg_t {
     const ib_logformat_t *auditlog_index_hp; /**< Audit log index fmt helper */
     const char      *auditlog_dir;      /**< Audit log base directory */
     const char      *auditlog_sdir_fmt; /**< Audit log sub-directory format */
+    ib_num_t         auditlog_queue_size; /**< Audit log queue size or 0 */
+    ib_num_t         auditlog_queue_wait; /**< Wait if audit queue is full? */
+    ib_num_t         auditlog_segment_size; /**< Audit log segment size */
     const char      *audit;             /**< Active audit provider key */
     const char      *parser;            /**< Active parser provider key */
     const char      *data;              /**< Active data provider key */
@@ -95,10 +98,66 @@ struct ib_core_cfg_t {
     ib_num_t         rule_log_level;    /**< Rule execution logging level */
     const char      *rule_debug_str;    /**< Rule debug logging level */
     ib_num_t         rule_debug_level;  /**< Rule debug logging level */
+    ib_num_t         rule_profile;      /**< Rule profiling enabled? */
+    ib_num_t         tx_recycle;        /**< Recycle transaction pools? */
+    ib_num_t         body_buffer_limit; /**< Request body bytes in memory */
+    ib_num_t         body_limit;        /**< Request body bytes stored */
+    const char      *body_spill_dir;    /**< Request body spill directory */
     ib_num_t         block_status;      /**< Status codes when blocking. */
     ib_num_t inspection_engine_options; /**< Inspection engine options */
 };
 
+/**
+ * Audit log writer statistics.
+ *
+ * Counted when audit logs are written by a writer thread
+ * (AuditLogQueueSize).
+ */
+typedef struct {
+    uint64_t         queued;            /**< Audit logs queued */
+    uint64_t         written;           /**< Audit logs written */
+    uint64_t         dropped;           /**< Dropped, queue full */
+    uint64_t         waited;            /**< Waits for queue space */
+    uint64_t         errors;            /**< Audit logs failed to write */
+    uint64_t         batches;           /**< Batches written */
+} ib_core_auditlog_stats_t;
+
+/**
+ * Get the audit log writer statistics of an engine.
+ *
+ * @param[in] ib Engine
+ * @param[out] stats Statistics
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_ENOENT if audit logs are written synchronously.
+ */
+ib_status_t DLL_PUBLIC ib_core_auditlog_stats(
+    const ib_engine_t        *ib,
+    ib_core_auditlog_stats_t *stats);
+
+/**
+ * Request body storage statistics.
+ *
+ * See RequestBodyBufferLimit and RequestBodyLimit.
+ */
+typedef struct {
+    uint64_t         bodies_spilled;    /**< Bodies written to disk */
+    uint64_t         bytes_spilled;     /**< Bytes written to disk */
+    uint64_t         bytes_truncated;   /**< Bytes dropped, over the limit */
+} ib_core_body_stats_t;
+
+/**
+ * Get the request body storage statistics of an engine.
+ *
+ * @param[in] ib Engine
+ * @param[out] stats Statistics
+ *
+ * @returns IB_OK
+ */
+ib_status_t DLL_PUBLIC ib_core_body_stats(
+    const ib_engine_t    *ib,
+    ib_core_body_stats_t *stats);
 
 /**
  * @} IronBeeCore
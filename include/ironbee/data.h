@@ -69,6 +69,21 @@ ib_mpool_t DLL_PUBLIC *ib_data_pool(
     const ib_data_t *data
 );
 
+/**
+ * Access the generation of @a data.
+ *
+ * The generation changes whenever an existing field is replaced, removed
+ * or adjusted in place, so callers caching results derived from fields can
+ * detect that a cached field may no longer be current.  Adding a new field
+ * does not change the generation.
+ *
+ * @param[in] data Data to access generation of.
+ * @returns Generation of @a data.
+ */
+size_t DLL_PUBLIC ib_data_generation(
+    const ib_data_t *data
+);
+
 /**
  * Add a data field.
  *
@@ -210,6 +225,54 @@ ib_status_t DLL_PUBLIC ib_data_get_ex(
     ib_field_t      **pf
 );
 
+/**
+ * Precompiled data field selector.
+ *
+ * A selector holds a field name such as @c FOO, @c FOO:bar or
+ * @c FOO:/regex/ parsed once, with any regex filter already compiled, so
+ * that repeated lookups avoid string parsing and regex compilation.
+ */
+typedef struct ib_data_selector_t ib_data_selector_t;
+
+/**
+ * Create a data field selector.
+ *
+ * @param[in] mp Memory pool to allocate from; the compiled filter, if
+ *            any, is released when @a mp is destroyed.
+ * @param[in] name Name as byte string, as accepted by ib_data_get_ex().
+ * @param[in] nlen Name length
+ * @param[out] selector The new selector.
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_EINVAL if @a name contains a malformed or uncompilable filter.
+ * - IB_EALLOC on allocation failure.
+ */
+ib_status_t DLL_PUBLIC ib_data_selector_create(
+    ib_mpool_t                *mp,
+    const char                *name,
+    size_t                     nlen,
+    const ib_data_selector_t **selector
+);
+
+/**
+ * Get a data field using a precompiled selector.
+ *
+ * Equivalent to ib_data_get_ex() with the name @a selector was created
+ * from.
+ *
+ * @param[in] data Data.
+ * @param[in] selector Selector created by ib_data_selector_create().
+ * @param[out] pf Pointer where new field is written. Must not be NULL.
+ *
+ * @returns IB_OK on success or IB_ENOENT if the element is not found.
+ */
+ib_status_t DLL_PUBLIC ib_data_get_selector(
+    const ib_data_t          *data,
+    const ib_data_selector_t *selector,
+    ib_field_t              **pf
+);
+
 /**
  * Get all data fields from a data provider instance.
  *
@@ -26,12 +26,14 @@
  */
 
 #include <ironbee/array.h>
+#include <ironbee/bodystore.h>
 #include <ironbee/clock.h>
 #include <ironbee/data.h>
 #include <ironbee/hash.h>
 #include <ironbee/mpool.h>
 #include <ironbee/parsed_content.h>
 #include <ironbee/rule_defs.h>
+#include <ironbee/slice.h>
 #include <ironbee/stream.h>
 #include <ironbee/types.h>
 #include <ironbee/uuid.h>
@@ -158,10 +160,16 @@ typedef enum {
     IB_CTYPE_CUSTOM,
 } ib_ctype_t;
 
-/** Transaction Data Structure */
+/**
+ * Transaction Data Structure
+ *
+ * When @a slice is set, @a data and @a dlen are its data and a hook may
+ * take a reference to the slice rather than copy the data.
+ */
 struct ib_txdata_t {
     size_t              dlen;            /**< Data buffer length */
     uint8_t            *data;            /**< Data buffer */
+    ib_slice_t         *slice;           /**< Slice holding data or NULL */
 };
 
 /** Connection Structure */
@@ -192,6 +200,7 @@ struct ib_conn_t {
     ib_tx_t            *tx_first;        /**< First transaction in the list */
     ib_tx_t            *tx;              /**< Pending transaction(s) */
     ib_tx_t            *tx_last;         /**< Last transaction in the list */
+    ib_tx_t            *tx_recycle;      /**< Finished transaction shells */
 
     ib_flags_t          flags;           /**< Connection flags */
 };
@@ -237,12 +246,12 @@ struct ib_tx_t {
     /* Request */
     ib_parsed_req_line_t *request_line;  /**< Request line */
     ib_parsed_header_wrapper_t *request_header;/**< Request header */
-    ib_stream_t        *request_body;    /**< Request body (up to a limit) */
+    ib_bodystore_t     *request_body;    /**< Request body (up to a limit) */
 
     /* Response */
     ib_parsed_resp_line_t *response_line; /**< Response line */
     ib_parsed_header_wrapper_t *response_header; /**< Response header */
-    ib_stream_t        *response_body;   /**< Response body (up to a limit) */
+    ib_bodystore_t     *response_body;   /**< Response body (up to a limit) */
 };
 
 
@@ -56,6 +56,9 @@ extern "C" {
  *   common parent.
  * - A and B can be simultaneously created even if they share a common parent.
  *
+ * Neither case takes a lock: children are added to and reused from the
+ * child list of their parent with atomic operations.
+ *
  * Furthermore, all allocation routines can be called on A and B as long as
  * A and B are distinct, i.e, even if one is a descendant of the other.
  *
@@ -76,6 +79,11 @@ extern "C" {
  * for a memory pool.  Largely page sizes will mean higher runtime performance
  * and higher memory wastage.  The minimum pagesize is currently 1024.
  *
+ * Pages of destroyed pools that use the default pagesize, malloc(), and
+ * free() are kept in a per thread cache, bounded in size, and reused by
+ * later pools before new pages are allocated.  This makes short lived pools,
+ * such as one per transaction, cheap to create and destroy.
+ *
  * @section Valgrind
  *
  * If mpool.c is compiled with IB_MPOOL_VALGRIND defined then additional code
@@ -132,7 +140,6 @@ typedef void (*ib_mpool_free_fn_t)(void *ptr);
  * - IB_OK     -- Success.
  * - IB_EINVAL -- @a pmp is NULL.
  * - IB_EALLOC -- Allocation error.
- * - Other     -- Locking failure, see ib_lock_lock().
  */
 ib_status_t DLL_PUBLIC ib_mpool_create(
     ib_mpool_t **pmp,
@@ -165,7 +172,6 @@ ib_status_t DLL_PUBLIC ib_mpool_create(
  * - IB_OK     -- Success.
  * - IB_EINVAL -- @a pmp is NULL.
  * - IB_EALLOC -- Allocation error.
- * - Other     -- Locking failure, see ib_lock_lock().
  */
 ib_status_t DLL_PUBLIC ib_mpool_create_ex(
     ib_mpool_t           **pmp,
@@ -316,6 +322,9 @@ void DLL_PUBLIC ib_mpool_clear(
  *
  * This is similar to ib_mpool_clear() except that it returns the memory to
  * the underlying memory system and destroys itself and its descendants.
+ * Pages may be kept in the thread cache instead (see Performance) and the
+ * structure of a pool with a parent is kept for reuse by the parent until
+ * the parent is destroyed.
  *
  * @a mp or any descendant should not be used after calling this.
  *
@@ -332,9 +341,9 @@ void DLL_PUBLIC ib_mpool_destroy(
  *
  * If @a mp has no parent, this is identical to ib_mpool_destroy().  If @a mp
  * has a parent, then this is semantically identical to ib_mpool_destroy(),
- * but instead of freeing the pool, it is added to the free subpool list of
- * its parent and will be reused the next time ib_mpool_create() is called
- * with the parent.
+ * but instead of freeing the pool, it is marked free with its parent and
+ * will be reused the next time ib_mpool_create() is called with the
+ * parent.
  *
  * In the presence of a parent, release is significantly faster than destroy
  * but does not return memory to malloc/free.  It is a good choice if new
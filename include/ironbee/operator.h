@@ -37,6 +37,7 @@
 #include <ironbee/build.h>
 #include <ironbee/engine.h>
 #include <ironbee/field.h>
+#include <ironbee/list.h>
 #include <ironbee/rule_defs.h>
 #include <ironbee/types.h>
 
@@ -132,6 +133,14 @@ struct ib_operator_inst_t {
     void                 *data;    /**< Data passed to the execute function */
     char                 *params;  /**< Parameters passed to create */
     ib_field_t           *fparam;  /**< Parameters as a field */
+
+    /**
+     * Literals (const ib_bytestr_t *), one of which is in every value the
+     * operator is true for (or NULL).  May be set by the create function;
+     * the rule engine then only executes the operator on values which
+     * contain one of them.
+     */
+    const ib_list_t      *prefilter;
 };
 
 /** Operator instance flags */
@@ -87,6 +87,7 @@ struct ib_rule_t {
     ib_rule_t             *chained_from;    /**< Ptr to rule chained from */
     const char            *capture_collection; /**< Capture collection name */
     ib_flags_t             flags;           /**< External, etc. */
+    size_t                 profile_index;   /**< Index of profile counters */
 };
 
 /**
@@ -96,6 +97,33 @@ typedef struct {
     ib_rule_t             *previous;     /**< Previous rule parsed */
 } ib_rule_parser_data_t;
 
+/**
+ * Rule profiling counters
+ *
+ * Collected for every rule executed in a context with rule profiling
+ * enabled (RuleEngineProfile).  Times are in nanoseconds.
+ */
+typedef struct {
+    const ib_rule_t       *rule;            /**< The rule */
+    uint64_t               invocations;     /**< Number of executions */
+    uint64_t               targets;         /**< Number of targets operated on */
+    uint64_t               true_results;    /**< Executions with true result */
+    uint64_t               false_results;   /**< Executions with false result */
+    uint64_t               tfn_nsec;        /**< Time in transformations */
+    uint64_t               operator_nsec;   /**< Time in the operator */
+    uint64_t               action_nsec;     /**< Time in actions */
+} ib_rule_profile_t;
+
+/**
+ * Per-thread rule profiling counters (opaque)
+ */
+typedef struct ib_rule_profile_block_t ib_rule_profile_block_t;
+
+/**
+ * Per-transaction transformation result cache (opaque)
+ */
+typedef struct ib_rule_tfn_cache_t ib_rule_tfn_cache_t;
+
 /**
  * Rule execution data
  */
@@ -123,6 +151,15 @@ struct ib_rule_exec_t {
 
     /* Stack of values for the FIELD* targets */
     ib_list_t              *value_stack; /**< Stack of values */
+
+    /* Transformation results shared by all rules of the transaction */
+    ib_rule_tfn_cache_t    *tfn_cache;   /**< Transformation cache */
+
+    /* Merged literal operator results of the transaction */
+    ib_hash_t              *literal_cache; /**< Literal set results */
+
+    /* Profiling counters of the executing thread (NULL if not profiling) */
+    ib_rule_profile_block_t *profile;    /**< Profiling counters */
 };
 
 /**
@@ -808,6 +845,56 @@ ib_status_t DLL_PUBLIC ib_rule_chain_invalidate(
 ib_mpool_t DLL_PUBLIC *ib_rule_mpool(
     ib_engine_t                *ib);
 
+/**
+ * Get the transformation cache statistics of a transaction.
+ *
+ * Transformation results are cached per transaction, keyed by the
+ * transformation and the identity and value of its input field, so that
+ * rules applying the same transformations to the same fields share work.
+ *
+ * @param[in] rule_exec Rule execution object
+ * @param[out] entries Number of cached results (or NULL)
+ * @param[out] hits Number of cache hits (or NULL)
+ * @param[out] misses Number of cache misses (or NULL)
+ */
+void DLL_PUBLIC ib_rule_tfn_cache_stats(
+    const ib_rule_exec_t       *rule_exec,
+    size_t                     *entries,
+    size_t                     *hits,
+    size_t                     *misses);
+
+/**
+ * Get a snapshot of the rule profiling counters.
+ *
+ * Counters are summed across all threads.  This neither allocates memory
+ * nor takes locks, so it may be called at any time, including from a
+ * signal handler; counters being updated concurrently may be slightly
+ * behind.
+ *
+ * @param[in] ib IronBee engine
+ * @param[out] profiles Array to fill, indexed by ib_rule_t::profile_index
+ * @param[in] count Number of elements in @a profiles
+ *
+ * @returns Number of rules with profile counters, which may be larger
+ * than @a count.
+ */
+size_t DLL_PUBLIC ib_rule_profile_snapshot(
+    const ib_engine_t          *ib,
+    ib_rule_profile_t          *profiles,
+    size_t                      count);
+
+/**
+ * Log the rule profiling counters.
+ *
+ * Every executed rule is logged, most expensive first.  Does nothing if
+ * no rule was profiled.  This is done automatically when the engine is
+ * destroyed.
+ *
+ * @param[in] ib IronBee engine
+ */
+void DLL_PUBLIC ib_rule_profile_log(
+    const ib_engine_t          *ib);
+
 /**
  * Perform logging of a rule's execution
  *
@@ -0,0 +1,159 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef _IB_SLICE_H_
+#define _IB_SLICE_H_
+
+/**
+ * @file
+ * @brief IronBee --- Buffer Slice Routines
+ */
+
+#include <ironbee/build.h>
+#include <ironbee/mpool.h>
+#include <ironbee/types.h>
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup IronBeeUtilSlice Buffer Slices
+ * @ingroup IronBeeUtil
+ *
+ * Reference counted views of buffers owned by someone else.
+ *
+ * A server creates a slice over a buffer it owns, with a callback which
+ * gives the buffer back.  Anyone who needs the data to outlive a call takes
+ * a reference instead of copying it; the callback is called when the last
+ * reference is released.  A sub-slice is a view of part of a slice and
+ * keeps the whole slice alive.
+ *
+ * Reference counts are atomic, so the last reference may be released by
+ * any thread.
+ *
+ * @{
+ */
+
+typedef struct ib_slice_t ib_slice_t;
+
+/**
+ * Slice release callback.
+ *
+ * Called when the last reference to a slice is released.
+ *
+ * @param[in] data Data of the slice
+ * @param[in] dlen Length of @a data
+ * @param[in] cbdata Callback data
+ */
+typedef void (*ib_slice_release_fn_t)(const uint8_t *data,
+                                      size_t dlen,
+                                      void *cbdata);
+
+/**
+ * Create a slice over a buffer.
+ *
+ * The caller holds the single reference to the new slice.
+ *
+ * @param[out] pslice Address which new slice is written
+ * @param[in] data Data
+ * @param[in] dlen Length of @a data
+ * @param[in] release Called when the last reference is released (or NULL)
+ * @param[in] cbdata Callback data for @a release
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_slice_create(ib_slice_t **pslice,
+                                       const uint8_t *data,
+                                       size_t dlen,
+                                       ib_slice_release_fn_t release,
+                                       void *cbdata);
+
+/**
+ * Create a slice over part of another slice.
+ *
+ * The new slice holds a reference to @a slice; the caller holds the single
+ * reference to the new slice.
+ *
+ * @param[out] psub Address which new slice is written
+ * @param[in] slice Slice
+ * @param[in] offset Offset of the data in @a slice
+ * @param[in] dlen Length of the data
+ *
+ * @returns Status code:
+ *   - IB_OK on success.
+ *   - IB_EINVAL if the range is not within @a slice.
+ *   - IB_EALLOC on memory error.
+ */
+ib_status_t DLL_PUBLIC ib_slice_sub(ib_slice_t **psub,
+                                    ib_slice_t *slice,
+                                    size_t offset,
+                                    size_t dlen);
+
+/**
+ * Take a reference to a slice.
+ *
+ * @param[in] slice Slice
+ */
+void DLL_PUBLIC ib_slice_ref(ib_slice_t *slice);
+
+/**
+ * Release a reference to a slice.
+ *
+ * @param[in] slice Slice
+ */
+void DLL_PUBLIC ib_slice_release(ib_slice_t *slice);
+
+/**
+ * Take a reference to a slice which is released with a memory pool.
+ *
+ * @param[in] slice Slice
+ * @param[in] mp Memory pool; the reference is released when it is cleared
+ *            or destroyed
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_slice_ref_mpool(ib_slice_t *slice,
+                                          ib_mpool_t *mp);
+
+/**
+ * Data of a slice.
+ *
+ * @param[in] slice Slice
+ *
+ * @returns Data
+ */
+const uint8_t DLL_PUBLIC *ib_slice_data(const ib_slice_t *slice);
+
+/**
+ * Length of a slice.
+ *
+ * @param[in] slice Slice
+ *
+ * @returns Length of the data
+ */
+size_t DLL_PUBLIC ib_slice_length(const ib_slice_t *slice);
+
+/** @} IronBeeUtilSlice */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _IB_SLICE_H_ */
@@ -133,6 +133,24 @@ ib_status_t DLL_PUBLIC ib_state_notify_request_body_data(ib_engine_t *ib,
                                                          ib_tx_t *tx,
                                                          ib_txdata_t *txdata);
 
+/**
+ * Notify the state machine that more request body data is available in a
+ * slice.
+ *
+ * As ib_state_notify_request_body_data(), but the engine takes references
+ * to @a slice instead of copying data it keeps past the call.  The caller
+ * keeps its own reference.
+ *
+ * @param ib Engine handle
+ * @param tx Transaction
+ * @param slice Request body data
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_state_notify_request_body_slice(ib_engine_t *ib,
+                                                          ib_tx_t *tx,
+                                                          ib_slice_t *slice);
+
 /**
  * Notify the state machine that the entire request is finished.
  *
@@ -200,6 +218,24 @@ ib_status_t DLL_PUBLIC ib_state_notify_response_body_data(ib_engine_t *ib,
                                                           ib_tx_t *tx,
                                                           ib_txdata_t *txdata);
 
+/**
+ * Notify the state machine that more response body data is available in a
+ * slice.
+ *
+ * As ib_state_notify_response_body_data(), but the engine takes references
+ * to @a slice instead of copying data it keeps past the call.  The caller
+ * keeps its own reference.
+ *
+ * @param ib Engine handle
+ * @param tx Transaction
+ * @param slice Response body data
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_state_notify_response_body_slice(ib_engine_t *ib,
+                                                           ib_tx_t *tx,
+                                                           ib_slice_t *slice);
+
 /**
  * Notify the state machine that the entire response is finished.
  *
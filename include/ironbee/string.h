@@ -236,6 +236,25 @@ const char DLL_PUBLIC *ib_strstr_ex(const char *haystack,
                                     const char *needle,
                                     size_t      needle_len);
 
+/**
+ * Case insensitive strstr() clone that works with non-NUL terminated
+ * strings.
+ *
+ * Only ASCII letters are folded.
+ *
+ * @param[in] haystack String to search.
+ * @param[in] haystack_len Length of @a haystack.
+ * @param[in] needle String to search for.
+ * @param[in] needle_len Length of @a needle.
+ *
+ * @returns Pointer to the first match in @a haystack, or NULL if no match
+ * found.
+ */
+const char DLL_PUBLIC *ib_strcasestr_ex(const char *haystack,
+                                        size_t      haystack_len,
+                                        const char *needle,
+                                        size_t      needle_len);
+
 /**
  * Reverse strstr() clone that works with non-NUL terminated strings.
  *
@@ -19,7 +19,20 @@
  * @file
  * @brief IronBee --- AhoCorasick Matcher Module
  *
- * This module adds an AhoCorasick based matcher named "ac".
+ * This module adds an AhoCorasick based matcher named "ac" and the @c pm and
+ * @c pmf operators.
+ *
+ * By default, the operators build an @ref ib_ac_t tree of their pattern
+ * lists.  If the @c PmCacheDir directive is given, Eudoxus automata compiled
+ * earlier are mapped from that directory instead.  With @c PmCompile @c On,
+ * which requires C++ support, pattern lists not found there are compiled
+ * into automata at configuration time and written to the directory, if
+ * any.
+ * Automata are shared by all operators with the same pattern list.
+ *
+ * Compiling takes far longer than building a tree and automata usually
+ * scan slower, so trees remain the default; mapped automata save memory and
+ * configuration time.
  *
  * @author Pablo Rincon <pablo.rincon.crespo@gmail.com>
  */
@@ -28,9 +41,11 @@
 #include <ironbee/bytestr.h>
 #include <ironbee/capture.h>
 #include <ironbee/cfgmap.h>
+#include <ironbee/config.h>
 #include <ironbee/engine.h>
 #include <ironbee/escape.h>
 #include <ironbee/field.h>
+#include <ironbee/hash.h>
 #include <ironbee/module.h>
 #include <ironbee/mpool.h>
 #include <ironbee/operator.h>
@@ -41,10 +56,15 @@
 #include <ironbee/types.h>
 #include <ironbee/util.h>
 
+#include <ironautomata/eudoxus.h>
+
+#include "ac_private.h"
+
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -66,7 +86,6 @@
 #define AC_MINOR           1
 #define AC_DATE            20110812
 
-typedef struct modac_cfg_t modac_cfg_t;
 typedef struct modac_cpatt_t modac_cpatt_t;
 
 /* Define the public module symbol. */
@@ -89,10 +108,20 @@ typedef struct modac_provider_data_t modac_provider_data_t;
  * stored in tx.
  */
 struct modac_workspace_t {
-    ib_ac_context_t *ctx; /**< Context. */
+    ib_ac_context_t    *ctx;       /**< Context (AC tree). */
+    ia_eudoxus_state_t *state;     /**< State (automata). */
+    ib_num_t            match_cnt; /**< Matches so far (automata). */
 };
 typedef struct modac_workspace_t modac_workspace_t;
 
+/**
+ * Size of a pattern key including the NUL.
+ *
+ * A key is a 64 bit hash in hex and two numbers of at most 20 digits, all
+ * separated by dashes.
+ */
+#define MODAC_KEY_SIZE (16 + 1 + 20 + 1 + 20 + 1)
+
 /* -- Helper Internal Functions -- */
 
 /**
@@ -148,25 +177,76 @@ static ib_status_t get_or_create_rule_data_hash(ib_tx_t *tx,
 
 }
 
+/**
+ * Count an automata match and stop.
+ *
+ * Patterns are only matched to find whether any matches, so execution stops
+ * at the first match.
+ *
+ * @param[in] engine Ignored.
+ * @param[in] output Ignored.
+ * @param[in] output_length Ignored.
+ * @param[in] input_location Ignored.
+ * @param[in] callback_data Match counter (ib_num_t).
+ *
+ * @returns IA_EUDOXUS_CMD_STOP
+ */
+static ia_eudoxus_command_t modac_eudoxus_match(
+    ia_eudoxus_t  *engine,
+    const char    *output,
+    size_t         output_length,
+    const uint8_t *input_location,
+    void          *callback_data
+)
+{
+    assert(callback_data != NULL);
+
+    ++*(ib_num_t *)callback_data;
+
+    return IA_EUDOXUS_CMD_STOP;
+}
+
+/**
+ * Memory pool cleanup destroying an automata.
+ *
+ * @param[in] data Automata (ia_eudoxus_t).
+ */
+static void modac_eudoxus_cleanup(void *data)
+{
+    ia_eudoxus_destroy((ia_eudoxus_t *)data);
+}
+
+/**
+ * Memory pool cleanup destroying an automata execution state.
+ *
+ * @param[in] data State (ia_eudoxus_state_t).
+ */
+static void modac_eudoxus_state_cleanup(void *data)
+{
+    ia_eudoxus_destroy_state((ia_eudoxus_state_t *)data);
+}
+
 /**
  * Create the per-transaction data for use with the dfa operator.
  *
  * @param[in,out] tx Transaction to store the value in.
- * @param[in] ac The Ahocorasic engine object.
+ * @param[in] opdata The operator data whose automata or AC tree is used.
  * @param[in] id The operator identifier used to get it's workspace.
  * @param[out] workspace Created.
  *
  * @returns
  *   - IB_OK on success.
  *   - IB_EALLOC on an allocation error.
+ *   - IB_EOTHER if the automata execution state could not be created.
  */
 static ib_status_t alloc_ac_tx_data(ib_tx_t *tx,
-                                    ib_ac_t *ac,
+                                    const modac_operator_data_t *opdata,
                                     const char *id,
                                     modac_workspace_t **workspace)
 {
     assert(tx);
     assert(tx->mp);
+    assert(opdata);
     assert(id);
     assert(workspace);
 
@@ -178,20 +258,45 @@ static ib_status_t alloc_ac_tx_data(ib_tx_t *tx,
         return rc;
     }
 
-    *workspace = (modac_workspace_t *)ib_mpool_alloc(tx->mp,
-                                                     sizeof(**workspace));
+    *workspace = (modac_workspace_t *)ib_mpool_calloc(tx->mp, 1,
+                                                      sizeof(**workspace));
 
     if (*workspace == NULL) {
         return IB_EALLOC;
     }
 
-    (*workspace)->ctx =
-        (ib_ac_context_t *)ib_mpool_alloc(tx->mp, sizeof(*(*workspace)->ctx));
-    if ((*workspace)->ctx == NULL) {
-        return IB_EALLOC;
+    if (opdata->eudoxus != NULL) {
+        ia_eudoxus_result_t irc;
+
+        irc = ia_eudoxus_create_state(&(*workspace)->state,
+                                      opdata->eudoxus,
+                                      modac_eudoxus_match,
+                                      &(*workspace)->match_cnt);
+        if (irc == IA_EUDOXUS_EALLOC) {
+            return IB_EALLOC;
+        }
+        else if (irc != IA_EUDOXUS_OK && irc != IA_EUDOXUS_STOP) {
+            return IB_EOTHER;
+        }
+
+        rc = ib_mpool_cleanup_register(tx->mp,
+                                       modac_eudoxus_state_cleanup,
+                                       (*workspace)->state);
+        if (rc != IB_OK) {
+            ia_eudoxus_destroy_state((*workspace)->state);
+            return rc;
+        }
     }
+    else {
+        (*workspace)->ctx =
+            (ib_ac_context_t *)ib_mpool_alloc(tx->mp,
+                                              sizeof(*(*workspace)->ctx));
+        if ((*workspace)->ctx == NULL) {
+            return IB_EALLOC;
+        }
 
-    ib_ac_init_ctx((*workspace)->ctx, ac);
+        ib_ac_init_ctx((*workspace)->ctx, opdata->ac);
+    }
 
     rc = ib_hash_set(rule_data, id, *workspace);
     if (rc != IB_OK) {
@@ -512,6 +617,573 @@ static ib_status_t readfile(const ib_engine_t *ib,
     return IB_OK;
 }
 
+
+/**
+ * Pattern list of a pm or pmf operator.
+ *
+ * The patterns point into buffers owned by the operator create function.
+ */
+struct modac_patterns_t {
+    const char **patterns; /**< Patterns; not NUL terminated. */
+    size_t      *lengths;  /**< Lengths of patterns. */
+    size_t       n;        /**< Number of patterns. */
+    size_t       size;     /**< Allocated length of the arrays. */
+};
+typedef struct modac_patterns_t modac_patterns_t;
+
+/**
+ * Append a pattern to a pattern list.
+ *
+ * @param[in,out] patterns Pattern list.
+ * @param[in] pattern Pattern; must outlive @a patterns.
+ * @param[in] length Length of @a pattern.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC on an allocation error.
+ */
+static ib_status_t modac_patterns_add(modac_patterns_t *patterns,
+                                      const char *pattern,
+                                      size_t length)
+{
+    assert(patterns);
+    assert(pattern);
+
+    if (patterns->n == patterns->size) {
+        size_t size = (patterns->size == 0) ? 64 : 2 * patterns->size;
+        const char **new_patterns;
+        size_t *new_lengths;
+
+        new_patterns = realloc(patterns->patterns,
+                               size * sizeof(*new_patterns));
+        if (new_patterns == NULL) {
+            return IB_EALLOC;
+        }
+        patterns->patterns = new_patterns;
+
+        new_lengths = realloc(patterns->lengths,
+                              size * sizeof(*new_lengths));
+        if (new_lengths == NULL) {
+            return IB_EALLOC;
+        }
+        patterns->lengths = new_lengths;
+
+        patterns->size = size;
+    }
+
+    patterns->patterns[patterns->n] = pattern;
+    patterns->lengths[patterns->n] = length;
+    ++patterns->n;
+
+    return IB_OK;
+}
+
+/**
+ * Release the arrays of a pattern list.
+ *
+ * @param[in] patterns Pattern list.
+ */
+static void modac_patterns_free(modac_patterns_t *patterns)
+{
+    assert(patterns);
+
+    free(patterns->patterns);
+    free(patterns->lengths);
+}
+
+/**
+ * Compute the key of a pattern list.
+ *
+ * The key is a 64 bit FNV-1a hash of the patterns and their lengths,
+ * followed by the number of patterns and their total length.  It is used
+ * to share automata between operators and as the name of cached automata
+ * files.
+ *
+ * @param[in] patterns Pattern list.
+ * @param[out] key Buffer of at least MODAC_KEY_SIZE bytes.
+ */
+static void modac_pattern_key(const modac_patterns_t *patterns,
+                              char *key)
+{
+    assert(patterns);
+    assert(key);
+
+    uint64_t hash = UINT64_C(14695981039346656037);
+    size_t total = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < patterns->n; ++i) {
+        const uint8_t *p = (const uint8_t *)patterns->patterns[i];
+        size_t length = patterns->lengths[i];
+
+        /* Hash the length too, so that "ab" "c" and "a" "bc" differ. */
+        for (j = 0; j < sizeof(length); ++j) {
+            hash ^= (length >> (8 * j)) & 0xff;
+            hash *= UINT64_C(1099511628211);
+        }
+        for (j = 0; j < length; ++j) {
+            hash ^= p[j];
+            hash *= UINT64_C(1099511628211);
+        }
+        total += length;
+    }
+
+    snprintf(key, MODAC_KEY_SIZE, "%016" PRIx64 "-%zu-%zu",
+             hash, patterns->n, total);
+}
+
+/**
+ * Fetch the automata cache, creating it on first use.
+ *
+ * @param[in] ib IronBee engine.
+ *
+ * @returns The cache or NULL on failure.
+ */
+static modac_cache_t *modac_get_cache(ib_engine_t *ib)
+{
+    assert(ib);
+
+    ib_module_t  *module;
+    modac_cfg_t  *config;
+    ib_status_t   rc;
+
+    rc = ib_engine_module_get(ib, MODULE_NAME_STR, &module);
+    if (rc != IB_OK) {
+        return NULL;
+    }
+
+    rc = ib_context_module_config(ib_context_main(ib), module, &config);
+    if (rc != IB_OK) {
+        return NULL;
+    }
+
+    if (config->cache == NULL) {
+        modac_cache_t *cache;
+        ib_mpool_t *mp = ib_engine_pool_main_get(ib);
+
+        cache = ib_mpool_calloc(mp, 1, sizeof(*cache));
+        if (cache == NULL) {
+            return NULL;
+        }
+        cache->mp = mp;
+
+        rc = ib_hash_create(&cache->automata, mp);
+        if (rc != IB_OK) {
+            return NULL;
+        }
+
+        config->cache = cache;
+    }
+
+    return config->cache;
+}
+
+/**
+ * Add an automata to the cache.
+ *
+ * On failure, @a eudoxus is destroyed.
+ *
+ * @param[in] cache Automata cache.
+ * @param[in] key Pattern key.
+ * @param[in] eudoxus Automata; owned by the cache on success.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC on an allocation error.
+ */
+static ib_status_t modac_cache_add(modac_cache_t *cache,
+                                   const char *key,
+                                   ia_eudoxus_t *eudoxus)
+{
+    assert(cache);
+    assert(key);
+    assert(eudoxus);
+
+    ib_status_t rc;
+    const char *key_copy;
+
+    rc = ib_mpool_cleanup_register(cache->mp,
+                                   modac_eudoxus_cleanup,
+                                   eudoxus);
+    if (rc != IB_OK) {
+        ia_eudoxus_destroy(eudoxus);
+        return rc;
+    }
+
+    key_copy = ib_mpool_strdup(cache->mp, key);
+    if (key_copy == NULL) {
+        return IB_EALLOC;
+    }
+
+    return ib_hash_set(cache->automata, key_copy, eudoxus);
+}
+
+/**
+ * Path of the cached automata file of a pattern key.
+ *
+ * @param[in] mp Memory pool to allocate from.
+ * @param[in] cache Automata cache; must have a directory.
+ * @param[in] key Pattern key.
+ *
+ * @returns The path or NULL on allocation failure.
+ */
+static const char *modac_cache_path(ib_mpool_t *mp,
+                                    const modac_cache_t *cache,
+                                    const char *key)
+{
+    assert(mp);
+    assert(cache);
+    assert(cache->dir);
+    assert(key);
+
+    char file[MODAC_KEY_SIZE + sizeof(".e")];
+
+    snprintf(file, sizeof(file), "%s.e", key);
+
+    return ib_util_path_join(mp, cache->dir, file);
+}
+
+/**
+ * Map the cached automata file of a pattern key.
+ *
+ * Files that do not carry @a key as their metadata are ignored.
+ *
+ * @param[in] ib IronBee engine.
+ * @param[in] path Path of the cached automata.
+ * @param[in] key Pattern key.
+ * @param[out] eudoxus Mapped automata.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_ENOENT if there is no usable file at @a path.
+ */
+static ib_status_t modac_cache_load(ib_engine_t *ib,
+                                    const char *path,
+                                    const char *key,
+                                    ia_eudoxus_t **eudoxus)
+{
+    assert(ib);
+    assert(path);
+    assert(key);
+    assert(eudoxus);
+
+    ia_eudoxus_result_t irc;
+    const uint8_t *value;
+    size_t value_length;
+
+    if (access(path, R_OK) != 0) {
+        return IB_ENOENT;
+    }
+
+    irc = ia_eudoxus_create_from_path_mmap(eudoxus, path);
+    if (irc != IA_EUDOXUS_OK) {
+        ib_log_warning(ib,
+                       MODULE_NAME_STR ": Ignoring cached automata %s: "
+                       "error loading it[%d].",
+                       path, irc);
+        return IB_ENOENT;
+    }
+
+    irc = ia_eudoxus_metadata_with_key(
+        *eudoxus,
+        (const uint8_t *)MODAC_PATTERN_KEY, sizeof(MODAC_PATTERN_KEY) - 1,
+        &value, &value_length
+    );
+    if (
+        irc != IA_EUDOXUS_OK ||
+        value_length != strlen(key) ||
+        memcmp(value, key, value_length) != 0
+    ) {
+        ib_log_warning(ib,
+                       MODULE_NAME_STR ": Ignoring cached automata %s: "
+                       "pattern key does not match.",
+                       path);
+        ia_eudoxus_destroy(*eudoxus);
+        *eudoxus = NULL;
+        return IB_ENOENT;
+    }
+
+    return IB_OK;
+}
+
+#ifdef MODAC_EUDOXUS
+/**
+ * Write a compiled automata to the cache directory.
+ *
+ * The automata is written to a temporary file that is then renamed, so
+ * that concurrently starting engines never see a partial file.
+ *
+ * @param[in] ib IronBee engine.
+ * @param[in] mp Memory pool for temporary allocations.
+ * @param[in] path Path of the cached automata.
+ * @param[in] automata Compiled automata.
+ * @param[in] automata_length Length of @a automata.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC on an allocation error.
+ *   - IB_EOTHER if the file could not be written; will log.
+ */
+static ib_status_t modac_cache_write(ib_engine_t *ib,
+                                     ib_mpool_t *mp,
+                                     const char *path,
+                                     const char *automata,
+                                     size_t automata_length)
+{
+    assert(ib);
+    assert(mp);
+    assert(path);
+    assert(automata);
+
+    char *tmp_path;
+    size_t tmp_path_size = strlen(path) + 32;
+    FILE *fp;
+    size_t written;
+
+    tmp_path = ib_mpool_alloc(mp, tmp_path_size);
+    if (tmp_path == NULL) {
+        return IB_EALLOC;
+    }
+    snprintf(tmp_path, tmp_path_size, "%s.%ld.tmp", path, (long)getpid());
+
+    fp = fopen(tmp_path, "wb");
+    if (fp == NULL) {
+        ib_log_warning(ib,
+                       MODULE_NAME_STR ": Failed to open %s for writing: %s",
+                       tmp_path, strerror(errno));
+        return IB_EOTHER;
+    }
+
+    written = fwrite(automata, 1, automata_length, fp);
+    if (fclose(fp) != 0 || written != automata_length) {
+        ib_log_warning(ib,
+                       MODULE_NAME_STR ": Failed to write %s: %s",
+                       tmp_path, strerror(errno));
+        unlink(tmp_path);
+        return IB_EOTHER;
+    }
+
+    if (rename(tmp_path, path) != 0) {
+        ib_log_warning(ib,
+                       MODULE_NAME_STR ": Failed to rename %s to %s: %s",
+                       tmp_path, path, strerror(errno));
+        unlink(tmp_path);
+        return IB_EOTHER;
+    }
+
+    return IB_OK;
+}
+
+/**
+ * Compile a pattern list into an automata.
+ *
+ * If the cache has a directory, the automata is written there and mapped
+ * from the written file.
+ *
+ * @param[in] ib IronBee engine.
+ * @param[in] mp Memory pool for temporary allocations.
+ * @param[in] path Path of the cached automata or NULL.
+ * @param[in] patterns Pattern list.
+ * @param[in] key Pattern key of @a patterns.
+ * @param[out] eudoxus Compiled automata.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC on an allocation error.
+ *   - IB_EOTHER if compilation failed; will log.
+ */
+static ib_status_t modac_compile_automata(ib_engine_t *ib,
+                                          ib_mpool_t *mp,
+                                          const char *path,
+                                          const modac_patterns_t *patterns,
+                                          const char *key,
+                                          ia_eudoxus_t **eudoxus)
+{
+    assert(ib);
+    assert(mp);
+    assert(patterns);
+    assert(key);
+    assert(eudoxus);
+
+    ib_status_t rc;
+    ia_eudoxus_result_t irc;
+    char *automata;
+    size_t automata_length;
+    clock_t start = clock();
+
+    rc = modac_eudoxus_compile(&automata, &automata_length,
+                               patterns->patterns, patterns->lengths,
+                               patterns->n, key);
+    if (rc != IB_OK) {
+        ib_log_error(ib,
+                     MODULE_NAME_STR ": Failed to compile %zu patterns: %s",
+                     patterns->n, ib_status_to_string(rc));
+        return rc;
+    }
+
+    ib_log_debug(ib,
+                 MODULE_NAME_STR ": Compiled %zu patterns into %zu bytes "
+                 "in %.3f s.",
+                 patterns->n, automata_length,
+                 (double)(clock() - start) / CLOCKS_PER_SEC);
+
+    if (path != NULL) {
+        rc = modac_cache_write(ib, mp, path, automata, automata_length);
+        if (rc == IB_OK) {
+            free(automata);
+            return modac_cache_load(ib, path, key, eudoxus) == IB_OK ?
+                IB_OK : IB_EOTHER;
+        }
+        /* Not fatal; use the automata from memory. */
+    }
+
+    irc = ia_eudoxus_create(eudoxus, automata);
+    if (irc != IA_EUDOXUS_OK) {
+        free(automata);
+        ib_log_error(ib,
+                     MODULE_NAME_STR ": Failed to load compiled automata[%d].",
+                     irc);
+        return IB_EOTHER;
+    }
+
+    return IB_OK;
+}
+#endif
+
+/**
+ * Create a fallback AC tree of a pattern list.
+ *
+ * @param[in] pool Memory pool of the tree.
+ * @param[in] patterns Pattern list.
+ * @param[out] ac Created tree.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - Other on failure of ib_ac_t functions.
+ */
+static ib_status_t modac_create_ac(ib_mpool_t *pool,
+                                   const modac_patterns_t *patterns,
+                                   ib_ac_t **ac)
+{
+    assert(pool);
+    assert(patterns);
+    assert(ac);
+
+    ib_status_t rc;
+    size_t i;
+
+    rc = ib_ac_create(ac, 0, pool);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    for (i = 0; i < patterns->n; ++i) {
+        /* Patterns are NUL terminated in the operator buffers. */
+        rc = ib_ac_add_pattern(*ac, patterns->patterns[i],
+                               &nop_ac_match, NULL, 0);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+
+    return ib_ac_build_links(*ac);
+}
+
+/**
+ * Create the operator data of a pattern list.
+ *
+ * Looks the pattern list up in the automata cache, then in the cache
+ * directory, and otherwise, if @c PmCompile is on, compiles it.  If no
+ * automata is available, an AC tree is built instead.
+ *
+ * @param[in] ib IronBee engine.
+ * @param[in] pool Memory pool of the operator.
+ * @param[in] patterns Pattern list.
+ * @param[out] opdata Created operator data.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC on an allocation error.
+ *   - Other on failure to compile or create the AC tree.
+ */
+static ib_status_t modac_operator_data_create(
+    ib_engine_t *ib,
+    ib_mpool_t *pool,
+    const modac_patterns_t *patterns,
+    modac_operator_data_t **opdata
+)
+{
+    assert(ib);
+    assert(pool);
+    assert(patterns);
+    assert(opdata);
+
+    ib_status_t rc;
+    modac_cache_t *cache;
+    ib_mpool_t *mp_tmp = ib_engine_pool_temp_get(ib);
+    const char *path = NULL;
+    char key[MODAC_KEY_SIZE];
+    void *cached;
+
+    *opdata = ib_mpool_calloc(pool, 1, sizeof(**opdata));
+    if (*opdata == NULL) {
+        return IB_EALLOC;
+    }
+
+    cache = modac_get_cache(ib);
+    if (cache == NULL) {
+        return IB_EALLOC;
+    }
+
+    modac_pattern_key(patterns, key);
+
+    ++cache->lookups;
+    rc = ib_hash_get(cache->automata, &cached, key);
+    if (rc == IB_OK) {
+        ++cache->hits;
+        ib_log_debug(ib,
+                     MODULE_NAME_STR ": Sharing automata %s "
+                     "(%" PRIu64 " of %" PRIu64 " lookups shared).",
+                     key, cache->hits, cache->lookups);
+        (*opdata)->eudoxus = (ia_eudoxus_t *)cached;
+        return IB_OK;
+    }
+
+    if (cache->dir != NULL) {
+        path = modac_cache_path(mp_tmp, cache, key);
+        if (path == NULL) {
+            return IB_EALLOC;
+        }
+
+        rc = modac_cache_load(ib, path, key, &(*opdata)->eudoxus);
+        if (rc == IB_OK) {
+            ib_log_debug(ib, MODULE_NAME_STR ": Mapped cached automata %s",
+                         path);
+            return modac_cache_add(cache, key, (*opdata)->eudoxus);
+        }
+    }
+
+#ifdef MODAC_EUDOXUS
+    if (cache->compile) {
+        rc = modac_compile_automata(ib, mp_tmp, path, patterns, key,
+                                    &(*opdata)->eudoxus);
+        if (rc == IB_OK) {
+            return modac_cache_add(cache, key, (*opdata)->eudoxus);
+        }
+        else if (rc == IB_EALLOC) {
+            return rc;
+        }
+
+        ib_log_warning(ib,
+                       MODULE_NAME_STR ": Falling back to AC tree for %s.",
+                       key);
+    }
+#endif
+
+    return modac_create_ac(pool, patterns, &(*opdata)->ac);
+}
+
 static ib_status_t pmf_operator_create(ib_engine_t *ib,
                                        ib_context_t *ctx,
                                        const ib_rule_t *rule,
@@ -521,10 +1193,13 @@ static ib_status_t pmf_operator_create(ib_engine_t *ib,
 {
     ib_status_t rc;
 
-    ib_ac_t *ac;
+    modac_operator_data_t *opdata;
+    modac_patterns_t patterns = {NULL, NULL, 0, 0};
 
     char* file = NULL;
     char* line = NULL;
+    char* unescaped;
+    char* unescaped_end;
     size_t pattern_file_len = strlen(pattern_file);
 
     /* Escaped directive and length. */
@@ -565,58 +1240,60 @@ static ib_status_t pmf_operator_create(ib_engine_t *ib,
         return rc;
     }
 
-    rc = ib_ac_create(&ac, 0, pool);
-
-    if (rc != IB_OK) {
+    /* Unescaped lines are never longer than the file, so all of them are
+     * stored one after another in a single buffer. */
+    unescaped = malloc(strlen(file) + 1);
+    if (unescaped == NULL) {
         free(file);
-        return rc;
+        return IB_EALLOC;
     }
+    unescaped_end = unescaped;
 
     /* Iterate through the file contents, one line at a time.
-     * Each line is unescaped (allowing null characters) into line_unescaped
-     * and added to the ahocorasic object as a pattern. */
+     * Each line is unescaped (allowing null characters) and added to the
+     * pattern list. */
     for (line=strtok(file, "\n"); line != NULL; line=strtok(NULL, "\n")) {
         size_t line_len = strlen(line);
 
         if ( line_len > 0 ) {
             size_t line_unescaped_len;
-            char *line_unescaped = malloc(line_len+1);
-
-            if ( line_unescaped == NULL ) {
-                free(file);
-                free(line_unescaped);
-                return IB_EALLOC;
-            }
 
             /* Escape a pattern, allowing nulls in the line. */
-            ib_util_unescape_string(line_unescaped,
+            ib_util_unescape_string(unescaped_end,
                                     &line_unescaped_len,
                                     line,
                                     line_len,
                                     IB_UTIL_UNESCAPE_NULTERMINATE);
 
-            rc = ib_ac_add_pattern (ac, line_unescaped, &nop_ac_match, NULL, 0);
-
-            free(line_unescaped);
+            /* As the AC tree, match up to the first NUL. */
+            line_unescaped_len = strlen(unescaped_end);
+            if (line_unescaped_len == 0) {
+                continue;
+            }
 
+            rc = modac_patterns_add(&patterns,
+                                    unescaped_end,
+                                    line_unescaped_len);
             if (rc != IB_OK) {
-                free(file);
-                return rc;
+                goto finish;
             }
+
+            unescaped_end += line_unescaped_len + 1;
         }
     }
 
-    rc = ib_ac_build_links(ac);
-
+    rc = modac_operator_data_create(ib, pool, &patterns, &opdata);
     if (rc != IB_OK) {
-        free(file);
-        return rc;
+        goto finish;
     }
 
-    op_inst->data = ac;
+    op_inst->data = opdata;
 
+finish:
+    modac_patterns_free(&patterns);
+    free(unescaped);
     free(file);
-    return IB_OK;
+    return rc;
 }
 
 static ib_status_t pm_operator_create(ib_engine_t *ib,
@@ -628,7 +1305,8 @@ static ib_status_t pm_operator_create(ib_engine_t *ib,
 {
     ib_status_t rc;
 
-    ib_ac_t *ac;
+    modac_operator_data_t *opdata;
+    modac_patterns_t patterns = {NULL, NULL, 0, 0};
 
     const size_t pattern_len = strlen(pattern);
     size_t tok_buffer_sz = pattern_len+1;
@@ -648,45 +1326,85 @@ static ib_status_t pm_operator_create(ib_engine_t *ib,
 
     memcpy(tok_buffer, pattern, tok_buffer_sz);
 
-    rc = ib_ac_create(&ac, 0, pool);
-
-    if (rc != IB_OK) {
-        free(tok_buffer);
-        return rc;
-    }
-
     for (tok = strtok(tok_buffer, " "); tok != NULL; tok = strtok(NULL, " "))
     {
-        if (strlen(tok) > 0) {
-            rc = ib_ac_add_pattern(ac, tok, &nop_ac_match, NULL, 0);
+        size_t tok_len = strlen(tok);
+
+        if (tok_len > 0) {
+            rc = modac_patterns_add(&patterns, tok, tok_len);
 
             if (rc != IB_OK) {
-                free(tok_buffer);
-                return rc;
+                goto finish;
             }
         }
     }
 
-    rc = ib_ac_build_links(ac);
-
+    rc = modac_operator_data_create(ib, pool, &patterns, &opdata);
     if (rc != IB_OK) {
-        free(tok_buffer);
-        return rc;
+        goto finish;
     }
 
-    op_inst->data = ac;
+    op_inst->data = opdata;
 
+finish:
+    modac_patterns_free(&patterns);
     free(tok_buffer);
+    return rc;
+}
+
+/**
+ * Fetch or create the stream rule workspace of an operator.
+ *
+ * @param[in] tx Transaction.
+ * @param[in] opdata Operator data.
+ * @param[in] rule Rule; must be a stream rule.
+ * @param[out] workspace Workspace of @a rule in @a tx.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - Other on failure to create the workspace; will log.
+ */
+static ib_status_t get_stream_workspace(ib_tx_t *tx,
+                                        const modac_operator_data_t *opdata,
+                                        const ib_rule_t *rule,
+                                        modac_workspace_t **workspace)
+{
+    assert(tx);
+    assert(opdata);
+    assert(rule);
+    assert(workspace);
+
+    ib_status_t rc;
+
+    ib_log_debug_tx(tx, "Fetching stream rule data.");
+
+    rc = get_dfa_tx_data(tx, ib_rule_id(rule), workspace);
+
+    if ( (rc == IB_ENOENT) || (*workspace == NULL) ) {
+        rc = alloc_ac_tx_data(tx, opdata, ib_rule_id(rule), workspace);
+        if (rc != IB_OK) {
+            ib_log_error_tx(tx,
+                            "Unexpected error creating tx data: %d",
+                            rc);
+            return rc;
+        }
+    }
+    else if (rc != IB_OK) {
+        ib_log_error_tx(tx, "Unexpected error retrieving tx data: %d", rc);
+        return rc;
+    }
+
     return IB_OK;
 }
 
 static ib_status_t initialize_ac_ctx(ib_tx_t *tx,
-                                     ib_ac_t *ac,
+                                     const modac_operator_data_t *opdata,
                                      const ib_rule_t *rule,
                                      ib_ac_context_t **ac_ctx)
 {
     assert(tx);
-    assert(ac);
+    assert(opdata);
+    assert(opdata->ac);
     assert(ac_ctx);
     assert(rule);
 
@@ -697,21 +1415,8 @@ static ib_status_t initialize_ac_ctx(ib_tx_t *tx,
     if (ib_rule_is_stream(rule)) {
         modac_workspace_t *workspace = NULL;
 
-        ib_log_debug_tx(tx, "Fetching stream rule data.");
-
-        rc = get_dfa_tx_data(tx, ib_rule_id(rule), &workspace);
-
-        if ( (rc == IB_ENOENT) || (workspace == NULL) ) {
-            rc = alloc_ac_tx_data(tx, ac, ib_rule_id(rule), &workspace);
-            if (rc != IB_OK) {
-                ib_log_error_tx(tx,
-                                "Unexpected error creating tx data: %d",
-                                rc);
-                return rc;
-            }
-        }
-        else if (rc != IB_OK) {
-            ib_log_error_tx(tx, "Unexpected error retrieving tx data: %d", rc);
+        rc = get_stream_workspace(tx, opdata, rule, &workspace);
+        if (rc != IB_OK) {
             return rc;
         }
 
@@ -725,9 +1430,133 @@ static ib_status_t initialize_ac_ctx(ib_tx_t *tx,
             return IB_EALLOC;
         }
 
-        ib_ac_init_ctx(*ac_ctx, ac);
+        ib_ac_init_ctx(*ac_ctx, opdata->ac);
+    }
+
+    return IB_OK;
+}
+
+/**
+ * Match a subject against the AC tree of an operator.
+ *
+ * @param[in] tx Transaction.
+ * @param[in] opdata Operator data with an AC tree.
+ * @param[in] rule Rule being executed.
+ * @param[in] subject Subject.
+ * @param[in] subject_len Length of @a subject.
+ * @param[out] result 1 if any pattern matched, else 0.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - Other on failure.
+ */
+static ib_status_t execute_ac(ib_tx_t *tx,
+                              const modac_operator_data_t *opdata,
+                              const ib_rule_t *rule,
+                              const char *subject,
+                              size_t subject_len,
+                              ib_num_t *result)
+{
+    ib_ac_context_t *ac_ctx = NULL;
+    ib_status_t rc;
+
+    rc = initialize_ac_ctx(tx, opdata, rule, &ac_ctx);
+    if (rc != IB_OK) {
+        ib_log_error_tx(tx, "Cannot initialize AhoCorasic context: %d", rc);
+        return rc;
+    }
+
+    rc = ib_ac_consume(ac_ctx, subject, subject_len, 0, tx->mp);
+
+    if (rc == IB_ENOENT) {
+        *result = 0;
+        return IB_OK;
+    }
+    else if (rc == IB_OK) {
+        *result = (ac_ctx->match_cnt > 0) ? 1 : 0;
+    }
+
+    return rc;
+}
+
+/**
+ * Match a subject against the automata of an operator.
+ *
+ * Stream rules continue from the state of the previous call and, once
+ * matched, match without executing the automata again.
+ *
+ * @param[in] tx Transaction.
+ * @param[in] opdata Operator data with an automata.
+ * @param[in] rule Rule being executed.
+ * @param[in] subject Subject.
+ * @param[in] subject_len Length of @a subject.
+ * @param[out] result 1 if any pattern matched, else 0.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC on an allocation error.
+ *   - IB_EOTHER on automata execution failure; will log.
+ */
+static ib_status_t execute_eudoxus(ib_tx_t *tx,
+                                   const modac_operator_data_t *opdata,
+                                   const ib_rule_t *rule,
+                                   const char *subject,
+                                   size_t subject_len,
+                                   ib_num_t *result)
+{
+    ia_eudoxus_state_t *state;
+    ia_eudoxus_result_t irc;
+    ib_num_t match_cnt = 0;
+    ib_num_t *match_cnt_p = &match_cnt;
+    ib_status_t rc;
+
+    if (ib_rule_is_stream(rule)) {
+        modac_workspace_t *workspace = NULL;
+
+        rc = get_stream_workspace(tx, opdata, rule, &workspace);
+        if (rc != IB_OK) {
+            return rc;
+        }
+
+        state = workspace->state;
+        match_cnt_p = &workspace->match_cnt;
+    }
+    else {
+        irc = ia_eudoxus_create_state(&state,
+                                      opdata->eudoxus,
+                                      modac_eudoxus_match,
+                                      &match_cnt);
+        if (irc == IA_EUDOXUS_EALLOC) {
+            return IB_EALLOC;
+        }
+        else if (irc != IA_EUDOXUS_OK && irc != IA_EUDOXUS_STOP) {
+            ib_log_error_tx(tx, "Cannot create automata state: %d", irc);
+            return IB_EOTHER;
+        }
+    }
+
+    irc = IA_EUDOXUS_OK;
+    if (*match_cnt_p == 0) {
+        irc = ia_eudoxus_execute(state,
+                                 (const uint8_t *)subject,
+                                 subject_len);
+    }
+
+    if (! ib_rule_is_stream(rule)) {
+        ia_eudoxus_destroy_state(state);
+    }
+
+    if (
+        irc != IA_EUDOXUS_OK   &&
+        irc != IA_EUDOXUS_STOP &&
+        irc != IA_EUDOXUS_END
+    ) {
+        ib_log_error_tx(tx, "Error executing automata: %d", irc);
+        return IB_EOTHER;
     }
 
+    *result = (*match_cnt_p > 0) ? 1 : 0;
+
     return IB_OK;
 }
 
@@ -740,8 +1569,7 @@ static ib_status_t pm_operator_execute(const ib_rule_exec_t *rule_exec,
     assert(rule_exec);
     assert(data);
 
-    ib_ac_t *ac = (ib_ac_t *)data;
-    ib_ac_context_t *ac_ctx = NULL;
+    const modac_operator_data_t *opdata = (const modac_operator_data_t *)data;
     ib_tx_t *tx = rule_exec->tx;
     ib_status_t rc;
 
@@ -770,45 +1598,39 @@ static ib_status_t pm_operator_execute(const ib_rule_exec_t *rule_exec,
         return IB_EALLOC;
     }
 
-    rc = initialize_ac_ctx(tx, ac, rule_exec->rule, &ac_ctx);
+    if (opdata->eudoxus != NULL) {
+        rc = execute_eudoxus(tx, opdata, rule_exec->rule,
+                             subject, subject_len, result);
+    }
+    else {
+        rc = execute_ac(tx, opdata, rule_exec->rule,
+                        subject, subject_len, result);
+    }
     if (rc != IB_OK) {
-        ib_log_error_tx(tx, "Cannot initialize AhoCorasic context: %d", rc);
         return rc;
     }
 
-    rc = ib_ac_consume(ac_ctx, subject, subject_len, 0, tx->mp);
-
-    if (rc == IB_ENOENT) {
-        *result = 0;
-        return IB_OK;
-    }
-    else if (rc == IB_OK) {
-        *result = (ac_ctx->match_cnt > 0) ? 1 : 0;
-
-        if (ib_rule_should_capture(rule_exec, *result)) {
-            ib_field_t *f;
-            const char *name;
-            char *scopy;
-
-            ib_rule_capture_clear(rule_exec);
-            scopy = (char *)ib_mpool_alloc(tx->mp, subject_len);
-            if (scopy != NULL) {
-                memcpy(scopy, subject, subject_len);
-                name = ib_capture_name(0);
-                rc = ib_field_create_bytestr_alias(&f, tx->mp,
-                                                   name, strlen(name),
-                                                   (uint8_t *)scopy,
-                                                   subject_len);
-                if (rc == IB_OK) {
-                    ib_rule_capture_set_item(rule_exec, 0, f);
-                }
+    if (ib_rule_should_capture(rule_exec, *result)) {
+        ib_field_t *f;
+        const char *name;
+        char *scopy;
+
+        ib_rule_capture_clear(rule_exec);
+        scopy = (char *)ib_mpool_alloc(tx->mp, subject_len);
+        if (scopy != NULL) {
+            memcpy(scopy, subject, subject_len);
+            name = ib_capture_name(0);
+            rc = ib_field_create_bytestr_alias(&f, tx->mp,
+                                               name, strlen(name),
+                                               (uint8_t *)scopy,
+                                               subject_len);
+            if (rc == IB_OK) {
+                ib_rule_capture_set_item(rule_exec, 0, f);
             }
         }
-
-        return IB_OK;
     }
 
-    return rc;
+    return IB_OK;
 }
 
 static ib_status_t pm_operator_destroy(ib_operator_inst_t *op_inst)
@@ -820,6 +1642,129 @@ static ib_status_t pm_operator_destroy(ib_operator_inst_t *op_inst)
     return IB_OK;
 }
 
+/* -- Directives -- */
+
+/**
+ * Handle the PmCacheDir directive.
+ *
+ * Sets the directory that compiled automata of the pm and pmf operators
+ * are written to and mapped from.  Must occur in the main context, before
+ * any rule using the operators.
+ *
+ * @param[in] cp Configuration parser.
+ * @param[in] name Directive name.
+ * @param[in] p1 Directory.
+ * @param[in] cbdata Ignored.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EINVAL if not in main context or @a p1 is not a writable
+ *     directory; will log.
+ *   - IB_EALLOC on an allocation error.
+ */
+static ib_status_t modac_dir_cache_dir(ib_cfgparser_t *cp,
+                                       const char *name,
+                                       const char *p1,
+                                       void *cbdata)
+{
+    assert(cp);
+    assert(cp->ib);
+    assert(name);
+    assert(p1);
+
+    ib_engine_t *ib = cp->ib;
+    modac_cache_t *cache;
+    const char *dir;
+
+    if (cp->cur_ctx != ib_context_main(ib)) {
+        ib_cfg_log_error(cp,
+                         MODULE_NAME_STR ": %s directive must occur in "
+                         "main context.",
+                         name);
+        return IB_EINVAL;
+    }
+
+    cache = modac_get_cache(ib);
+    if (cache == NULL) {
+        return IB_EALLOC;
+    }
+
+    dir = ib_util_relative_file(cache->mp, cp->cur_file, p1);
+    if (dir == NULL) {
+        return IB_EALLOC;
+    }
+
+    if (access(dir, R_OK | W_OK | X_OK) != 0) {
+        ib_cfg_log_error(cp,
+                         MODULE_NAME_STR ": %s: Cannot access directory "
+                         "%s: %s",
+                         name, dir, strerror(errno));
+        return IB_EINVAL;
+    }
+
+    cache->dir = dir;
+
+    return IB_OK;
+}
+
+/**
+ * Handle the PmCompile directive.
+ *
+ * Enables compiling pattern lists that are not in the cache directory into
+ * Eudoxus automata.  Must occur in the main context, before any rule using
+ * the operators.
+ *
+ * @param[in] cp Configuration parser.
+ * @param[in] name Directive name.
+ * @param[in] onoff On or off.
+ * @param[in] cbdata Ignored.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EINVAL if not in main context or turned on without C++ support;
+ *     will log.
+ *   - IB_EALLOC on an allocation error.
+ */
+static ib_status_t modac_dir_compile(ib_cfgparser_t *cp,
+                                     const char *name,
+                                     int onoff,
+                                     void *cbdata)
+{
+    assert(cp);
+    assert(cp->ib);
+    assert(name);
+
+    ib_engine_t *ib = cp->ib;
+    modac_cache_t *cache;
+
+    if (cp->cur_ctx != ib_context_main(ib)) {
+        ib_cfg_log_error(cp,
+                         MODULE_NAME_STR ": %s directive must occur in "
+                         "main context.",
+                         name);
+        return IB_EINVAL;
+    }
+
+#ifndef MODAC_EUDOXUS
+    if (onoff) {
+        ib_cfg_log_error(cp,
+                         MODULE_NAME_STR ": %s requires IronBee to be built "
+                         "with C++ support.",
+                         name);
+        return IB_EINVAL;
+    }
+#endif
+
+    cache = modac_get_cache(ib);
+    if (cache == NULL) {
+        return IB_EALLOC;
+    }
+
+    cache->compile = (onoff != 0);
+
+    return IB_OK;
+}
+
 /* -- Module Routines -- */
 
 static ib_status_t modac_init(ib_engine_t *ib,
@@ -877,6 +1822,27 @@ static ib_status_t modac_init(ib_engine_t *ib,
     return IB_OK;
 }
 
+/**
+ * Initial values of @ref modac_cfg_t.
+ */
+static modac_cfg_t g_modac_config = {NULL};
+
+static IB_DIRMAP_INIT_STRUCTURE(modac_directive_map) = {
+    IB_DIRMAP_INIT_PARAM1(
+        "PmCacheDir",
+        modac_dir_cache_dir,
+        NULL
+    ),
+    IB_DIRMAP_INIT_ONOFF(
+        "PmCompile",
+        modac_dir_compile,
+        NULL
+    ),
+
+    /* signal the end of the list */
+    IB_DIRMAP_INIT_LAST
+};
+
 /**
  * Module structure.
  *
@@ -885,9 +1851,9 @@ static ib_status_t modac_init(ib_engine_t *ib,
 IB_MODULE_INIT(
     IB_MODULE_HEADER_DEFAULTS,            /**< Default metadata */
     MODULE_NAME_STR,                      /**< Module name */
-    IB_MODULE_CONFIG_NULL,                /* Global config data */
+    IB_MODULE_CONFIG(&g_modac_config),    /**< Global config data */
     NULL,                                 /**< Configuration field map */
-    NULL,                                 /**< Config directive map */
+    modac_directive_map,                  /**< Config directive map */
     modac_init,                           /**< Initialize function */
     NULL,                                 /**< Callback data */
     NULL,                                 /**< Finish function */
@@ -0,0 +1,113 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee --- AhoCorasick Module Pattern List Compiler
+ *
+ * Compiles pattern lists of the pm and pmf operators into Eudoxus automata
+ * in-process.  This is the same pipeline as @c ac_generator followed by
+ * @c ec.
+ */
+
+#include "ac_private.h"
+
+#include <ironautomata/deduplicate_outputs.hpp>
+#include <ironautomata/eudoxus_compiler.hpp>
+#include <ironautomata/generator/aho_corasick.hpp>
+#include <ironautomata/intermediate.hpp>
+#include <ironautomata/optimize_edges.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+using namespace std;
+
+namespace ia = IronAutomata;
+
+extern "C" {
+
+ib_status_t modac_eudoxus_compile(
+    char              **automata,
+    size_t             *automata_length,
+    const char *const  *patterns,
+    const size_t       *lengths,
+    size_t              n,
+    const char         *key
+)
+{
+    if (
+        automata        == NULL ||
+        automata_length == NULL ||
+        (n > 0 && (patterns == NULL || lengths == NULL)) ||
+        key             == NULL
+    ) {
+        return IB_EINVAL;
+    }
+
+    try {
+        ia::EudoxusCompiler::result_t result;
+
+        {
+            ia::Intermediate::Automata a;
+
+            ia::Generator::aho_corasick_begin(a);
+            for (size_t i = 0; i < n; ++i) {
+                ia::Generator::aho_corasick_add_length(
+                    a,
+                    string(patterns[i], lengths[i])
+                );
+            }
+            ia::Generator::aho_corasick_finish(a);
+
+            ia::Intermediate::breadth_first(
+                a,
+                ia::Intermediate::optimize_edges
+            );
+            ia::Intermediate::deduplicate_outputs(a);
+
+            a.metadata()["Output-Type"] = "length";
+            a.metadata()[MODAC_PATTERN_KEY] = key;
+
+            // The start node and its neighbors have many edges; split
+            // edges let them be searched with vector compares.
+            ia::EudoxusCompiler::configuration_t configuration;
+            configuration.split_low_edges_degree = 8;
+
+            result = ia::EudoxusCompiler::compile(a, configuration);
+        }
+
+        *automata_length = result.buffer.size();
+        *automata = reinterpret_cast<char *>(malloc(*automata_length));
+        if (*automata == NULL) {
+            return IB_EALLOC;
+        }
+        memcpy(*automata, &result.buffer[0], *automata_length);
+    }
+    catch (const bad_alloc&) {
+        return IB_EALLOC;
+    }
+    catch (...) {
+        return IB_EOTHER;
+    }
+
+    return IB_OK;
+}
+
+}
@@ -0,0 +1,124 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef _IB_MODULE_AC_PRIVATE_H_
+#define _IB_MODULE_AC_PRIVATE_H_
+
+/**
+ * @file
+ * @brief IronBee --- Private AhoCorasick module definitions
+ *
+ * The pattern list compiler is implemented in C++ on top of IronAutomata
+ * and is only available when IronBee is built with C++ support, in which
+ * case @c MODAC_EUDOXUS is defined.
+ *
+ * The operator data and automata cache are defined here for the tests.
+ */
+
+#include <ironautomata/eudoxus.h>
+
+#include <ironbee/ahocorasick.h>
+#include <ironbee/hash.h>
+#include <ironbee/mpool.h>
+#include <ironbee/types.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h> /* size_t */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Operator instance data of the pm and pmf operators.
+ *
+ * Exactly one of the members is set.
+ */
+struct modac_operator_data_t {
+    ia_eudoxus_t *eudoxus; /**< Compiled automata (shared). */
+    ib_ac_t      *ac;      /**< Fallback AC tree. */
+};
+typedef struct modac_operator_data_t modac_operator_data_t;
+
+/**
+ * Engine-wide cache of compiled automata.
+ *
+ * Operators with the same pattern list share a single automata, however
+ * many contexts the rules are included in.  Cached automata are destroyed
+ * with the engine's main memory pool.
+ */
+struct modac_cache_t {
+    ib_mpool_t *mp;       /**< Pool of cached automata */
+    ib_hash_t  *automata; /**< Pattern key -> ia_eudoxus_t */
+    const char *dir;      /**< Directory of compiled automata or NULL */
+    uint64_t    lookups;  /**< Number of lookups */
+    uint64_t    hits;     /**< Lookups finding an automata */
+    bool        compile;  /**< Compile lists not found; see PmCompile */
+};
+typedef struct modac_cache_t modac_cache_t;
+
+/**
+ * Module configuration.
+ *
+ * Only the configuration of the main context is used.
+ */
+struct modac_cfg_t {
+    modac_cache_t *cache; /**< Automata cache; created on first use. */
+};
+typedef struct modac_cfg_t modac_cfg_t;
+
+/**
+ * Metadata key under which compiled automata record their pattern key.
+ */
+#define MODAC_PATTERN_KEY "Pattern-Key"
+
+/**
+ * Compile @a patterns into an Aho-Corasick Eudoxus automata.
+ *
+ * The automata has an output for every pattern, recording its length, and
+ * carries @a key as its @ref MODAC_PATTERN_KEY metadata.
+ *
+ * @param[out] automata        Compiled automata; malloc'd, suitable for
+ *                             ia_eudoxus_create().  Caller must free or
+ *                             pass ownership on.
+ * @param[out] automata_length Length of @a automata.
+ * @param[in]  patterns        Patterns to match; need not be NUL
+ *                             terminated.
+ * @param[in]  lengths         Lengths of @a patterns.
+ * @param[in]  n               Number of patterns.
+ * @param[in]  key             Pattern key to record in the automata.
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_EALLOC on allocation failure.
+ * - IB_EOTHER on any other failure of the compiler.
+ */
+ib_status_t modac_eudoxus_compile(
+    char              **automata,
+    size_t             *automata_length,
+    const char *const  *patterns,
+    const size_t       *lengths,
+    size_t              n,
+    const char         *key
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _IB_MODULE_AC_PRIVATE_H_ */
@@ -36,6 +36,7 @@
 #include <ironbee/util.h>
 
 #include <assert.h>
+#include <strings.h>
 #include <unistd.h>
 
 /* Define the module name as well as a string version of it. */
@@ -53,6 +54,8 @@ static ib_hash_t *g_eudoxus_pattern_hash = NULL;
  *
  * The filename should point to a compiled automata. If a relative path is
  * given, it will be loaded relative to the current configuration file.
+ * The LoadEudoxusMmap form maps the file read-only instead of reading it,
+ * sharing its pages with other processes using the same file.
  *
  * @param[in] cp Configuration parser.
  * @param[in] name Directive name.
@@ -103,7 +106,12 @@ static ib_status_t load_eudoxus_pattern_param2(ib_cfgparser_t *cp,
         return IB_EINVAL;
     }
 
-    ia_rc = ia_eudoxus_create_from_path(&eudoxus, automata_file);
+    if (strcasecmp(name, "LoadEudoxusMmap") == 0) {
+        ia_rc = ia_eudoxus_create_from_path_mmap(&eudoxus, automata_file);
+    }
+    else {
+        ia_rc = ia_eudoxus_create_from_path(&eudoxus, automata_file);
+    }
     if (ia_rc != IA_EUDOXUS_OK) {
         ib_log_error(cp->ib,
                      MODULE_NAME_STR ": Error loading eudoxus automata file[%d]: %s.",
@@ -126,6 +134,11 @@ static IB_DIRMAP_INIT_STRUCTURE(eudoxus_directive_map) = {
         load_eudoxus_pattern_param2,
         NULL
     ),
+    IB_DIRMAP_INIT_PARAM2(
+        "LoadEudoxusMmap",
+        load_eudoxus_pattern_param2,
+        NULL
+    ),
 
     /* signal the end of the list */
     IB_DIRMAP_INIT_LAST
@@ -247,6 +260,55 @@ static ib_status_t ee_match_any_operator_create(ib_engine_t *ib,
     return IB_OK;
 }
 
+/**
+ * Get the input to match from a string field.
+ *
+ * @param[in] field The field to match.
+ * @param[out] input Set to the value of @a field.
+ * @param[out] input_len Set to the length of @a input.
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_EINVAL if @a field is not a string field.
+ * - Errors from ib_field_value().
+ */
+static ib_status_t ee_field_input(const ib_field_t *field,
+                                  const uint8_t **input,
+                                  size_t *input_len)
+{
+    ib_status_t rc;
+
+    if (field->type == IB_FTYPE_NULSTR) {
+        const char *nulstr;
+        rc = ib_field_value(field, ib_ftype_nulstr_out(&nulstr));
+        if (rc != IB_OK) {
+            return rc;
+        }
+        *input = (const uint8_t *)nulstr;
+        *input_len = strlen(nulstr);
+    }
+    else if (field->type == IB_FTYPE_BYTESTR) {
+        const ib_bytestr_t *bs;
+        rc = ib_field_value(field, ib_ftype_bytestr_out(&bs));
+        if (rc != IB_OK) {
+            return rc;
+        }
+        *input = ib_bytestr_const_ptr(bs);
+        *input_len = ib_bytestr_length(bs);
+    }
+    else {
+        return IB_EINVAL;
+    }
+
+    /* A NULL input resumes an eudoxus state rather than executing it. */
+    if (*input == NULL) {
+        *input = (const uint8_t *)"";
+        *input_len = 0;
+    }
+
+    return IB_OK;
+}
+
 /**
  * Execute the @c ee_match_any operator.
  *
@@ -255,6 +317,10 @@ static ib_status_t ee_match_any_operator_create(ib_engine_t *ib,
  * The capture option is supported; the matched pattern will be placed in the
  * capture variable if a match occurs.
  *
+ * If @a field is a list, every element is searched.  The elements are
+ * executed together with ia_eudoxus_execute_batch() which is faster than
+ * searching them one after another for large automata.
+ *
  * @param[in] rule_exec The rule being executed.
  * @param[in] data Callback data -- This is the initialized eudoxus engine
  *                 set by ee_match_any_operator_create().
@@ -272,53 +338,94 @@ static ib_status_t ee_match_any_operator_execute(
     ib_status_t rc;
     ia_eudoxus_result_t ia_rc;
     ia_eudoxus_t* eudoxus = data;
-    ia_eudoxus_state_t* state;
-    const char *input;
-    size_t input_len;
+    ia_eudoxus_state_t *single_state = NULL;
+    const uint8_t *single_input;
+    size_t single_input_len;
+    ia_eudoxus_state_t **states = &single_state;
+    const uint8_t **inputs = &single_input;
+    size_t *input_lens = &single_input_len;
+    size_t num_inputs = 1;
+    size_t index;
+    const ib_list_t *list;
+    const ib_list_node_t *node;
+    ib_mpool_t *mp;
 
     assert(rule_exec != NULL);
     assert(data != NULL);
 
     *result = 0;
 
-    if (field->type == IB_FTYPE_NULSTR) {
-        rc = ib_field_value(field, ib_ftype_nulstr_out(&input));
+    if (field->type != IB_FTYPE_LIST) {
+        rc = ee_field_input(field, &single_input, &single_input_len);
         if (rc != IB_OK) {
             return rc;
         }
-        input_len = strlen(input);
     }
-    else if (field->type == IB_FTYPE_BYTESTR) {
-        const ib_bytestr_t *bs;
-        rc = ib_field_value(field, ib_ftype_bytestr_out(&bs));
+    else {
+        rc = ib_field_value(field, ib_ftype_list_out(&list));
         if (rc != IB_OK) {
             return rc;
         }
-        input = (const char *)ib_bytestr_const_ptr(bs);
-        input_len = ib_bytestr_length(bs);
-    }
-    else if (field->type == IB_FTYPE_LIST) {
-        return IB_ENOTIMPL;
-    }
-    else {
-        return IB_EINVAL;
-    }
+        num_inputs = ib_list_elements(list);
+        if (num_inputs == 0) {
+            return IB_OK;
+        }
 
-    ia_rc = ia_eudoxus_create_state(&state, eudoxus, ee_first_match_callback,
-                                    (void *)rule_exec);
-    if (ia_rc != IA_EUDOXUS_OK) {
-        return IB_EINVAL;
+        mp = rule_exec->tx->mp;
+        states = ib_mpool_calloc(mp, num_inputs, sizeof(*states));
+        inputs = ib_mpool_calloc(mp, num_inputs, sizeof(*inputs));
+        input_lens = ib_mpool_calloc(mp, num_inputs, sizeof(*input_lens));
+        if (states == NULL || inputs == NULL || input_lens == NULL) {
+            return IB_EALLOC;
+        }
+
+        index = 0;
+        IB_LIST_LOOP_CONST(list, node) {
+            rc = ee_field_input(
+                (const ib_field_t *)ib_list_node_data_const(node),
+                &inputs[index],
+                &input_lens[index]);
+            if (rc != IB_OK) {
+                return rc;
+            }
+            ++index;
+        }
     }
+
     rc = IB_OK;
-    ia_rc = ia_eudoxus_execute(state, (const uint8_t *)input, input_len);
+    for (index = 0; index < num_inputs; ++index) {
+        ia_rc = ia_eudoxus_create_state(&states[index], eudoxus,
+                                        ee_first_match_callback,
+                                        (void *)rule_exec);
+        if (ia_rc != IA_EUDOXUS_OK) {
+            rc = IB_EINVAL;
+            goto done;
+        }
+    }
+
+    ia_rc = ia_eudoxus_execute_batch(states, inputs, input_lens,
+                                     num_inputs, &index);
     if (ia_rc == IA_EUDOXUS_STOP) {
         *result = 1;
-        rc = IB_OK;
     }
     else if (ia_rc == IA_EUDOXUS_ERROR) {
         rc = IB_EUNKNOWN;
     }
-    ia_eudoxus_destroy_state(state);
+    else if (ia_rc != IA_EUDOXUS_OK) {
+        const char *message = ia_eudoxus_error(eudoxus);
+        ib_log_error_tx(rule_exec->tx,
+                        "Eudoxus error executing input %zu: %s",
+                        index,
+                        message == NULL ? "no message" : message);
+        rc = IB_EINVAL;
+    }
+
+done:
+    for (index = 0; index < num_inputs; ++index) {
+        if (states[index] != NULL) {
+            ia_eudoxus_destroy_state(states[index]);
+        }
+    }
 
     return rc;
 }
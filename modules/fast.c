@@ -21,9 +21,12 @@
  *
  * This module adds support for fast rules.  See fast/fast.html for details.
  *
- * Provides a single directive:
+ * Provides four directives:
  * @code
  * FastAutomata <path>
+ * FastAutomataMmap <path>
+ * FastProfile <path>
+ * FastFeed <phase> <field> <separator> [<tfn>...]
  * @endcode
  *
  * @c FastAutomata must occur in the main context and at most once in
@@ -33,12 +36,38 @@
  * rules into a set of scripts which creates the automata (see
  * fast/fast.html).
  *
+ * @c FastAutomataMmap may be used instead of @c FastAutomata.  It maps the
+ * automata read-only rather than reading it into memory, so that its pages
+ * are loaded on demand and shared by all processes using the same file.
+ *
+ * @c FastProfile must follow @c FastAutomata.  It enables profiling of the
+ * automata and writes the node visit counts when the engine is destroyed.
+ * Each process writes its own profile to the specified path followed by a
+ * period and its pid, so that prefork servers do not overwrite each other's
+ * counts.  The profiles can be given to the automata compiler
+ * (@c ec @c --profile, repeated to sum them) to lay out the nodes visited
+ * most by, e.g., traffic replayed through clipp.
+ *
+ * @c FastFeed must follow @c FastAutomata.  It adds @c field, a bytestring
+ * or collection, to the data fed to the automata in @c phase (one of
+ * @c REQUEST_HEADER, @c REQUEST, @c RESPONSE_HEADER, or @c RESPONSE).  A
+ * bytestring is followed by @c separator; every entry of a collection is fed
+ * as its key, @c separator, and its value.  Values, but not keys, are
+ * transformed by the given transformations, in order, first; values that are
+ * not bytestrings after transformation are not fed.  The first
+ * @c FastFeed of a phase replaces the default feed of that phase; see
+ * c_default_feeds.  The automata must be generated for the same feeds (see
+ * fast/fast.html).
+ *
+ * Request and response bodies are fed to the automata as they stream, each
+ * through an automata state kept with the transaction.  Rules found in a
+ * body are injected, subject to the usual phase and context checks, along
+ * with the rules found in the data of the body phase.  Bodies are thus
+ * neither buffered nor rescanned.
+ *
  * In general, @c EOTHER is used to indicate IronBee related failures and
  * @c EINVAL is used to indicate IronAutomata related failures.
  *
- * @todo Support response phases.
- * @todo Support streaming phases.
- *
  * @author Christopher Alfeld <calfeld@qualys.com>
  */
 
@@ -48,8 +77,14 @@
 #include <ironbee/engine.h>
 #include <ironbee/module.h>
 #include <ironbee/rule_engine.h>
+#include <ironbee/transformation.h>
 
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
 
 /** Module name. */
 #define MODULE_NAME        fast
@@ -64,7 +99,10 @@ IB_MODULE_DECLARE();
 typedef struct fast_runtime_t         fast_runtime_t;
 typedef struct fast_config_t          fast_config_t;
 typedef struct fast_search_t          fast_search_t;
-typedef struct fast_collection_spec_t fast_collection_spec_t;
+typedef struct fast_feed_spec_t       fast_feed_spec_t;
+typedef struct fast_stream_t          fast_stream_t;
+typedef struct fast_body_t            fast_body_t;
+typedef struct fast_tx_t              fast_tx_t;
 
 /**
  * Module runtime data.
@@ -82,6 +120,20 @@ struct fast_runtime_t
 
     /** Hash of id (@c const @c char *) to index (@c uint32_t *) */
     ib_hash_t *by_id;
+
+    /** Path to write profile to or NULL if not profiling. */
+    const char *profile_path;
+
+    /**
+     * Data to feed in each phase.
+     *
+     * List of @ref fast_feed_spec_t for each phase that is fed; NULL for
+     * other phases.
+     */
+    ib_list_t *feeds[IB_RULE_PHASE_COUNT];
+
+    /** True for each phase whose feed has been set by @c FastFeed. */
+    bool feeds_configured[IB_RULE_PHASE_COUNT];
 };
 
 /**
@@ -102,14 +154,22 @@ struct fast_config_t
  *
  * This structure holds the data used during a search of the automata.  In
  * particular it is the callback data of the function passed to
- * ia_eudoxus_execute().
+ * ia_eudoxus_create_state().
  */
 struct fast_search_t
 {
+    /** IronBee engine; used for logging. */
+    const ib_engine_t *ib;
+
     /** Runtime data. */
     const fast_runtime_t *runtime;
 
-    /** Rule execution context. */
+    /**
+     * Rule execution context.
+     *
+     * NULL while streaming a body, in which case phase and context are not
+     * checked until the rules are injected.  See fast_search_add().
+     */
     const ib_rule_exec_t *rule_exec;
 
     /** List to add eligible rules to. */
@@ -119,6 +179,61 @@ struct fast_search_t
     ib_hash_t *rule_set;
 };
 
+/**
+ * Input stream.
+ *
+ * Data gathered from one or more sources to be executed through a single
+ * automata state.  See fast_feed_phase().
+ */
+struct fast_stream_t
+{
+    /** Memory pool to allocate @c data from. */
+    ib_mpool_t *mp;
+
+    /** Data gathered so far. */
+    uint8_t *data;
+
+    /** Length of @c data. */
+    size_t length;
+
+    /** Allocated size of @c data. */
+    size_t size;
+};
+
+/** Index of the request body in fast_tx_t::bodies. */
+#define FAST_REQUEST_BODY  0
+/** Index of the response body in fast_tx_t::bodies. */
+#define FAST_RESPONSE_BODY 1
+/** Number of bodies; also used to indicate no body. */
+#define FAST_NUM_BODIES    2
+
+/**
+ * Body stream.
+ *
+ * Automata state for a body that is fed to the automata as it arrives.  See
+ * fast_body_data().
+ */
+struct fast_body_t
+{
+    /** State of automata or NULL if no data has been fed yet. */
+    ia_eudoxus_state_t *state;
+
+    /** Search state; callback data of @c state. */
+    fast_search_t search;
+
+    /** True if no further data should be fed. */
+    bool finished;
+};
+
+/**
+ * Per-transaction data.
+ */
+struct fast_tx_t
+{
+    /** Body streams, indexed by @ref FAST_REQUEST_BODY, etc. */
+    fast_body_t bodies[FAST_NUM_BODIES];
+};
+
 /* Configuration */
 
 /** IndexSize key for automata metadata. */
@@ -131,71 +246,84 @@ static const char *c_index_key = "Index";
 static const char *c_fast_action = "fast";
 
 /**
- * Collection specification.
+ * Feed specification.
+ *
+ * Data to feed to the automata; set by the @c FastFeed directive.
  */
-struct fast_collection_spec_t
+struct fast_feed_spec_t
 {
-    /** Name of collection to feed to automata. */
+    /** Name of bytestring or collection to feed to automata. */
     const char *name;
-    /** String to separate key and value with. */
+    /**
+     * String to follow a bytestring with or to separate key and value of
+     * collection entries with.
+     */
     const char *separator;
+    /** Transformations (@c const @ref ib_tfn_t *) or NULL if none. */
+    const ib_list_t *tfns;
 };
 
-/** Bytestrings to feed during REQUEST_HEADER phase. */
-static const char *c_request_header_bytestrings[] = {
-    "REQUEST_METHOD",
-    "REQUEST_URI",
-    "REQUEST_PROTOCOL",
-    NULL
-};
-/** Collections to feed during REQUEST_HEADER phase. */
-static const fast_collection_spec_t c_request_header_collections[] = {
-    { "REQUEST_HEADERS",    ":" },
-    { "REQUEST_URI_PARAMS", "=" },
-    { NULL, NULL }
+/** Default feed of REQUEST_HEADER phase. */
+static const fast_feed_spec_t c_request_header_feed[] = {
+    { "REQUEST_METHOD",     " ", NULL },
+    { "REQUEST_URI",        " ", NULL },
+    { "REQUEST_PROTOCOL",   " ", NULL },
+    { "REQUEST_HEADERS",    ":", NULL },
+    { "REQUEST_URI_PARAMS", "=", NULL },
+    { NULL, NULL, NULL }
 };
 
-/** Bytestrings to feed during REQUEST_BODY phase. */
-static const char *c_request_body_bytestrings[] = {
-    NULL
+/** Default feed of REQUEST_BODY phase. */
+static const fast_feed_spec_t c_request_body_feed[] = {
+    { "REQUEST_BODY_PARAMS", "=", NULL },
+    { NULL, NULL, NULL }
 };
 
-/** Collections to feed during REQUEST_BODY phase. */
-static const fast_collection_spec_t c_request_body_collections[] = {
-    { "REQUEST_BODY_PARAMS", "=" },
-    { NULL, NULL }
+/** Default feed of RESPONSE_HEADER phase. */
+static const fast_feed_spec_t c_response_header_feed[] = {
+    { "RESPONSE_PROTOCOL", " ", NULL },
+    { "RESPONSE_STATUS",   " ", NULL },
+    { "RESPONSE_MESSAGE",  " ", NULL },
+    { "RESPONSE_HEADERS",  ":", NULL },
+    { NULL, NULL, NULL }
 };
 
-/** Bytestrings to feed during RESPONSE_HEADER phase. */
-static const char *c_response_header_bytestrings[] = {
-    "RESPONSE_PROTOCOL",
-    "RESPONSE_STATUS",
-    "RESPONSE_MESSAGE",
-    NULL
-};
-/** Collections to feed during RESPONSE_HEADER phase. */
-static const fast_collection_spec_t c_response_header_collections[] = {
-    { "RESPONSE_HEADERS",    ":" },
-    { NULL, NULL }
+/** Default feed of RESPONSE_BODY phase. */
+static const fast_feed_spec_t c_response_body_feed[] = {
+    { NULL, NULL, NULL }
 };
 
-/** Bytestrings to feed during RESPONSE_BODY phase. */
-static const char *c_response_body_bytestrings[] = {
-    NULL
+/**
+ * Default feed of each phase.
+ *
+ * Phases without a default feed are never fed and may not be named by
+ * @c FastFeed.
+ */
+static const fast_feed_spec_t *c_default_feeds[IB_RULE_PHASE_COUNT] = {
+    [PHASE_REQUEST_HEADER]  = c_request_header_feed,
+    [PHASE_REQUEST_BODY]    = c_request_body_feed,
+    [PHASE_RESPONSE_HEADER] = c_response_header_feed,
+    [PHASE_RESPONSE_BODY]   = c_response_body_feed
 };
 
-/** Collections to feed during RESPONSE_BODY phase. */
-static const fast_collection_spec_t c_response_body_collections[] = {
-    { NULL, NULL }
-};
+/** Initial allocated size of a stream. */
+static const size_t c_stream_min_size = 1024;
 
-/** String to separate bytestrings. */
-static const char *c_bytestring_separator = " ";
 /** String to separate different keys, bytestring or collection entries. */
 static const char *c_data_separator = "\n";
 
 /* Helper functions */
 
+/* Documented in definition below. */
+static
+ia_eudoxus_command_t fast_eudoxus_callback(
+    ia_eudoxus_t  *eudoxus,
+    const char    *output,
+    size_t         output_length,
+    const uint8_t *input_location,
+    void          *callback_data
+);
+
 /**
  * As ia_eudoxus_error() but uses "no error" for NULL.
  *
@@ -253,178 +381,248 @@ fast_config_t *fast_get_config(
 }
 
 /**
- * Feed data to the automata.
+ * Feed data to a stream.
  *
- * @param[in] ib          IronBee engine; used for logging.
- * @param[in] eudoxus     Eudoxus engine; used for ia_eudoxus_error().
- * @param[in] state       Current Eudoxus execution state; updated.
+ * @param[in] stream      Stream to append to; updated.
  * @param[in] data        Data to send to automata.
  * @param[in] data_length Length of @a data.
  * @return
  * - IB_OK on success.
- * - IB_EINVAL on IronAutomata failure; will emit log message.
+ * - IB_EALLOC on allocation failure; no log message.
  */
 static
 ib_status_t fast_feed(
-    const ib_engine_t  *ib,
-    const ia_eudoxus_t *eudoxus,
-    ia_eudoxus_state_t *state,
-    const uint8_t      *data,
-    size_t              data_length
+    fast_stream_t *stream,
+    const uint8_t *data,
+    size_t         data_length
 )
 {
-    assert(ib      != NULL);
-    assert(eudoxus != NULL);
-    assert(state   != NULL);
-    assert(data    != NULL);
+    assert(stream != NULL);
+    assert(data   != NULL);
 
-    ia_eudoxus_result_t irc;
+    if (stream->length + data_length > stream->size) {
+        size_t   size = stream->size * 2;
+        uint8_t *new_data;
 
-    irc = ia_eudoxus_execute(state, data, data_length);
-    if (irc != IA_EUDOXUS_OK) {
-        ib_log_error(
-            ib,
-            "fast: Eudoxus Execution Failure: %s",
-            fast_eudoxus_error(eudoxus)
-        );
-        return IB_EINVAL;
+        if (size < stream->length + data_length) {
+            size = stream->length + data_length;
+        }
+        if (size < c_stream_min_size) {
+            size = c_stream_min_size;
+        }
+        new_data = ib_mpool_alloc(stream->mp, size);
+        if (new_data == NULL) {
+            return IB_EALLOC;
+        }
+        if (stream->length > 0) {
+            memcpy(new_data, stream->data, stream->length);
+        }
+        stream->data = new_data;
+        stream->size = size;
     }
 
+    memcpy(stream->data + stream->length, data, data_length);
+    stream->length += data_length;
+
     return IB_OK;
 }
 
 /**
- * Feed a byte string from an @ref ib_data_t to the automata.
+ * Transform the value of a field for feeding.
+ *
+ * Values that are not bytestrings, e.g., the number some transformations
+ * result in, are not fed; they are skipped with a debug message.
  *
- * @param[in] ib                    IronBee engine; used for logging.
- * @param[in] eudoxus               Eudoxus engine; used for
- *                                  ia_eudoxus_error().
- * @param[in] state                 Current Eudoxus execution state; updated.
- * @param[in] data                  Data source.
- * @param[in] bytestring_field_name Name of data field to feed.
+ * @param[in]  ib    IronBee engine; used for transformations and logging.
+ * @param[in]  mp    Memory pool for transformations.
+ * @param[in]  spec  Feed spec; provides transformations.
+ * @param[in]  field Field to transform.
+ * @param[out] bs    Transformed value.
  * @return
  * - IB_OK on success.
- * - IB_EINVAL on IronAutomata failure; will emit log message.
+ * - IB_DECLINED if the transformed value is not a bytestring; will emit
+ *   debug message.
  * - IB_EOTHER on IronBee failure; will emit log message.
  */
 static
-ib_status_t fast_feed_data_bytestring(
-    const ib_engine_t  *ib,
-    const ia_eudoxus_t *eudoxus,
-    ia_eudoxus_state_t *state,
-    const ib_data_t    *data,
-    const char         *bytestring_field_name
+ib_status_t fast_feed_transform(
+    ib_engine_t             *ib,
+    ib_mpool_t              *mp,
+    const fast_feed_spec_t  *spec,
+    const ib_field_t        *field,
+    const ib_bytestr_t     **bs
 )
 {
-    assert(ib                    != NULL);
-    assert(eudoxus               != NULL);
-    assert(state                 != NULL);
-    assert(data                  != NULL);
-    assert(bytestring_field_name != NULL);
+    assert(ib    != NULL);
+    assert(mp    != NULL);
+    assert(spec  != NULL);
+    assert(field != NULL);
+    assert(bs    != NULL);
 
-    ib_field_t         *field;
-    const ib_bytestr_t *bs;
-    ib_status_t         rc;
+    const ib_list_node_t *node;
+    ib_status_t           rc;
 
-    rc = ib_data_get(data, bytestring_field_name, &field);
-    if (rc == IB_ENOENT) {
-        ib_log_error(
-            ib,
-            "fast: No such data %s",
-            bytestring_field_name
-        );
-        return IB_EOTHER;
+    if (spec->tfns != NULL) {
+        IB_LIST_LOOP_CONST(spec->tfns, node) {
+            const ib_tfn_t *tfn =
+                (const ib_tfn_t *)ib_list_node_data_const(node);
+            ib_field_t     *out;
+            ib_flags_t      flags = 0;
+
+            rc = ib_tfn_transform(ib, mp, tfn, field, &out, &flags);
+            if (rc != IB_OK) {
+                ib_log_error(
+                    ib,
+                    "fast: Error applying transformation %s to %s: %s",
+                    tfn->name,
+                    spec->name,
+                    ib_status_to_string(rc)
+                );
+                return IB_EOTHER;
+            }
+            field = out;
+        }
     }
-    else if (rc != IB_OK) {
-        ib_log_error(
+
+    if (field->type != IB_FTYPE_BYTESTR) {
+        ib_log_debug(
             ib,
-            "fast: Error fetching data %s: %s",
-            bytestring_field_name,
-            ib_status_to_string(rc)
+            "fast: Not feeding value of %s of field type %d; "
+            "only bytestrings are fed.",
+            spec->name,
+            field->type
         );
-        return IB_EOTHER;
+        return IB_DECLINED;
     }
 
     rc = ib_field_value_type(
         field,
-        ib_ftype_bytestr_out(&bs),
+        ib_ftype_bytestr_out(bs),
         IB_FTYPE_BYTESTR
     );
     if (rc != IB_OK) {
         ib_log_error(
             ib,
             "fast: Error loading data field %s: %s",
-            bytestring_field_name,
+            spec->name,
             ib_status_to_string(rc)
         );
         return IB_EOTHER;
     }
 
+    return IB_OK;
+}
+
+/**
+ * Feed a bytestring value to a stream.
+ *
+ * @param[in] stream Stream to append to; updated.
+ * @param[in] bs     Value to feed; may be empty.
+ * @return
+ * - IB_OK on success.
+ * - IB_EALLOC on allocation failure.
+ */
+static
+ib_status_t fast_feed_value(
+    fast_stream_t      *stream,
+    const ib_bytestr_t *bs
+)
+{
+    assert(stream != NULL);
+    assert(bs     != NULL);
+
     if (ib_bytestr_const_ptr(bs) == NULL || ib_bytestr_size(bs) == 0) {
         return IB_OK;
     }
     return fast_feed(
-        ib,
-        eudoxus,
-        state,
+        stream,
         ib_bytestr_const_ptr(bs), ib_bytestr_size(bs)
     );
 }
 
 /**
- * Feed a collection of byte strings from an @ref ib_data_t to automata.
+ * Feed a byte string to a stream.
+ *
+ * Nothing is fed if the transformed value is not a bytestring.
  *
- * @param[in] ib          IronBee engine; used for logging.
- * @param[in] eudoxus     Eudoxus engine; used for ia_eudoxus_error().
- * @param[in] state       Current Eudoxus execution state; updated.
- * @param[in] data        Data source.
- * @param[in] collection  Collection to feed.
+ * @param[in] ib     IronBee engine; used for transformations and logging.
+ * @param[in] stream Stream to append to; updated.
+ * @param[in] spec   Feed spec.
+ * @param[in] field  Bytestring field named by @a spec.
  * @return
  * - IB_OK on success.
- * - IB_EINVAL on IronAutomata failure; will emit log message.
+ * - IB_EALLOC on allocation failure; no log message.
+ * - IB_EOTHER on IronBee failure; will emit log message.
+ */
+static
+ib_status_t fast_feed_data_bytestring(
+    ib_engine_t            *ib,
+    fast_stream_t          *stream,
+    const fast_feed_spec_t *spec,
+    const ib_field_t       *field
+)
+{
+    assert(ib     != NULL);
+    assert(stream != NULL);
+    assert(spec   != NULL);
+    assert(field  != NULL);
+
+    const ib_bytestr_t *bs;
+    ib_status_t         rc;
+
+    rc = fast_feed_transform(ib, stream->mp, spec, field, &bs);
+    if (rc == IB_DECLINED) {
+        return IB_OK;
+    }
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    rc = fast_feed_value(stream, bs);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return fast_feed(
+        stream,
+        (const uint8_t *)spec->separator,
+        strlen(spec->separator)
+    );
+}
+
+/**
+ * Feed a collection of byte strings to a stream.
+ *
+ * Entries whose transformed value is not a bytestring are skipped.
+ *
+ * @param[in] ib     IronBee engine; used for transformations and logging.
+ * @param[in] stream Stream to append to; updated.
+ * @param[in] spec   Feed spec.
+ * @param[in] field  Collection field named by @a spec.
+ * @return
+ * - IB_OK on success.
+ * - IB_EALLOC on allocation failure; no log message.
  * - IB_EOTHER on IronBee failure; will emit log message.
  */
 static
 ib_status_t fast_feed_data_collection(
-    const ib_engine_t             *ib,
-    const ia_eudoxus_t            *eudoxus,
-    ia_eudoxus_state_t            *state,
-    const ib_data_t               *data,
-    const fast_collection_spec_t  *collection
+    ib_engine_t            *ib,
+    fast_stream_t          *stream,
+    const fast_feed_spec_t *spec,
+    const ib_field_t       *field
 )
 {
-    assert(ib         != NULL);
-    assert(eudoxus    != NULL);
-    assert(state      != NULL);
-    assert(data       != NULL);
-    assert(collection != NULL);
+    assert(ib     != NULL);
+    assert(stream != NULL);
+    assert(spec   != NULL);
+    assert(field  != NULL);
 
-    ib_field_t           *field;
     const ib_list_t      *subfields;
     const ib_list_node_t *node;
     const ib_field_t     *subfield;
     const ib_bytestr_t   *bs;
     ib_status_t           rc;
 
-    rc = ib_data_get(data, collection->name, &field);
-    if (rc == IB_ENOENT) {
-        ib_log_error(
-            ib,
-            "fast: No such data %s",
-            collection->name
-        );
-        return IB_EOTHER;
-    }
-    else if (rc != IB_OK) {
-        ib_log_error(
-            ib,
-            "fast: Error fetching data %s: %s",
-            collection->name,
-            ib_status_to_string(rc)
-        );
-        return IB_EOTHER;
-    }
-
     rc = ib_field_value_type(
         field,
         ib_ftype_list_out(&subfields),
@@ -434,7 +632,7 @@ ib_status_t fast_feed_data_collection(
         ib_log_error(
             ib,
             "fast: Error loading data field %s: %s",
-            collection->name,
+            spec->name,
             ib_status_to_string(rc)
         );
         return IB_EOTHER;
@@ -444,26 +642,16 @@ ib_status_t fast_feed_data_collection(
         subfield = (const ib_field_t *)ib_list_node_data_const(node);
         assert(subfield != NULL);
 
-        rc = ib_field_value_type(
-            subfield,
-            ib_ftype_bytestr_out(&bs),
-            IB_FTYPE_BYTESTR
-        );
+        rc = fast_feed_transform(ib, stream->mp, spec, subfield, &bs);
+        if (rc == IB_DECLINED) {
+            continue;
+        }
         if (rc != IB_OK) {
-            ib_log_error(
-                ib,
-                "fast: Error loading data subfield %s of %s: %s",
-                subfield->name,
-                collection->name,
-                ib_status_to_string(rc)
-            );
-            return IB_EOTHER;
+            return rc;
         }
 
         rc = fast_feed(
-            ib,
-            eudoxus,
-            state,
+            stream,
             (const uint8_t *)subfield->name,
             subfield->nlen
         );
@@ -472,33 +660,21 @@ ib_status_t fast_feed_data_collection(
         }
 
         rc = fast_feed(
-            ib,
-            eudoxus,
-            state,
-            (const uint8_t *)collection->separator,
-            strlen(collection->separator)
+            stream,
+            (const uint8_t *)spec->separator,
+            strlen(spec->separator)
         );
         if (rc != IB_OK) {
             return rc;
         }
 
-        if (ib_bytestr_const_ptr(bs) != NULL && ib_bytestr_size(bs) > 0) {
-            rc = fast_feed(
-                ib,
-                eudoxus,
-                state,
-                ib_bytestr_const_ptr(bs),
-                ib_bytestr_size(bs)
-            );
-            if (rc != IB_OK) {
-                return rc;
-            }
+        rc = fast_feed_value(stream, bs);
+        if (rc != IB_OK) {
+            return rc;
         }
 
         rc = fast_feed(
-            ib,
-            eudoxus,
-            state,
+            stream,
             (const uint8_t *)c_data_separator,
             strlen(c_data_separator)
         );
@@ -513,74 +689,122 @@ ib_status_t fast_feed_data_collection(
 /**
  * Feed data for a specific phase.
  *
- * Pull and feed the specified bytestrings and collections to an automata.
- * This function is similar to fast_rule_injection() but requires an already
- * functioning automata execution.  It can be combined with other feed
- * functions.
+ * Pull the data of the feed specs of the phase and execute the automata on
+ * it.  The bytestrings are gathered into one stream and each collection
+ * into a stream of its own.  The streams are then executed together, each
+ * from the start of the automata, by ia_eudoxus_execute_batch(), which hides
+ * much of the memory latency of large automata.  Fields that do not exist
+ * in the transaction are skipped.
  *
- * @param[in] ib          IronBee engine.
- * @param[in] eudoxus     Eudoxus engine.
- * @param[in] state       Eudoxus execution state; updated.
- * @param[in] data        Data source.
- * @param[in] bytestrings Bytestrings to feed.
- * @param[in] collections Collections to feed.
+ * Every collection stream is preceded by @ref c_data_separator, which is
+ * what precedes it when all data is fed as one stream, so that patterns
+ * anchored to the start of a line still match the first entry.  Patterns
+ * spanning two different collections no longer match, but no rule can
+ * depend on such a pattern.
+ *
+ * @param[in] ib            IronBee engine.
+ * @param[in] eudoxus       Eudoxus engine.
+ * @param[in] search        Search state; callback data of the automata.
+ * @param[in] mp            Memory pool for streams.
+ * @param[in] data          Data source.
+ * @param[in] feed          Feed specs (@ref fast_feed_spec_t) of phase.
  * @return
  * - IB_OK on success.
+ * - IB_EALLOC on allocation failure; no log message.
  * - IB_EINVAL on IronAutomata failure; will emit log message.
  * - IB_EOTHER on IronBee failure; will emit log message.
  */
 static
 ib_status_t fast_feed_phase(
-    const ib_engine_t             *ib,
-    const ia_eudoxus_t            *eudoxus,
-    ia_eudoxus_state_t            *state,
-    const ib_data_t               *data,
-    const char                   **bytestrings,
-    const fast_collection_spec_t  *collections
+    ib_engine_t           *ib,
+    ia_eudoxus_t          *eudoxus,
+    fast_search_t         *search,
+    ib_mpool_t            *mp,
+    const ib_data_t       *data,
+    const ib_list_t       *feed
 )
 {
-    assert(ib          != NULL);
-    assert(eudoxus     != NULL);
-    assert(state       != NULL);
-    assert(data        != NULL);
-    assert(bytestrings != NULL);
-    assert(collections != NULL);
+    assert(ib      != NULL);
+    assert(eudoxus != NULL);
+    assert(search  != NULL);
+    assert(mp      != NULL);
+    assert(data    != NULL);
+    assert(feed    != NULL);
+
+    fast_stream_t        *streams;
+    ia_eudoxus_state_t  **states;
+    const uint8_t       **inputs;
+    size_t               *input_lengths;
+    size_t                num_streams = 1 + ib_list_elements(feed);
+    size_t                num_inputs = 0;
+    size_t                index;
+    const ib_list_node_t *node;
+    ia_eudoxus_result_t   irc;
+    ib_status_t           rc = IB_OK;
 
-    ib_status_t rc;
+    streams       = ib_mpool_calloc(mp, num_streams, sizeof(*streams));
+    states        = ib_mpool_calloc(mp, num_streams, sizeof(*states));
+    inputs        = ib_mpool_calloc(mp, num_streams, sizeof(*inputs));
+    input_lengths = ib_mpool_calloc(mp, num_streams, sizeof(*input_lengths));
+    if (
+        streams       == NULL ||
+        states        == NULL ||
+        inputs        == NULL ||
+        input_lengths == NULL
+    ) {
+        return IB_EALLOC;
+    }
+    for (size_t i = 0; i < num_streams; ++i) {
+        streams[i].mp = mp;
+    }
 
-    /* Lower level feed_* routines log errors, so we simply abort on
+    /* Bytestrings are fed to streams[0] and the collection of the i-th spec
+     * to streams[i], which is otherwise left empty.
+     *
+     * Lower level feed_* routines log errors, so we simply abort on
      * non-OK returns. */
-    for (
-        const char **bytestring_name = bytestrings;
-        *bytestring_name != NULL;
-        ++bytestring_name
-    ) {
-        rc = fast_feed_data_bytestring(
-            ib,
-            eudoxus,
-            state,
-            data,
-            *bytestring_name
-        );
-        if (rc != IB_OK) {
-            return rc;
+    index = 0;
+    IB_LIST_LOOP_CONST(feed, node) {
+        const fast_feed_spec_t *spec =
+            (const fast_feed_spec_t *)ib_list_node_data_const(node);
+        ib_field_t *field;
+
+        ++index;
+        rc = ib_data_get(data, spec->name, &field);
+        if (rc == IB_ENOENT) {
+            continue;
+        }
+        else if (rc != IB_OK) {
+            ib_log_error(
+                ib,
+                "fast: Error fetching data %s: %s",
+                spec->name,
+                ib_status_to_string(rc)
+            );
+            return IB_EOTHER;
+        }
+
+        if (field->type == IB_FTYPE_LIST) {
+            rc = fast_feed(
+                &streams[index],
+                (uint8_t *)c_data_separator,
+                strlen(c_data_separator)
+            );
+            if (rc != IB_OK) {
+                return rc;
+            }
+            rc = fast_feed_data_collection(ib, &streams[index], spec, field);
+        }
+        else {
+            rc = fast_feed_data_bytestring(ib, &streams[0], spec, field);
         }
-        rc = fast_feed(
-            ib,
-            eudoxus,
-            state,
-            (const uint8_t *)c_bytestring_separator,
-            strlen(c_bytestring_separator)
-        );
         if (rc != IB_OK) {
             return rc;
         }
     }
 
     rc = fast_feed(
-        ib,
-        eudoxus,
-        state,
+        &streams[0],
         (uint8_t *)c_data_separator,
         strlen(c_data_separator)
     );
@@ -588,24 +812,115 @@ ib_status_t fast_feed_phase(
         return rc;
     }
 
-    for (
-        const fast_collection_spec_t *collection = collections;
-        collection->name != NULL;
-        ++collection
-    ) {
-        rc = fast_feed_data_collection(
-            ib,
+    for (size_t i = 0; i < num_streams; ++i) {
+        if (streams[i].length == 0) {
+            continue;
+        }
+        irc = ia_eudoxus_create_state(
+            &states[num_inputs],
             eudoxus,
-            state,
-            data,
-            collection
+            fast_eudoxus_callback,
+            search
         );
-        if (rc != IB_OK) {
-            return rc;
+        if (irc != IA_EUDOXUS_OK) {
+            ib_log_error(
+                ib,
+                "fast: Error creating state: %s",
+                fast_eudoxus_error(eudoxus)
+            );
+            rc = IB_EINVAL;
+            goto done;
         }
+        inputs[num_inputs]        = streams[i].data;
+        input_lengths[num_inputs] = streams[i].length;
+        ++num_inputs;
     }
 
-    return IB_OK;
+    irc = ia_eudoxus_execute_batch(
+        states,
+        inputs,
+        input_lengths,
+        num_inputs,
+        &index
+    );
+    if (irc != IA_EUDOXUS_OK) {
+        ib_log_error(
+            ib,
+            "fast: Eudoxus Execution Failure: %s",
+            fast_eudoxus_error(eudoxus)
+        );
+        rc = IB_EINVAL;
+    }
+
+done:
+    for (size_t i = 0; i < num_inputs; ++i) {
+        ia_eudoxus_destroy_state(states[i]);
+    }
+
+    return rc;
+}
+
+/**
+ * Add a rule found by the automata to the rules of a search.
+ *
+ * If @a search has a rule execution context, @a rule is only added if it is
+ * in the current phase and the current context or one of its ancestors.
+ * Otherwise, as while streaming a body, those checks are left until the
+ * rules are injected (see fast_inject_body()).  In either case, a rule is
+ * added at most once.
+ *
+ * @param[in] search Search state; rule list and set are updated.
+ * @param[in] rule   Rule to add.
+ * @return
+ * - IB_OK on success, including if @a rule is not eligible.
+ * - Other on rule set or rule list failure.
+ */
+static
+ib_status_t fast_search_add(
+    fast_search_t   *search,
+    const ib_rule_t *rule
+)
+{
+    assert(search            != NULL);
+    assert(search->rule_list != NULL);
+    assert(search->rule_set  != NULL);
+    assert(rule              != NULL);
+
+    void        *dummy_value;
+    ib_status_t  rc;
+
+    if (search->rule_exec != NULL) {
+        /* Check phase. */
+        if (rule->meta.phase != search->rule_exec->phase) {
+            return IB_OK;
+        }
+
+        /* Check context. */
+        const ib_context_t *ctx = search->rule_exec->tx->ctx;
+        while (ctx != NULL && rule->ctx != ctx) {
+            ctx = ib_context_parent_get(ctx);
+        }
+        if (ctx == NULL) {
+            return IB_OK;
+        }
+    }
+
+    /* Check/mark if already added. */
+    rc = ib_hash_get_ex(search->rule_set, &dummy_value, &rule, sizeof(rule));
+    if (rc == IB_OK) {
+        /* Rule already added. */
+        return IB_OK;
+    }
+    if (rc != IB_ENOENT) {
+        return rc;
+    }
+
+    rc = ib_hash_set_ex(search->rule_set, &rule, sizeof(rule), (void *)1);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return ib_list_push(search->rule_list, (void *)rule);
 }
 
 /* Callbacks */
@@ -637,10 +952,8 @@ ia_eudoxus_command_t fast_eudoxus_callback(
 
     fast_search_t *search = (fast_search_t *)callback_data;
 
-    assert(search->runtime   != NULL);
-    assert(search->rule_exec != NULL);
-    assert(search->rule_list != NULL);
-    assert(search->rule_set  != NULL);
+    assert(search->ib      != NULL);
+    assert(search->runtime != NULL);
 
     uint32_t         index;
     const ib_rule_t *rule;
@@ -665,74 +978,264 @@ ia_eudoxus_command_t fast_eudoxus_callback(
          * be evaluated by the rule eudoxus is usual, so this is not a fatal
          * error. */
         ib_log_warning(
-            search->rule_exec->ib,
+            search->ib,
             "Found rule in automata that is not in index.  "
             "Index likely out of date."
         );
         return IA_EUDOXUS_CMD_CONTINUE;
     }
 
-    /* Check phase. */
-    if (rule->meta.phase != search->rule_exec->phase) {
-        return IA_EUDOXUS_CMD_CONTINUE;
+    rc = fast_search_add(search, rule);
+    if (rc != IB_OK) {
+        ia_eudoxus_set_error_printf(
+            eudoxus,
+            "Error adding rule to search: %s",
+            ib_status_to_string(rc)
+        );
+        return IA_EUDOXUS_CMD_ERROR;
     }
 
-    /* Check context. */
-    {
-        const ib_context_t *ctx = search->rule_exec->tx->ctx;
-        while (ctx != NULL && rule->ctx != ctx) {
-            ctx = ib_context_parent_get(ctx);
-        }
-        if (ctx == NULL) {
-            return IA_EUDOXUS_CMD_CONTINUE;
+    return IA_EUDOXUS_CMD_CONTINUE;
+}
+
+/**
+ * Called when a transaction memory pool is destroyed.
+ *
+ * Destroys the automata states of the body streams.
+ *
+ * @param[in] data The @ref fast_tx_t.
+ */
+static
+void fast_tx_cleanup(
+    void *data
+)
+{
+    assert(data != NULL);
+
+    fast_tx_t *fast_tx = (fast_tx_t *)data;
+
+    for (size_t i = 0; i < FAST_NUM_BODIES; ++i) {
+        if (fast_tx->bodies[i].state != NULL) {
+            ia_eudoxus_destroy_state(fast_tx->bodies[i].state);
         }
     }
+}
 
-    /* Check/mark if already added. */
-    {
-        void *dummy_value;
-        rc = ib_hash_get_ex(
-            search->rule_set,
-            &dummy_value,
-            output,
-            output_length
-        );
-        if (rc == IB_OK) {
-            /* Rule already added. */
-            return IA_EUDOXUS_CMD_CONTINUE;
-        }
-        if (rc != IB_ENOENT) {
-            /* Error. */
-            ia_eudoxus_set_error_printf(
-                eudoxus,
-                "Unexpected error reading from rule set hash: %s",
-                ib_status_to_string(rc)
-            );
-            return IA_EUDOXUS_CMD_ERROR;
-        }
+/**
+ * Fetch the per-transaction data of @a tx, creating it if needed.
+ *
+ * @param[in]  tx       Transaction.
+ * @param[out] fast_tx  Per-transaction data.
+ * @return
+ * - IB_OK on success.
+ * - IB_EALLOC on allocation failure.
+ * - Other on failure to access module data.
+ */
+static
+ib_status_t fast_get_tx(
+    ib_tx_t    *tx,
+    fast_tx_t **fast_tx
+)
+{
+    assert(tx      != NULL);
+    assert(tx->mp  != NULL);
+    assert(fast_tx != NULL);
+
+    ib_status_t rc;
+
+    rc = ib_tx_get_module_data(tx, IB_MODULE_STRUCT_PTR, fast_tx);
+    if (rc == IB_OK && *fast_tx != NULL) {
+        return IB_OK;
+    }
+
+    *fast_tx = ib_mpool_calloc(tx->mp, 1, sizeof(**fast_tx));
+    if (*fast_tx == NULL) {
+        return IB_EALLOC;
     }
 
-    rc = ib_hash_set_ex(search->rule_set, output, output_length, (void *)1);
+    rc = ib_mpool_cleanup_register(tx->mp, fast_tx_cleanup, *fast_tx);
     if (rc != IB_OK) {
-        ia_eudoxus_set_error_printf(
-            eudoxus,
-            "Unexpected error writing to rule set hash: %s",
+        return rc;
+    }
+
+    return ib_tx_set_module_data(tx, IB_MODULE_STRUCT_PTR, *fast_tx);
+}
+
+/**
+ * Start a body stream.
+ *
+ * Creates the search state and automata state of @a body and feeds
+ * @ref c_data_separator, as for collections, so that patterns anchored to
+ * the start of a line match the start of the body.
+ *
+ * @param[in] ib      IronBee engine.
+ * @param[in] runtime Runtime.
+ * @param[in] tx      Transaction.
+ * @param[in] body    Body to start.
+ * @return
+ * - IB_OK on success.
+ * - IB_EALLOC on allocation failure; no log message.
+ * - IB_EINVAL on IronAutomata failure; will emit log message.
+ * - IB_EOTHER on IronBee failure; will emit log message.
+ */
+static
+ib_status_t fast_body_start(
+    const ib_engine_t    *ib,
+    const fast_runtime_t *runtime,
+    ib_tx_t              *tx,
+    fast_body_t          *body
+)
+{
+    assert(ib          != NULL);
+    assert(runtime     != NULL);
+    assert(tx          != NULL);
+    assert(body        != NULL);
+    assert(body->state == NULL);
+
+    ia_eudoxus_result_t irc;
+    ib_status_t         rc;
+
+    body->search.ib        = ib;
+    body->search.runtime   = runtime;
+    body->search.rule_exec = NULL;
+
+    rc = ib_list_create(&body->search.rule_list, tx->mp);
+    if (rc == IB_OK) {
+        rc = ib_hash_create(&body->search.rule_set, tx->mp);
+    }
+    if (rc != IB_OK) {
+        ib_log_error_tx(
+            tx,
+            "fast: Error creating body rule list or set: %s",
             ib_status_to_string(rc)
         );
-        return IA_EUDOXUS_CMD_ERROR;
+        return IB_EOTHER;
     }
 
-    rc = ib_list_push(search->rule_list, (void *)rule);
-    if (rc != IB_OK) {
-         ia_eudoxus_set_error_printf(
-             eudoxus,
-             "Error pushing rule onto rule list: %s",
+    irc = ia_eudoxus_create_state(
+        &body->state,
+        runtime->eudoxus,
+        fast_eudoxus_callback,
+        &body->search
+    );
+    if (irc != IA_EUDOXUS_OK) {
+        body->state = NULL;
+        ib_log_error_tx(
+            tx,
+            "fast: Error creating state: %s",
+            fast_eudoxus_error(runtime->eudoxus)
+        );
+        return IB_EINVAL;
+    }
+
+    irc = ia_eudoxus_execute(
+        body->state,
+        (const uint8_t *)c_data_separator,
+        strlen(c_data_separator)
+    );
+    if (irc == IA_EUDOXUS_END) {
+        body->finished = true;
+    }
+    else if (irc != IA_EUDOXUS_OK) {
+        body->finished = true;
+        ib_log_error_tx(
+            tx,
+            "fast: Eudoxus Execution Failure: %s",
+            fast_eudoxus_error(runtime->eudoxus)
+        );
+        return IB_EINVAL;
+    }
+
+    return IB_OK;
+}
+
+/**
+ * Called with each chunk of request or response body.
+ *
+ * Feeds the chunk to the automata state of the body, continuing from the
+ * previous chunk.  Rules found are held until fast_inject_body().
+ *
+ * @param[in] ib     IronBee engine.
+ * @param[in] tx     Transaction.
+ * @param[in] event  Request or response body data event.
+ * @param[in] txdata Body chunk.
+ * @param[in] cbdata Runtime.
+ * @return
+ * - IB_OK on success.
+ * - IB_EALLOC on allocation failure; no log message.
+ * - IB_EINVAL on IronAutomata failure; will emit log message.
+ * - IB_EOTHER on IronBee failure; will emit log message.
+ */
+static
+ib_status_t fast_body_data(
+    ib_engine_t           *ib,
+    ib_tx_t               *tx,
+    ib_state_event_type_t  event,
+    ib_txdata_t           *txdata,
+    void                  *cbdata
+)
+{
+    assert(ib     != NULL);
+    assert(tx     != NULL);
+    assert(cbdata != NULL);
+
+    const fast_runtime_t *runtime = (const fast_runtime_t *)cbdata;
+
+    assert(runtime->eudoxus != NULL);
+
+    fast_tx_t           *fast_tx;
+    fast_body_t         *body;
+    ia_eudoxus_result_t  irc;
+    ib_status_t          rc;
+
+    if (txdata == NULL || txdata->data == NULL || txdata->dlen == 0) {
+        return IB_OK;
+    }
+
+    rc = fast_get_tx(tx, &fast_tx);
+    if (rc == IB_EALLOC) {
+        return rc;
+    }
+    else if (rc != IB_OK) {
+        ib_log_error_tx(
+            tx,
+            "fast: Error fetching transaction data: %s",
             ib_status_to_string(rc)
         );
-        return IA_EUDOXUS_CMD_ERROR;
+        return IB_EOTHER;
     }
 
-    return IA_EUDOXUS_CMD_CONTINUE;
+    body = &fast_tx->bodies[
+        event == request_body_data_event ?
+            FAST_REQUEST_BODY : FAST_RESPONSE_BODY
+    ];
+    if (body->finished) {
+        return IB_OK;
+    }
+    if (body->state == NULL) {
+        /* fast_body_start() will handle logging errors. */
+        rc = fast_body_start(ib, runtime, tx, body);
+        if (rc != IB_OK || body->finished) {
+            return rc;
+        }
+    }
+
+    irc = ia_eudoxus_execute(body->state, txdata->data, txdata->dlen);
+    if (irc == IA_EUDOXUS_END) {
+        /* Automata can find nothing more in this body. */
+        body->finished = true;
+    }
+    else if (irc != IA_EUDOXUS_OK) {
+        body->finished = true;
+        ib_log_error_tx(
+            tx,
+            "fast: Eudoxus Execution Failure: %s",
+            fast_eudoxus_error(runtime->eudoxus)
+        );
+        return IB_EINVAL;
+    }
+
+    return IB_OK;
 }
 
 /**
@@ -822,18 +1325,77 @@ ib_status_t fast_ownership(
     }
     FAST_CHECK_RC("Could not access by_id hash.");
 
-    /* Claim rule. */
-    runtime->index[*index] = rule;
-    FAST_RETURN(IB_OK);
+    /* Claim rule. */
+    runtime->index[*index] = rule;
+    FAST_RETURN(IB_OK);
+
+#undef FAST_CHECK_RC
+#undef FAST_RETURN
+    assert(! "Should never reach this line.");
+done:
+    if (tmp_mp != NULL) {
+        ib_mpool_destroy(tmp_mp);
+    }
+    return rc;
+}
+
+/**
+ * Add the rules found in a body stream to a search.
+ *
+ * The phase and context checks skipped while streaming are applied here.
+ * Does nothing if no data of the body was seen.
+ *
+ * @param[in] ib     IronBee engine.
+ * @param[in] search Search state of current phase.
+ * @param[in] body   Index of body, e.g., @ref FAST_REQUEST_BODY.
+ * @return
+ * - IB_OK on success.
+ * - IB_EOTHER on IronBee failure; will emit log message.
+ */
+static
+ib_status_t fast_inject_body(
+    const ib_engine_t *ib,
+    fast_search_t     *search,
+    size_t             body
+)
+{
+    assert(ib                != NULL);
+    assert(search            != NULL);
+    assert(search->rule_exec != NULL);
+    assert(body < FAST_NUM_BODIES);
+
+    const ib_list_node_t *node;
+    fast_tx_t            *fast_tx = NULL;
+    ib_status_t           rc;
 
-#undef FAST_CHECK_RC
-#undef FAST_RETURN
-    assert(! "Should never reach this line.");
-done:
-    if (tmp_mp != NULL) {
-        ib_mpool_destroy(tmp_mp);
+    rc = ib_tx_get_module_data(
+        search->rule_exec->tx,
+        IB_MODULE_STRUCT_PTR,
+        &fast_tx
+    );
+    if (rc != IB_OK || fast_tx == NULL) {
+        return IB_OK;
     }
-    return rc;
+    if (fast_tx->bodies[body].state == NULL) {
+        return IB_OK;
+    }
+
+    IB_LIST_LOOP_CONST(fast_tx->bodies[body].search.rule_list, node) {
+        rc = fast_search_add(
+            search,
+            (const ib_rule_t *)ib_list_node_data_const(node)
+        );
+        if (rc != IB_OK) {
+            ib_log_error(
+                ib,
+                "fast: Error adding rule found in body: %s",
+                ib_status_to_string(rc)
+            );
+            return IB_EOTHER;
+        }
+    }
+
+    return IB_OK;
 }
 
 /**
@@ -841,18 +1403,21 @@ done:
  *
  * This function handles injection for a single phase.  It is called by
  * phase specific functions that simply forward their parameters along with
- * the bytestrings and collections specific to the phase.
+ * the body specific to the phase.  The data fed is the feed of the phase
+ * (see fast_runtime_t::feeds).
  *
  * @sa fast_feed_phase()
+ * @sa fast_inject_body()
  *
  * @param[in] ib          IronBee engine.
  * @param[in] rule_exec   Current rule execution context.
  * @param[in] rule_list   List to add injected rules to; updated.
  * @param[in] cbdata      Runtime.
- * @param[in] bytestrings Bytestrings to feed.
- * @param[in] collections Collections to feed.
+ * @param[in] body        Index of body streamed before phase or
+ *                        @ref FAST_NUM_BODIES if none.
  * @return
  * - IB_OK on success.
+ * - IB_EALLOC on allocation failure; no log message.
  * - IB_EINVAL on IronAutomata failure; will emit log message.
  * - IB_EOTHER on IronBee failure; will emit log message.
  */
@@ -862,8 +1427,7 @@ ib_status_t fast_rule_injection(
     const ib_rule_exec_t          *rule_exec,
     ib_list_t                     *rule_list,
     void                          *cbdata,
-    const char                   **bytestrings,
-    const fast_collection_spec_t  *collections
+    size_t                         body
 )
 {
     assert(ib                  != NULL);
@@ -877,9 +1441,8 @@ ib_status_t fast_rule_injection(
     assert(runtime          != NULL);
     assert(runtime->eudoxus != NULL);
     assert(runtime->index   != NULL);
+    assert(runtime->feeds[rule_exec->phase] != NULL);
 
-    ia_eudoxus_result_t  irc;
-    ia_eudoxus_state_t  *state = NULL;
     ib_status_t          rc;
     const ib_data_t     *data;
     ib_mpool_t          *tmp_mp = NULL;
@@ -909,6 +1472,7 @@ ib_status_t fast_rule_injection(
     }
 
     fast_search_t search = {
+        .ib        = ib,
         .runtime   = runtime,
         .rule_exec = rule_exec,
         .rule_list = rule_list,
@@ -917,36 +1481,20 @@ ib_status_t fast_rule_injection(
 
     data = rule_exec->tx->data;
 
-    irc = ia_eudoxus_create_state(
-        &state,
-        runtime->eudoxus,
-        fast_eudoxus_callback,
-        &search
-    );
-    if (irc != IA_EUDOXUS_OK) {
-        ib_log_error(
-            ib,
-            "fast: Error creating state: %s",
-            fast_eudoxus_error(runtime->eudoxus)
-        );
-        rc = IB_EINVAL;
-        goto done;
-    }
-
     /* fast_feed_phase() will handle logging errors. */
     rc = fast_feed_phase(
-        ib,
+        rule_exec->ib,
         runtime->eudoxus,
-        state,
+        &search,
+        tmp_mp,
         data,
-        bytestrings,
-        collections
+        runtime->feeds[rule_exec->phase]
     );
+    if (rc == IB_OK && body != FAST_NUM_BODIES) {
+        rc = fast_inject_body(ib, &search, body);
+    }
 
 done:
-    if (state != NULL) {
-        ia_eudoxus_destroy_state(state);
-    }
     if (tmp_mp != NULL) {
         ib_mpool_destroy(tmp_mp);
     }
@@ -979,8 +1527,7 @@ ib_status_t fast_rule_injection_request_header(
         rule_exec,
         rule_list,
         cbdata,
-        c_request_header_bytestrings,
-        c_request_header_collections
+        FAST_NUM_BODIES
     );
 }
 
@@ -1009,8 +1556,7 @@ ib_status_t fast_rule_injection_request_body(
         rule_exec,
         rule_list,
         cbdata,
-        c_request_body_bytestrings,
-        c_request_body_collections
+        FAST_REQUEST_BODY
     );
 }
 
@@ -1039,8 +1585,7 @@ ib_status_t fast_rule_injection_response_header(
         rule_exec,
         rule_list,
         cbdata,
-        c_response_header_bytestrings,
-        c_response_header_collections
+        FAST_NUM_BODIES
     );
 }
 
@@ -1069,16 +1614,15 @@ ib_status_t fast_rule_injection_response_body(
         rule_exec,
         rule_list,
         cbdata,
-        c_response_body_bytestrings,
-        c_response_body_collections
+        FAST_RESPONSE_BODY
     );
 }
 
 /**
- * Called when @c FastAutomata directive appears in configuration.
+ * Called when @c FastAutomata or @c FastAutomataMmap appears in configuration.
  *
  * @param[in] cp     Configuration parsed; used for logging.
- * @param[in] name   Name; ignored.
+ * @param[in] name   Name; @c FastAutomataMmap maps the automata.
  * @param[in] p1     Path to automata.
  * @param[in] cbdata Ignored.
  *
@@ -1133,8 +1677,8 @@ ib_status_t fast_dir_fast_automata(
     if (cp->cur_ctx != ib_context_main(ib)) {
         ib_cfg_log_error(
             cp,
-            "fast: %s: FastAutomata directive must occur in main context.",
-            p1
+            "fast: %s: %s directive must occur in main context.",
+            p1, name
         );
         return IB_EINVAL;
     }
@@ -1148,8 +1692,8 @@ ib_status_t fast_dir_fast_automata(
     if (config->runtime != NULL) {
         ib_cfg_log_error(
             cp,
-            "fast: %s: FastAutomata directive must be unique.",
-            p1
+            "fast: %s: %s directive must be unique.",
+            p1, name
         );
         return IB_EINVAL;
     }
@@ -1162,7 +1706,12 @@ ib_status_t fast_dir_fast_automata(
     }
 
     /* Load Automata */
-    irc = ia_eudoxus_create_from_path(&runtime->eudoxus, p1);
+    if (strcasecmp(name, "FastAutomataMmap") == 0) {
+        irc = ia_eudoxus_create_from_path_mmap(&runtime->eudoxus, p1);
+    }
+    else {
+        irc = ia_eudoxus_create_from_path(&runtime->eudoxus, p1);
+    }
     if (irc != IA_EUDOXUS_OK) {
         /* Note: ia_eudoxus_error() will not work as runtime->eudoxus
          * did not finish construction. */
@@ -1219,6 +1768,23 @@ ib_status_t fast_dir_fast_automata(
     rc = ib_hash_create(&runtime->by_id, cfg_mp);
     FAST_CHECK_RC("Could not create hash");
 
+    /* Default feeds; replaced by FastFeed. */
+    for (int phase = 0; phase < IB_RULE_PHASE_COUNT; ++phase) {
+        if (c_default_feeds[phase] == NULL) {
+            continue;
+        }
+        rc = ib_list_create(&runtime->feeds[phase], mp);
+        FAST_CHECK_RC("Could not create feed list");
+        for (
+            const fast_feed_spec_t *spec = c_default_feeds[phase];
+            spec->name != NULL;
+            ++spec
+        ) {
+            rc = ib_list_push(runtime->feeds[phase], (void *)spec);
+            FAST_CHECK_RC("Could not add to feed list");
+        }
+    }
+
     /* Load index */
     irc = ia_eudoxus_metadata_with_key(
         runtime->eudoxus,
@@ -1302,6 +1868,19 @@ ib_status_t fast_dir_fast_automata(
     );
     FAST_CHECK_RC("Error registering injection for response header phase.");
 
+    rc = ib_hook_txdata_register(
+        ib,
+        request_body_data_event,
+        fast_body_data, runtime
+    );
+    FAST_CHECK_RC("Error registering request body data hook.");
+    rc = ib_hook_txdata_register(
+        ib,
+        response_body_data_event,
+        fast_body_data, runtime
+    );
+    FAST_CHECK_RC("Error registering response body data hook.");
+
     rc = ib_rule_register_ownership_fn(
         ib,
         MODULE_NAME_STR,
@@ -1325,6 +1904,325 @@ ib_status_t fast_dir_fast_automata(
 #undef FAST_IB_ERROR
 }
 
+/**
+ * Called when @c FastProfile appears in configuration.
+ *
+ * @param[in] cp     Configuration parsed; used for logging.
+ * @param[in] name   Name of directive.
+ * @param[in] p1     Path to write profile to.
+ * @param[in] cbdata Ignored.
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_EINVAL if not in main context, not after @c FastAutomata, or
+ *   duplicate directive; will emit log message.
+ * - IB_EALLOC on failures due to memory allocation; no log message.
+ **/
+static
+ib_status_t fast_dir_fast_profile(
+    ib_cfgparser_t *cp,
+    const char     *name,
+    const char     *p1,
+    void           *cbdata
+)
+{
+    assert(cp     != NULL);
+    assert(cp->ib != NULL);
+    assert(name   != NULL);
+    assert(p1     != NULL);
+
+    ib_engine_t         *ib = cp->ib;
+    fast_config_t       *config;
+    fast_runtime_t      *runtime;
+    ia_eudoxus_result_t  irc;
+
+    if (cp->cur_ctx != ib_context_main(ib)) {
+        ib_cfg_log_error(
+            cp,
+            "fast: %s: %s directive must occur in main context.",
+            p1, name
+        );
+        return IB_EINVAL;
+    }
+
+    config = fast_get_config(ib);
+    assert(config != NULL);
+
+    runtime = config->runtime;
+    if (runtime == NULL) {
+        ib_cfg_log_error(
+            cp,
+            "fast: %s: %s directive must follow FastAutomata.",
+            p1, name
+        );
+        return IB_EINVAL;
+    }
+    if (runtime->profile_path != NULL) {
+        ib_cfg_log_error(
+            cp,
+            "fast: %s: %s directive must be unique.",
+            p1, name
+        );
+        return IB_EINVAL;
+    }
+
+    irc = ia_eudoxus_enable_profile(runtime->eudoxus);
+    if (irc == IA_EUDOXUS_EALLOC) {
+        return IB_EALLOC;
+    }
+    else if (irc != IA_EUDOXUS_OK) {
+        ib_cfg_log_error(
+            cp,
+            "fast: %s: Error enabling profile: %d",
+            p1,
+            irc
+        );
+        return IB_EINVAL;
+    }
+
+    runtime->profile_path =
+        ib_mpool_strdup(ib_engine_pool_main_get(ib), p1);
+    if (runtime->profile_path == NULL) {
+        return IB_EALLOC;
+    }
+
+    return IB_OK;
+}
+
+/**
+ * Called when @c FastFeed appears in configuration.
+ *
+ * @param[in] cp     Configuration parsed; used for logging.
+ * @param[in] name   Name of directive.
+ * @param[in] params Phase, field, separator, and transformations.
+ * @param[in] cbdata Ignored.
+ *
+ * @returns
+ * - IB_OK on success.
+ * - IB_EINVAL if not in main context, not after @c FastAutomata, too few
+ *   parameters, a phase that is not fed, or an unknown transformation;
+ *   will emit log message.
+ * - IB_EOTHER on failures due to IronBee API failures; will emit log message.
+ * - IB_EALLOC on failures due to memory allocation; no log message.
+ **/
+static
+ib_status_t fast_dir_fast_feed(
+    ib_cfgparser_t  *cp,
+    const char      *name,
+    const ib_list_t *params,
+    void            *cbdata
+)
+{
+    assert(cp     != NULL);
+    assert(cp->ib != NULL);
+    assert(name   != NULL);
+    assert(params != NULL);
+
+    ib_engine_t          *ib = cp->ib;
+    ib_mpool_t           *mp = ib_engine_pool_main_get(ib);
+    fast_config_t        *config;
+    fast_runtime_t       *runtime;
+    fast_feed_spec_t     *spec;
+    ib_list_t            *tfns = NULL;
+    const ib_list_node_t *node;
+    const char           *phase_name;
+    ib_rule_phase_num_t   phase;
+    ib_status_t           rc;
+
+    if (cp->cur_ctx != ib_context_main(ib)) {
+        ib_cfg_log_error(
+            cp,
+            "fast: %s directive must occur in main context.",
+            name
+        );
+        return IB_EINVAL;
+    }
+
+    config = fast_get_config(ib);
+    assert(config != NULL);
+
+    runtime = config->runtime;
+    if (runtime == NULL) {
+        ib_cfg_log_error(
+            cp,
+            "fast: %s directive must follow FastAutomata.",
+            name
+        );
+        return IB_EINVAL;
+    }
+
+    if (ib_list_elements(params) < 3) {
+        ib_cfg_log_error(
+            cp,
+            "fast: %s directive requires phase, field, and separator.",
+            name
+        );
+        return IB_EINVAL;
+    }
+
+    spec = ib_mpool_calloc(mp, 1, sizeof(*spec));
+    if (spec == NULL) {
+        return IB_EALLOC;
+    }
+
+    node = ib_list_first_const(params);
+    phase_name = (const char *)ib_list_node_data_const(node);
+    phase = ib_rule_lookup_phase(phase_name, false);
+    if (phase == PHASE_INVALID || runtime->feeds[phase] == NULL) {
+        ib_cfg_log_error(
+            cp,
+            "fast: %s: %s directive phase must be one of REQUEST_HEADER, "
+            "REQUEST, RESPONSE_HEADER, or RESPONSE.",
+            phase_name, name
+        );
+        return IB_EINVAL;
+    }
+
+    node = ib_list_node_next_const(node);
+    spec->name = ib_mpool_strdup(mp, ib_list_node_data_const(node));
+    node = ib_list_node_next_const(node);
+    spec->separator = ib_mpool_strdup(mp, ib_list_node_data_const(node));
+    if (spec->name == NULL || spec->separator == NULL) {
+        return IB_EALLOC;
+    }
+
+    for (
+        node = ib_list_node_next_const(node);
+        node != NULL;
+        node = ib_list_node_next_const(node)
+    ) {
+        const char *tfn_name = (const char *)ib_list_node_data_const(node);
+        ib_tfn_t   *tfn;
+
+        rc = ib_tfn_lookup(ib, tfn_name, &tfn);
+        if (rc != IB_OK) {
+            ib_cfg_log_error(
+                cp,
+                "fast: %s: %s directive: No such transformation %s.",
+                spec->name, name, tfn_name
+            );
+            return IB_EINVAL;
+        }
+        if (tfns == NULL) {
+            rc = ib_list_create(&tfns, mp);
+            if (rc != IB_OK) {
+                ib_cfg_log_error(
+                    cp,
+                    "fast: %s: Could not create transformation list: %s",
+                    spec->name,
+                    ib_status_to_string(rc)
+                );
+                return IB_EOTHER;
+            }
+        }
+        rc = ib_list_push(tfns, tfn);
+        if (rc != IB_OK) {
+            ib_cfg_log_error(
+                cp,
+                "fast: %s: Could not add transformation: %s",
+                spec->name,
+                ib_status_to_string(rc)
+            );
+            return IB_EOTHER;
+        }
+    }
+    spec->tfns = tfns;
+
+    /* First FastFeed of a phase replaces its default feed. */
+    if (! runtime->feeds_configured[phase]) {
+        rc = ib_list_create(&runtime->feeds[phase], mp);
+        if (rc != IB_OK) {
+            ib_cfg_log_error(
+                cp,
+                "fast: %s: Could not create feed list: %s",
+                spec->name,
+                ib_status_to_string(rc)
+            );
+            return IB_EOTHER;
+        }
+        runtime->feeds_configured[phase] = true;
+    }
+
+    rc = ib_list_push(runtime->feeds[phase], spec);
+    if (rc != IB_OK) {
+        ib_cfg_log_error(
+            cp,
+            "fast: %s: Could not add to feed list: %s",
+            spec->name,
+            ib_status_to_string(rc)
+        );
+        return IB_EOTHER;
+    }
+
+    return IB_OK;
+}
+
+/**
+ * Write profile of @a runtime to its profile path followed by the pid.
+ *
+ * Every process of a prefork server has its own counts; the pid keeps them
+ * from overwriting each other.
+ *
+ * @param[in] ib      IronBee engine; used for logging.
+ * @param[in] runtime Runtime to write profile of.
+ */
+static
+void fast_write_profile(
+    ib_engine_t          *ib,
+    const fast_runtime_t *runtime
+)
+{
+    assert(ib                    != NULL);
+    assert(runtime               != NULL);
+    assert(runtime->profile_path != NULL);
+
+    FILE                *fp;
+    ia_eudoxus_result_t  irc;
+    char                *path;
+    size_t               path_size;
+
+    /* Room for the period, the pid, and the NUL. */
+    path_size = strlen(runtime->profile_path) + 24;
+    path = malloc(path_size);
+    if (path == NULL) {
+        ib_log_error(
+            ib,
+            "fast: %s: Could not allocate profile path.",
+            runtime->profile_path
+        );
+        return;
+    }
+    snprintf(
+        path, path_size,
+        "%s.%ld", runtime->profile_path, (long)getpid()
+    );
+
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        ib_log_error(
+            ib,
+            "fast: %s: Could not open profile for writing.",
+            path
+        );
+        free(path);
+        return;
+    }
+
+    irc = ia_eudoxus_write_profile(runtime->eudoxus, fp);
+    if (fclose(fp) != 0 || irc != IA_EUDOXUS_OK) {
+        ib_log_error(
+            ib,
+            "fast: %s: Error writing profile.",
+            path
+        );
+    }
+    else {
+        ib_log_info(ib, "fast: Wrote profile to %s.", path);
+    }
+
+    free(path);
+}
+
 /**
  * Called when module unloads.
  *
@@ -1349,6 +2247,10 @@ ib_status_t fast_fini(
         return IB_OK;
     }
 
+    if (config->runtime->profile_path != NULL) {
+        fast_write_profile(ib, config->runtime);
+    }
+
     ia_eudoxus_destroy(config->runtime->eudoxus);
 
     return IB_OK;
@@ -1369,6 +2271,21 @@ static IB_DIRMAP_INIT_STRUCTURE(fast_directive_map) = {
         fast_dir_fast_automata,
         NULL
     ),
+    IB_DIRMAP_INIT_PARAM1(
+        "FastAutomataMmap",
+        fast_dir_fast_automata,
+        NULL
+    ),
+    IB_DIRMAP_INIT_PARAM1(
+        "FastProfile",
+        fast_dir_fast_profile,
+        NULL
+    ),
+    IB_DIRMAP_INIT_LIST(
+        "FastFeed",
+        fast_dir_fast_feed,
+        NULL
+    ),
 
     /* End */
     IB_DIRMAP_INIT_LAST
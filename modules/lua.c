@@ -38,6 +38,7 @@
 #include <ironbee/module.h>
 #include <ironbee/mpool.h>
 #include <ironbee/provider.h>
+#include <ironbee/string.h>
 
 #include <lauxlib.h>
 #include <lua.h>
@@ -46,6 +47,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <stdbool.h>
 
 #if defined(__cplusplus) && !defined(__STDC_FORMAT_MACROS)
 /* C99 requires that inttypes.h only exposes PRI* macros
@@ -73,6 +75,8 @@ IB_MODULE_DECLARE();
 typedef struct modlua_runtime_t modlua_runtime_t;
 typedef struct modlua_cfg_t modlua_cfg_t;
 typedef struct modlua_lua_cbdata_t modlua_lua_cbdata_t;
+typedef struct modlua_state_t modlua_state_t;
+typedef struct modlua_replay_t modlua_replay_t;
 
 /**
  * Callback type for functions executed protected by global lock.
@@ -92,6 +96,58 @@ typedef ib_status_t(*critical_section_fn_t)(ib_engine_t *ib,
  */
 struct modlua_runtime_t {
     lua_State          *L;            /**< Lua stack */
+    modlua_state_t     *state;        /**< Leased pool state or NULL */
+};
+
+/**
+ * A Lua state of the state pool.
+ *
+ * Each pooled state is a complete Lua runtime loaded with the same Lua
+ * modules, module configuration and Lua rules as the configuration state.
+ * A connection leases one for its lifetime, so Lua code of different
+ * connections runs in different states without any locking.
+ */
+struct modlua_state_t {
+    lua_State          *L;            /**< Lua runtime */
+    modlua_state_t     *next;         /**< Next free state */
+    modlua_state_t     *all_next;     /**< Next of all states */
+};
+
+/**
+ * Kind of configuration time Lua work.
+ */
+typedef enum {
+    MODLUA_REPLAY_MODULE,             /**< LuaLoadModule */
+    MODLUA_REPLAY_RULE,               /**< RuleExt lua: */
+    MODLUA_REPLAY_DIRECTIVE           /**< Directive of a Lua module */
+} modlua_replay_type_t;
+
+/**
+ * Parameters of a Lua module directive.
+ */
+typedef enum {
+    MODLUA_PARAMS_NONE,               /**< Block end */
+    MODLUA_PARAMS_NUM,                /**< On/off or flags */
+    MODLUA_PARAMS_STR1,               /**< One string */
+    MODLUA_PARAMS_STR2,               /**< Two strings */
+    MODLUA_PARAMS_LIST                /**< List of strings */
+} modlua_params_t;
+
+/**
+ * Configuration time Lua work, repeated to build each pooled state.
+ */
+struct modlua_replay_t {
+    modlua_replay_type_t  type;       /**< Kind of work */
+    ib_module_t          *module;     /**< Lua module (module, directive) */
+    const char           *file;       /**< Lua file (module, rule) */
+    const char           *func;       /**< Rule function or modlua handler */
+    ib_context_t         *ctx;        /**< Directive context */
+    const char           *name;       /**< Directive name */
+    modlua_params_t       params;     /**< Directive parameter types */
+    const char           *p1;         /**< First string parameter */
+    const char           *p2;         /**< Second string parameter */
+    ib_num_t              num;        /**< Numeric parameter */
+    ib_list_t            *list;       /**< List parameter */
 };
 
 /**
@@ -113,14 +169,26 @@ struct modlua_lua_cbdata_t {
 struct modlua_cfg_t {
     char               *pkg_path;  /**< Package path Lua Configuration. */
     char               *pkg_cpath; /**< Cpath Lua Configuration. */
+    ib_num_t            pool_size; /**< Pooled states built at startup. */
     lua_State          *L;         /**< Lua runtime stack. */
     ib_lock_t          *L_lck;     /**< Lua runtime stack lock. */
+    ib_list_t          *replay;    /**< List of modlua_replay_t. */
+    bool                pool;      /**< Use the state pool? */
+    modlua_state_t     *pool_free; /**< Free pooled states. */
+    modlua_state_t     *pool_all;  /**< All pooled states. */
+    ib_lock_t          *pool_lck;  /**< Protects pool_free and pool_all. */
 };
 
 /* Instantiate a module global configuration. */
 static modlua_cfg_t modlua_global_cfg = {
     NULL, /* pkg_path */
     NULL, /* pkg_cpath */
+    0,    /* pool_size */
+    NULL,
+    NULL,
+    NULL,
+    false,
+    NULL,
     NULL,
     NULL
 };
@@ -133,6 +201,14 @@ ib_status_t modlua_rule_driver(
     void *cbdata
 );
 
+static ib_status_t modlua_state_acquire(
+    ib_engine_t *ib,
+    modlua_state_t **pstate);
+
+static ib_status_t modlua_state_release(
+    ib_engine_t *ib,
+    modlua_state_t *state);
+
 /* -- Lua Routines -- */
 
 #define IB_FFI_MODULE  ironbee-ffi
@@ -466,72 +542,140 @@ static ib_status_t modlua_push_config_path(
 }
 
 /**
- * @param[in] cp Configuration parser.
- * @param[in] name Directive name for the block that is being closed.
- * @param[in,out] cbdata Callback data.
+ * Record configuration time Lua work to repeat in pooled states.
+ *
+ * @param[in] ib IronBee engine.
+ * @param[in] replay Work to record. Allocated from the main memory pool.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC on a memory error.
  */
-static ib_status_t modlua_config_cb_blkend(
-    ib_cfgparser_t *cp,
-    const char *name,
-    void *cbdata)
+static ib_status_t modlua_replay_add(
+    ib_engine_t *ib,
+    modlua_replay_t *replay)
 {
-    assert(cp);
-    assert(name);
-    assert(cbdata);
+    assert(ib);
+    assert(replay);
 
     ib_status_t rc;
-    modlua_lua_cbdata_t *modlua_lua_cbdata = (modlua_lua_cbdata_t *)cbdata;
-    lua_State *L = modlua_global_cfg.L;
-    ib_module_t *module = modlua_lua_cbdata->module;
-    ib_engine_t *ib = module->ib;
-    ib_context_t *ctx;
 
-    rc = ib_cfgparser_context_current(cp, &ctx);
-    if (rc != IB_OK) {
-        ib_cfg_log_error(cp, "Could not retrieve current context.");
-        return rc;
+    if (modlua_global_cfg.replay == NULL) {
+        rc = ib_list_create(&(modlua_global_cfg.replay),
+                            ib_engine_pool_main_get(ib));
+        if (rc != IB_OK) {
+            return rc;
+        }
     }
 
+    return ib_list_push(modlua_global_cfg.replay, replay);
+}
+
+/**
+ * Call the modlua handler of a Lua module directive.
+ *
+ * @param[in] ib IronBee engine.
+ * @param[in,out] L Lua state whose module configuration is updated.
+ * @param[in] dir The directive.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EINVAL on a Lua error or the directive handler's failure.
+ */
+static ib_status_t modlua_directive_eval(
+    ib_engine_t *ib,
+    lua_State *L,
+    const modlua_replay_t *dir)
+{
+    assert(ib);
+    assert(L);
+    assert(dir);
+
+    ib_status_t rc;
+    int args = 4;
+
     /* Push standard module directive arguments. */
     lua_getglobal(L, "modlua");
-    lua_getfield(L, -1, "modlua_config_cb_blkend");
+    lua_getfield(L, -1, dir->func);
     lua_replace(L, -2); /* Effectively remove then modlua table. */
-    lua_pushlightuserdata(L, module->ib);
-    lua_pushinteger(L, module->idx);
-    rc = modlua_push_config_path(ib, ctx, L);
+    lua_pushlightuserdata(L, ib);
+    lua_pushinteger(L, dir->module->idx);
+    rc = modlua_push_config_path(ib, dir->ctx, L);
     if (rc != IB_OK) {
         lua_pop(L, 3);
         return rc;
     }
 
     /* Push config parameters. */
-    lua_pushstring(L, name);
+    lua_pushstring(L, dir->name);
+    switch (dir->params) {
+        case MODLUA_PARAMS_NONE:
+            break;
+        case MODLUA_PARAMS_NUM:
+            lua_pushinteger(L, dir->num);
+            ++args;
+            break;
+        case MODLUA_PARAMS_STR1:
+            lua_pushstring(L, dir->p1);
+            ++args;
+            break;
+        case MODLUA_PARAMS_STR2:
+            lua_pushstring(L, dir->p1);
+            lua_pushstring(L, dir->p2);
+            args += 2;
+            break;
+        case MODLUA_PARAMS_LIST:
+            lua_pushlightuserdata(L, dir->list);
+            ++args;
+            break;
+    }
 
-    rc = modlua_config_cb_eval(L, ib, module, name, 4);
-    return rc;
+    return modlua_config_cb_eval(L, ib, dir->module, dir->name, args);
 }
 
 /**
+ * Common code of the Lua module directive callbacks.
+ *
+ * The directive is evaluated in the configuration Lua state and recorded
+ * so that it can be repeated in pooled states.
+ *
  * @param[in] cp Configuration parser.
- * @param[in] name Configuration directive name.
- * @param[in] onoff On or off setting.
- * @param[in] cbdata Callback data.
+ * @param[in] cbdata Callback data (modlua_lua_cbdata_t).
+ * @param[in] func Name of the modlua directive handler.
+ * @param[in] name Directive name.
+ * @param[in] params Parameter types.
+ * @param[in] p1 First string parameter or NULL.
+ * @param[in] p2 Second string parameter or NULL.
+ * @param[in] num Numeric parameter.
+ * @param[in] list List parameter or NULL.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC on a memory error.
+ *   - IB_EINVAL on a Lua error or the directive handler's failure.
  */
-static ib_status_t modlua_config_cb_onoff(
+static ib_status_t modlua_config_cb(
     ib_cfgparser_t *cp,
+    void *cbdata,
+    const char *func,
     const char *name,
-    int onoff,
-    void *cbdata)
+    modlua_params_t params,
+    const char *p1,
+    const char *p2,
+    ib_num_t num,
+    const ib_list_t *list)
 {
     assert(cp);
-    assert(name);
     assert(cbdata);
+    assert(func);
+    assert(name);
 
     ib_status_t rc;
     modlua_lua_cbdata_t *modlua_lua_cbdata = (modlua_lua_cbdata_t *)cbdata;
-    lua_State *L = modlua_global_cfg.L;
     ib_module_t *module = modlua_lua_cbdata->module;
     ib_engine_t *ib = module->ib;
+    ib_mpool_t *mp = ib_engine_pool_main_get(ib);
+    modlua_replay_t *dir;
     ib_context_t *ctx;
 
     rc = ib_cfgparser_context_current(cp, &ctx);
@@ -540,24 +684,91 @@ static ib_status_t modlua_config_cb_onoff(
         return rc;
     }
 
-    /* Push standard module directive arguments. */
-    lua_getglobal(L, "modlua");
-    lua_getfield(L, -1, "modlua_config_cb_onoff");
-    lua_replace(L, -2); /* Effectively remove then modlua table. */
-    lua_pushlightuserdata(L, module->ib);
-    lua_pushinteger(L, module->idx);
-    rc = modlua_push_config_path(ib, ctx, L);
+    dir = ib_mpool_calloc(mp, 1, sizeof(*dir));
+    if (dir == NULL) {
+        return IB_EALLOC;
+    }
+    dir->type = MODLUA_REPLAY_DIRECTIVE;
+    dir->module = module;
+    dir->func = func;
+    dir->ctx = ctx;
+    dir->name = ib_mpool_strdup(mp, name);
+    dir->params = params;
+    dir->p1 = (p1 == NULL) ? NULL : ib_mpool_strdup(mp, p1);
+    dir->p2 = (p2 == NULL) ? NULL : ib_mpool_strdup(mp, p2);
+    dir->num = num;
+    if ( (dir->name == NULL) ||
+         ( (p1 != NULL) && (dir->p1 == NULL) ) ||
+         ( (p2 != NULL) && (dir->p2 == NULL) ) )
+    {
+        return IB_EALLOC;
+    }
+
+    /* The parser's list does not outlive configuration; copy it. */
+    if (list != NULL) {
+        const ib_list_node_t *node;
+
+        rc = ib_list_create(&(dir->list), mp);
+        if (rc != IB_OK) {
+            return rc;
+        }
+        IB_LIST_LOOP_CONST(list, node) {
+            const char *value = ib_mpool_strdup(
+                mp, (const char *)ib_list_node_data_const(node));
+            if (value == NULL) {
+                return IB_EALLOC;
+            }
+            rc = ib_list_push(dir->list, (void *)value);
+            if (rc != IB_OK) {
+                return rc;
+            }
+        }
+    }
+
+    rc = modlua_directive_eval(ib, modlua_global_cfg.L, dir);
     if (rc != IB_OK) {
-        lua_pop(L, 3);
         return rc;
     }
 
-    /* Push config parameters. */
-    lua_pushstring(L, name);
-    lua_pushinteger(L, onoff);
+    return modlua_replay_add(ib, dir);
+}
 
-    rc = modlua_config_cb_eval(L, ib, module, name, 5);
-    return rc;
+/**
+ * @param[in] cp Configuration parser.
+ * @param[in] name Directive name for the block that is being closed.
+ * @param[in,out] cbdata Callback data.
+ */
+static ib_status_t modlua_config_cb_blkend(
+    ib_cfgparser_t *cp,
+    const char *name,
+    void *cbdata)
+{
+    assert(cp);
+    assert(name);
+    assert(cbdata);
+
+    return modlua_config_cb(cp, cbdata, "modlua_config_cb_blkend", name,
+                            MODLUA_PARAMS_NONE, NULL, NULL, 0, NULL);
+}
+
+/**
+ * @param[in] cp Configuration parser.
+ * @param[in] name Configuration directive name.
+ * @param[in] onoff On or off setting.
+ * @param[in] cbdata Callback data.
+ */
+static ib_status_t modlua_config_cb_onoff(
+    ib_cfgparser_t *cp,
+    const char *name,
+    int onoff,
+    void *cbdata)
+{
+    assert(cp);
+    assert(name);
+    assert(cbdata);
+
+    return modlua_config_cb(cp, cbdata, "modlua_config_cb_onoff", name,
+                            MODLUA_PARAMS_NUM, NULL, NULL, onoff, NULL);
 }
 /**
  * @param[in] cp Configuration parser.
@@ -576,37 +787,8 @@ static ib_status_t modlua_config_cb_param1(
     assert(p1);
     assert(cbdata);
 
-    ib_status_t rc;
-    modlua_lua_cbdata_t *modlua_lua_cbdata = (modlua_lua_cbdata_t *)cbdata;
-    lua_State *L = modlua_global_cfg.L;
-    ib_module_t *module = modlua_lua_cbdata->module;
-    ib_engine_t *ib = module->ib;
-    ib_context_t *ctx;
-
-    rc = ib_cfgparser_context_current(cp, &ctx);
-    if (rc != IB_OK) {
-        ib_cfg_log_error(cp, "Could not retrieve current context.");
-        return rc;
-    }
-
-    /* Push standard module directive arguments. */
-    lua_getglobal(L, "modlua");
-    lua_getfield(L, -1, "modlua_config_cb_param1");
-    lua_replace(L, -2); /* Effectively remove then modlua table. */
-    lua_pushlightuserdata(L, module->ib);
-    lua_pushinteger(L, module->idx);
-    rc = modlua_push_config_path(ib, ctx, L);
-    if (rc != IB_OK) {
-        lua_pop(L, 3);
-        return rc;
-    }
-
-    /* Push config parameters. */
-    lua_pushstring(L, name);
-    lua_pushstring(L, p1);
-
-    rc = modlua_config_cb_eval(L, ib, module, name, 5);
-    return rc;
+    return modlua_config_cb(cp, cbdata, "modlua_config_cb_param1", name,
+                            MODLUA_PARAMS_STR1, p1, NULL, 0, NULL);
 }
 /**
  * @param[in] cp Configuration parser.
@@ -628,38 +810,8 @@ static ib_status_t modlua_config_cb_param2(
     assert(p2);
     assert(cbdata);
 
-    ib_status_t rc;
-    modlua_lua_cbdata_t *modlua_lua_cbdata = (modlua_lua_cbdata_t *)cbdata;
-    lua_State *L = modlua_global_cfg.L;
-    ib_module_t *module = modlua_lua_cbdata->module;
-    ib_engine_t *ib = module->ib;
-    ib_context_t *ctx;
-
-    rc = ib_cfgparser_context_current(cp, &ctx);
-    if (rc != IB_OK) {
-        ib_cfg_log_error(cp, "Could not retrieve current context.");
-        return rc;
-    }
-
-    /* Push standard module directive arguments. */
-    lua_getglobal(L, "modlua");
-    lua_getfield(L, -1, "modlua_config_cb_param2");
-    lua_replace(L, -2); /* Effectively remove then modlua table. */
-    lua_pushlightuserdata(L, module->ib);
-    lua_pushinteger(L, module->idx);
-    rc = modlua_push_config_path(ib, ctx, L);
-    if (rc != IB_OK) {
-        lua_pop(L, 3);
-        return rc;
-    }
-
-    /* Push config parameters. */
-    lua_pushstring(L, name);
-    lua_pushstring(L, p1);
-    lua_pushstring(L, p2);
-
-    rc = modlua_config_cb_eval(L, ib, module, name, 6);
-    return rc;
+    return modlua_config_cb(cp, cbdata, "modlua_config_cb_param2", name,
+                            MODLUA_PARAMS_STR2, p1, p2, 0, NULL);
 }
 /**
  * @param[in] cp Configuration parser.
@@ -678,37 +830,8 @@ static ib_status_t modlua_config_cb_list(
     assert(list);
     assert(cbdata);
 
-    ib_status_t rc;
-    modlua_lua_cbdata_t *modlua_lua_cbdata = (modlua_lua_cbdata_t *)cbdata;
-    lua_State *L = modlua_global_cfg.L;
-    ib_module_t *module = modlua_lua_cbdata->module;
-    ib_engine_t *ib = module->ib;
-    ib_context_t *ctx;
-
-    rc = ib_cfgparser_context_current(cp, &ctx);
-    if (rc != IB_OK) {
-        ib_cfg_log_error(cp, "Could not retrieve current context.");
-        return rc;
-    }
-
-    /* Push standard module directive arguments. */
-    lua_getglobal(L, "modlua");
-    lua_getfield(L, -1, "modlua_config_cb_list");
-    lua_replace(L, -2); /* Effectively remove then modlua table. */
-    lua_pushlightuserdata(L, module->ib);
-    lua_pushinteger(L, module->idx);
-    rc = modlua_push_config_path(ib, ctx, L);
-    if (rc != IB_OK) {
-        lua_pop(L, 3);
-        return rc;
-    }
-
-    /* Push config parameters. */
-    lua_pushstring(L, name);
-    lua_pushlightuserdata(L, (void *)list);
-
-    rc = modlua_config_cb_eval(L, ib, module, name, 5);
-    return rc;
+    return modlua_config_cb(cp, cbdata, "modlua_config_cb_list", name,
+                            MODLUA_PARAMS_LIST, NULL, NULL, 0, list);
 }
 /**
  * @param[in] cp Configuration parser.
@@ -726,37 +849,8 @@ static ib_status_t modlua_config_cb_opflags(
     assert(name);
     assert(cbdata);
 
-    ib_status_t rc;
-    modlua_lua_cbdata_t *modlua_lua_cbdata = (modlua_lua_cbdata_t *)cbdata;
-    lua_State *L = modlua_global_cfg.L;
-    ib_module_t *module = modlua_lua_cbdata->module;
-    ib_engine_t *ib = module->ib;
-    ib_context_t *ctx;
-
-    rc = ib_cfgparser_context_current(cp, &ctx);
-    if (rc != IB_OK) {
-        ib_cfg_log_error(cp, "Could not retrieve current context.");
-        return rc;
-    }
-
-    /* Push standard module directive arguments. */
-    lua_getglobal(L, "modlua");
-    lua_getfield(L, -1, "modlua_config_cb_opflags");
-    lua_replace(L, -2); /* Effectively remove then modlua table. */
-    lua_pushlightuserdata(L, module->ib);
-    lua_pushinteger(L, module->idx);
-    rc = modlua_push_config_path(ib, ctx, L);
-    if (rc != IB_OK) {
-        lua_pop(L, 3);
-        return rc;
-    }
-
-    /* Push config parameters. */
-    lua_pushstring(L, name);
-    lua_pushinteger(L, mask);
-
-    rc = modlua_config_cb_eval(L, ib, module, name, 5);
-    return rc;
+    return modlua_config_cb(cp, cbdata, "modlua_config_cb_opflags", name,
+                            MODLUA_PARAMS_NUM, NULL, NULL, mask, NULL);
 }
 /**
  * @param[in] cp Configuration parser.
@@ -775,37 +869,8 @@ static ib_status_t modlua_config_cb_sblk1(
     assert(p1);
     assert(cbdata);
 
-    ib_status_t rc;
-    modlua_lua_cbdata_t *modlua_lua_cbdata = (modlua_lua_cbdata_t *)cbdata;
-    lua_State *L = modlua_global_cfg.L;
-    ib_module_t *module = modlua_lua_cbdata->module;
-    ib_engine_t *ib = module->ib;
-    ib_context_t *ctx;
-
-    rc = ib_cfgparser_context_current(cp, &ctx);
-    if (rc != IB_OK) {
-        ib_cfg_log_error(cp, "Could not retrieve current context.");
-        return rc;
-    }
-
-    /* Push standard module directive arguments. */
-    lua_getglobal(L, "modlua");
-    lua_getfield(L, -1, "modlua_config_cb_sblk1");
-    lua_replace(L, -2); /* Effectively remove then modlua table. */
-    lua_pushlightuserdata(L, module->ib);
-    lua_pushinteger(L, module->idx);
-    rc = modlua_push_config_path(ib, ctx, L);
-    if (rc != IB_OK) {
-        lua_pop(L, 3);
-        return rc;
-    }
-
-    /* Push config parameters. */
-    lua_pushstring(L, name);
-    lua_pushstring(L, p1);
-
-    rc = modlua_config_cb_eval(L, ib, module, name, 5);
-    return rc;
+    return modlua_config_cb(cp, cbdata, "modlua_config_cb_sblk1", name,
+                            MODLUA_PARAMS_STR1, p1, NULL, 0, NULL);
 }
 
 
@@ -1002,6 +1067,26 @@ exit:
     return lua_gettop(L);
 }
 
+/**
+ * Stand-in for modlua_config_register_directive() when building pooled
+ * states.
+ *
+ * The directives were registered when the module was first loaded; this
+ * only returns success to the module.
+ *
+ * @param[in] L Lua state. See modlua_config_register_directive().
+ */
+static int modlua_config_register_directive_replay(lua_State *L)
+{
+    assert(L);
+
+    lua_pop(L, lua_gettop(L));
+    lua_pushinteger(L, IB_OK);
+    lua_pushstring(L, "Success.");
+
+    return lua_gettop(L);
+}
+
 /**
  * Push the specified handler for a lua module on top of the Lua stack L.
  *
@@ -1443,6 +1528,7 @@ static ib_status_t modlua_null(
     ib_status_t rc;
     ib_status_t join_rc; /* We need a temporary rc value for thread joins. */
     lua_State *L;
+    modlua_state_t *state = NULL;
     modlua_lua_cbdata_t *modlua_lua_cbdata;
     ib_module_t *module;
 
@@ -1450,10 +1536,22 @@ static ib_status_t modlua_null(
     module = modlua_lua_cbdata->module;
 
     /* Since there is  no connection Lua stack, we make a new one. */
-    rc = call_in_critical_section(ib, &ib_lua_new_thread, &L);
-    if (rc != IB_OK) {
-        ib_log_alert(ib, "Failed to allocate new Lua thread.");
-        return rc;
+    if (modlua_global_cfg.pool) {
+        rc = modlua_state_acquire(ib, &state);
+        if (rc != IB_OK) {
+            ib_log_alert(ib, "Failed to lease a pooled Lua state.");
+            return rc;
+        }
+    }
+    if (state != NULL) {
+        L = state->L;
+    }
+    else {
+        rc = call_in_critical_section(ib, &ib_lua_new_thread, &L);
+        if (rc != IB_OK) {
+            ib_log_alert(ib, "Failed to allocate new Lua thread.");
+            return rc;
+        }
     }
 
     /* Push Lua dispatch method to stack. */
@@ -1487,7 +1585,12 @@ static ib_status_t modlua_null(
         /* Do not return. We must join the Lua thread. */
     }
 
-    join_rc = call_in_critical_section(ib, &ib_lua_join_thread, &L);
+    if (state != NULL) {
+        join_rc = modlua_state_release(ib, state);
+    }
+    else {
+        join_rc = call_in_critical_section(ib, &ib_lua_join_thread, &L);
+    }
     if (join_rc != IB_OK) {
         ib_log_alert(ib, "Failed to join created Lua thread.");
 
@@ -1695,6 +1798,8 @@ static ib_status_t modlua_respline(
  * @param[in] ib IronBee engine.
  * @param[in] file The file we are loading.
  * @param[in] module The registered module structure.
+ * @param[in] register_directive Directive registration function passed
+ *            to the module.
  * @param[in,out] L The lua context that @a file will be loaded into as
  *                @a module.
  * @returns
@@ -1704,6 +1809,7 @@ static ib_status_t modlua_module_load_lua(
     ib_engine_t *ib,
     const char *file,
     ib_module_t *module,
+    lua_CFunction register_directive,
     lua_State *L)
 {
     assert(ib);
@@ -1740,7 +1846,7 @@ static ib_status_t modlua_module_load_lua(
     lua_pushlightuserdata(L, module); /* Push module engine. */
     lua_pushstring(L, file);
     lua_pushinteger(L, module->idx);
-    lua_pushcfunction(L, &modlua_config_register_directive);
+    lua_pushcfunction(L, register_directive);
     lua_rc = luaL_loadfile(L, file);
     switch(lua_rc) {
         case 0:
@@ -1977,6 +2083,7 @@ static ib_status_t modlua_module_load_wire_callbacks(
 static ib_status_t modlua_module_load(ib_engine_t *ib, const char *file) {
     lua_State *L;
     ib_module_t *module;
+    modlua_replay_t *replay;
     ib_status_t rc;
 
     rc = build_near_empty_module(ib, file, &module);
@@ -1996,7 +2103,8 @@ static ib_status_t modlua_module_load(ib_engine_t *ib, const char *file) {
         return IB_OK;
     }
 
-    rc = modlua_module_load_lua(ib, file, module, L);
+    rc = modlua_module_load_lua(ib, file, module,
+                                &modlua_config_register_directive, L);
     if (rc != IB_OK) {
         ib_log_error(ib, "Failed to load lua modules: %s", file);
         return rc;
@@ -2008,7 +2116,19 @@ static ib_status_t modlua_module_load(ib_engine_t *ib, const char *file) {
         return rc;
     }
 
-    return rc;
+    /* Record the load for pooled states. */
+    replay = ib_mpool_calloc(ib_engine_pool_main_get(ib), 1, sizeof(*replay));
+    if (replay == NULL) {
+        return IB_EALLOC;
+    }
+    replay->type = MODLUA_REPLAY_MODULE;
+    replay->module = module;
+    replay->file = ib_mpool_strdup(ib_engine_pool_main_get(ib), file);
+    if (replay->file == NULL) {
+        return IB_EALLOC;
+    }
+
+    return modlua_replay_add(ib, replay);
 }
 
 /**
@@ -2195,6 +2315,298 @@ static ib_status_t modlua_commit_configuration(ib_engine_t *ib)
 }
 
 
+/**
+ * Set up a new Lua state the way all module Lua states are set up.
+ *
+ * @param[in] ib IronBee engine.
+ * @param[in,out] L The new Lua state.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - Errors of modlua_setup_searchpath() or modlua_preload().
+ */
+static ib_status_t modlua_state_init(ib_engine_t *ib, lua_State *L)
+{
+    ib_status_t rc;
+
+    luaL_openlibs(L);
+
+    /* Setup search paths before ffi, api, etc loading. */
+    rc = modlua_setup_searchpath(ib, L);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    /* Load ffi, api, etc. */
+    rc = modlua_preload(ib, L);
+    if (rc != IB_OK) {
+        ib_log_error(ib, "Failed to pre-load Lua files.");
+        return rc;
+    }
+
+    /* Set package paths if configured. */
+    if (modlua_global_cfg.pkg_path) {
+        ib_log_debug(
+            ib,
+            "Using lua package.path=\"%s\"",
+             modlua_global_cfg.pkg_path);
+        lua_getfield(L, -1, "path");
+        lua_pushstring(L, modlua_global_cfg.pkg_path);
+        lua_setglobal(L, "path");
+    }
+    if (modlua_global_cfg.pkg_cpath) {
+        ib_log_debug(
+            ib,
+            "Using lua package.cpath=\"%s\"",
+            modlua_global_cfg.pkg_cpath);
+        lua_getfield(L, -1, "cpath");
+        lua_pushstring(L, modlua_global_cfg.pkg_cpath);
+        lua_setglobal(L, "cpath");
+    }
+
+    return IB_OK;
+}
+
+/**
+ * Create a Lua state for the state pool.
+ *
+ * The state is set up like the configuration state, and the Lua modules,
+ * Lua module directives and Lua rules of the configuration are then loaded
+ * into it in the order they were configured.
+ *
+ * @param[in] ib IronBee engine.
+ * @param[out] pstate The new state.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC on a memory error.
+ *   - Other errors if loading the configuration fails. See log file.
+ */
+static ib_status_t modlua_state_create(
+    ib_engine_t *ib,
+    modlua_state_t **pstate)
+{
+    assert(ib);
+    assert(pstate);
+
+    modlua_state_t *state;
+    const ib_list_node_t *node;
+    ib_status_t rc;
+
+    state = calloc(1, sizeof(*state));
+    if (state == NULL) {
+        return IB_EALLOC;
+    }
+    state->L = luaL_newstate();
+    if (state->L == NULL) {
+        free(state);
+        return IB_EALLOC;
+    }
+
+    rc = modlua_state_init(ib, state->L);
+    if (rc != IB_OK) {
+        goto failed;
+    }
+
+    if (modlua_global_cfg.replay != NULL) {
+        IB_LIST_LOOP_CONST(modlua_global_cfg.replay, node) {
+            const modlua_replay_t *replay =
+                (const modlua_replay_t *)ib_list_node_data_const(node);
+
+            switch (replay->type) {
+                case MODLUA_REPLAY_MODULE:
+                    rc = modlua_module_load_lua(
+                        ib,
+                        replay->file,
+                        replay->module,
+                        &modlua_config_register_directive_replay,
+                        state->L);
+                    break;
+                case MODLUA_REPLAY_RULE:
+                    rc = ib_lua_load_func(ib, state->L,
+                                          replay->file, replay->func);
+                    break;
+                case MODLUA_REPLAY_DIRECTIVE:
+                    rc = modlua_directive_eval(ib, state->L, replay);
+                    break;
+            }
+            if (rc != IB_OK) {
+                ib_log_error(ib,
+                             "Failed to load configuration into pooled "
+                             "Lua state: %s",
+                             ib_status_to_string(rc));
+                goto failed;
+            }
+        }
+    }
+
+    /* Clear stack. */
+    lua_pop(state->L, lua_gettop(state->L));
+
+    *pstate = state;
+    return IB_OK;
+
+failed:
+    lua_close(state->L);
+    free(state);
+    return rc;
+}
+
+/**
+ * Lease a Lua state from the state pool.
+ *
+ * The pool is built with the configuration and never grows: building a
+ * state replays the configuration, which is not safe while traffic is
+ * processed.  If all states are leased, no state is returned and the
+ * caller uses a thread of the shared configuration state instead.
+ *
+ * @param[in] ib IronBee engine.
+ * @param[out] pstate The leased state, or NULL if none is free.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - Errors from ib_lock_lock().
+ */
+static ib_status_t modlua_state_acquire(
+    ib_engine_t *ib,
+    modlua_state_t **pstate)
+{
+    assert(ib);
+    assert(pstate);
+
+    modlua_state_t *state;
+    ib_status_t rc;
+
+    rc = ib_lock_lock(modlua_global_cfg.pool_lck);
+    if (rc != IB_OK) {
+        ib_log_error(ib, "Failed to lock Lua state pool.");
+        return rc;
+    }
+    state = modlua_global_cfg.pool_free;
+    if (state != NULL) {
+        modlua_global_cfg.pool_free = state->next;
+    }
+    ib_lock_unlock(modlua_global_cfg.pool_lck);
+
+    if (state == NULL) {
+        ib_log_debug(ib,
+                     "All pooled Lua states are in use: "
+                     "Using the shared Lua state.");
+    }
+
+    *pstate = state;
+    return IB_OK;
+}
+
+/**
+ * Return a leased Lua state to the state pool.
+ *
+ * @param[in] ib IronBee engine.
+ * @param[in] state The state.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - Errors from ib_lock_lock().
+ */
+static ib_status_t modlua_state_release(
+    ib_engine_t *ib,
+    modlua_state_t *state)
+{
+    assert(ib);
+    assert(state);
+
+    ib_status_t rc;
+
+    /* Drop anything a failed call left on the stack. */
+    lua_pop(state->L, lua_gettop(state->L));
+
+    rc = ib_lock_lock(modlua_global_cfg.pool_lck);
+    if (rc != IB_OK) {
+        ib_log_error(ib, "Failed to lock Lua state pool.");
+        return rc;
+    }
+    state->next = modlua_global_cfg.pool_free;
+    modlua_global_cfg.pool_free = state;
+    ib_lock_unlock(modlua_global_cfg.pool_lck);
+
+    return IB_OK;
+}
+
+/**
+ * Create the Lua state pool.
+ *
+ * Called once the configuration is complete.
+ *
+ * @param[in] ib IronBee engine.
+ * @param[in] size Number of states to create now.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC on a memory error.
+ *   - Errors from modlua_state_create().
+ */
+static ib_status_t modlua_pool_create(ib_engine_t *ib, ib_num_t size)
+{
+    assert(ib);
+
+    ib_status_t rc;
+
+    modlua_global_cfg.pool_lck = malloc(sizeof(*modlua_global_cfg.pool_lck));
+    if (modlua_global_cfg.pool_lck == NULL) {
+        return IB_EALLOC;
+    }
+    rc = ib_lock_init(modlua_global_cfg.pool_lck);
+    if (rc != IB_OK) {
+        free(modlua_global_cfg.pool_lck);
+        modlua_global_cfg.pool_lck = NULL;
+        return rc;
+    }
+
+    for (ib_num_t n = 0; n < size; ++n) {
+        modlua_state_t *state;
+
+        rc = modlua_state_create(ib, &state);
+        if (rc != IB_OK) {
+            return rc;
+        }
+        state->next = modlua_global_cfg.pool_free;
+        modlua_global_cfg.pool_free = state;
+        state->all_next = modlua_global_cfg.pool_all;
+        modlua_global_cfg.pool_all = state;
+    }
+
+    modlua_global_cfg.pool = true;
+    ib_log_debug(ib, "Created %" PRId64 " pooled Lua states.", size);
+
+    return IB_OK;
+}
+
+/**
+ * Destroy the Lua state pool.
+ */
+static void modlua_pool_destroy(void)
+{
+    modlua_state_t *state = modlua_global_cfg.pool_all;
+
+    while (state != NULL) {
+        modlua_state_t *next = state->all_next;
+
+        lua_close(state->L);
+        free(state);
+        state = next;
+    }
+    modlua_global_cfg.pool_all = NULL;
+    modlua_global_cfg.pool_free = NULL;
+    modlua_global_cfg.pool = false;
+
+    if (modlua_global_cfg.pool_lck != NULL) {
+        ib_lock_destroy(modlua_global_cfg.pool_lck);
+        free(modlua_global_cfg.pool_lck);
+        modlua_global_cfg.pool_lck = NULL;
+    }
+}
+
+
 /* -- Event Handlers -- */
 
 /**
@@ -2204,6 +2616,10 @@ static ib_status_t modlua_commit_configuration(ib_engine_t *ib)
  * "owned" not by the module written in Lua by the user, but by this
  * module, the Lua Module.
  *
+ * With a state pool the stack is a pooled Lua state leased for the
+ * lifetime of the connection.  Without one, or if all pooled states are
+ * leased, it is a new thread of the configuration state.
+ *
  * @param ib Engine.
  * @param event Event type.
  * @param conn Connection.
@@ -2226,15 +2642,30 @@ static ib_status_t modlua_conn_init_lua_runtime(ib_engine_t *ib,
     ib_status_t rc;
     modlua_runtime_t *modlua_runtime;
 
-    modlua_runtime = ib_mpool_alloc(conn->mp, sizeof(modlua_runtime));
+    modlua_runtime = ib_mpool_calloc(conn->mp, 1, sizeof(*modlua_runtime));
     if (!modlua_runtime) {
         return IB_EALLOC;
     }
 
-    rc = call_in_critical_section(ib, &ib_lua_new_thread, &modlua_runtime->L);
-    if (rc != IB_OK) {
-        ib_log_alert(ib, "Failed to allocate new Lua thread for connection.");
-        return rc;
+    if (modlua_global_cfg.pool) {
+        rc = modlua_state_acquire(ib, &modlua_runtime->state);
+        if (rc != IB_OK) {
+            ib_log_alert(ib, "Failed to lease a Lua state for connection.");
+            return rc;
+        }
+    }
+    if (modlua_runtime->state != NULL) {
+        modlua_runtime->L = modlua_runtime->state->L;
+    }
+    else {
+        rc = call_in_critical_section(ib,
+                                      &ib_lua_new_thread,
+                                      &modlua_runtime->L);
+        if (rc != IB_OK) {
+            ib_log_alert(ib,
+                         "Failed to allocate new Lua thread for connection.");
+            return rc;
+        }
     }
 
     rc = modlua_runtime_set(conn, modlua_runtime);
@@ -2294,8 +2725,16 @@ static ib_status_t modlua_conn_fini_lua_runtime(ib_engine_t *ib,
         return IB_EOTHER;
     }
 
-    /* Atomically destroy the Lua stack */
-    rc = call_in_critical_section(ib, &ib_lua_join_thread, &modlua_runtime->L);
+    /* Return the pooled state, or atomically destroy the Lua stack */
+    if (modlua_runtime->state != NULL) {
+        rc = modlua_state_release(ib, modlua_runtime->state);
+        modlua_runtime->state = NULL;
+    }
+    else {
+        rc = call_in_critical_section(ib,
+                                      &ib_lua_join_thread,
+                                      &modlua_runtime->L);
+    }
 
     return rc;
 }
@@ -2327,6 +2766,8 @@ static ib_status_t rules_lua_init(ib_engine_t *ib, ib_module_t *m, void *cbdata)
  * @details This will atomically create and destroy a lua_State*
  *          allowing for concurrent execution of @a func_name
  *          by a ib_lua_func_eval(ib_engine_t*, ib_txt_t*, const char*).
+ *          With a state pool the rule runs in the pooled state leased by
+ *          the transaction's connection, and no lock is taken.
  *
  * @param[in,out] rule_exec Rule execution environment
  * @param[in] func_name The Lua function name to call.
@@ -2346,7 +2787,24 @@ static ib_status_t ib_lua_func_eval_r(const ib_rule_exec_t *rule_exec,
     ib_tx_t *tx = rule_exec->tx;
     int result_int;
     ib_status_t ib_rc;
+    ib_status_t join_rc;
     lua_State *L;
+    modlua_runtime_t *modlua_runtime = NULL;
+
+    /* With a state pool, run in the state leased by the connection. */
+    if (modlua_global_cfg.pool) {
+        ib_rc = modlua_runtime_get(tx->conn, &modlua_runtime);
+        if ( (ib_rc == IB_OK) &&
+             (modlua_runtime != NULL) &&
+             (modlua_runtime->state != NULL) )
+        {
+            ib_rc = ib_lua_func_eval_int(rule_exec, ib, tx,
+                                         modlua_runtime->L,
+                                         func_name, &result_int);
+            *result = result_int;
+            return ib_rc;
+        }
+    }
 
     /* Atomically create a new Lua stack */
     ib_rc = call_in_critical_section(ib, &ib_lua_new_thread, &L);
@@ -2361,14 +2819,10 @@ static ib_status_t ib_lua_func_eval_r(const ib_rule_exec_t *rule_exec,
     /* Convert the passed in integer type to an ib_num_t. */
     *result = result_int;
 
-    if (ib_rc != IB_OK) {
-        return ib_rc;
-    }
-
     /* Atomically destroy the Lua stack */
-    ib_rc = call_in_critical_section(ib, &ib_lua_join_thread, &L);
+    join_rc = call_in_critical_section(ib, &ib_lua_join_thread, &L);
 
-    return ib_rc;
+    return (ib_rc != IB_OK) ? ib_rc : join_rc;
 }
 
 static ib_status_t lua_operator_create(ib_engine_t *ib,
@@ -2435,6 +2889,7 @@ ib_status_t modlua_rule_driver(
 
     ib_status_t rc;
     ib_operator_inst_t *op_inst;
+    modlua_replay_t *replay;
     const char *slash;
     const char *name;
 
@@ -2459,6 +2914,23 @@ ib_status_t modlua_rule_driver(
         return rc;
     }
 
+    /* Record the rule for pooled states. */
+    replay = ib_mpool_calloc(ib_engine_pool_main_get(cp->ib), 1,
+                             sizeof(*replay));
+    if (replay == NULL) {
+        return IB_EALLOC;
+    }
+    replay->type = MODLUA_REPLAY_RULE;
+    replay->file = ib_mpool_strdup(ib_engine_pool_main_get(cp->ib), location);
+    replay->func = ib_rule_id(rule);
+    if (replay->file == NULL) {
+        return IB_EALLOC;
+    }
+    rc = modlua_replay_add(cp->ib, replay);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
     ib_cfg_log_debug3(cp, "Loaded lua file \"%s\"", location);
     slash = strrchr(location, '/');
     if (slash == NULL) {
@@ -2534,6 +3006,11 @@ static ib_status_t modlua_init(ib_engine_t *ib,
 
     /* Set up defaults */
     modlua_global_cfg.L = NULL;
+    modlua_global_cfg.replay = NULL;
+    modlua_global_cfg.pool = false;
+    modlua_global_cfg.pool_free = NULL;
+    modlua_global_cfg.pool_all = NULL;
+    modlua_global_cfg.pool_lck = NULL;
 
     modlua_global_cfg.L = luaL_newstate();
     if (modlua_global_cfg.L == NULL) {
@@ -2541,41 +3018,11 @@ static ib_status_t modlua_init(ib_engine_t *ib,
         return IB_EUNKNOWN;
     }
 
-    luaL_openlibs(modlua_global_cfg.L);
-
-    /* Setup search paths before ffi, api, etc loading. */
-    rc = modlua_setup_searchpath(ib, modlua_global_cfg.L);
-    if (rc != IB_OK) {
-        return rc;
-    }
-
-    /* Load ffi, api, etc. */
-    rc = modlua_preload(ib, modlua_global_cfg.L);
+    rc = modlua_state_init(ib, modlua_global_cfg.L);
     if (rc != IB_OK) {
-        ib_log_error(ib, "Failed to pre-load Lua files.");
         return rc;
     }
 
-    /* Set package paths if configured. */
-    if (modlua_global_cfg.pkg_path) {
-        ib_log_debug(
-            ib,
-            "Using lua package.path=\"%s\"",
-             modlua_global_cfg.pkg_path);
-        lua_getfield(modlua_global_cfg.L, -1, "path");
-        lua_pushstring(modlua_global_cfg.L, modlua_global_cfg.pkg_path);
-        lua_setglobal(modlua_global_cfg.L, "path");
-    }
-    if (modlua_global_cfg.pkg_cpath) {
-        ib_log_debug(
-            ib,
-            "Using lua package.cpath=\"%s\"",
-            modlua_global_cfg.pkg_cpath);
-        lua_getfield(modlua_global_cfg.L, -1, "cpath");
-        lua_pushstring(modlua_global_cfg.L, modlua_global_cfg.pkg_cpath);
-        lua_setglobal(modlua_global_cfg.L, "cpath");
-    }
-
     /* Hook to initialize the lua runtime with the connection.
      * There is a modlua_conn_fini_lua_runtime which is only registered
      * when the main configuration context is being closed. This ensures
@@ -2621,6 +3068,7 @@ static ib_status_t modlua_context_close(ib_engine_t  *ib,
                                         void         *cbdata)
 {
     ib_status_t rc;
+    modlua_cfg_t *cfg = NULL;
 
     /* Close of the main context signifies configuration finished. */
     if (ib_context_type(ctx) == IB_CTYPE_MAIN) {
@@ -2645,6 +3093,20 @@ static ib_status_t modlua_context_close(ib_engine_t  *ib,
         if (rc != IB_OK) {
             return rc;
         }
+
+        /* With the configuration complete, build the state pool. */
+        rc = ib_context_module_config(ctx, m, &cfg);
+        if (rc != IB_OK) {
+            return rc;
+        }
+        if (cfg->pool_size > 0) {
+            rc = modlua_pool_create(ib, cfg->pool_size);
+            if (rc != IB_OK) {
+                ib_log_error(ib, "Failed to create Lua state pool: %s",
+                             ib_status_to_string(rc));
+                return rc;
+            }
+        }
     }
 
     return IB_OK;
@@ -2674,6 +3136,12 @@ static IB_CFGMAP_INIT_STRUCTURE(modlua_config_map) = {
         modlua_cfg_t,
         pkg_cpath
     ),
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".pool_size",
+        IB_FTYPE_NUM,
+        modlua_cfg_t,
+        pool_size
+    ),
 
     IB_CFGMAP_INIT_LAST
 };
@@ -2873,6 +3341,30 @@ static ib_status_t modlua_dir_param1(ib_cfgparser_t *cp,
         free(p1_unescaped);
         return rc;
     }
+    else if (strcasecmp("LuaStatePoolSize", name) == 0) {
+        ib_num_t size;
+
+        if ( (cp->cur_ctx != NULL) &&
+             (cp->cur_ctx != ib_context_main(ib)) )
+        {
+            ib_cfg_log_error(cp, "%s is only valid in the main context.",
+                             name);
+            free(p1_unescaped);
+            return IB_EINVAL;
+        }
+        rc = ib_string_to_num(p1_unescaped, 0, &size);
+        if ( (rc != IB_OK) || (size < 0) ) {
+            ib_cfg_log_error(cp, "Invalid value for %s: %s",
+                             name, p1_unescaped);
+            free(p1_unescaped);
+            return IB_EINVAL;
+        }
+        ib_log_debug2(ib, "%s: %" PRId64, name, size);
+        rc = ib_context_set_num(ib_context_main(ib),
+                                MODULE_NAME_STR ".pool_size", size);
+        free(p1_unescaped);
+        return rc;
+    }
     else if (strcasecmp("LuaPackageCPath", name) == 0) {
         ib_context_t *ctx = cp->cur_ctx ? cp->cur_ctx : ib_context_main(ib);
         ib_log_debug2(ib, "%s: \"%s\" ctx=%p", name, p1_unescaped, ctx);
@@ -2906,6 +3398,11 @@ static IB_DIRMAP_INIT_STRUCTURE(modlua_directive_map) = {
         modlua_dir_param1,
         NULL
     ),
+    IB_DIRMAP_INIT_PARAM1(
+        "LuaStatePoolSize",
+        modlua_dir_param1,
+        NULL
+    ),
     IB_DIRMAP_INIT_PARAM1(
         "LuaInclude",
         modlua_dir_lua_include,
@@ -2922,10 +3419,12 @@ static IB_DIRMAP_INIT_STRUCTURE(modlua_directive_map) = {
 };
 
 /**
- * Destroy global lock and Lua state.
+ * Destroy global lock, Lua state and the Lua state pool.
  */
 static ib_status_t modlua_fini(ib_engine_t *ib, ib_module_t *m, void *cbdata) {
 
+    modlua_pool_destroy();
+
     ib_lock_destroy(modlua_global_cfg.L_lck);
     free(modlua_global_cfg.L_lck);
     modlua_global_cfg.L_lck = NULL;
@@ -503,6 +503,8 @@ static inline ib_status_t modhtp_set_bstr(
  * Set headers to libhtp
  *
  * The callback function @a fn is called for each iteration of @a header.
+ * The header names and values are in the transaction pool, which outlives
+ * the libhtp transaction, so libhtp references them instead of copying.
  *
  * @param[in] itx IronBee transaction
  * @param[in] htx HTP transaction passed to @a fn
@@ -538,7 +540,7 @@ static ib_status_t modhtp_set_header(
                  (const char *)ib_bytestr_const_ptr(node->name),
                  ib_bytestr_length(node->name),
                  value, vlen,
-                 HTP_ALLOC_COPY);
+                 HTP_ALLOC_REUSE);
         if (hrc != HTP_OK) {
             return IB_EUNKNOWN;
         }
@@ -1775,11 +1777,12 @@ static ib_status_t modhtp_iface_request_line(
         return IB_EUNKNOWN;
     }
 
-    /* Hand the whole request line to libhtp */
+    /* Hand the whole request line to libhtp; it is in the transaction
+     * pool, which outlives the libhtp transaction. */
     hrc = htp_tx_req_set_line(txdata->htx,
                               (const char *)ib_bytestr_const_ptr(line->raw),
                               ib_bytestr_length(line->raw),
-                              HTP_ALLOC_COPY);
+                              HTP_ALLOC_REUSE);
     if (hrc != HTP_OK) {
         return IB_EUNKNOWN;
     }
@@ -1932,12 +1935,12 @@ static ib_status_t modhtp_iface_response_line(
         return IB_EUNKNOWN;
     }
 
-    /* Hand off the status line */
+    /* Hand off the status line; as the request line, it is not copied. */
     hrc = htp_tx_res_set_status_line(
         htx,
         (const char *)ib_bytestr_const_ptr(line->raw),
         ib_bytestr_length(line->raw),
-        HTP_ALLOC_COPY);
+        HTP_ALLOC_REUSE);
     if (hrc != HTP_OK) {
         return IB_EUNKNOWN;
     }
@@ -30,6 +30,8 @@
 #include <ironbee/engine.h>
 #include <ironbee/escape.h>
 #include <ironbee/field.h>
+#include <ironbee/hash.h>
+#include <ironbee/lock.h>
 #include <ironbee/module.h>
 #include <ironbee/mpool.h>
 #include <ironbee/operator.h>
@@ -38,10 +40,14 @@
 #include <ironbee/rule_engine.h>
 #include <ironbee/util.h>
 
+#include "pcre_private.h"
+
 #include <pcre.h>
 
 #include <assert.h>
 #include <ctype.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -81,6 +87,17 @@ const int PCRE_JIT_STACK_MAX_MULT   = 512;
  */
 #define WORKSPACE_SIZE_DEFAULT (WORKSPACE_SIZE_MIN * 10)
 
+/**
+ * Default number of bytes of a body stream kept between chunks.
+ */
+#define STREAM_TAIL_MAX_DEFAULT (1024)
+
+/**
+ * Minimum length of a prefilter literal.  Shorter literals are in too many
+ * values to skip much.
+ */
+#define PREFILTER_MIN_LENGTH (3)
+
 /* Define the public module symbol. */
 IB_MODULE_DECLARE();
 
@@ -95,6 +112,8 @@ typedef struct modpcre_cfg_t {
     ib_num_t       jit_stack_start;       /**< Starting JIT stack size */
     ib_num_t       jit_stack_max;         /**< Max JIT stack size */
     ib_num_t       dfa_workspace_size;    /**< Size of DFA workspace */
+    ib_num_t       stream_tail_max;       /**< Max bytes kept between chunks */
+    ib_num_t       prefilter;             /**< Bool: Derive rule prefilters */
 } modpcre_cfg_t;
 
 /**
@@ -111,16 +130,57 @@ typedef struct modpcre_cpat_data_t {
     int                  jit_stack_start; /**< Starting JIT stack size */
     int                  jit_stack_max;   /**< Max JIT stack size */
     int                  dfa_ws_size;     /**< Size of DFA workspace */
+    struct modpcre_cache_t *cache;        /**< Cache holding this (or NULL) */
+    const char          *cache_key;       /**< Key in cache */
+    uint32_t             refs;            /**< Operators using this */
 } modpcre_cpat_data_t;
 
+/**
+ * Engine-wide cache of compiled patterns.
+ *
+ * Operator instances with the same pattern and compile settings share a
+ * single compiled pattern (and its JIT code), however many contexts the
+ * rules are included in.  Cached patterns are not modified after they are
+ * compiled.
+ */
+struct modpcre_cache_t {
+    ib_mpool_t          *mp;              /**< Pool of cached patterns */
+    ib_hash_t           *patterns;        /**< Key -> modpcre_cpat_data_t */
+    ib_lock_t            lock;            /**< Protects patterns and refs */
+    uint64_t             lookups;         /**< Number of lookups */
+    uint64_t             hits;            /**< Lookups finding a pattern */
+};
+
 /**
  * PCRE and DFA rule data types are an alias for the compiled pattern structure.
  */
 typedef struct modpcre_rule_data_t {
     modpcre_cpat_data_t *cpdata;          /**< Compiled pattern data */
     const char          *id;              /**< ID for DFA rules */
+    const char          *stream_key;      /**< Key of the stream tx data */
+    size_t               tail_max;        /**< Max bytes kept between chunks */
+    size_t               lookbehind;      /**< Max lookbehind of pattern */
 } modpcre_rule_data_t;
 
+/**
+ * Per-transaction state of a rule matching a body stream.
+ *
+ * A match may straddle the boundary of two chunks.  The end of a chunk
+ * which may still be the start of a match (as reported by a partial match)
+ * is kept and matched again in front of the next chunk.  At most
+ * modpcre_rule_data_t::tail_max bytes are kept, so memory use does not
+ * depend on the size of the body.
+ *
+ * Once data before the tail has been dropped, the subject no longer starts
+ * at the start of the body, and is matched with @c PCRE_NOTBOL.
+ */
+typedef struct modpcre_stream_t {
+    char                *buf;             /**< Tail followed by a chunk */
+    size_t               buf_size;        /**< Allocated size of buf */
+    size_t               tail_len;        /**< Length of the kept tail */
+    bool                 notbol;          /**< Data before tail dropped? */
+} modpcre_stream_t;
+
 /* Instantiate a module global configuration. */
 static modpcre_cfg_t modpcre_global_cfg = {
     1,                      /* study */
@@ -129,9 +189,167 @@ static modpcre_cfg_t modpcre_global_cfg = {
     5000,                   /* match_limit_recursion */
     0,                      /* jit_stack_start; 0 means auto */
     0,                      /* jit_stack_max; 0 means auto */
-    WORKSPACE_SIZE_DEFAULT  /* dfa_workspace_size */
+    WORKSPACE_SIZE_DEFAULT, /* dfa_workspace_size */
+    STREAM_TAIL_MAX_DEFAULT,/* stream_tail_max */
+    1                       /* prefilter */
 };
 
+/** Match statistics. */
+static modpcre_stats_t modpcre_stats;
+
+#ifdef PCRE_JIT_STACK
+/**
+ * JIT stack of a thread.
+ *
+ * Each thread keeps a single JIT stack which is used by every JIT compiled
+ * pattern.  It is replaced only when a pattern needs a larger maximum size,
+ * so once every pattern has run on a thread no JIT stacks are allocated.
+ */
+typedef struct modpcre_jit_stack_t {
+    pcre_jit_stack      *stack;           /**< The stack */
+    int                  max;             /**< Max size of stack */
+} modpcre_jit_stack_t;
+
+/** Key of the JIT stack of each thread: modpcre_jit_stack_t *. */
+static pthread_key_t  s_jit_stack_key;
+/** Was s_jit_stack_key created? */
+static bool           s_jit_stack_key_valid = false;
+/** Control for creating s_jit_stack_key. */
+static pthread_once_t s_jit_stack_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Free the JIT stack of a thread when it exits.
+ *
+ * @param[in] data JIT stack of the thread (modpcre_jit_stack_t *).
+ */
+static void jit_stack_destroy(void *data)
+{
+    modpcre_jit_stack_t *jit_stack = (modpcre_jit_stack_t *)data;
+
+    if (jit_stack->stack != NULL) {
+        pcre_jit_stack_free(jit_stack->stack);
+    }
+    free(jit_stack);
+}
+
+/**
+ * Create s_jit_stack_key; called once.
+ */
+static void jit_stack_key_create(void)
+{
+    s_jit_stack_key_valid =
+        (pthread_key_create(&s_jit_stack_key, jit_stack_destroy) == 0);
+}
+
+/**
+ * JIT stack callback: the JIT stack of the calling thread.
+ *
+ * Assigned to every JIT compiled pattern, so the shared study data is not
+ * modified when matching.  If the thread has no stack PCRE falls back to
+ * its 32K stack on the machine stack.
+ *
+ * @param[in] cbdata Callback data (unused).
+ *
+ * @returns JIT stack or NULL.
+ */
+static pcre_jit_stack *jit_stack_callback(void *cbdata)
+{
+    const modpcre_jit_stack_t *jit_stack;
+
+    if (! s_jit_stack_key_valid) {
+        return NULL;
+    }
+    jit_stack = (const modpcre_jit_stack_t *)
+        pthread_getspecific(s_jit_stack_key);
+
+    return (jit_stack == NULL) ? NULL : jit_stack->stack;
+}
+
+/**
+ * Make sure the JIT stack of the calling thread is large enough.
+ *
+ * The stack is allocated on first use and grows to the largest maximum of
+ * the patterns the thread has run.  If allocation fails the current stack
+ * (if any) is kept.
+ *
+ * @param[in] start Starting size the pattern asks for.
+ * @param[in] max Maximum size the pattern asks for.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC if the stack could not be allocated.
+ *   - IB_EUNKNOWN if the thread key could not be created or set.
+ */
+static ib_status_t jit_stack_reserve(int start, int max)
+{
+    modpcre_jit_stack_t *jit_stack;
+    pcre_jit_stack *stack;
+
+    pthread_once(&s_jit_stack_once, jit_stack_key_create);
+    if (! s_jit_stack_key_valid) {
+        return IB_EUNKNOWN;
+    }
+
+    jit_stack = (modpcre_jit_stack_t *)pthread_getspecific(s_jit_stack_key);
+    if (jit_stack == NULL) {
+        jit_stack = (modpcre_jit_stack_t *)calloc(1, sizeof(*jit_stack));
+        if (jit_stack == NULL) {
+            return IB_EALLOC;
+        }
+        if (pthread_setspecific(s_jit_stack_key, jit_stack) != 0) {
+            free(jit_stack);
+            return IB_EUNKNOWN;
+        }
+    }
+    else if (jit_stack->max >= max) {
+        return IB_OK;
+    }
+
+    if (max < jit_stack->max) {
+        max = jit_stack->max;
+    }
+    if (start > max) {
+        start = max;
+    }
+    stack = pcre_jit_stack_alloc(start, max);
+    if (stack == NULL) {
+        return IB_EALLOC;
+    }
+
+    if (jit_stack->stack != NULL) {
+        pcre_jit_stack_free(jit_stack->stack);
+        __sync_fetch_and_add(&(modpcre_stats.jit_growths), 1);
+    }
+    __sync_fetch_and_add(&(modpcre_stats.jit_stacks), 1);
+    jit_stack->stack = stack;
+    jit_stack->max = max;
+
+    return IB_OK;
+}
+#endif
+
+/**
+ * Count a pcre_exec() result in the match statistics.
+ *
+ * @param[in] rc Return value of pcre_exec().
+ */
+static void count_exec_result(int rc)
+{
+    switch (rc) {
+    case PCRE_ERROR_MATCHLIMIT:
+    case PCRE_ERROR_RECURSIONLIMIT:
+        __sync_fetch_and_add(&(modpcre_stats.match_limits), 1);
+        break;
+#ifdef PCRE_ERROR_JIT_STACKLIMIT
+    case PCRE_ERROR_JIT_STACKLIMIT:
+        __sync_fetch_and_add(&(modpcre_stats.jit_limits), 1);
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
 /**
  * Internal compilation of the modpcre pattern.
  *
@@ -367,6 +585,10 @@ static ib_status_t pcre_compile_internal(ib_engine_t *ib,
         else {
             cpdata->jit_stack_max = (int)config->jit_stack_max;
         }
+#endif
+#ifdef PCRE_JIT_STACK
+        /* Match on the JIT stack of the matching thread. */
+        pcre_assign_jit_stack(cpdata->edata, jit_stack_callback, NULL);
 #endif
     }
     else {
@@ -395,6 +617,132 @@ static ib_status_t pcre_compile_internal(ib_engine_t *ib,
     return IB_OK;
 }
 
+/**
+ * Compile a pattern for an operator, sharing it through the pattern cache.
+ *
+ * The cache key is made of the pattern and every setting which affects
+ * its compilation.  A pattern found in the cache gets another reference.
+ *
+ * @param[in] ib IronBee engine for logging.
+ * @param[in] cache Pattern cache.
+ * @param[in] config Module configuration
+ * @param[in] is_dfa Set to true for DFA
+ * @param[out] pcpdata Shared compiled pattern.
+ * @param[in] patt The uncompiled pattern to match.
+ * @param[out] errptr Pointer to an error message describing the failure.
+ * @param[out] erroffset The location of the failure, if this fails.
+ *
+ * @returns IronBee status. IB_EINVAL if the pattern is invalid,
+ *          IB_EALLOC if memory allocation fails or IB_OK.
+ */
+static ib_status_t pcre_compile_cached(ib_engine_t *ib,
+                                       modpcre_cache_t *cache,
+                                       const modpcre_cfg_t *config,
+                                       bool is_dfa,
+                                       modpcre_cpat_data_t **pcpdata,
+                                       const char *patt,
+                                       const char **errptr,
+                                       int *erroffset)
+{
+    assert(ib != NULL);
+    assert(cache != NULL);
+    assert(config != NULL);
+    assert(pcpdata != NULL);
+    assert(patt != NULL);
+
+    modpcre_cpat_data_t *cpdata;
+    char *key;
+    size_t key_sz;
+    ib_status_t rc;
+
+    /* Settings (eight numbers of at most 20 digits and a separator) and
+     * the pattern. */
+    key_sz = (8 * 21) + strlen(patt) + 2;
+    key = malloc(key_sz);
+    if (key == NULL) {
+        return IB_EALLOC;
+    }
+    snprintf(key, key_sz, "%d %ld %ld %ld %ld %ld %ld %ld\x1f%s",
+             is_dfa ? 1 : 0,
+             (long int)config->study,
+             (long int)config->use_jit,
+             (long int)config->match_limit,
+             (long int)config->match_limit_recursion,
+             (long int)config->jit_stack_start,
+             (long int)config->jit_stack_max,
+             (long int)config->dfa_workspace_size,
+             patt);
+
+    /* Operators may be created outside of configuration (e.g. by Lua
+     * modules), so the lookup, compilation and insertion are serialized. */
+    rc = ib_lock_lock(&(cache->lock));
+    if (rc != IB_OK) {
+        free(key);
+        return rc;
+    }
+
+    __sync_fetch_and_add(&(cache->lookups), 1);
+    rc = ib_hash_get(cache->patterns, &cpdata, key);
+    if (rc == IB_OK) {
+        __sync_fetch_and_add(&(cache->hits), 1);
+        ++(cpdata->refs);
+        *errptr = NULL;
+        *pcpdata = cpdata;
+        goto done;
+    }
+
+    rc = pcre_compile_internal(ib, cache->mp, config, is_dfa,
+                               &cpdata, patt, errptr, erroffset);
+    if (rc != IB_OK) {
+        goto done;
+    }
+
+    cpdata->cache = cache;
+    cpdata->cache_key = ib_mpool_strdup(cache->mp, key);
+    cpdata->refs = 1;
+    if (cpdata->cache_key == NULL) {
+        rc = IB_EALLOC;
+        goto done;
+    }
+    rc = ib_hash_set(cache->patterns, cpdata->cache_key, cpdata);
+    if (rc != IB_OK) {
+        goto done;
+    }
+
+    *pcpdata = cpdata;
+
+done:
+    ib_lock_unlock(&(cache->lock));
+    free(key);
+    return rc;
+}
+
+/**
+ * Release an operator's reference to a compiled pattern.
+ *
+ * The last reference removes the pattern from the cache; its memory
+ * belongs to the cache's pool.
+ *
+ * @param[in] cpdata Compiled pattern.
+ */
+static void pcre_cpat_release(modpcre_cpat_data_t *cpdata)
+{
+    assert(cpdata != NULL);
+
+    modpcre_cache_t *cache = cpdata->cache;
+
+    if (cache == NULL) {
+        return;
+    }
+    if (ib_lock_lock(&(cache->lock)) != IB_OK) {
+        return;
+    }
+    if (--(cpdata->refs) == 0) {
+        ib_hash_remove(cache->patterns, NULL, cpdata->cache_key);
+    }
+    ib_lock_unlock(&(cache->lock));
+}
+
 
 /* -- Matcher Interface -- */
 
@@ -506,9 +854,17 @@ static ib_status_t modpcre_match_compiled(ib_provider_t *mpr,
         return IB_EALLOC;
     }
 
+#ifdef PCRE_JIT_STACK
+    /* Without a stack the JIT code runs on its 32K machine stack. */
+    if (cpdata->is_jit) {
+        jit_stack_reserve(cpdata->jit_stack_start, cpdata->jit_stack_max);
+    }
+#endif
+
     ec = pcre_exec(cpdata->cpatt, cpdata->edata,
                    (const char *)data, dlen,
                    0, 0, ovector, ovector_sz);
+    count_exec_result(ec);
 
     free(ovector);
 
@@ -564,6 +920,415 @@ static IB_PROVIDER_IFACE_TYPE(matcher) modpcre_matcher_iface = {
     modpcre_match
 };
 
+/**
+ * Parse a quantifier.
+ *
+ * @param[in] p Start of the possible quantifier.
+ * @param[in] end End of the pattern.
+ * @param[out] min Minimum repeat count of the quantifier.
+ *
+ * @returns Length of the quantifier (including a lazy or possessive
+ *          suffix), or 0 if there is none at @a p.
+ */
+static size_t prefilter_quantifier(const char *p,
+                                   const char *end,
+                                   unsigned int *min)
+{
+    const char *q;
+
+    if (p == end) {
+        return 0;
+    }
+
+    switch (*p) {
+    case '*':
+    case '?':
+        *min = 0;
+        q = p + 1;
+        break;
+    case '+':
+        *min = 1;
+        q = p + 1;
+        break;
+    case '{':
+        /* {n}, {n,} or {n,m}; anything else is a literal '{'. */
+        *min = 0;
+        q = p + 1;
+        if ( (q == end) || (! isdigit((unsigned char)*q)) ) {
+            return 0;
+        }
+        while ( (q < end) && isdigit((unsigned char)*q) ) {
+            if (*q != '0') {
+                *min = 1;
+            }
+            ++q;
+        }
+        if ( (q < end) && (*q == ',') ) {
+            ++q;
+            while ( (q < end) && isdigit((unsigned char)*q) ) {
+                ++q;
+            }
+        }
+        if ( (q == end) || (*q != '}') ) {
+            return 0;
+        }
+        ++q;
+        break;
+    default:
+        return 0;
+    }
+
+    if ( (q < end) && ( (*q == '?') || (*q == '+') ) ) {
+        ++q;
+    }
+
+    return q - p;
+}
+
+/**
+ * Skip a character class.
+ *
+ * @param[in] p The opening '['.
+ * @param[in] end End of the pattern.
+ *
+ * @returns The character after the class, or NULL if it can't be parsed.
+ */
+static const char *prefilter_skip_class(const char *p, const char *end)
+{
+    const char *q = p + 1;
+
+    if ( (q < end) && (*q == '^') ) {
+        ++q;
+    }
+    if ( (q < end) && (*q == ']') ) {
+        ++q;
+    }
+    while (q < end) {
+        if (*q == '\\') {
+            if ( (q + 1 == end) || (q[1] == 'Q') ) {
+                return NULL;
+            }
+            q += 2;
+        }
+        else if ( (*q == '[') && (q + 1 < end) &&
+                  ( (q[1] == ':') || (q[1] == '.') || (q[1] == '=') ) )
+        {
+            /* POSIX class, e.g. [:alpha:] */
+            char t = q[1];
+
+            q += 2;
+            while ( (q + 1 < end) && ! ( (q[0] == t) && (q[1] == ']') ) ) {
+                ++q;
+            }
+            if (q + 1 >= end) {
+                return NULL;
+            }
+            q += 2;
+        }
+        else if (*q == ']') {
+            return q + 1;
+        }
+        else {
+            ++q;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Skip a group.
+ *
+ * @param[in] p The opening '('.
+ * @param[in] end End of the pattern.
+ *
+ * @returns The character after the group, or NULL if it can't be parsed.
+ */
+static const char *prefilter_skip_group(const char *p, const char *end)
+{
+    const char *q = p;
+    int depth = 0;
+
+    while (q < end) {
+        switch (*q) {
+        case '\\':
+            if ( (q + 1 == end) || (q[1] == 'Q') ) {
+                return NULL;
+            }
+            q += 2;
+            break;
+        case '[':
+            q = prefilter_skip_class(q, end);
+            if (q == NULL) {
+                return NULL;
+            }
+            break;
+        case '(':
+            /* A comment may contain unbalanced parentheses. */
+            if ( (q + 2 < end) && (q[1] == '?') && (q[2] == '#') ) {
+                return NULL;
+            }
+            ++depth;
+            ++q;
+            break;
+        case ')':
+            --depth;
+            ++q;
+            if (depth == 0) {
+                return q;
+            }
+            break;
+        default:
+            ++q;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Derive the prefilter of a pattern.
+ *
+ * Each top level alternative of the pattern contributes its longest run
+ * of required literal characters; every match contains one of them.  The
+ * pattern is parsed conservatively: anything which may change how the
+ * literals are matched (option settings, \\Q..\\E, unknown escapes) and
+ * alternatives without a literal of at least PREFILTER_MIN_LENGTH bytes
+ * result in no prefilter.
+ *
+ * @param[in] mp Memory pool to use for allocations.
+ * @param[in] patt Pattern.
+ * @param[out] pprefilter List of literals (const ib_bytestr_t *), or NULL
+ *             for no prefilter.
+ *
+ * @returns
+ *   - IB_OK on success (even if there is no prefilter).
+ *   - IB_EALLOC on memory failure.
+ */
+static ib_status_t pcre_prefilter_create(ib_mpool_t *mp,
+                                         const char *patt,
+                                         const ib_list_t **pprefilter)
+{
+    assert(mp != NULL);
+    assert(patt != NULL);
+    assert(pprefilter != NULL);
+
+    size_t plen = strlen(patt);
+    const char *p = patt;
+    const char *end = patt + plen;
+    uint8_t *run = NULL;
+    uint8_t *best = NULL;
+    ib_list_t *literals;
+    ib_status_t rc;
+
+    *pprefilter = NULL;
+
+    rc = ib_list_create(&literals, mp);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    run = malloc(plen + 1);
+    best = malloc(plen + 1);
+    if ( (run == NULL) || (best == NULL) ) {
+        rc = IB_EALLOC;
+        goto done;
+    }
+
+    for (;;) {
+        size_t run_len = 0;
+        size_t best_len = 0;
+        ib_bytestr_t *literal;
+
+        while ( (p < end) && (*p != '|') ) {
+            int c = -1;            /* Literal byte of the atom, or -1 */
+            unsigned int min = 0;
+            size_t qlen;
+
+            switch (*p) {
+            case '\\':
+                if (p + 1 == end) {
+                    goto done;
+                }
+                if (! isalnum((unsigned char)p[1])) {
+                    c = (unsigned char)p[1];
+                    p += 2;
+                    break;
+                }
+                switch (p[1]) {
+                case 'a': c = '\a'; break;
+                case 'e': c = 0x1b; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'x':
+                    if ( (p + 3 < end) &&
+                         isxdigit((unsigned char)p[2]) &&
+                         isxdigit((unsigned char)p[3]) )
+                    {
+                        char hex[3] = { p[2], p[3], '\0' };
+
+                        c = (int)strtol(hex, NULL, 16);
+                        p += 2;
+                        break;
+                    }
+                    goto done;
+                case 'd': case 'D': case 'w': case 'W': case 's': case 'S':
+                case 'h': case 'H': case 'v': case 'V': case 'R':
+                case 'b': case 'B': case 'A': case 'z': case 'Z': case 'G':
+                    break;
+                default:
+                    goto done;
+                }
+                p += 2;
+                break;
+            case '[':
+                p = prefilter_skip_class(p, end);
+                if (p == NULL) {
+                    goto done;
+                }
+                break;
+            case '(':
+                /* Verbs and option settings apply beyond the group. */
+                if ( (p + 1 < end) && (p[1] == '*') ) {
+                    goto done;
+                }
+                if ( (p + 2 < end) && (p[1] == '?') &&
+                     (strchr("imsxXJU-^#", p[2]) != NULL) )
+                {
+                    goto done;
+                }
+                p = prefilter_skip_group(p, end);
+                if (p == NULL) {
+                    goto done;
+                }
+                break;
+            case '.':
+            case '^':
+            case '$':
+                ++p;
+                break;
+            case ')':
+            case '*':
+            case '+':
+            case '?':
+                goto done;
+            case '{':
+                if (prefilter_quantifier(p, end, &min) != 0) {
+                    goto done;
+                }
+                c = '{';
+                ++p;
+                break;
+            default:
+                c = (unsigned char)*p;
+                ++p;
+            }
+
+            /* A literal extends the run, unless it is quantified. */
+            qlen = prefilter_quantifier(p, end, &min);
+            if ( (c >= 0) && ( (qlen == 0) || (min > 0) ) ) {
+                run[run_len++] = (uint8_t)c;
+            }
+            if ( (c < 0) || (qlen != 0) ) {
+                if (run_len > best_len) {
+                    memcpy(best, run, run_len);
+                    best_len = run_len;
+                }
+                run_len = 0;
+                p += qlen;
+            }
+        }
+        if (run_len > best_len) {
+            memcpy(best, run, run_len);
+            best_len = run_len;
+        }
+
+        /* This alternative may match without a literal. */
+        if (best_len < PREFILTER_MIN_LENGTH) {
+            goto done;
+        }
+
+        rc = ib_bytestr_dup_mem(&literal, mp, best, best_len);
+        if (rc != IB_OK) {
+            goto done;
+        }
+        rc = ib_list_push(literals, literal);
+        if (rc != IB_OK) {
+            goto done;
+        }
+
+        if (p == end) {
+            break;
+        }
+        ++p; /* Skip '|' */
+    }
+
+    *pprefilter = literals;
+
+done:
+    free(run);
+    free(best);
+    return rc;
+}
+
+/**
+ * Initialize the stream matching members of rule data.
+ *
+ * @param[in] op_inst Operator instance.
+ * @param[in] config Module configuration.
+ * @param[in] mp Memory pool to use for allocations.
+ * @param[in,out] rule_data Rule data; the compiled pattern must be set.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC on memory failure.
+ */
+static ib_status_t stream_init(const ib_operator_inst_t *op_inst,
+                               const modpcre_cfg_t *config,
+                               ib_mpool_t *mp,
+                               modpcre_rule_data_t *rule_data)
+{
+    assert(op_inst != NULL);
+    assert(config != NULL);
+    assert(mp != NULL);
+    assert(rule_data != NULL);
+    assert(rule_data->cpdata != NULL);
+
+    /* "stream-" prefix, 0x prefix, 16 hex digits and the \0. */
+    size_t key_sz = 7 + 2 + 16 + 1;
+    char *key;
+    int lookbehind = 0;
+
+    key = ib_mpool_alloc(mp, key_sz);
+    if (key == NULL) {
+        return IB_EALLOC;
+    }
+    snprintf(key, key_sz, "stream-%p", (const void *)op_inst);
+    rule_data->stream_key = key;
+
+    if (config->stream_tail_max > 0) {
+        rule_data->tail_max = config->stream_tail_max;
+    }
+    else {
+        rule_data->tail_max = 0;
+    }
+
+    /* Characters before the start of a match may be needed to match it. */
+#ifdef PCRE_INFO_MAXLOOKBEHIND
+    if (pcre_fullinfo(rule_data->cpdata->cpatt,
+                      rule_data->cpdata->edata,
+                      PCRE_INFO_MAXLOOKBEHIND,
+                      &lookbehind) != 0)
+    {
+        lookbehind = 0;
+    }
+#endif
+    rule_data->lookbehind = lookbehind;
+
+    return IB_OK;
+}
+
 /**
  * @brief Create the PCRE operator.
  * @param[in] ib The IronBee engine (unused)
@@ -619,16 +1384,15 @@ static ib_status_t pcre_operator_create(ib_engine_t *ib,
         return rc;
     }
 
-    /* Compile the pattern.  Note that the rule data is an alias for
-     * the compiled pattern type */
-    rc = pcre_compile_internal(ib,
-                               pool,
-                               config,
-                               false,
-                               &cpdata,
-                               pattern,
-                               &errptr,
-                               &erroffset);
+    /* Compile the pattern (or share an identical one). */
+    rc = pcre_compile_cached(ib,
+                             ((modpcre_data_t *)module->data)->cache,
+                             config,
+                             false,
+                             &cpdata,
+                             pattern,
+                             &errptr,
+                             &erroffset);
     if (rc != IB_OK) {
         return rc;
     }
@@ -636,15 +1400,37 @@ static ib_status_t pcre_operator_create(ib_engine_t *ib,
     /* Allocate a rule data object, populate it */
     rule_data = ib_mpool_alloc(pool, sizeof(*rule_data));
     if (rule_data == NULL) {
-        return IB_EALLOC;
+        rc = IB_EALLOC;
+        goto failed;
     }
     rule_data->cpdata = cpdata;
     rule_data->id = NULL;           /* Not needed for rx rules */
+    rc = stream_init(op_inst, config, pool, rule_data);
+    if (rc != IB_OK) {
+        goto failed;
+    }
+
+    /* Let the rule engine skip values without a required literal. */
+    if (config->prefilter) {
+        rc = pcre_prefilter_create(pool, pattern, &(op_inst->prefilter));
+        if (rc != IB_OK) {
+            goto failed;
+        }
+        if (op_inst->prefilter != NULL) {
+            ib_log_debug(ib, "PCRE prefilter for \"%s\": %zd literals",
+                         pattern, IB_LIST_ELEMENTS(op_inst->prefilter));
+        }
+    }
 
     /* Rule data is an alias for the compiled pattern data */
     op_inst->data = rule_data;
 
     return rc;
+
+failed:
+    /* The operator will not be destroyed; drop its pattern reference. */
+    pcre_cpat_release(cpdata);
+    return rc;
 }
 
 /**
@@ -652,13 +1438,20 @@ static ib_status_t pcre_operator_create(ib_engine_t *ib,
  * @param[in,out] op_inst The instance of the operator to be deallocated.
  *                Operator data is allocated out of the memory pool for
  *                IronBee so we do not destroy the operator here.
- *                pool for IronBee and need not be freed by us.
+ *                pool for IronBee and need not be freed by us.  The
+ *                reference to the shared compiled pattern is released.
  * @returns IB_OK always.
  */
 static ib_status_t pcre_operator_destroy(ib_operator_inst_t *op_inst)
 {
     assert(op_inst != NULL);
-    /* Nop */
+
+    const modpcre_rule_data_t *rule_data =
+        (const modpcre_rule_data_t *)op_inst->data;
+
+    if (rule_data != NULL) {
+        pcre_cpat_release(rule_data->cpdata);
+    }
     return IB_OK;
 }
 
@@ -747,63 +1540,467 @@ static ib_status_t pcre_set_matches(const ib_rule_exec_t *rule_exec,
  * collection (all with "0" key).
  *
  * @param[in] rule_exec Rule execution object
- * @param[in] ovector The vector of integer pairs of matches from PCRE.
- * @param[in] matches The number of matches.
- * @param[in] subject The matched-against string data.
+ * @param[in] ovector The vector of integer pairs of matches from PCRE.
+ * @param[in] matches The number of matches.
+ * @param[in] subject The matched-against string data.
+ *
+ * @returns IB_OK or IB_EALLOC.
+ */
+static ib_status_t pcre_dfa_set_match(const ib_rule_exec_t *rule_exec,
+                                      int *ovector,
+                                      int matches,
+                                      const char *subject)
+{
+    assert(rule_exec != NULL);
+    assert(rule_exec->ib != NULL);
+    assert(rule_exec->tx != NULL);
+    assert(ovector != NULL);
+
+    ib_tx_t *tx = rule_exec->tx;
+    int i;
+
+    /* We have a match! Now populate TX:0-9 in tx->data. */
+    ib_log_debug2_tx(tx, "DFA populating %d matches", matches);
+    for (i = 0; i < matches; ++i)
+    {
+        size_t match_len;
+        const char *match_start;
+        const char *name;
+        ib_bytestr_t *bs;
+        ib_field_t *field;
+        ib_status_t rc;
+
+        /* Readability. Mark the start and length of the string. */
+        match_start = subject+ovector[i * 2];
+        match_len = ovector[i * 2 + 1] - ovector[i * 2];
+
+        /* Create a byte-string representation */
+        rc = ib_bytestr_dup_mem(&bs,
+                                tx->mp,
+                                (const uint8_t*)match_start,
+                                match_len);
+        if (rc != IB_OK) {
+            return rc;
+        }
+
+        /* Create a field to hold the byte-string */
+        name = ib_rule_capture_name(rule_exec, 0);
+        rc = ib_field_create(&field, tx->mp, name, strlen(name),
+                             IB_FTYPE_BYTESTR, ib_ftype_bytestr_in(bs));
+        if (rc != IB_OK) {
+            return rc;
+        }
+
+        /* Add it to the capture collection */
+        rc = ib_rule_capture_add_item(rule_exec, field);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+
+    return IB_OK;
+}
+
+/**
+ * Get or create an ib_hash_t inside of @c tx for storing dfa rule data.
+ *
+ * The hash is stored at the key @c HASH_NAME_STR.
+ *
+ * @param[in] tx The transaction containing @c tx->data which holds
+ *            the @a rule_data object.
+ * @param[out] hash The fetched or created rule data hash. This is set
+ *             to NULL on failure.
+ *
+ * @return
+ *   - IB_OK on success.
+ *   - IB_EALLOC on allocation failure
+ */
+static ib_status_t get_or_create_rule_data_hash(ib_tx_t *tx,
+                                                ib_hash_t **hash)
+{
+    assert(tx);
+    assert(tx->mp);
+
+    ib_status_t rc;
+
+    /* Get or create the hash that contains the rule data. */
+    rc = ib_tx_get_module_data(tx, IB_MODULE_STRUCT_PTR, (void **)hash);
+    if ( (rc == IB_OK) && (*hash != NULL) ) {
+        ib_log_debug2_tx(tx, "Found rule data hash in tx.");
+        return IB_OK;
+    }
+
+    ib_log_debug2_tx(tx, "Rule data hash did not exist in tx.");
+
+    rc = ib_hash_create(hash, tx->mp);
+    if (rc != IB_OK) {
+        ib_log_debug2_tx(tx, "Failed to create hash: %s",
+                         ib_status_to_string(rc));
+        return rc;
+    }
+
+    rc = ib_tx_set_module_data(tx, IB_MODULE_STRUCT_PTR, *hash);
+    if (rc != IB_OK) {
+        ib_log_debug2_tx(tx, "Failed to store hash: %s",
+                         ib_status_to_string(rc));
+        *hash = NULL;
+    }
+
+    ib_log_debug2_tx(tx, "Returning rule hash at %p.", *hash);
+
+    return rc;
+
+}
+
+struct dfa_workspace_t {
+    int *workspace;
+    int wscount;
+};
+typedef struct dfa_workspace_t dfa_workspace_t;
+
+/**
+ * Is a rule matching a request or response body stream?
+ *
+ * @param[in] rule_exec Rule execution object
+ *
+ * @returns true if the data is a chunk of a body stream.
+ */
+static bool is_body_stream(const ib_rule_exec_t *rule_exec)
+{
+    assert(rule_exec != NULL);
+
+    return rule_exec->is_stream &&
+        ( (rule_exec->phase == PHASE_STR_REQUEST_BODY) ||
+          (rule_exec->phase == PHASE_STR_RESPONSE_BODY) );
+}
+
+/**
+ * Free the buffer of a stream when the transaction is destroyed.
+ *
+ * @param[in] cbdata The stream (modpcre_stream_t).
+ */
+static void stream_cleanup(void *cbdata)
+{
+    assert(cbdata != NULL);
+
+    modpcre_stream_t *stream = (modpcre_stream_t *)cbdata;
+
+    free(stream->buf);
+    stream->buf = NULL;
+    stream->buf_size = 0;
+}
+
+/**
+ * Get or create the per-transaction stream state of a rule.
+ *
+ * @param[in,out] tx Transaction to store the state in.
+ * @param[in] rule_data Rule data.
+ * @param[out] pstream The stream state.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC on an allocation error.
+ */
+static ib_status_t get_stream_tx_data(ib_tx_t *tx,
+                                      const modpcre_rule_data_t *rule_data,
+                                      modpcre_stream_t **pstream)
+{
+    assert(tx != NULL);
+    assert(tx->mp != NULL);
+    assert(rule_data != NULL);
+    assert(pstream != NULL);
+
+    ib_hash_t *hash;
+    ib_status_t rc;
+    modpcre_stream_t *stream;
+
+    rc = get_or_create_rule_data_hash(tx, &hash);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    rc = ib_hash_get(hash, pstream, rule_data->stream_key);
+    if (rc != IB_ENOENT) {
+        return rc;
+    }
+
+    stream = ib_mpool_calloc(tx->mp, 1, sizeof(*stream));
+    if (stream == NULL) {
+        return IB_EALLOC;
+    }
+    rc = ib_mpool_cleanup_register(tx->mp, stream_cleanup, stream);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_hash_set(hash, rule_data->stream_key, stream);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    *pstream = stream;
+    return IB_OK;
+}
+
+/**
+ * Make sure the buffer of a stream holds at least @a size bytes.
+ *
+ * @param[in,out] stream The stream.
+ * @param[in] size Required size.
+ *
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC on an allocation error.
+ */
+static ib_status_t stream_reserve(modpcre_stream_t *stream, size_t size)
+{
+    assert(stream != NULL);
+
+    char *buf;
+
+    if (size <= stream->buf_size) {
+        return IB_OK;
+    }
+
+    buf = realloc(stream->buf, size);
+    if (buf == NULL) {
+        return IB_EALLOC;
+    }
+    stream->buf = buf;
+    stream->buf_size = size;
+
+    return IB_OK;
+}
+
+/**
+ * Run one partial match of a rule against a stream subject.
+ *
+ * @param[in] rule_data Rule data.
+ * @param[in] edata Study data to use (or NULL).
+ * @param[in] ws DFA workspace (NULL for rx rules).
+ * @param[in] subject Subject.
+ * @param[in] subject_len Length of @a subject.
+ * @param[in] start_offset Offset in @a subject to start matching at.
+ * @param[in] options Options in addition to @c PCRE_PARTIAL_SOFT.
+ * @param[out] ovector The vector of integer pairs of matches.
+ * @param[in] ovecsize Size of @a ovector.
+ *
+ * @returns The return value of pcre_exec() or pcre_dfa_exec().
+ */
+static int stream_exec(const modpcre_rule_data_t *rule_data,
+                       pcre_extra *edata,
+                       dfa_workspace_t *ws,
+                       const char *subject,
+                       size_t subject_len,
+                       int start_offset,
+                       int options,
+                       int *ovector,
+                       int ovecsize)
+{
+    if (ws == NULL) {
+        int rc = pcre_exec(rule_data->cpdata->cpatt,
+                           edata,
+                           subject,
+                           subject_len,
+                           start_offset,
+                           PCRE_PARTIAL_SOFT | options,
+                           ovector,
+                           ovecsize);
+
+        count_exec_result(rc);
+        return rc;
+    }
+
+    return pcre_dfa_exec(rule_data->cpdata->cpatt,
+                         edata,
+                         subject,
+                         subject_len,
+                         start_offset,
+                         PCRE_PARTIAL_SOFT | options,
+                         ovector,
+                         ovecsize,
+                         ws->workspace,
+                         ws->wscount);
+}
+
+/**
+ * Match a chunk of a body stream, including the tail kept from the
+ * previous chunk.
+ *
+ * Matches which end in the kept tail were already counted for the previous
+ * chunk and are skipped.  A new tail is kept from the start of a partial
+ * match at the end of the subject (less the pattern's maximum lookbehind),
+ * truncated to modpcre_rule_data_t::tail_max bytes.  Subjects not at the
+ * start of the body are matched with @c PCRE_NOTBOL, so @c ^ only matches
+ * at the start of the body (or, in multiline mode, after a newline).
+ *
+ * @param[in] rule_exec Rule execution object
+ * @param[in] rule_data Rule data.
+ * @param[in] edata Study data to use (or NULL).
+ * @param[in] ws DFA workspace (NULL for rx rules).
+ * @param[in] chunk Data of the chunk.
+ * @param[in] chunk_len Length of @a chunk.
+ * @param[in] all Report all matches (else only the first).
+ * @param[out] ovector The vector of integer pairs of matches.
+ * @param[in] ovecsize Size of @a ovector.
+ * @param[out] match_count Number of matches found.
  *
- * @returns IB_OK or IB_EALLOC.
+ * @returns
+ *   - IB_OK on success.
+ *   - IB_EALLOC on an allocation error.
+ *   - IB_EUNKNOWN if PCRE failed.
  */
-static ib_status_t pcre_dfa_set_match(const ib_rule_exec_t *rule_exec,
-                                      int *ovector,
-                                      int matches,
-                                      const char *subject)
+static ib_status_t stream_match(const ib_rule_exec_t *rule_exec,
+                                const modpcre_rule_data_t *rule_data,
+                                pcre_extra *edata,
+                                dfa_workspace_t *ws,
+                                const char *chunk,
+                                size_t chunk_len,
+                                bool all,
+                                int *ovector,
+                                int ovecsize,
+                                int *match_count)
 {
     assert(rule_exec != NULL);
-    assert(rule_exec->ib != NULL);
     assert(rule_exec->tx != NULL);
+    assert(rule_data != NULL);
+    assert(chunk != NULL);
     assert(ovector != NULL);
+    assert(match_count != NULL);
 
     ib_tx_t *tx = rule_exec->tx;
-    int i;
+    modpcre_stream_t *stream;
+    const char *subject;
+    size_t subject_len;
+    size_t tail_len;
+    size_t keep_from;
+    size_t keep;
+    int start_offset = 0;
+    int options;
+    int matches;
+    ib_status_t rc;
 
-    /* We have a match! Now populate TX:0-9 in tx->data. */
-    ib_log_debug2_tx(tx, "DFA populating %d matches", matches);
-    for (i = 0; i < matches; ++i)
-    {
-        size_t match_len;
-        const char *match_start;
-        const char *name;
-        ib_bytestr_t *bs;
-        ib_field_t *field;
-        ib_status_t rc;
+    *match_count = 0;
 
-        /* Readability. Mark the start and length of the string. */
-        match_start = subject+ovector[i * 2];
-        match_len = ovector[i * 2 + 1] - ovector[i * 2];
+    rc = get_stream_tx_data(tx, rule_data, &stream);
+    if (rc != IB_OK) {
+        ib_rule_log_error(rule_exec,
+                          "Error fetching stream data for rule: %s",
+                          ib_status_to_string(rc));
+        return rc;
+    }
 
-        /* Create a byte-string representation */
-        rc = ib_bytestr_dup_mem(&bs,
-                                tx->mp,
-                                (const uint8_t*)match_start,
-                                match_len);
+    /* The subject is the kept tail followed by the chunk. */
+    tail_len = stream->tail_len;
+    if (tail_len == 0) {
+        subject = chunk;
+        subject_len = chunk_len;
+    }
+    else {
+        rc = stream_reserve(stream, tail_len + chunk_len);
         if (rc != IB_OK) {
             return rc;
         }
+        memcpy(stream->buf + tail_len, chunk, chunk_len);
+        subject = stream->buf;
+        subject_len = tail_len + chunk_len;
+    }
 
-        /* Create a field to hold the byte-string */
-        name = ib_rule_capture_name(rule_exec, 0);
-        rc = ib_field_create(&field, tx->mp, name, strlen(name),
-                             IB_FTYPE_BYTESTR, ib_ftype_bytestr_in(bs));
-        if (rc != IB_OK) {
-            return rc;
+    options = stream->notbol ? PCRE_NOTBOL : 0;
+
+    if (subject_len > rule_data->lookbehind) {
+        keep_from = subject_len - rule_data->lookbehind;
+    }
+    else {
+        keep_from = 0;
+    }
+
+    for (;;) {
+        matches = stream_exec(rule_data, edata, ws,
+                              subject, subject_len, start_offset, options,
+                              ovector, ovecsize);
+        if (matches == 0) {
+            /* The ovector was too small; it holds the first matches. */
+            matches = ovecsize / 3;
         }
 
-        /* Add it to the capture collection */
-        rc = ib_rule_capture_add_item(rule_exec, field);
+        if (matches > 0) {
+            /* Without all, only the first match is reported, but the
+             * subject is still scanned for a partial match at its end. */
+            if ( ((size_t)ovector[1] > tail_len) &&
+                 (all || (*match_count == 0)) )
+            {
+                ++(*match_count);
+                if (ib_rule_should_capture(rule_exec, 1)) {
+                    if (ws == NULL) {
+                        pcre_set_matches(rule_exec, ovector, matches, subject);
+                    }
+                    else {
+                        pcre_dfa_set_match(rule_exec, ovector, 1, subject);
+                    }
+                }
+            }
+
+            /* Never keep (and report again) matched data. */
+            if ((size_t)ovector[1] > keep_from) {
+                keep_from = ovector[1];
+            }
+
+            /* Continue after the match (or its start if empty). */
+            if (ovector[1] > ovector[0]) {
+                start_offset = ovector[1];
+            }
+            else {
+                start_offset = ovector[0] + 1;
+            }
+            if ((size_t)start_offset > subject_len) {
+                break;
+            }
+        }
+        else if (matches == PCRE_ERROR_PARTIAL) {
+            size_t partial_from = ovector[0];
+
+            if (partial_from > rule_data->lookbehind) {
+                partial_from -= rule_data->lookbehind;
+            }
+            else {
+                partial_from = 0;
+            }
+            if (partial_from < keep_from) {
+                keep_from = partial_from;
+            }
+            break;
+        }
+        else if (matches == PCRE_ERROR_NOMATCH) {
+            break;
+        }
+        else {
+            ib_rule_log_error(rule_exec,
+                              "Stream match failed (cpat=%p): %d",
+                              (void *)rule_data->cpdata->cpatt, matches);
+            return IB_EUNKNOWN;
+        }
+    }
+
+    /* Keep the tail for the next chunk. */
+    keep = subject_len - keep_from;
+    if (keep > rule_data->tail_max) {
+        ib_rule_log_debug(rule_exec,
+                          "Stream tail of %zd bytes truncated to %zd bytes; "
+                          "a match straddling chunks may be missed.",
+                          keep, rule_data->tail_max);
+        keep = rule_data->tail_max;
+    }
+    if (keep > 0) {
+        rc = stream_reserve(stream, keep);
         if (rc != IB_OK) {
             return rc;
         }
+        memmove(stream->buf, subject + subject_len - keep, keep);
+    }
+    if (keep < subject_len) {
+        stream->notbol = true;
     }
+    stream->tail_len = keep;
 
     return IB_OK;
 }
@@ -840,9 +2037,6 @@ static ib_status_t pcre_operator_execute(const ib_rule_exec_t *rule_exec,
     const ib_bytestr_t *bytestr;
     modpcre_rule_data_t *rule_data = (modpcre_rule_data_t *)data;
     pcre_extra *edata = NULL;
-#ifdef PCRE_JIT_STACK
-    pcre_jit_stack *jit_stack = NULL;
-#endif
 
     assert(rule_data->cpdata->is_dfa == false);
 
@@ -899,50 +2093,53 @@ static ib_status_t pcre_operator_execute(const ib_rule_exec_t *rule_exec,
         }
     }
 
-    if (rule_data->cpdata->is_jit) {
 #ifdef PCRE_JIT_STACK
-        jit_stack = pcre_jit_stack_alloc(rule_data->cpdata->jit_stack_start,
-                                         rule_data->cpdata->jit_stack_max);
-        if (jit_stack == NULL) {
+    if (rule_data->cpdata->is_jit) {
+        ib_rc = jit_stack_reserve(rule_data->cpdata->jit_stack_start,
+                                  rule_data->cpdata->jit_stack_max);
+        if (ib_rc != IB_OK) {
             ib_rule_log_debug(rule_exec,
                               "Failed to allocate a jit stack for a "
-                              "jit-compiled rule.  "
-                              "Not using jit for this call.");
-        }
-        /* If the study data is NULL or size zero, don't use it. */
-        else if (rule_data->cpdata->study_data_sz > 0) {
-            edata = rule_data->cpdata->edata;
-        }
-        if (edata != NULL) {
-            pcre_assign_jit_stack(edata, NULL, jit_stack);
+                              "jit-compiled rule: %s",
+                              ib_status_to_string(ib_rc));
         }
-#else
-        edata = NULL;
-#endif
     }
-    else if (rule_data->cpdata->study_data_sz > 0) {
+#endif
+
+    /* If the study data is NULL or size zero, don't use it. */
+    if (rule_data->cpdata->study_data_sz > 0) {
         edata = rule_data->cpdata->edata;
     }
-    else {
-        edata = NULL;
-    }
 
-    matches = pcre_exec(rule_data->cpdata->cpatt,
-                        edata,
-                        subject,
-                        subject_len,
-                        0, /* Starting offset. */
-                        0, /* Options. */
-                        ovector,
-                        ovecsize);
+    if (is_body_stream(rule_exec)) {
+        int match_count;
 
-#ifdef PCRE_JIT_STACK
-    if (jit_stack != NULL) {
-        pcre_jit_stack_free(jit_stack);
+        ib_rc = stream_match(rule_exec, rule_data, edata, NULL,
+                             subject, subject_len, false,
+                             ovector, ovecsize, &match_count);
+        matches = (match_count > 0) ? match_count : PCRE_ERROR_NOMATCH;
     }
-#endif
-
-    if (matches > 0) {
+    else {
+        ib_rc = IB_OK;
+        matches = pcre_exec(rule_data->cpdata->cpatt,
+                            edata,
+                            subject,
+                            subject_len,
+                            0, /* Starting offset. */
+                            0, /* Options. */
+                            ovector,
+                            ovecsize);
+        count_exec_result(matches);
+    }
+
+    if (ib_rc != IB_OK) {
+        *result = 0;
+    }
+    else if (is_body_stream(rule_exec)) {
+        /* Captures are set by stream_match(). */
+        *result = (matches > 0);
+    }
+    else if (matches > 0) {
         if (ib_rule_should_capture(rule_exec, 1) ) {
             pcre_set_matches(rule_exec, ovector, matches, subject);
         }
@@ -1076,14 +2273,14 @@ static ib_status_t dfa_operator_create(ib_engine_t *ib,
         return rc;
     }
 
-    rc = pcre_compile_internal(ib,
-                               pool,
-                               config,
-                               true,
-                               &cpdata,
-                               pattern,
-                               &errptr,
-                               &erroffset);
+    rc = pcre_compile_cached(ib,
+                             ((modpcre_data_t *)module->data)->cache,
+                             config,
+                             true,
+                             &cpdata,
+                             pattern,
+                             &errptr,
+                             &erroffset);
 
     if (rc != IB_OK) {
         ib_log_error(ib, "Failed to parse DFA operator pattern \"%s\":%s",
@@ -1094,79 +2291,32 @@ static ib_status_t dfa_operator_create(ib_engine_t *ib,
     /* Allocate a rule data object, populate it */
     rule_data = ib_mpool_alloc(pool, sizeof(*rule_data));
     if (rule_data == NULL) {
-        return IB_EALLOC;
+        rc = IB_EALLOC;
+        goto failed;
     }
     rule_data->cpdata = cpdata;
     rc = dfa_id_set(rule, op_inst, pool, rule_data);
     if (rc != IB_OK) {
         ib_log_error(ib, "Error creating ID for DFA: %s",
                      ib_status_to_string(rc));
-        return rc;
+        goto failed;
+    }
+    rc = stream_init(op_inst, config, pool, rule_data);
+    if (rc != IB_OK) {
+        goto failed;
     }
     ib_log_debug(ib, "Compiled DFA id=\"%s\" operator pattern \"%s\" @ %p",
                  rule_data->id, pattern, (void *)cpdata->cpatt);
 
     op_inst->data = (void *)rule_data;
     return IB_OK;
-}
-
-/**
- * Get or create an ib_hash_t inside of @c tx for storing dfa rule data.
- *
- * The hash is stored at the key @c HASH_NAME_STR.
- *
- * @param[in] tx The transaction containing @c tx->data which holds
- *            the @a rule_data object.
- * @param[out] hash The fetched or created rule data hash. This is set
- *             to NULL on failure.
- *
- * @return
- *   - IB_OK on success.
- *   - IB_EALLOC on allocation failure
- */
-static ib_status_t get_or_create_rule_data_hash(ib_tx_t *tx,
-                                                ib_hash_t **hash)
-{
-    assert(tx);
-    assert(tx->mp);
-
-    ib_status_t rc;
-
-    /* Get or create the hash that contains the rule data. */
-    rc = ib_tx_get_module_data(tx, IB_MODULE_STRUCT_PTR, (void **)hash);
-    if ( (rc == IB_OK) && (*hash != NULL) ) {
-        ib_log_debug2_tx(tx, "Found rule data hash in tx.");
-        return IB_OK;
-    }
-
-    ib_log_debug2_tx(tx, "Rule data hash did not exist in tx.");
-
-    rc = ib_hash_create(hash, tx->mp);
-    if (rc != IB_OK) {
-        ib_log_debug2_tx(tx, "Failed to create hash: %s",
-                         ib_status_to_string(rc));
-        return rc;
-    }
-
-    rc = ib_tx_set_module_data(tx, IB_MODULE_STRUCT_PTR, *hash);
-    if (rc != IB_OK) {
-        ib_log_debug2_tx(tx, "Failed to store hash: %s",
-                         ib_status_to_string(rc));
-        *hash = NULL;
-    }
-
-    ib_log_debug2_tx(tx, "Returning rule hash at %p.", *hash);
 
+failed:
+    /* The operator will not be destroyed; drop its pattern reference. */
+    pcre_cpat_release(cpdata);
     return rc;
-
 }
 
-struct dfa_workspace_t {
-    int *workspace;
-    int wscount;
-};
-typedef struct dfa_workspace_t dfa_workspace_t;
-
 /**
  * Create the per-transaction data for use with the dfa operator.
  *
@@ -1291,7 +2441,6 @@ static ib_status_t dfa_operator_execute(const ib_rule_exec_t *rule_exec,
     const ib_bytestr_t *bytestr;
     dfa_workspace_t *dfa_workspace;
     const char *id = ib_rule_id(rule_exec->rule);
-    int options; /* dfa exec options. */
     bool capture;
     int start_offset;
     int match_count;
@@ -1354,8 +2503,6 @@ static ib_status_t dfa_operator_execute(const ib_rule_exec_t *rule_exec,
                             ib_status_to_string(ib_rc));
         }
 
-        options = PCRE_PARTIAL_SOFT;
-
         ib_rc = alloc_dfa_tx_data(tx, rule_data->cpdata, id, &dfa_workspace);
         if (ib_rc != IB_OK) {
             free(ovector);
@@ -1369,7 +2516,6 @@ static ib_status_t dfa_operator_execute(const ib_rule_exec_t *rule_exec,
                           dfa_workspace);
     }
     else if (ib_rc == IB_OK) {
-        options = PCRE_PARTIAL_SOFT | PCRE_DFA_RESTART;
         ib_rule_log_debug(rule_exec, "Reusing existing DFA workspace %p.",
                           dfa_workspace);
     }
@@ -1387,33 +2533,46 @@ static ib_status_t dfa_operator_execute(const ib_rule_exec_t *rule_exec,
     capture = ib_rule_should_capture(rule_exec, 1);
     start_offset = 0;
     match_count = 0;
-    do {
-        matches = pcre_dfa_exec(rule_data->cpdata->cpatt,
-                                rule_data->cpdata->edata,
-                                subject,
-                                subject_len,
-                                start_offset, /* Starting offset. */
-                                options,
-                                ovector,
-                                ovecsize,
-                                dfa_workspace->workspace,
-                                dfa_workspace->wscount);
-
-        if (matches > 0) {
-            ib_log_debug3_tx(tx, "DFA matched: %d", matches);
-
-            ++match_count;
-
-            /* Use the longest match - the first in ovector -
-             * to set the offset in the subject for the next
-             * match.
-             */
-            start_offset = ovector[1] + 1;
-            if (capture) {
-                pcre_dfa_set_match(rule_exec, ovector, 1, subject);
-            }
+    if (is_body_stream(rule_exec)) {
+        ib_rc = stream_match(rule_exec, rule_data, rule_data->cpdata->edata,
+                             dfa_workspace, subject, subject_len, capture,
+                             ovector, ovecsize, &match_count);
+        if (ib_rc != IB_OK) {
+            free(ovector);
+            *result = 0;
+            return ib_rc;
         }
-    } while (capture && (matches > 0));
+        matches = PCRE_ERROR_NOMATCH;
+    }
+    else {
+        do {
+            matches = pcre_dfa_exec(rule_data->cpdata->cpatt,
+                                    rule_data->cpdata->edata,
+                                    subject,
+                                    subject_len,
+                                    start_offset, /* Starting offset. */
+                                    PCRE_PARTIAL_SOFT,
+                                    ovector,
+                                    ovecsize,
+                                    dfa_workspace->workspace,
+                                    dfa_workspace->wscount);
+
+            if (matches > 0) {
+                ib_log_debug3_tx(tx, "DFA matched: %d", matches);
+
+                ++match_count;
+
+                /* Use the longest match - the first in ovector -
+                 * to set the offset in the subject for the next
+                 * match.
+                 */
+                start_offset = ovector[1] + 1;
+                if (capture) {
+                    pcre_dfa_set_match(rule_exec, ovector, 1, subject);
+                }
+            }
+        } while (capture && (matches > 0));
+    }
 
     if (match_count > 0) {
         ib_rc = IB_OK;
@@ -1465,7 +2624,13 @@ static ib_status_t dfa_operator_destroy(ib_operator_inst_t *op_inst)
 {
     assert(op_inst != NULL);
 
-    /* Nop - Memory released by mpool. */
+    const modpcre_rule_data_t *rule_data =
+        (const modpcre_rule_data_t *)op_inst->data;
+
+    /* Memory released by mpool. */
+    if (rule_data != NULL) {
+        pcre_cpat_release(rule_data->cpdata);
+    }
 
     return IB_OK;
 }
@@ -1515,6 +2680,18 @@ static IB_CFGMAP_INIT_STRUCTURE(config_map) = {
         modpcre_cfg_t,
         dfa_workspace_size
     ),
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".stream_tail_max",
+        IB_FTYPE_NUM,
+        modpcre_cfg_t,
+        stream_tail_max
+    ),
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".prefilter",
+        IB_FTYPE_NUM,
+        modpcre_cfg_t,
+        prefilter
+    ),
     IB_CFGMAP_INIT_LAST
 };
 
@@ -1566,6 +2743,9 @@ static ib_status_t handle_directive_onoff(ib_cfgparser_t *cp,
     else if (strcasecmp("PcreUseJit", name) == 0) {
         pname = MODULE_NAME_STR ".use_jit";
     }
+    else if (strcasecmp("PcrePrefilter", name) == 0) {
+        pname = MODULE_NAME_STR ".prefilter";
+    }
     else {
         ib_cfg_log_error(cp, "Unhandled directive \"%s\"", name);
         return IB_EINVAL;
@@ -1647,6 +2827,9 @@ static ib_status_t handle_directive_param(ib_cfgparser_t *cp,
     else if (strcasecmp("PcreDfaWorkspaceSize", name) == 0) {
         pname = "pcre.dfa_workspace_size";
     }
+    else if (strcasecmp("PcreStreamTailMax", name) == 0) {
+        pname = "pcre.stream_tail_max";
+    }
     else {
         ib_cfg_log_error(cp, "Unhandled directive \"%s\"", name);
         return IB_EINVAL;
@@ -1670,6 +2853,11 @@ static IB_DIRMAP_INIT_STRUCTURE(directive_map) = {
         handle_directive_onoff,
         NULL
     ),
+    IB_DIRMAP_INIT_ONOFF(
+        "PcrePrefilter",
+        handle_directive_onoff,
+        NULL
+    ),
     IB_DIRMAP_INIT_PARAM1(
         "PcreMatchLimit",
         handle_directive_param,
@@ -1695,9 +2883,26 @@ static IB_DIRMAP_INIT_STRUCTURE(directive_map) = {
         handle_directive_param,
         NULL
     ),
+    IB_DIRMAP_INIT_PARAM1(
+        "PcreStreamTailMax",
+        handle_directive_param,
+        NULL
+    ),
     IB_DIRMAP_INIT_LAST
 };
 
+/**
+ * Destroy the pattern cache lock with the cache's pool.
+ *
+ * @param[in] data Pattern cache.
+ */
+static void modpcre_cache_cleanup(void *data)
+{
+    modpcre_cache_t *cache = (modpcre_cache_t *)data;
+
+    ib_lock_destroy(&(cache->lock));
+}
+
 static ib_status_t modpcre_init(ib_engine_t *ib,
                                 ib_module_t *m,
                                 void        *cbdata)
@@ -1705,6 +2910,36 @@ static ib_status_t modpcre_init(ib_engine_t *ib,
     assert(ib != NULL);
     assert(m != NULL);
     ib_status_t rc;
+    modpcre_data_t *mdata;
+    modpcre_cache_t *cache;
+
+    mdata = ib_mpool_calloc(ib_engine_pool_main_get(ib), 1, sizeof(*mdata));
+    if (mdata == NULL) {
+        return IB_EALLOC;
+    }
+    mdata->stats = &modpcre_stats;
+
+    /* Create the pattern cache. */
+    cache = ib_mpool_calloc(ib_engine_pool_main_get(ib), 1, sizeof(*cache));
+    if (cache == NULL) {
+        return IB_EALLOC;
+    }
+    cache->mp = ib_engine_pool_main_get(ib);
+    rc = ib_hash_create(&(cache->patterns), cache->mp);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_lock_init(&(cache->lock));
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_mpool_cleanup_register(cache->mp, modpcre_cache_cleanup, cache);
+    if (rc != IB_OK) {
+        ib_lock_destroy(&(cache->lock));
+        return rc;
+    }
+    mdata->cache = cache;
+    m->data = mdata;
 
     /* Register as a matcher provider. */
     rc = ib_provider_register(ib,
@@ -1727,7 +2962,7 @@ static ib_status_t modpcre_init(ib_engine_t *ib,
     /* Register operators. */
     ib_operator_register(ib,
                          "pcre",
-                         (IB_OP_FLAG_PHASE | IB_OP_FLAG_CAPTURE),
+                         (IB_OP_FLAG_PHASE | IB_OP_FLAG_STREAM | IB_OP_FLAG_CAPTURE),
                          pcre_operator_create,
                          NULL,
                          pcre_operator_destroy,
@@ -1738,7 +2973,7 @@ static ib_status_t modpcre_init(ib_engine_t *ib,
     /* An alias of pcre. The same callbacks are registered. */
     ib_operator_register(ib,
                          "rx",
-                         (IB_OP_FLAG_PHASE | IB_OP_FLAG_CAPTURE),
+                         (IB_OP_FLAG_PHASE | IB_OP_FLAG_STREAM | IB_OP_FLAG_CAPTURE),
                          pcre_operator_create,
                          NULL,
                          pcre_operator_destroy,
@@ -1760,6 +2995,78 @@ static ib_status_t modpcre_init(ib_engine_t *ib,
     return IB_OK;
 }
 
+/**
+ * Report the pattern cache statistics when the main context is closed.
+ *
+ * @param[in] ib IronBee engine
+ * @param[in] m Module
+ * @param[in] ctx Context being closed
+ * @param[in] cbdata Callback data (unused)
+ *
+ * @returns IB_OK
+ */
+static ib_status_t modpcre_context_close(ib_engine_t *ib,
+                                         ib_module_t *m,
+                                         ib_context_t *ctx,
+                                         void *cbdata)
+{
+    assert(ib != NULL);
+    assert(m != NULL);
+    assert(ctx != NULL);
+
+    const modpcre_data_t *mdata = (const modpcre_data_t *)m->data;
+    const modpcre_cache_t *cache;
+    uint64_t lookups;
+    uint64_t hits;
+
+    if ( (mdata == NULL) || (ctx != ib_context_main(ib)) ) {
+        return IB_OK;
+    }
+    cache = mdata->cache;
+    if (cache == NULL) {
+        return IB_OK;
+    }
+
+    lookups = __atomic_load_n(&(cache->lookups), __ATOMIC_RELAXED);
+    hits = __atomic_load_n(&(cache->hits), __ATOMIC_RELAXED);
+    ib_log_info(ib,
+                "PCRE pattern cache: %zd patterns, "
+                "%" PRIu64 " lookups, %" PRIu64 " hits",
+                ib_hash_size(cache->patterns), lookups, hits);
+
+    return IB_OK;
+}
+
+/**
+ * Report the match statistics when the module is unloaded.
+ *
+ * @param[in] ib IronBee engine
+ * @param[in] m Module
+ * @param[in] cbdata Callback data (unused)
+ *
+ * @returns IB_OK
+ */
+static ib_status_t modpcre_fini(ib_engine_t *ib,
+                                ib_module_t *m,
+                                void *cbdata)
+{
+    assert(ib != NULL);
+    assert(m != NULL);
+
+    ib_log_info(ib,
+                "PCRE matches: %" PRIu64 " jit stacks allocated, "
+                "%" PRIu64 " jit stack growths, "
+                "%" PRIu64 " jit stack limit hits, "
+                "%" PRIu64 " match limit hits",
+                __atomic_load_n(&(modpcre_stats.jit_stacks), __ATOMIC_RELAXED),
+                __atomic_load_n(&(modpcre_stats.jit_growths), __ATOMIC_RELAXED),
+                __atomic_load_n(&(modpcre_stats.jit_limits), __ATOMIC_RELAXED),
+                __atomic_load_n(&(modpcre_stats.match_limits),
+                                __ATOMIC_RELAXED));
+
+    return IB_OK;
+}
+
 /**
  * Module structure.
  *
@@ -1773,11 +3080,11 @@ IB_MODULE_INIT(
     directive_map,                        /**< Config directive map */
     modpcre_init,                         /**< Initialize function */
     NULL,                                 /**< Callback data */
-    NULL,                                 /**< Finish function */
+    modpcre_fini,                         /**< Finish function */
     NULL,                                 /**< Callback data */
     NULL,                                 /**< Context open function */
     NULL,                                 /**< Callback data */
-    NULL,                                 /**< Context close function */
+    modpcre_context_close,                /**< Context close function */
     NULL,                                 /**< Callback data */
     NULL,                                 /**< Context destroy function */
     NULL                                  /**< Callback data */
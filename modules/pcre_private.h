@@ -0,0 +1,62 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef _IB_MODULE_PCRE_PRIVATE_H_
+#define _IB_MODULE_PCRE_PRIVATE_H_
+
+/**
+ * @file
+ * @brief IronBee --- Private PCRE module definitions
+ *
+ * The module data (ib_module_t::data) of the pcre module is a
+ * modpcre_data_t.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Process-wide match statistics.
+ *
+ * Reported when the module is unloaded.  Counters are updated atomically.
+ */
+typedef struct modpcre_stats_t {
+    uint64_t             jit_stacks;      /**< JIT stacks allocated */
+    uint64_t             jit_growths;     /**< JIT stacks replaced by larger */
+    uint64_t             jit_limits;      /**< Matches out of JIT stack */
+    uint64_t             match_limits;    /**< Matches hitting match limits */
+} modpcre_stats_t;
+
+/** Engine-wide cache of compiled patterns; opaque outside the module. */
+typedef struct modpcre_cache_t modpcre_cache_t;
+
+/**
+ * Module data.
+ */
+typedef struct modpcre_data_t {
+    modpcre_cache_t     *cache;           /**< Compiled pattern cache */
+    modpcre_stats_t     *stats;           /**< Match statistics */
+} modpcre_data_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _IB_MODULE_PCRE_PRIVATE_H_ */
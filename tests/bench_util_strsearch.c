@@ -0,0 +1,211 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee --- Substring search microbenchmark
+ *
+ * Compares ib_strstr_ex() and ib_strcasestr_ex() with the byte by byte
+ * search they replaced and with the C library's memmem() on haystacks of
+ * typical header and body sizes.  The needles do not occur in the
+ * haystack, so every search scans it completely.
+ *
+ * Usage: bench_util_strsearch [iterations-scale]
+ */
+
+#include "ironbee_config_auto.h"
+
+#include <ironbee/clock.h>
+#include <ironbee/string.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The search ib_strstr_ex() used to do.
+ */
+static const char *naive_strstr(const char *haystack,
+                                size_t      haystack_len,
+                                const char *needle,
+                                size_t      needle_len)
+{
+    size_t imax;
+
+    if ( (haystack == NULL) || (haystack_len == 0) ||
+         (needle == NULL) || (needle_len == 0) ||
+         (needle_len > haystack_len) )
+    {
+        return NULL;
+    }
+
+    imax = haystack_len - (needle_len - 1);
+    for (size_t i = 0; i < imax; ++i) {
+        const char *hp = haystack + i;
+        bool found = true;
+
+        for (size_t j = 0; j < needle_len; ++j) {
+            if (hp[j] != needle[j]) {
+                found = false;
+                break;
+            }
+        }
+        if (found) {
+            return hp;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * memmem() with the ib_strstr_ex() signature.
+ */
+static const char *libc_memmem(const char *haystack,
+                               size_t      haystack_len,
+                               const char *needle,
+                               size_t      needle_len)
+{
+    return memmem(haystack, haystack_len, needle, needle_len);
+}
+
+typedef const char *(*search_fn_t)(const char *, size_t,
+                                   const char *, size_t);
+
+typedef struct {
+    const char  *name;
+    search_fn_t  fn;
+} search_impl_t;
+
+static const search_impl_t impls[] = {
+    { "naive",            naive_strstr },
+    { "memmem",           libc_memmem },
+    { "ib_strstr_ex",     ib_strstr_ex },
+    { "ib_strcasestr_ex", ib_strcasestr_ex },
+    { NULL,               NULL }
+};
+
+/** Haystack sizes: short and long header values, small and large bodies. */
+static const size_t sizes[] = { 64, 512, 4096, 65536, 1048576, 0 };
+
+/** Needles; none occur in the generated haystack. */
+static const char *needles[] = {
+    "<script",
+    "union select",
+    "/etc/passwd",
+    "x-forwarded-for: 127.0.0.1",
+    NULL
+};
+
+/**
+ * Fill a buffer with header and form like text.
+ */
+static void fill(char *buf, size_t len)
+{
+    static const char *words[] = {
+        "Accept: ", "text/html", "application/xml;q=0.9", "gzip, deflate",
+        "Mozilla/5.0 ", "(X11; Linux x86_64) ", "name=value&", "id=1234&",
+        "session=", "a8f5f167f44f4964e6c998dee827110c", "; path=/", "\r\n",
+        "Cookie: ", "Host: www.example.com", "Content-Type: ", "utf-8 ",
+        NULL
+    };
+    size_t nwords = 0;
+    size_t pos = 0;
+
+    while (words[nwords] != NULL) {
+        ++nwords;
+    }
+    srand(1);
+    while (pos < len) {
+        const char *w = words[rand() % nwords];
+        size_t      n = strlen(w);
+
+        if (n > len - pos) {
+            n = len - pos;
+        }
+        memcpy(buf + pos, w, n);
+        pos += n;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    long   scale = (argc > 1) ? atol(argv[1]) : 1;
+    char  *haystack;
+    size_t max = 0;
+
+    if (scale <= 0) {
+        fprintf(stderr, "Usage: %s [iterations-scale]\n", argv[0]);
+        return 1;
+    }
+
+    for (size_t s = 0; sizes[s] != 0; ++s) {
+        if (sizes[s] > max) {
+            max = sizes[s];
+        }
+    }
+    haystack = malloc(max);
+    if (haystack == NULL) {
+        fprintf(stderr, "Allocation failed\n");
+        return 1;
+    }
+    fill(haystack, max);
+
+    printf("%-18s %8s %-28s %12s %10s\n",
+           "implementation", "size", "needle", "ns/search", "MB/s");
+    for (size_t s = 0; sizes[s] != 0; ++s) {
+        /* Scan about 64MB per measurement. */
+        size_t iterations = (scale * (64 << 20)) / sizes[s];
+
+        for (size_t n = 0; needles[n] != NULL; ++n) {
+            for (size_t i = 0; impls[i].name != NULL; ++i) {
+                const char *needle = needles[n];
+                size_t      needle_len = strlen(needle);
+                size_t      found = 0;
+                uint64_t    start;
+                uint64_t    elapsed;
+
+                /* Warm up caches and the implementation selection. */
+                impls[i].fn(haystack, sizes[s], needle, needle_len);
+
+                start = ib_clock_get_time_ns();
+                for (size_t k = 0; k < iterations; ++k) {
+                    if (impls[i].fn(haystack, sizes[s],
+                                    needle, needle_len) != NULL)
+                    {
+                        ++found;
+                    }
+                }
+                elapsed = ib_clock_get_time_ns() - start;
+                if (elapsed == 0) {
+                    elapsed = 1;
+                }
+
+                printf("%-18s %8zu %-28s %12.1f %10.1f%s\n",
+                       impls[i].name, sizes[s], needle,
+                       (double)elapsed / iterations,
+                       ((double)sizes[s] * iterations / (1 << 20)) /
+                           ((double)elapsed / 1e9),
+                       (found != 0) ? " (found!)" : "");
+            }
+        }
+    }
+
+    free(haystack);
+    return 0;
+}
@@ -28,6 +28,7 @@
 #include <ironbee/field.h>
 #include <ironbee/state_notify.h>
 #include <ironbee/bytestr.h>
+#include <ironbee/string.h>
 #include <ironbee/transformation.h>
 #include <ironbee/provider.h>
 
@@ -35,6 +36,19 @@
 #include "ibtest_util.hpp"
 #include "engine_private.h"
 
+#include <ironbee/core.h>
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
 /// @test Test ironbee library - ib_engine_create()
 TEST(TestIronBee, test_engine_create_null_server)
 {
@@ -401,3 +415,450 @@ TEST(TestIronBee, test_data_pcre)
 
     ibtest_engine_destroy(ib);
 }
+
+// Test pattern matching a field through a precompiled selector.
+TEST(TestIronBee, test_data_selector)
+{
+    ib_engine_t *ib;
+    ib_data_t *data;
+    ib_field_t *list_field;
+    ib_field_t *out_field;
+    ib_list_t *list;
+    ib_list_t *out_list;
+    ib_field_t *field1;
+    ib_field_t *field2;
+    const ib_data_selector_t *selector;
+    ib_num_t num1 = 1;
+    ib_num_t num2 = 2;
+
+    ibtest_engine_create(&ib);
+
+    ASSERT_EQ(IB_OK, ib_data_create(ib_engine_pool_main_get(ib), &data));
+    ASSERT_TRUE(data);
+
+    ASSERT_IB_OK(
+        ib_field_create(&field1, ib_data_pool(data), "field1", 6, IB_FTYPE_NUM, &num1));
+    ASSERT_IB_OK(
+        ib_field_create(&field2, ib_data_pool(data), "field2", 6, IB_FTYPE_NUM, &num2));
+    ASSERT_IB_OK(ib_data_add_list(data, "ARGV", &list_field));
+    ASSERT_IB_OK(ib_field_value(list_field, &list));
+    ASSERT_IB_OK(ib_list_push(list, field1));
+    ASSERT_IB_OK(ib_list_push(list, field2));
+
+    /* Malformed filters are rejected when the selector is created. */
+    ASSERT_EQ(IB_EINVAL,
+        ib_data_selector_create(ib_data_pool(data), IB_S2SL("ARGV://"),
+                                &selector));
+    ASSERT_EQ(IB_EINVAL,
+        ib_data_selector_create(ib_data_pool(data), IB_S2SL("ARGV:/(/"),
+                                &selector));
+
+    /* Plain field. */
+    ASSERT_IB_OK(
+        ib_data_selector_create(ib_data_pool(data), IB_S2SL("ARGV"),
+                                &selector));
+    ASSERT_IB_OK(ib_data_get_selector(data, selector, &out_field));
+    ASSERT_EQ(list_field, out_field);
+
+    /* Filter, used more than once. */
+    ASSERT_IB_OK(
+        ib_data_selector_create(ib_data_pool(data), IB_S2SL("ARGV:/.*2/"),
+                                &selector));
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_IB_OK(ib_data_get_selector(data, selector, &out_field));
+        ASSERT_IB_OK(ib_field_value(out_field, &out_list));
+        ASSERT_EQ(1U, IB_LIST_ELEMENTS(out_list));
+        out_field = (ib_field_t *) IB_LIST_FIRST(out_list)->data;
+        ASSERT_FALSE(memcmp(out_field->name, field2->name, field2->nlen));
+    }
+
+    /* Missing parent. */
+    ASSERT_IB_OK(
+        ib_data_selector_create(ib_data_pool(data), IB_S2SL("NOPE:/x/"),
+                                &selector));
+    ASSERT_EQ(IB_ENOENT, ib_data_get_selector(data, selector, &out_field));
+
+    ibtest_engine_destroy(ib);
+}
+
+class TxRecycleTest : public BaseFixture
+{
+};
+
+/// @test Test ironbee library - transaction recycling (TxRecycle)
+TEST_F(TxRecycleTest, test_tx_recycle)
+{
+    configureIronBeeByString(getBasicIronBeeConfig() + "TxRecycle On\n");
+
+    ib_conn_t *conn = buildIronBeeConnection();
+    ib_tx_t *tx;
+    ib_mpool_t *mp;
+
+    tx = buildIronBeeTransaction(conn);
+    mp = tx->mp;
+    ASSERT_TRUE(ib_mpool_alloc(mp, 10000));
+    ib_tx_destroy(tx);
+    ASSERT_TRUE(conn->tx_recycle);
+    EXPECT_EQ(sizeof(*tx), ib_mpool_inuse(mp));
+
+    /* The next transaction of the connection reuses the pool. */
+    tx = buildIronBeeTransaction(conn);
+    EXPECT_EQ(mp, tx->mp);
+    EXPECT_FALSE(conn->tx_recycle);
+    EXPECT_EQ(2U, conn->tx_count);
+    EXPECT_EQ(conn->tx_first, tx);
+    EXPECT_TRUE(tx->data);
+    ib_tx_destroy(tx);
+
+    ib_conn_destroy(conn);
+}
+
+class ContextSelectionTest : public BaseFixture
+{
+public:
+    /**
+     * Select the context of a transaction.
+     *
+     * @returns "site:location" of the selected context.
+     */
+    std::string select(ib_conn_t *conn, const char *host, const char *path)
+    {
+        ib_tx_t *tx = buildIronBeeTransaction(conn);
+        ib_context_t *ctx;
+        const ib_site_t *site;
+        const ib_site_location_t *location;
+        std::string result;
+
+        tx->hostname = host;
+        tx->path = path;
+        if (ib_ctxsel_select_context(ib_engine, conn, tx, &ctx) != IB_OK) {
+            throw std::runtime_error("Context selection failed.");
+        }
+        if ( (ib_context_site_get(ctx, &site) != IB_OK) ||
+             (ib_context_location_get(ctx, &location) != IB_OK) ||
+             (site == NULL) || (location == NULL) )
+        {
+            throw std::runtime_error("Selected context has no location.");
+        }
+        result = std::string(site->name) + ":" + location->path;
+        ib_tx_destroy(tx);
+
+        return result;
+    }
+};
+
+/// @test Test ironbee library - indexed site selection
+TEST_F(ContextSelectionTest, test_select)
+{
+    configureIronBeeByString(
+        getBasicIronBeeConfig() +
+        "<Site www>\n"
+        "  SiteId AAAABBBB-1111-2222-3333-000000000001\n"
+        "  Hostname www.example.com\n"
+        "  Service 1.0.0.1:80\n"
+        "  <Location /admin>\n"
+        "  </Location>\n"
+        "</Site>\n"
+        "<Site wildcard>\n"
+        "  SiteId AAAABBBB-1111-2222-3333-000000000002\n"
+        "  Hostname *.example.com\n"
+        "</Site>\n"
+        "<Site other>\n"
+        "  SiteId AAAABBBB-1111-2222-3333-000000000003\n"
+        "  Hostname other.com\n"
+        "  Service 2.0.0.1:80\n"
+        "</Site>\n"
+        "<Site default>\n"
+        "  SiteId AAAABBBB-1111-2222-3333-000000000004\n"
+        "  Hostname *\n"
+        "  <Location /x>\n"
+        "  </Location>\n"
+        "  <Location /x/y>\n"
+        "  </Location>\n"
+        "</Site>\n");
+
+    ib_conn_t *conn = buildIronBeeConnection();
+
+    EXPECT_EQ("test-site:/", select(conn, "somesite.com", "/admin"));
+    EXPECT_EQ("www:/admin", select(conn, "www.example.com", "/admin/x"));
+    EXPECT_EQ("www:/", select(conn, "WWW.Example.COM", "/"));
+    EXPECT_EQ("wildcard:/", select(conn, "a.b.example.com", "/admin"));
+    EXPECT_EQ("default:/", select(conn, "example.com", "/"));
+    /* The service of "other" does not match the connection. */
+    EXPECT_EQ("default:/", select(conn, "other.com", "/"));
+    /* The first location that is a prefix wins, not the longest. */
+    EXPECT_EQ("default:/x", select(conn, "nowhere.org", "/x/y/z"));
+
+    ib_conn_destroy(conn);
+}
+
+class AuditLogQueueTest : public BaseTransactionFixture
+{
+public:
+    AuditLogQueueTest() : m_fifo_fd(-1)
+    {
+    }
+
+    virtual void SetUp()
+    {
+        strcpy(m_basedir, "/tmp/XXXXXX");
+        ASSERT_TRUE(mkdtemp(m_basedir));
+        BaseTransactionFixture::SetUp();
+    }
+
+    virtual void TearDown()
+    {
+        std::string cmd = std::string("/bin/rm -fr ") + m_basedir;
+
+        BaseTransactionFixture::TearDown();
+        if (m_fifo_fd >= 0) {
+            close(m_fifo_fd);
+        }
+        if (system(cmd.c_str()) != 0) {
+            throw std::runtime_error("Failed to cleanup " + cmd);
+        }
+    }
+
+    /**
+     * Create a FIFO in the base directory with nothing but a full pipe.
+     *
+     * An index written to it blocks the writer thread on its flush until
+     * drainFifo() is called.  The read end is kept open until the engine
+     * is destroyed.
+     *
+     * @returns Path of the FIFO.
+     */
+    std::string fullFifo()
+    {
+        std::string path = std::string(m_basedir) + "/index.fifo";
+        char buf[4096];
+        int fd;
+
+        if (mkfifo(path.c_str(), 0600) != 0) {
+            throw std::runtime_error("Failed to create " + path);
+        }
+        m_fifo_fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+        fd = open(path.c_str(), O_WRONLY | O_NONBLOCK);
+        if ( (m_fifo_fd < 0) || (fd < 0) ) {
+            throw std::runtime_error("Failed to open " + path);
+        }
+        memset(buf, 'x', sizeof(buf));
+        while (write(fd, buf, sizeof(buf)) > 0) {
+        }
+        while (write(fd, buf, 1) > 0) {
+        }
+        if (errno != EAGAIN) {
+            throw std::runtime_error("Failed to fill " + path);
+        }
+        close(fd);
+
+        return path;
+    }
+
+    /**
+     * Read the FIFO of fullFifo() until every queued record is written.
+     *
+     * Reading goes on for a while after the last record so that the
+     * writer's final flush completes.
+     */
+    void drainFifo()
+    {
+        ib_core_auditlog_stats_t stats;
+        char buf[4096];
+        int idle = 0;
+
+        for (int i = 0; (i < 5000) && (idle < 100); ++i) {
+            while (read(m_fifo_fd, buf, sizeof(buf)) > 0) {
+            }
+            ASSERT_EQ(IB_OK, ib_core_auditlog_stats(ib_engine, &stats));
+            if (stats.written + stats.errors == stats.queued) {
+                ++idle;
+            }
+            usleep(1000);
+        }
+        ASSERT_EQ(100, idle);
+    }
+
+    char m_basedir[32];
+    int m_fifo_fd;
+};
+
+/// @test Test ironbee library - audit log writer thread and segments
+TEST_F(AuditLogQueueTest, test_segment)
+{
+    ib_core_auditlog_stats_t stats;
+    std::string line;
+
+    configureIronBeeByString(
+        getBasicIronBeeConfig() +
+        "AuditEngine On\n"
+        "AuditLogBaseDir " + m_basedir + "\n"
+        "AuditLogQueueSize 4\n"
+        "AuditLogSegmentSize 1048576\n");
+    performTx();
+
+    /* The index is flushed at the end of the writer's batch. */
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_EQ(IB_OK, ib_core_auditlog_stats(ib_engine, &stats));
+        if (stats.batches > 0) {
+            break;
+        }
+        usleep(1000);
+    }
+    EXPECT_EQ(1U, stats.queued);
+    EXPECT_EQ(1U, stats.written);
+    EXPECT_EQ(0U, stats.dropped);
+    EXPECT_EQ(0U, stats.errors);
+
+    std::ifstream index(
+        (std::string(m_basedir) + "/ironbee-index.log").c_str());
+    std::getline(index, line);
+    ASSERT_FALSE(line.empty());
+    EXPECT_NE(std::string::npos, line.find(" ironbee-audit-"));
+    EXPECT_NE(std::string::npos, line.find(".log@0"));
+}
+
+/// @test Test ironbee library - audit log writer in a forked process
+TEST_F(AuditLogQueueTest, test_fork)
+{
+    ib_core_auditlog_stats_t stats;
+    pid_t pid;
+    int status;
+
+    configureIronBeeByString(
+        getBasicIronBeeConfig() +
+        "AuditEngine On\n"
+        "AuditLogBaseDir " + m_basedir + "\n"
+        "AuditLogQueueSize 4\n"
+        "AuditLogQueueFull Wait\n"
+        "AuditLogSegmentSize 1048576\n");
+
+    /* Like a server's worker: configured by the parent, logs after fork. */
+    pid = fork();
+    ASSERT_LE(0, pid);
+    if (pid == 0) {
+        int rc = 1;
+
+        performTx();
+        for (int i = 0; i < 1000; ++i) {
+            if ( (ib_core_auditlog_stats(ib_engine, &stats) == IB_OK) &&
+                 (stats.written == 1) )
+            {
+                rc = 0;
+                break;
+            }
+            usleep(1000);
+        }
+        _exit(rc);
+    }
+
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status));
+
+    /* The parent queued nothing and the child's record is on disk. */
+    ASSERT_EQ(IB_OK, ib_core_auditlog_stats(ib_engine, &stats));
+    EXPECT_EQ(0U, stats.queued);
+
+    std::string line;
+    std::ifstream index(
+        (std::string(m_basedir) + "/ironbee-index.log").c_str());
+    std::getline(index, line);
+    ASSERT_FALSE(line.empty());
+    std::string segment =
+        "-" + boost::lexical_cast<std::string>(pid) + "-1.log@0";
+    EXPECT_NE(std::string::npos, line.find(segment));
+
+    /* The parent still writes its own records. */
+    performTx();
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_EQ(IB_OK, ib_core_auditlog_stats(ib_engine, &stats));
+        if (stats.written > 0) {
+            break;
+        }
+        usleep(1000);
+    }
+    EXPECT_EQ(1U, stats.written);
+}
+
+/// @test Test ironbee library - audit log writer dropping when full
+TEST_F(AuditLogQueueTest, test_drop)
+{
+    static const uint64_t num_tx = 64;
+    ib_core_auditlog_stats_t stats;
+
+    configureIronBeeByString(
+        getBasicIronBeeConfig() +
+        "AuditEngine On\n"
+        "AuditLogBaseDir " + m_basedir + "\n"
+        "AuditLogIndex " + fullFifo() + "\n"
+        "AuditLogQueueSize 1\n"
+        "AuditLogQueueFull Drop\n"
+        "AuditLogSegmentSize 1048576\n");
+
+    /* The writer blocks writing the index, after which the one slot of
+     * the queue fills and further records are dropped. */
+    for (uint64_t i = 0; i < num_tx; ++i) {
+        performTx();
+    }
+    ASSERT_EQ(IB_OK, ib_core_auditlog_stats(ib_engine, &stats));
+    EXPECT_EQ(num_tx, stats.queued + stats.dropped);
+    EXPECT_LT(0U, stats.dropped);
+    EXPECT_EQ(0U, stats.waited);
+
+    drainFifo();
+    ASSERT_EQ(IB_OK, ib_core_auditlog_stats(ib_engine, &stats));
+    EXPECT_EQ(stats.queued, stats.written);
+    EXPECT_EQ(num_tx, stats.written + stats.dropped);
+}
+
+/// @test Test ironbee library - audit log writer with a file per record
+TEST_F(AuditLogQueueTest, test_file)
+{
+    ib_core_auditlog_stats_t stats;
+    std::string line;
+    struct stat st;
+
+    configureIronBeeByString(
+        getBasicIronBeeConfig() +
+        "AuditEngine On\n"
+        "AuditLogBaseDir " + m_basedir + "\n"
+        "AuditLogSubDirFormat audit\n"
+        "AuditLogQueueSize 4\n");
+    performTx();
+
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_EQ(IB_OK, ib_core_auditlog_stats(ib_engine, &stats));
+        if (stats.batches > 0) {
+            break;
+        }
+        usleep(1000);
+    }
+    EXPECT_EQ(1U, stats.queued);
+    EXPECT_EQ(1U, stats.written);
+    EXPECT_EQ(0U, stats.errors);
+
+    /* The index names the record's own file, renamed into place. */
+    std::ifstream index(
+        (std::string(m_basedir) + "/ironbee-index.log").c_str());
+    std::getline(index, line);
+    ASSERT_FALSE(line.empty());
+    size_t start = line.find(" audit/");
+    ASSERT_NE(std::string::npos, start);
+    size_t end = line.find(' ', start + 1);
+    std::string name = line.substr(
+        start + 1,
+        end == std::string::npos ? end : end - start - 1);
+    EXPECT_NE(std::string::npos, name.find(ib_tx->id));
+    EXPECT_EQ(std::string::npos, line.find('@'));
+
+    std::string path = std::string(m_basedir) + "/" + name;
+    ASSERT_EQ(0, stat(path.c_str(), &st));
+    EXPECT_LT(0, st.st_size);
+    EXPECT_NE(0, stat((path + ".part").c_str(), &st));
+
+    std::string header;
+    std::ifstream record(path.c_str());
+    std::getline(record, header);
+    EXPECT_EQ(0U, header.find("MIME-Version: 1.0"));
+}
@@ -22,6 +22,8 @@
 #include <stdexcept>
 #include "base_fixture.h"
 
+#include <pthread.h>
+
 extern "C" {
 #include "engine_private.h"
 #include "rule_engine_private.h"
@@ -112,3 +114,229 @@ const char * IronBeeLuaModules::c_ib_conf =
 
 TEST_F(IronBeeLuaModules, load){
 }
+
+/**
+ * Run a transaction with Lua modules in pooled Lua states.
+ */
+struct IronBeeLuaStatePool : public IronBeeLuaModules
+{
+    static const char *c_ib_conf;
+
+    virtual void SetUp()
+    {
+        BaseTransactionFixture::SetUp();
+        configureIronBeeByString(c_ib_conf);
+        performTx();
+    }
+};
+
+const char * IronBeeLuaStatePool::c_ib_conf =
+    "LogLevel 9\n"
+    "SensorId AAAABBBB-1111-2222-3333-FFFF00000023\n"
+    "SensorName ExampleSensorName\n"
+    "SensorHostname example.sensor.tld\n"
+    "LoadModule \"ibmod_htp.so\"\n"
+    "LoadModule \"ibmod_pcre.so\"\n"
+    "LoadModule \"ibmod_rules.so\"\n"
+    "LoadModule \"ibmod_lua.so\"\n"
+    "ModuleBasePath \".\"\n"
+    "LuaStatePoolSize 1\n"
+    "LuaLoadModule \"test_ironbee_lua_modules.lua\"\n"
+    "MyLuaDirective pooled\n"
+    "Set parser \"htp\"\n"
+    "<Site default>\n"
+        "SiteId AAAABBBB-1111-2222-3333-000000000000\n"
+        "Hostname *\n"
+    "</Site>\n" ;
+
+TEST_F(IronBeeLuaStatePool, directive){
+    ib_field_t *field;
+
+    /* The module's transaction callbacks, running in the pooled state,
+     * copy the directive's value from their configuration. */
+    ASSERT_EQ(IB_OK, ib_data_get(ib_tx->data, "MyLuaDirective", &field));
+}
+
+/**
+ * Lease pooled Lua states from several connections.
+ */
+struct IronBeeLuaStatePoolSize : public IronBeeLuaModules
+{
+    static const char *c_ib_conf;
+
+    virtual void SetUp()
+    {
+        BaseTransactionFixture::SetUp();
+        configureIronBeeByString(c_ib_conf);
+        ib_conn = NULL;
+    }
+
+    virtual void TearDown() {
+        BaseFixture::TearDown();
+    }
+
+    /* Open a connection, leasing a Lua state. */
+    ib_conn_t *openConn()
+    {
+        return buildIronBeeConnection();
+    }
+
+    /* Close a connection, returning its Lua state. */
+    static void closeConn(ib_engine_t *ib, ib_conn_t *conn)
+    {
+        ASSERT_EQ(IB_OK, ib_state_notify_conn_closed(ib, conn));
+        ib_conn_destroy(conn);
+    }
+
+    /* Run a transaction on @a conn and check the Lua module saw it. */
+    void runTx(ib_conn_t *conn)
+    {
+        ib_field_t *field;
+
+        ib_tx = buildIronBeeTransaction(conn);
+        sendRequest();
+        sendResponse();
+        postProcess(ib_tx);
+        ASSERT_EQ(IB_OK, ib_data_get(ib_tx->data, "MyLuaDirective", &field));
+    }
+};
+
+const char * IronBeeLuaStatePoolSize::c_ib_conf =
+    "LogLevel 9\n"
+    "SensorId AAAABBBB-1111-2222-3333-FFFF00000023\n"
+    "SensorName ExampleSensorName\n"
+    "SensorHostname example.sensor.tld\n"
+    "LoadModule \"ibmod_htp.so\"\n"
+    "LoadModule \"ibmod_pcre.so\"\n"
+    "LoadModule \"ibmod_rules.so\"\n"
+    "LoadModule \"ibmod_lua.so\"\n"
+    "ModuleBasePath \".\"\n"
+    "LuaStatePoolSize 2\n"
+    "LuaLoadModule \"test_ironbee_lua_modules.lua\"\n"
+    "MyLuaDirective pooled\n"
+    "Set parser \"htp\"\n"
+    "<Site default>\n"
+        "SiteId AAAABBBB-1111-2222-3333-000000000000\n"
+        "Hostname *\n"
+    "</Site>\n" ;
+
+/* Two connections lease both states; a third uses the shared state. */
+TEST_F(IronBeeLuaStatePoolSize, exhausted){
+    ib_conn_t *conns[3];
+
+    for (int i = 0; i < 3; ++i) {
+        conns[i] = openConn();
+    }
+    for (int i = 0; i < 3; ++i) {
+        runTx(conns[i]);
+    }
+    for (int i = 0; i < 3; ++i) {
+        closeConn(ib_engine, conns[i]);
+    }
+
+    /* The states were returned and are leased again. */
+    conns[0] = openConn();
+    runTx(conns[0]);
+    closeConn(ib_engine, conns[0]);
+}
+
+/**
+ * Thread body: open and close connections, each leasing a pooled state.
+ */
+static void *lease_states(void *arg)
+{
+    ib_engine_t *ib = (ib_engine_t *)arg;
+
+    for (int i = 0; i < 100; ++i) {
+        ib_conn_t *conn;
+
+        if (ib_conn_create(ib, &conn, NULL) != IB_OK) {
+            return (void *)1;
+        }
+        conn->local_ipstr = "1.0.0.1";
+        conn->remote_ipstr = "1.0.0.2";
+        conn->remote_port = 65534;
+        conn->local_port = 80;
+        if ( (ib_state_notify_conn_opened(ib, conn) != IB_OK) ||
+             (ib_state_notify_conn_closed(ib, conn) != IB_OK) )
+        {
+            return (void *)1;
+        }
+        ib_conn_destroy(conn);
+    }
+
+    return NULL;
+}
+
+/* As many threads as states lease them concurrently. */
+TEST_F(IronBeeLuaStatePoolSize, concurrent){
+    pthread_t threads[2];
+    void *result;
+
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL,
+                                    lease_states, ib_engine));
+    }
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_EQ(0, pthread_join(threads[i], &result));
+        EXPECT_TRUE(result == NULL);
+    }
+}
+
+/**
+ * Run a Lua rule in pooled Lua states.
+ */
+struct IronBeeLuaStatePoolRule : public IronBeeLuaStatePoolSize
+{
+    static const char *c_ib_conf;
+
+    virtual void SetUp()
+    {
+        BaseTransactionFixture::SetUp();
+        configureIronBeeByString(c_ib_conf);
+        ib_conn = NULL;
+    }
+
+    /* Run a transaction on @a conn and check the Lua rule fired. */
+    void runRuleTx(ib_conn_t *conn)
+    {
+        ib_field_t *field;
+
+        ib_tx = buildIronBeeTransaction(conn);
+        sendRequest();
+        sendResponse();
+        postProcess(ib_tx);
+        ASSERT_EQ(IB_OK, ib_data_get(ib_tx->data, "lua_rule", &field));
+    }
+};
+
+const char * IronBeeLuaStatePoolRule::c_ib_conf =
+    "LogLevel 9\n"
+    "SensorId AAAABBBB-1111-2222-3333-FFFF00000023\n"
+    "SensorName ExampleSensorName\n"
+    "SensorHostname example.sensor.tld\n"
+    "LoadModule \"ibmod_htp.so\"\n"
+    "LoadModule \"ibmod_pcre.so\"\n"
+    "LoadModule \"ibmod_rules.so\"\n"
+    "LoadModule \"ibmod_lua.so\"\n"
+    "ModuleBasePath \".\"\n"
+    "LuaStatePoolSize 1\n"
+    "Set parser \"htp\"\n"
+    "<Site default>\n"
+        "SiteId AAAABBBB-1111-2222-3333-000000000000\n"
+        "Hostname *\n"
+        "RuleExt lua:test_module_rules_lua.lua id:luarule001 "
+            "phase:REQUEST_HEADER \"setvar:lua_rule=1\"\n"
+    "</Site>\n" ;
+
+/* The rule function is replayed into the pooled state, which a second
+ * connection leases again after the first returns it. */
+TEST_F(IronBeeLuaStatePoolRule, rule){
+    ib_conn_t *conn;
+
+    for (int i = 0; i < 2; ++i) {
+        conn = openConn();
+        runRuleTx(conn);
+        closeConn(ib_engine, conn);
+    }
+}
@@ -34,6 +34,15 @@
 // @todo Remove this once there is something like ib_engine_operator_get()
 #include "engine_private.h"
 
+#include "ac_private.h"
+
+#include <ironbee/bytestr.h>
+#include <ironbee/module.h>
+
+#include <boost/filesystem.hpp>
+
+#include <stdlib.h>
+
 class AhoCorasickModuleTest : public BaseModuleFixture
 {
 public:
@@ -220,3 +229,325 @@ TEST_F(AhoCorasickModuleTest, test_pmf_rule)
     // This time we should succeed.
     ASSERT_TRUE(result);
 }
+
+/**
+ * Creates pm and pmf operators and inspects their data.
+ *
+ * Unlike AhoCorasickModuleTest, the module is only loaded by the
+ * configuration, so its automata cache is the one the operators use.
+ */
+class AhoCorasickOperatorTest : public BaseTransactionFixture
+{
+public:
+    AhoCorasickOperatorTest() : m_rules(0)
+    {
+    }
+
+    virtual void TearDown()
+    {
+        if (! m_dir.empty()) {
+            boost::filesystem::remove_all(m_dir);
+        }
+        BaseTransactionFixture::TearDown();
+    }
+
+    //! Configure IronBee, with @a extra after the basic configuration.
+    void configure(const std::string& extra = "")
+    {
+        configureIronBeeByString(getBasicIronBeeConfig() + extra);
+        ib_conn = buildIronBeeConnection();
+        ib_tx = buildIronBeeTransaction(ib_conn);
+    }
+
+    //! Create a temporary directory, removed after the test.
+    const std::string& makeDir()
+    {
+        char dir[] = "/tmp/test_module_ahocorasick.XXXXXX";
+
+        if (mkdtemp(dir) == NULL) {
+            throw std::runtime_error("Could not create temporary directory.");
+        }
+        m_dir = dir;
+
+        return m_dir;
+    }
+
+    //! Automata files in the directory of makeDir().
+    std::vector<std::string> cacheFiles()
+    {
+        std::vector<std::string> files;
+
+        for (
+            boost::filesystem::directory_iterator i(m_dir);
+            i != boost::filesystem::directory_iterator();
+            ++i
+        ) {
+            if (i->path().extension() == ".e") {
+                files.push_back(i->path().string());
+            }
+        }
+
+        return files;
+    }
+
+    //! The automata cache of the module.
+    modac_cache_t *cache()
+    {
+        ib_module_t *module;
+        modac_cfg_t *config;
+
+        if (
+            ib_engine_module_get(ib_engine, "ac", &module) != IB_OK ||
+            ib_context_module_config(ib_context_main(ib_engine),
+                                     module, &config) != IB_OK ||
+            config->cache == NULL
+        ) {
+            throw std::runtime_error("Could not fetch automata cache.");
+        }
+
+        return config->cache;
+    }
+
+    //! Create a rule; stream rules keep their state across executions.
+    ib_rule_t *createRule(bool is_stream)
+    {
+        ib_rule_t *rule;
+
+        if (ib_rule_create(ib_engine, ib_context_engine(ib_engine),
+                           __FILE__, __LINE__, is_stream, &rule) != IB_OK)
+        {
+            throw std::runtime_error("Could not create rule.");
+        }
+        rule->meta.id = ib_mpool_strdup(
+            ib_engine_pool_main_get(ib_engine),
+            (std::string("rule-") +
+                boost::lexical_cast<std::string>(++m_rules)).c_str()
+        );
+
+        return rule;
+    }
+
+    //! Create the operator @a name of @a rule with @a param.
+    ib_operator_inst_t *createOperator(ib_rule_t *rule,
+                                       const char *name,
+                                       const char *param)
+    {
+        ib_operator_inst_t *op_inst = NULL;
+
+        if (ib_operator_inst_create(ib_engine,
+                                    NULL,
+                                    rule,
+                                    ib_rule_is_stream(rule) ?
+                                        IB_OP_FLAG_STREAM :
+                                        IB_OP_FLAG_PHASE,
+                                    name,
+                                    param,
+                                    IB_OPINST_FLAG_NONE,
+                                    &op_inst) != IB_OK)
+        {
+            throw std::runtime_error("Could not create operator.");
+        }
+
+        return op_inst;
+    }
+
+    //! Operator data of @a op_inst.
+    static const modac_operator_data_t *data(const ib_operator_inst_t *op_inst)
+    {
+        return reinterpret_cast<const modac_operator_data_t *>(op_inst->data);
+    }
+
+    //! Does @a op_inst of @a rule match @a subject?
+    bool execute(ib_operator_inst_t *op_inst,
+                 ib_rule_t *rule,
+                 const std::string& subject)
+    {
+        ib_rule_exec_t rule_exec;
+        ib_field_t *field;
+        ib_num_t result;
+        uint8_t *copy;
+
+        copy = reinterpret_cast<uint8_t *>(
+            ib_mpool_memdup(ib_tx->mp, subject.data(), subject.length())
+        );
+        if (
+            copy == NULL ||
+            ib_field_create_bytestr_alias(&field, ib_tx->mp,
+                                          IB_FIELD_NAME("subject"),
+                                          copy, subject.length()) != IB_OK
+        ) {
+            throw std::runtime_error("Could not create subject field.");
+        }
+
+        memset(&rule_exec, 0, sizeof(rule_exec));
+        rule_exec.ib = ib_engine;
+        rule_exec.tx = ib_tx;
+        rule_exec.rule = rule;
+
+        if (op_inst->op->fn_execute(&rule_exec, op_inst->data,
+                                    op_inst->flags, field, &result) != IB_OK)
+        {
+            throw std::runtime_error("Could not execute operator.");
+        }
+
+        return result != 0;
+    }
+
+private:
+    std::string m_dir;
+    size_t m_rules;
+};
+
+TEST_F(AhoCorasickOperatorTest, test_pm_eudoxus)
+{
+    configure("PmCompile On\n");
+    ib_rule_t *rule = createRule(false);
+    ib_operator_inst_t *op_inst = createOperator(rule, "pm", "foo bar");
+
+    ASSERT_TRUE(data(op_inst)->eudoxus != NULL);
+    EXPECT_TRUE(data(op_inst)->ac == NULL);
+
+    EXPECT_TRUE(execute(op_inst, rule, "xxbarxx"));
+    EXPECT_FALSE(execute(op_inst, rule, "xxbaxx"));
+    EXPECT_TRUE(execute(op_inst, rule, "foo"));
+}
+
+TEST_F(AhoCorasickOperatorTest, test_pmf_eudoxus)
+{
+    configure("PmCompile On\n");
+    ib_rule_t *rule = createRule(false);
+    ib_operator_inst_t *op_inst =
+        createOperator(rule, "pmf", "ahocorasick.patterns");
+
+    ASSERT_TRUE(data(op_inst)->eudoxus != NULL);
+
+    EXPECT_TRUE(execute(op_inst, rule, "xstring2x"));
+    EXPECT_FALSE(execute(op_inst, rule, "string3"));
+}
+
+TEST_F(AhoCorasickOperatorTest, test_stream)
+{
+    configure("PmCompile On\n");
+    ib_rule_t *rule1 = createRule(true);
+    ib_rule_t *rule2 = createRule(true);
+    ib_operator_inst_t *op_inst1 = createOperator(rule1, "pm", "foobar");
+    ib_operator_inst_t *op_inst2 = createOperator(rule2, "pm", "foobar");
+
+    ASSERT_TRUE(data(op_inst1)->eudoxus != NULL);
+
+    // The match straddles two chunks.
+    EXPECT_FALSE(execute(op_inst1, rule1, "xxfoo"));
+    EXPECT_TRUE(execute(op_inst1, rule1, "barxx"));
+
+    // Once matched, the stream stays matched.
+    EXPECT_TRUE(execute(op_inst1, rule1, "yy"));
+
+    // Each rule has its own state.
+    EXPECT_FALSE(execute(op_inst2, rule2, "bar"));
+}
+
+TEST_F(AhoCorasickOperatorTest, test_share)
+{
+    configure("PmCompile On\n");
+    ib_rule_t *rule = createRule(false);
+    ib_operator_inst_t *op_inst1 = createOperator(rule, "pm", "foo bar");
+    uint64_t hits = cache()->hits;
+    ib_operator_inst_t *op_inst2 = createOperator(rule, "pm", "foo bar");
+    ib_operator_inst_t *op_inst3 = createOperator(rule, "pm", "foo baz");
+
+    ASSERT_TRUE(data(op_inst1)->eudoxus != NULL);
+    EXPECT_EQ(data(op_inst1)->eudoxus, data(op_inst2)->eudoxus);
+    EXPECT_NE(data(op_inst1)->eudoxus, data(op_inst3)->eudoxus);
+    EXPECT_EQ(hits + 1, cache()->hits);
+
+    EXPECT_FALSE(execute(op_inst2, rule, "baz"));
+    EXPECT_TRUE(execute(op_inst3, rule, "baz"));
+}
+
+TEST_F(AhoCorasickOperatorTest, test_default_ac)
+{
+    // Without PmCompile, lists are not compiled.
+    configure();
+
+    ib_rule_t *rule = createRule(false);
+    ib_rule_t *stream_rule = createRule(true);
+    ib_operator_inst_t *op_inst = createOperator(rule, "pm", "foo bar");
+    ib_operator_inst_t *stream_op_inst =
+        createOperator(stream_rule, "pm", "foobar");
+
+    EXPECT_TRUE(data(op_inst)->eudoxus == NULL);
+    ASSERT_TRUE(data(op_inst)->ac != NULL);
+
+    EXPECT_TRUE(execute(op_inst, rule, "xxbarxx"));
+    EXPECT_FALSE(execute(op_inst, rule, "xxbaxx"));
+
+    EXPECT_FALSE(execute(stream_op_inst, stream_rule, "xxfoo"));
+    EXPECT_TRUE(execute(stream_op_inst, stream_rule, "barxx"));
+}
+
+TEST_F(AhoCorasickOperatorTest, test_cache_dir)
+{
+    configure("PmCacheDir \"" + makeDir() + "\"\nPmCompile On\n");
+
+    ib_rule_t *rule = createRule(false);
+    ib_operator_inst_t *op_inst1 = createOperator(rule, "pm", "foo bar");
+
+    ASSERT_TRUE(data(op_inst1)->eudoxus != NULL);
+    ASSERT_EQ(1UL, cacheFiles().size());
+
+    // Forget the automata and turn PmCompile off, as after a restart
+    // without it, so the automata can only be mapped.
+    ib_hash_clear(cache()->automata);
+    cache()->compile = false;
+
+    ib_operator_inst_t *op_inst2 = createOperator(rule, "pm", "foo bar");
+
+    ASSERT_TRUE(data(op_inst2)->eudoxus != NULL);
+    EXPECT_NE(data(op_inst1)->eudoxus, data(op_inst2)->eudoxus);
+    EXPECT_TRUE(execute(op_inst2, rule, "xxbarxx"));
+    EXPECT_FALSE(execute(op_inst2, rule, "xxbaxx"));
+}
+
+TEST_F(AhoCorasickOperatorTest, test_cache_dir_key_mismatch)
+{
+    configure("PmCacheDir \"" + makeDir() + "\"\nPmCompile On\n");
+
+    ib_rule_t *rule = createRule(false);
+    createOperator(rule, "pm", "foo bar");
+    ASSERT_EQ(1UL, cacheFiles().size());
+    std::string bar_file = cacheFiles()[0];
+
+    createOperator(rule, "pm", "foo baz");
+    std::vector<std::string> files = cacheFiles();
+    ASSERT_EQ(2UL, files.size());
+    std::string baz_file = (files[0] == bar_file) ? files[1] : files[0];
+
+    // Put the automata of "foo bar" under the name of "foo baz".
+    boost::filesystem::remove(baz_file);
+    boost::filesystem::copy_file(bar_file, baz_file);
+
+    ib_hash_clear(cache()->automata);
+    cache()->compile = false;
+
+    ib_operator_inst_t *baz = createOperator(rule, "pm", "foo baz");
+    EXPECT_TRUE(data(baz)->eudoxus == NULL);
+    ASSERT_TRUE(data(baz)->ac != NULL);
+    EXPECT_TRUE(execute(baz, rule, "baz"));
+
+    ib_operator_inst_t *bar = createOperator(rule, "pm", "foo bar");
+    EXPECT_TRUE(data(bar)->eudoxus != NULL);
+}
+
+TEST_F(AhoCorasickOperatorTest, test_compile_main_only)
+{
+    EXPECT_THROW(
+        configure(
+            "<Site compile-site>\n"
+            "SiteId AAAABBBB-1111-2222-3333-000000000001\n"
+            "Hostname compile.com\n"
+            "PmCompile On\n"
+            "</Site>\n"
+        ),
+        std::runtime_error
+    );
+}
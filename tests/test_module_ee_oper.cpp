@@ -25,11 +25,18 @@
 #include "gtest/gtest.h"
 
 #include "base_fixture.h"
+#include <ironbee/field.h>
 #include <ironbee/operator.h>
+#include <ironbee/rule_engine.h>
 
 // @todo Remove once ib_engine_operator_get() is available.
 #include "engine_private.h"
 
+#include <fstream>
+#include <sstream>
+
+#include <unistd.h>
+
 class EeOperModuleTest : public BaseModuleFixture
 {
 public:
@@ -119,3 +126,161 @@ TEST_F(EeOperModuleTest, test_ee_match_any_fail)
     ib_field_value(f, ib_ftype_num_out(&n));
     EXPECT_EQ(0, n);
 }
+
+TEST_F(EeOperModuleTest, test_ee_match_any_list)
+{
+    ib_operator_inst_t *op_inst = NULL;
+    ib_rule_exec_t rule_exec;
+    ib_rule_t *rule;
+    ib_field_t *list;
+    ib_field_t *f;
+    ib_num_t result;
+    ib_mpool_t *mp = ib_engine_pool_main_get(ib_engine);
+    const char *values[] = { "header1", "UnitTest", "more string_to_match" };
+
+    ASSERT_EQ(IB_OK, ib_rule_create(ib_engine,
+                                    ib_context_engine(ib_engine),
+                                    __FILE__,
+                                    __LINE__,
+                                    true,
+                                    &rule));
+    ASSERT_EQ(IB_OK, ib_rule_set_id(ib_engine, rule, "ee_list"));
+    ASSERT_EQ(IB_OK, ib_operator_inst_create(ib_engine,
+                                             ib_context_main(ib_engine),
+                                             rule,
+                                             IB_OP_FLAG_PHASE,
+                                             "ee_match_any",
+                                             "pattern1",
+                                             IB_OPINST_FLAG_NONE,
+                                             &op_inst));
+
+    memset(&rule_exec, 0, sizeof(rule_exec));
+    rule_exec.ib = ib_engine;
+    rule_exec.tx = ib_conn->tx;
+    rule_exec.rule = rule;
+
+    // Every element is searched; only the last matches.
+    ASSERT_EQ(IB_OK, ib_field_create(&list, mp, IB_FIELD_NAME("list"),
+                                     IB_FTYPE_LIST, NULL));
+    for (size_t i = 0; i < sizeof(values) / sizeof(*values); ++i) {
+        ASSERT_EQ(IB_OK, ib_field_create(&f, mp, IB_FIELD_NAME("value"),
+                                         IB_FTYPE_NULSTR,
+                                         ib_ftype_nulstr_in(values[i])));
+        ASSERT_EQ(IB_OK, ib_field_list_add(list, f));
+
+        ASSERT_EQ(IB_OK, op_inst->op->fn_execute(&rule_exec,
+                                                 op_inst->data,
+                                                 op_inst->flags,
+                                                 list,
+                                                 &result));
+        EXPECT_EQ(i == 2 ? 1 : 0, result);
+    }
+
+    // An empty list matches nothing.
+    ASSERT_EQ(IB_OK, ib_field_create(&list, mp, IB_FIELD_NAME("empty"),
+                                     IB_FTYPE_LIST, NULL));
+    ASSERT_EQ(IB_OK, op_inst->op->fn_execute(&rule_exec,
+                                             op_inst->data,
+                                             op_inst->flags,
+                                             list,
+                                             &result));
+    EXPECT_EQ(0, result);
+}
+
+class EeOperMmapModuleTest : public EeOperModuleTest
+{
+public:
+    void configureIronBee(void)
+    {
+        BaseModuleFixture::configureIronBee("EeOperMmapModuleTest.config");
+    }
+};
+
+TEST_F(EeOperMmapModuleTest, test_ee_match_any)
+{
+    ib_field_t *f;
+    ib_num_t n;
+
+    ASSERT_EQ(IB_OK, ib_data_get(ib_tx->data, "request_matched", &f));
+    ib_field_value(f, ib_ftype_num_out(&n));
+    EXPECT_EQ(1, n);
+
+    ASSERT_EQ(IB_OK, ib_data_get(ib_tx->data, "response_matched", &f));
+    ib_field_value(f, ib_ftype_num_out(&n));
+    EXPECT_EQ(0, n);
+}
+
+/**
+ * Loads copies of eudoxus_pattern1.e, intact or damaged, with LoadEudoxusMmap.
+ */
+class EeOperMmapConfigTest : public BaseTransactionFixture
+{
+public:
+    void TearDown()
+    {
+        if (! m_path.empty()) {
+            unlink(m_path.c_str());
+        }
+        BaseTransactionFixture::TearDown();
+    }
+
+    //! Contents of eudoxus_pattern1.e.
+    std::string automata()
+    {
+        std::ifstream in("eudoxus_pattern1.e", std::ios::binary);
+        std::ostringstream out;
+
+        out << in.rdbuf();
+        if (! in || out.str().empty()) {
+            throw std::runtime_error("Could not read eudoxus_pattern1.e.");
+        }
+        return out.str();
+    }
+
+    //! Configure IronBee to map @a data with LoadEudoxusMmap.
+    void loadEudoxusMmap(const std::string& data)
+    {
+        char path[] = "/tmp/ee_oper_test.XXXXXX";
+        int fd = mkstemp(path);
+        if (fd == -1) {
+            throw std::runtime_error("Could not create temporary file.");
+        }
+        m_path = path;
+        if (write(fd, data.data(), data.length()) != ssize_t(data.length())) {
+            close(fd);
+            throw std::runtime_error("Could not write temporary file.");
+        }
+        close(fd);
+
+        configureIronBeeByString(
+            getBasicIronBeeConfig() +
+            "LoadModule \"ibmod_ee.so\"\n"
+            "LoadEudoxusMmap \"damaged\" \"" + m_path + "\"\n"
+        );
+    }
+
+private:
+    std::string m_path;
+};
+
+TEST_F(EeOperMmapConfigTest, test_load)
+{
+    EXPECT_NO_THROW(loadEudoxusMmap(automata()));
+}
+
+TEST_F(EeOperMmapConfigTest, test_truncated)
+{
+    std::string data = automata();
+
+    EXPECT_THROW(loadEudoxusMmap(data.substr(0, data.length() - 1)),
+                 std::runtime_error);
+}
+
+TEST_F(EeOperMmapConfigTest, test_bad_version)
+{
+    std::string data = automata();
+
+    // The version is the first byte of the automata.
+    data[0] = static_cast<char>(data[0] + 100);
+    EXPECT_THROW(loadEudoxusMmap(data), std::runtime_error);
+}
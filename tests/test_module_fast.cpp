@@ -0,0 +1,375 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee --- Fast module tests
+//////////////////////////////////////////////////////////////////////////////
+
+#include "gtest/gtest.h"
+#include "base_fixture.h"
+
+#include <ironbee/data.h>
+#include <ironbee/field.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+/**
+ * Runs a transaction through the fast rules of the test's config.
+ *
+ * The configs use fast_test.e, which holds the rules fast-hdr, fast-uri,
+ * fast-lower, and fast-body.  Fast rules only run if the automata finds their pattern in
+ * the data fed to it.
+ */
+class FastModuleTest : public BaseTransactionFixture
+{
+public:
+    void SetUp()
+    {
+        BaseTransactionFixture::SetUp();
+        configureIronBee();
+        performTx();
+    }
+
+    void sendRequestLine()
+    {
+        BaseTransactionFixture::sendRequestLine("GET", "/fasturi", "HTTP/1.1");
+    }
+
+    void generateRequestHeader()
+    {
+        addRequestHeader("Host", "UnitTest");
+        addRequestHeader("X-Test", "fasthdr");
+        addRequestHeader("X-Lower", "FASTLOWER");
+    }
+
+    bool isSet(const char *name)
+    {
+        ib_field_t *f;
+
+        return ib_data_get(ib_tx->data, name, &f) == IB_OK;
+    }
+};
+
+TEST_F(FastModuleTest, test_mmap)
+{
+    EXPECT_TRUE(isSet("fast_hdr"));
+    EXPECT_TRUE(isSet("fast_uri"));
+
+    // Headers are fed untransformed by default.
+    EXPECT_FALSE(isSet("fast_lower"));
+}
+
+/**
+ * Runs the transaction of FastModuleTest with FastFeed directives.
+ */
+class FastFeedTest : public FastModuleTest
+{
+public:
+    void SetUp()
+    {
+        BaseTransactionFixture::SetUp();
+    }
+
+    //! Configure the rules of fast_test.e with @a feeds and run the tx.
+    void feed(const std::string& feeds)
+    {
+        configureIronBeeByString(
+            "LogLevel 9\n"
+            "LoadModule \"ibmod_htp.so\"\n"
+            "LoadModule \"ibmod_pcre.so\"\n"
+            "LoadModule \"ibmod_rules.so\"\n"
+            "LoadModule \"ibmod_fast.so\"\n"
+            "Set parser \"htp\"\n"
+            "AuditEngine Off\n"
+            "FastAutomataMmap \"fast_test.e\"\n" +
+            feeds +
+            "<Site test-fast>\n"
+            "  SiteId AAAABBBB-1111-2222-3333-000000000000\n"
+            "  Hostname *\n"
+            "  Rule REQUEST_HEADERS @rx fasthdr id:fast-hdr "
+            "phase:REQUEST_HEADER \"fast:fasthdr\" \"setvar:fast_hdr=1\"\n"
+            "  Rule REQUEST_URI @rx fasturi id:fast-uri "
+            "phase:REQUEST_HEADER \"fast:fasturi\" \"setvar:fast_uri=1\"\n"
+            "  Rule REQUEST_HEADERS @rx fastlower id:fast-lower "
+            "phase:REQUEST_HEADER t:lowercase \"fast:fastlower\" "
+            "\"setvar:fast_lower=1\"\n"
+            "</Site>\n"
+        );
+        performTx();
+    }
+};
+
+TEST_F(FastFeedTest, test_replaces_default)
+{
+    feed("FastFeed REQUEST_HEADER REQUEST_URI \" \"\n");
+
+    EXPECT_TRUE(isSet("fast_uri"));
+    EXPECT_FALSE(isSet("fast_hdr"));
+}
+
+TEST_F(FastFeedTest, test_adds_to_feed)
+{
+    feed(
+        "FastFeed REQUEST_HEADER REQUEST_URI \" \"\n"
+        "FastFeed REQUEST_HEADER REQUEST_HEADERS \":\"\n"
+    );
+
+    EXPECT_TRUE(isSet("fast_uri"));
+    EXPECT_TRUE(isSet("fast_hdr"));
+}
+
+TEST_F(FastFeedTest, test_missing)
+{
+    feed(
+        "FastFeed REQUEST_HEADER NO_SUCH_FIELD \" \"\n"
+        "FastFeed REQUEST_HEADER REQUEST_URI \" \"\n"
+    );
+
+    EXPECT_TRUE(isSet("fast_uri"));
+}
+
+TEST_F(FastFeedTest, test_transformed)
+{
+    feed("FastFeed REQUEST_HEADER REQUEST_HEADERS \":\" lowercase\n");
+
+    EXPECT_TRUE(isSet("fast_lower"));
+    EXPECT_TRUE(isSet("fast_hdr"));
+}
+
+TEST_F(FastFeedTest, test_not_bytestring)
+{
+    // Lengths are numbers; they are skipped rather than failing the phase.
+    feed(
+        "FastFeed REQUEST_HEADER REQUEST_HEADERS \":\" length\n"
+        "FastFeed REQUEST_HEADER REQUEST_URI \" \" length\n"
+        "FastFeed REQUEST_HEADER REQUEST_URI \" \"\n"
+    );
+
+    EXPECT_TRUE(isSet("fast_uri"));
+    EXPECT_FALSE(isSet("fast_hdr"));
+}
+
+TEST_F(FastFeedTest, test_bad_phase)
+{
+    EXPECT_THROW(
+        feed("FastFeed POSTPROCESS REQUEST_URI \" \"\n"),
+        std::runtime_error
+    );
+}
+
+TEST_F(FastFeedTest, test_bad_tfn)
+{
+    EXPECT_THROW(
+        feed("FastFeed REQUEST_HEADER REQUEST_URI \" \" no_such_tfn\n"),
+        std::runtime_error
+    );
+}
+
+/**
+ * Streams a request body through the rules of fast_test.e.
+ *
+ * fast-body always matches once injected, so fast_body tells whether the
+ * automata found fastbody in the body.
+ */
+class FastBodyTest : public FastModuleTest
+{
+public:
+    void SetUp()
+    {
+        BaseTransactionFixture::SetUp();
+        configureIronBeeByString(
+            "LogLevel 9\n"
+            "LoadModule \"ibmod_htp.so\"\n"
+            "LoadModule \"ibmod_pcre.so\"\n"
+            "LoadModule \"ibmod_rules.so\"\n"
+            "LoadModule \"ibmod_fast.so\"\n"
+            "Set parser \"htp\"\n"
+            "AuditEngine Off\n"
+            "FastAutomataMmap \"fast_test.e\"\n"
+            "<Site test-fast>\n"
+            "  SiteId AAAABBBB-1111-2222-3333-000000000000\n"
+            "  Hostname *\n"
+            "  Rule REQUEST_METHOD @rx GET id:fast-hdr "
+            "phase:REQUEST_HEADER \"fast:fasthdr\" \"setvar:fast_hdr=1\"\n"
+            "  Rule REQUEST_METHOD @rx GET id:fast-body "
+            "phase:REQUEST \"fast:fastbody\" \"setvar:fast_body=1\"\n"
+            "</Site>\n"
+        );
+        ib_conn = buildIronBeeConnection();
+        ib_tx = buildIronBeeTransaction(ib_conn);
+    }
+
+    //! Headers without any fast pattern.
+    void generateRequestHeader()
+    {
+        addRequestHeader("Host", "UnitTest");
+    }
+
+    //! Send each of m_chunks as a separate block of request body.
+    void sendRequestBody()
+    {
+        for (size_t i = 0; i < m_chunks.size(); ++i) {
+            sendReponseBodyBlock(
+                ib_tx,
+                const_cast<char *>(m_chunks[i].data()),
+                m_chunks[i].length()
+            );
+        }
+    }
+
+    //! Run the transaction with request body @a first, then @a second.
+    void body(const char *first, const char *second = NULL)
+    {
+        m_chunks.push_back(first);
+        if (second != NULL) {
+            m_chunks.push_back(second);
+        }
+        sendRequest();
+        sendResponse();
+        postProcess(ib_tx);
+    }
+
+protected:
+    std::vector<std::string> m_chunks;
+};
+
+TEST_F(FastBodyTest, test_single_chunk)
+{
+    body("a=1&fastbody=2");
+
+    EXPECT_TRUE(isSet("fast_body"));
+}
+
+TEST_F(FastBodyTest, test_no_match)
+{
+    body("a=1&fastbod", "x=2");
+
+    EXPECT_FALSE(isSet("fast_body"));
+}
+
+TEST_F(FastBodyTest, test_straddles_chunks)
+{
+    // The automata state is carried from one chunk to the next, so neither
+    // chunk needs to hold all of the pattern.
+    body("a=1&fast", "body=2");
+
+    EXPECT_TRUE(isSet("fast_body"));
+}
+
+TEST_F(FastBodyTest, test_injected_at_body_phase)
+{
+    m_chunks.push_back("fasthdr fastbody");
+
+    sendRequestLine();
+    startRequestHeader(ib_tx, &ib_reqhdr);
+    generateRequestHeader();
+    sendRequestHeader(ib_tx, ib_reqhdr);
+    sendRequestBody();
+
+    // Rules found in the body wait for the body phase.
+    EXPECT_FALSE(isSet("fast_body"));
+
+    finishRequest(ib_tx);
+    EXPECT_TRUE(isSet("fast_body"));
+
+    // The header phase is over before the body arrives.
+    EXPECT_FALSE(isSet("fast_hdr"));
+
+    sendResponse();
+    postProcess(ib_tx);
+}
+
+/**
+ * Loads copies of fast_test.e, intact or damaged, with FastAutomataMmap.
+ */
+class FastModuleConfigTest : public BaseTransactionFixture
+{
+public:
+    void TearDown()
+    {
+        if (! m_path.empty()) {
+            unlink(m_path.c_str());
+        }
+        BaseTransactionFixture::TearDown();
+    }
+
+    //! Contents of fast_test.e.
+    std::string automata()
+    {
+        std::ifstream in("fast_test.e", std::ios::binary);
+        std::ostringstream out;
+
+        out << in.rdbuf();
+        if (! in || out.str().empty()) {
+            throw std::runtime_error("Could not read fast_test.e.");
+        }
+        return out.str();
+    }
+
+    //! Configure IronBee to map @a data with FastAutomataMmap.
+    void fastAutomataMmap(const std::string& data)
+    {
+        char path[] = "/tmp/fast_test.XXXXXX";
+        int fd = mkstemp(path);
+        if (fd == -1) {
+            throw std::runtime_error("Could not create temporary file.");
+        }
+        m_path = path;
+        if (write(fd, data.data(), data.length()) != ssize_t(data.length())) {
+            close(fd);
+            throw std::runtime_error("Could not write temporary file.");
+        }
+        close(fd);
+
+        configureIronBeeByString(
+            getBasicIronBeeConfig() +
+            "LoadModule \"ibmod_fast.so\"\n"
+            "FastAutomataMmap \"" + m_path + "\"\n"
+        );
+    }
+
+private:
+    std::string m_path;
+};
+
+TEST_F(FastModuleConfigTest, test_load)
+{
+    EXPECT_NO_THROW(fastAutomataMmap(automata()));
+}
+
+TEST_F(FastModuleConfigTest, test_truncated)
+{
+    std::string data = automata();
+
+    EXPECT_THROW(fastAutomataMmap(data.substr(0, data.length() - 1)),
+                 std::runtime_error);
+}
+
+TEST_F(FastModuleConfigTest, test_bad_version)
+{
+    std::string data = automata();
+
+    // The version is the first byte of the automata.
+    data[0] = static_cast<char>(data[0] + 100);
+    EXPECT_THROW(fastAutomataMmap(data), std::runtime_error);
+}
@@ -35,6 +35,11 @@
 
 // @todo Remove once ib_engine_operator_get() is available.
 #include "engine_private.h"
+#include "rule_engine_private.h"
+
+#include "pcre_private.h"
+
+#include <pthread.h>
 
 #include <string>
 
@@ -396,3 +401,439 @@ TEST_F(PcreModuleTest, test_match_capture_named)
     ib_field_value(ib_field, ib_ftype_list_out(&ib_list));
     ASSERT_EQ(0U, IB_LIST_ELEMENTS(ib_list));
 }
+
+//! Execute an operator instance on a body chunk in a stream rule.
+static ib_num_t ExecuteChunk(ib_tx_t *tx,
+                             ib_rule_exec_t *rule_exec,
+                             ib_operator_inst_t *op_inst,
+                             const char *chunk)
+{
+    ib_bytestr_t *bs;
+    ib_field_t *field;
+    ib_num_t result;
+
+    if (ib_bytestr_dup_nulstr(&bs, tx->mp, chunk) != IB_OK) {
+        throw std::runtime_error("Could not create chunk.");
+    }
+    if (ib_field_create(&field, tx->mp, IB_FIELD_NAME("txdata"),
+                        IB_FTYPE_BYTESTR,
+                        ib_ftype_bytestr_in(bs)) != IB_OK)
+    {
+        throw std::runtime_error("Could not create chunk field.");
+    }
+
+    rule_exec->phase = PHASE_STR_REQUEST_BODY;
+    rule_exec->is_stream = true;
+    if (op_inst->op->fn_execute(rule_exec, op_inst->data, op_inst->flags,
+                                field, &result) != IB_OK)
+    {
+        throw std::runtime_error("Could not execute operator.");
+    }
+    return result;
+}
+
+TEST_F(PcreModuleTest, test_stream_rx)
+{
+    ib_operator_inst_t *op_inst = NULL;
+
+    ASSERT_EQ(IB_OK,
+              ib_operator_inst_create(ib_engine,
+                                      ib_context_main(ib_engine),
+                                      rule1,
+                                      IB_OP_FLAG_STREAM,
+                                      "rx",
+                                      "foo\\d+bar",
+                                      IB_OPINST_FLAG_NONE,
+                                      &op_inst));
+
+    // The match straddles three chunks.
+    EXPECT_FALSE(ExecuteChunk(ib_tx, &rule_exec1, op_inst, "xxfoo1"));
+    EXPECT_FALSE(ExecuteChunk(ib_tx, &rule_exec1, op_inst, "23"));
+    EXPECT_TRUE(ExecuteChunk(ib_tx, &rule_exec1, op_inst, "4barxx"));
+
+    // The match is not reported again for the next chunk.
+    EXPECT_FALSE(ExecuteChunk(ib_tx, &rule_exec1, op_inst, "yy"));
+    EXPECT_TRUE(ExecuteChunk(ib_tx, &rule_exec1, op_inst, "foo5bar"));
+}
+
+TEST_F(PcreModuleTest, test_stream_rx_tail)
+{
+    ib_operator_inst_t *op_inst = NULL;
+
+    // The lookbehind makes the kept tail start a byte before a partial.
+    ASSERT_EQ(IB_OK,
+              ib_operator_inst_create(ib_engine,
+                                      ib_context_main(ib_engine),
+                                      rule1,
+                                      IB_OP_FLAG_STREAM,
+                                      "rx",
+                                      "(?<=x)q|y|z\\d+w",
+                                      IB_OPINST_FLAG_NONE,
+                                      &op_inst));
+
+    // "y" matches; the partial "z1" after it is still kept.
+    EXPECT_TRUE(ExecuteChunk(ib_tx, &rule_exec1, op_inst, "ayz1"));
+
+    // The tail "yz1" holds all of the "y" match, which is not reported
+    // again.
+    EXPECT_FALSE(ExecuteChunk(ib_tx, &rule_exec1, op_inst, "2"));
+
+    // The partial completes.
+    EXPECT_TRUE(ExecuteChunk(ib_tx, &rule_exec1, op_inst, "w"));
+}
+
+TEST_F(PcreModuleTest, test_stream_rx_anchor)
+{
+    ib_operator_inst_t *op_inst1 = NULL;
+    ib_operator_inst_t *op_inst2 = NULL;
+
+    ASSERT_EQ(IB_OK,
+              ib_operator_inst_create(ib_engine,
+                                      ib_context_main(ib_engine),
+                                      rule1,
+                                      IB_OP_FLAG_STREAM,
+                                      "rx",
+                                      "^abc",
+                                      IB_OPINST_FLAG_NONE,
+                                      &op_inst1));
+    ASSERT_EQ(IB_OK,
+              ib_operator_inst_create(ib_engine,
+                                      ib_context_main(ib_engine),
+                                      rule1,
+                                      IB_OP_FLAG_STREAM,
+                                      "rx",
+                                      "^abc",
+                                      IB_OPINST_FLAG_NONE,
+                                      &op_inst2));
+
+    // The second chunk does not start the body.
+    EXPECT_FALSE(ExecuteChunk(ib_tx, &rule_exec1, op_inst1, "x"));
+    EXPECT_FALSE(ExecuteChunk(ib_tx, &rule_exec1, op_inst1, "abc"));
+
+    // A match at the start of the body may still straddle chunks.
+    EXPECT_FALSE(ExecuteChunk(ib_tx, &rule_exec1, op_inst2, "ab"));
+    EXPECT_TRUE(ExecuteChunk(ib_tx, &rule_exec1, op_inst2, "c"));
+    EXPECT_FALSE(ExecuteChunk(ib_tx, &rule_exec1, op_inst2, "abc"));
+}
+
+TEST_F(PcreModuleTest, test_stream_dfa)
+{
+    ib_operator_inst_t *op_inst = NULL;
+
+    ASSERT_EQ(IB_OK,
+              ib_operator_inst_create(ib_engine,
+                                      ib_context_main(ib_engine),
+                                      rule1,
+                                      IB_OP_FLAG_STREAM,
+                                      "dfa",
+                                      "foobar",
+                                      IB_OPINST_FLAG_NONE,
+                                      &op_inst));
+
+    EXPECT_FALSE(ExecuteChunk(ib_tx, &rule_exec1, op_inst, "xxfo"));
+    EXPECT_TRUE(ExecuteChunk(ib_tx, &rule_exec1, op_inst, "obarxx"));
+    EXPECT_FALSE(ExecuteChunk(ib_tx, &rule_exec1, op_inst, "foo"));
+}
+
+//! Is a variable set in the transaction?
+static bool IsSet(ib_tx_t *tx, const char *name)
+{
+    ib_field_t *f;
+
+    return ib_data_get(tx->data, name, &f) == IB_OK;
+}
+
+TEST_F(PcreModuleTest, test_prefilter)
+{
+    ib_operator_inst_t *op_inst = NULL;
+    const ib_list_node_t *node;
+    const ib_bytestr_t *literal;
+    const ib_ruleset_phase_t *phase =
+        &(ib_tx->ctx->rules->ruleset.phases[PHASE_REQUEST_HEADER]);
+
+    // Each alternative contributes its longest literal.
+    ASSERT_EQ(IB_OK,
+              ib_operator_inst_create(ib_engine,
+                                      ib_context_main(ib_engine),
+                                      rule1,
+                                      IB_OP_FLAG_PHASE,
+                                      "rx",
+                                      "fo+bar\\d|x[yz]bazqux?",
+                                      IB_OPINST_FLAG_NONE,
+                                      &op_inst));
+    ASSERT_TRUE(op_inst->prefilter != NULL);
+    ASSERT_EQ(2U, IB_LIST_ELEMENTS(op_inst->prefilter));
+    node = IB_LIST_FIRST(op_inst->prefilter);
+    literal = (const ib_bytestr_t *)IB_LIST_NODE_DATA(node);
+    EXPECT_EQ("bar", std::string(
+        reinterpret_cast<const char*>(ib_bytestr_const_ptr(literal)),
+        ib_bytestr_length(literal)));
+    node = IB_LIST_NODE_NEXT(node);
+    literal = (const ib_bytestr_t *)IB_LIST_NODE_DATA(node);
+    EXPECT_EQ("bazqu", std::string(
+        reinterpret_cast<const char*>(ib_bytestr_const_ptr(literal)),
+        ib_bytestr_length(literal)));
+
+    // Option settings may change how literals match.
+    ASSERT_EQ(IB_OK,
+              ib_operator_inst_create(ib_engine,
+                                      ib_context_main(ib_engine),
+                                      rule1,
+                                      IB_OP_FLAG_PHASE,
+                                      "rx",
+                                      "(?i)foobar",
+                                      IB_OPINST_FLAG_NONE,
+                                      &op_inst));
+    EXPECT_TRUE(op_inst->prefilter == NULL);
+
+    // The rules of the config share one automaton.
+    ASSERT_TRUE(phase->literal_rules != NULL);
+    EXPECT_EQ(4UL, ib_hash_size(phase->literal_rules));
+    EXPECT_TRUE(IsSet(ib_tx, "p1"));
+    EXPECT_FALSE(IsSet(ib_tx, "p2"));
+    EXPECT_TRUE(IsSet(ib_tx, "p3"));
+    EXPECT_FALSE(IsSet(ib_tx, "p4"));
+    EXPECT_TRUE(IsSet(ib_tx, "p5"));
+}
+
+TEST_F(PcreModuleTest, test_prefilter_single)
+{
+    const ib_ruleset_phase_t *phases = ib_tx->ctx->rules->ruleset.phases;
+
+    ASSERT_TRUE(phases[PHASE_REQUEST_HEADER].literal_rules != NULL);
+    EXPECT_EQ(1UL, ib_hash_size(phases[PHASE_REQUEST_HEADER].literal_rules));
+    ASSERT_TRUE(phases[PHASE_REQUEST_BODY].literal_rules != NULL);
+    EXPECT_EQ(1UL, ib_hash_size(phases[PHASE_REQUEST_BODY].literal_rules));
+    EXPECT_TRUE(IsSet(ib_tx, "p1"));
+    EXPECT_FALSE(IsSet(ib_tx, "p2"));
+}
+
+TEST_F(PcreModuleTest, test_pattern_cache)
+{
+    ib_operator_inst_t *op_inst1 = NULL;
+    ib_operator_inst_t *op_inst2 = NULL;
+    ib_operator_inst_t *op_inst3 = NULL;
+    ib_num_t result;
+
+    ASSERT_EQ(IB_OK,
+              ib_operator_inst_create(ib_engine,
+                                      ib_context_main(ib_engine),
+                                      rule1,
+                                      IB_OP_FLAG_PHASE,
+                                      "rx",
+                                      "string\\s2",
+                                      IB_OPINST_FLAG_NONE,
+                                      &op_inst1));
+    ASSERT_EQ(IB_OK,
+              ib_operator_inst_create(ib_engine,
+                                      ib_context_main(ib_engine),
+                                      rule2,
+                                      IB_OP_FLAG_PHASE,
+                                      "pcre",
+                                      "string\\s2",
+                                      IB_OPINST_FLAG_NONE,
+                                      &op_inst2));
+    ASSERT_EQ(IB_OK,
+              ib_operator_inst_create(ib_engine,
+                                      ib_context_main(ib_engine),
+                                      rule1,
+                                      IB_OP_FLAG_PHASE,
+                                      "dfa",
+                                      "string\\s2",
+                                      IB_OPINST_FLAG_NONE,
+                                      &op_inst3));
+
+    // The compiled pattern is the first member of the operator data.
+    EXPECT_EQ(*reinterpret_cast<void **>(op_inst1->data),
+              *reinterpret_cast<void **>(op_inst2->data));
+    EXPECT_NE(*reinterpret_cast<void **>(op_inst1->data),
+              *reinterpret_cast<void **>(op_inst3->data));
+
+    // A shared pattern still matches for both.
+    ASSERT_EQ(IB_OK, op_inst1->op->fn_execute(&rule_exec1,
+                                              op_inst1->data,
+                                              op_inst1->flags,
+                                              field2,
+                                              &result));
+    EXPECT_TRUE(result);
+    ASSERT_EQ(IB_OK, ib_operator_inst_destroy(op_inst1));
+    ASSERT_EQ(IB_OK, op_inst2->op->fn_execute(&rule_exec2,
+                                              op_inst2->data,
+                                              op_inst2->flags,
+                                              field2,
+                                              &result));
+    EXPECT_TRUE(result);
+}
+
+//! Statistics of the pcre module of @a ib.
+static const modpcre_stats_t *PcreStats(ib_engine_t *ib)
+{
+    ib_module_t *module;
+
+    if (ib_engine_module_get(ib, "pcre", &module) != IB_OK) {
+        throw std::runtime_error("Could not get pcre module.");
+    }
+    return reinterpret_cast<const modpcre_data_t *>(module->data)->stats;
+}
+
+//! JIT stacks allocated so far.
+static uint64_t JitStacks(ib_engine_t *ib)
+{
+    return __atomic_load_n(&(PcreStats(ib)->jit_stacks), __ATOMIC_RELAXED);
+}
+
+//! An operator execution, run on a thread of its own.
+struct ExecuteArgs
+{
+    ib_rule_exec_t     *rule_exec;
+    ib_operator_inst_t *op_inst;
+    ib_field_t         *field;
+    int                 times;
+    uint64_t            jit_stacks;
+};
+
+//! Execute the operator @c times times; record JIT stacks allocated.
+static void *ExecuteThread(void *arg)
+{
+    ExecuteArgs *args = reinterpret_cast<ExecuteArgs *>(arg);
+    const modpcre_stats_t *stats = PcreStats(args->rule_exec->ib);
+    uint64_t before = __atomic_load_n(&(stats->jit_stacks), __ATOMIC_RELAXED);
+    ib_num_t result;
+
+    for (int i = 0; i < args->times; ++i) {
+        args->op_inst->op->fn_execute(args->rule_exec,
+                                      args->op_inst->data,
+                                      args->op_inst->flags,
+                                      args->field,
+                                      &result);
+    }
+    args->jit_stacks =
+        __atomic_load_n(&(stats->jit_stacks), __ATOMIC_RELAXED) - before;
+    return NULL;
+}
+
+//! Run ExecuteThread() on a new thread.
+static void ExecuteOnThread(ExecuteArgs *args)
+{
+    pthread_t thread;
+
+    ASSERT_EQ(0, pthread_create(&thread, NULL, ExecuteThread, args));
+    ASSERT_EQ(0, pthread_join(thread, NULL));
+}
+
+TEST_F(PcreModuleTest, test_jit_stack_reuse)
+{
+    ib_operator_inst_t *op_inst1 = NULL;
+    ib_operator_inst_t *op_inst2 = NULL;
+    ib_num_t result;
+    uint64_t jit_stacks;
+
+    ASSERT_EQ(IB_OK,
+              ib_operator_inst_create(ib_engine,
+                                      ib_context_main(ib_engine),
+                                      rule1,
+                                      IB_OP_FLAG_PHASE,
+                                      "rx",
+                                      "string\\s2",
+                                      IB_OPINST_FLAG_NONE,
+                                      &op_inst1));
+    ASSERT_EQ(IB_OK,
+              ib_operator_inst_create(ib_engine,
+                                      ib_context_main(ib_engine),
+                                      rule1,
+                                      IB_OP_FLAG_PHASE,
+                                      "rx",
+                                      "str(ing)+\\s\\d",
+                                      IB_OPINST_FLAG_NONE,
+                                      &op_inst2));
+
+    // A new thread allocates a JIT stack on its first JIT match (if PCRE
+    // has JIT support) and reuses it for every later match.
+    ExecuteArgs args = { &rule_exec1, op_inst1, field2, 10, 0 };
+    ExecuteOnThread(&args);
+    jit_stacks = args.jit_stacks;
+    EXPECT_GE(1U, jit_stacks);
+
+    // Another new thread allocates its own.
+    args.jit_stacks = 0;
+    ExecuteOnThread(&args);
+    EXPECT_EQ(jit_stacks, args.jit_stacks);
+
+    // Once a thread has a stack, no pattern with the same stack settings
+    // allocates another.
+    ASSERT_EQ(IB_OK, op_inst1->op->fn_execute(&rule_exec1,
+                                              op_inst1->data,
+                                              op_inst1->flags,
+                                              field2,
+                                              &result));
+    EXPECT_TRUE(result);
+    uint64_t before = JitStacks(ib_engine);
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQ(IB_OK, op_inst1->op->fn_execute(&rule_exec1,
+                                                  op_inst1->data,
+                                                  op_inst1->flags,
+                                                  field2,
+                                                  &result));
+        ASSERT_EQ(IB_OK, op_inst2->op->fn_execute(&rule_exec1,
+                                                  op_inst2->data,
+                                                  op_inst2->flags,
+                                                  field1,
+                                                  &result));
+        EXPECT_TRUE(result);
+    }
+    EXPECT_EQ(before, JitStacks(ib_engine));
+}
+
+TEST_F(PcreModuleTest, test_match_limit_stats)
+{
+    ib_operator_inst_t *op_inst = NULL;
+    ib_field_t *field;
+    ib_num_t result;
+    const modpcre_stats_t *stats = PcreStats(ib_engine);
+
+    // Exponential backtracking on a subject which never matches.
+    ASSERT_EQ(IB_OK,
+              ib_operator_inst_create(ib_engine,
+                                      ib_context_main(ib_engine),
+                                      rule1,
+                                      IB_OP_FLAG_PHASE,
+                                      "rx",
+                                      "^(a+)+b",
+                                      IB_OPINST_FLAG_NONE,
+                                      &op_inst));
+    ASSERT_EQ(IB_OK,
+              ib_field_create(&field,
+                              ib_engine_pool_main_get(ib_engine),
+                              IB_FIELD_NAME("field"),
+                              IB_FTYPE_NULSTR,
+                              ib_ftype_nulstr_in("aaaaaaaaaaaaaaaaaaaaaaaaac")));
+
+    uint64_t match_limits =
+        __atomic_load_n(&(stats->match_limits), __ATOMIC_RELAXED);
+    uint64_t jit_limits =
+        __atomic_load_n(&(stats->jit_limits), __ATOMIC_RELAXED);
+
+    // Every execution hits PcreMatchLimit and is counted once.
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(IB_EUNKNOWN, op_inst->op->fn_execute(&rule_exec1,
+                                                       op_inst->data,
+                                                       op_inst->flags,
+                                                       field,
+                                                       &result));
+        EXPECT_FALSE(result);
+    }
+    EXPECT_EQ(match_limits + 3,
+              __atomic_load_n(&(stats->match_limits), __ATOMIC_RELAXED));
+    EXPECT_EQ(jit_limits,
+              __atomic_load_n(&(stats->jit_limits), __ATOMIC_RELAXED));
+
+    // Matches within the limit are not counted.
+    ASSERT_EQ(IB_OK, op_inst->op->fn_execute(&rule_exec1,
+                                             op_inst->data,
+                                             op_inst->flags,
+                                             field1,
+                                             &result));
+    EXPECT_FALSE(result);
+    EXPECT_EQ(match_limits + 3,
+              __atomic_load_n(&(stats->match_limits), __ATOMIC_RELAXED));
+}
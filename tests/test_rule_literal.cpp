@@ -0,0 +1,118 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee --- Merged literal operator tests
+//////////////////////////////////////////////////////////////////////////////
+
+#include "gtest/gtest.h"
+#include "base_fixture.h"
+
+#include "engine_private.h"
+#include "rule_engine_private.h"
+
+#include <ironbee/data.h>
+#include <ironbee/field.h>
+#include <ironbee/hash.h>
+
+#include <string.h>
+
+/**
+ * The config creates nine rules with literal string operators on the same
+ * target, which are merged into one literal set, and one rule with
+ * different transformations which is not.  Each rule sets a variable when
+ * its (possibly inverted) operator is true.
+ */
+class RuleLiteralTest : public BaseTransactionFixture
+{
+public:
+    void SetUp()
+    {
+        BaseTransactionFixture::SetUp();
+        configureIronBee();
+        performTx();
+    }
+
+    bool isSet(const char *name)
+    {
+        ib_field_t *f;
+
+        return ib_data_get(ib_tx->data, name, &f) == IB_OK;
+    }
+};
+
+TEST_F(RuleLiteralTest, test_merged)
+{
+    const ib_ruleset_phase_t *phase =
+        &(ib_tx->ctx->rules->ruleset.phases[PHASE_REQUEST_HEADER]);
+
+    ASSERT_TRUE(phase->literal_rules != NULL);
+    EXPECT_EQ(9UL, ib_hash_size(phase->literal_rules));
+
+    /* contains */
+    EXPECT_TRUE(isSet("c1"));
+    EXPECT_TRUE(isSet("c2"));
+    EXPECT_FALSE(isSet("c3"));
+    EXPECT_TRUE(isSet("c4"));
+
+    /* streq / istreq */
+    EXPECT_TRUE(isSet("s1"));
+    EXPECT_TRUE(isSet("s2"));
+    EXPECT_FALSE(isSet("s3"));
+
+    /* imatch / match */
+    EXPECT_TRUE(isSet("m1"));
+    EXPECT_FALSE(isSet("m2"));
+
+    /* Not merged */
+    EXPECT_TRUE(isSet("t1"));
+}
+
+TEST_F(RuleLiteralTest, test_changed_in_place)
+{
+    ib_rule_t      *rule;
+    ib_rule_exec_t  rule_exec;
+    ib_field_t     *field;
+    ib_num_t        result;
+    char            value[] = "UnitTest";
+
+    ASSERT_EQ(IB_OK, ib_rule_lookup(ib_engine, ib_tx->ctx, "lit-1", &rule));
+    memset(&rule_exec, 0, sizeof(rule_exec));
+    rule_exec.ib = ib_engine;
+    rule_exec.tx = ib_tx;
+    rule_exec.phase = PHASE_REQUEST_HEADER;
+    rule_exec.rule = rule;
+
+    ASSERT_EQ(IB_OK,
+              ib_field_create_bytestr_alias(&field, ib_tx->mp,
+                                            "value", 5,
+                                            (uint8_t *)value,
+                                            strlen(value)));
+
+    ASSERT_EQ(IB_OK, ib_rule_literal_execute(&rule_exec, field, &result));
+    EXPECT_EQ(1, result);
+
+    // Same field, data and length; different content.
+    memcpy(value, "Test", 4);
+    ASSERT_EQ(IB_OK, ib_rule_literal_execute(&rule_exec, field, &result));
+    EXPECT_EQ(0, result);
+
+    memcpy(value, "Unit", 4);
+    ASSERT_EQ(IB_OK, ib_rule_literal_execute(&rule_exec, field, &result));
+    EXPECT_EQ(1, result);
+}
@@ -0,0 +1,129 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee --- Rule profiler tests
+//////////////////////////////////////////////////////////////////////////////
+
+#include "gtest/gtest.h"
+#include "base_fixture.h"
+
+#include <ironbee/rule_engine.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * The config enables rule profiling and creates four rules: one true, one
+ * false, one with two targets and one in a later phase.
+ */
+class RuleProfileTest : public BaseTransactionFixture
+{
+public:
+    void SetUp()
+    {
+        BaseTransactionFixture::SetUp();
+        configureIronBee();
+    }
+
+    std::vector<ib_rule_profile_t> snapshot()
+    {
+        size_t num = ib_rule_profile_snapshot(ib_engine, NULL, 0);
+        std::vector<ib_rule_profile_t> profiles(num);
+
+        if (num > 0) {
+            num = ib_rule_profile_snapshot(ib_engine, &profiles[0], num);
+        }
+        profiles.resize(num);
+        return profiles;
+    }
+
+    /* Position of rule @a id in @a profiles, or -1 if not there. */
+    int find(const std::vector<ib_rule_profile_t>& profiles, const char *id)
+    {
+        for (size_t n = 0; n < profiles.size(); ++n) {
+            if (std::string(ib_rule_id(profiles[n].rule)) == id) {
+                return (int)n;
+            }
+        }
+        return -1;
+    }
+};
+
+TEST_F(RuleProfileTest, test_profile)
+{
+    std::vector<ib_rule_profile_t> profiles;
+    int p1;
+    int p2;
+    int p3;
+    int p4;
+
+    /* Nothing has run yet. */
+    profiles = snapshot();
+    for (size_t n = 0; n < profiles.size(); ++n) {
+        EXPECT_EQ(0UL, profiles[n].invocations);
+    }
+
+    performTx();
+    profiles = snapshot();
+
+    p1 = find(profiles, "prof-1");
+    p2 = find(profiles, "prof-2");
+    p3 = find(profiles, "prof-3");
+    p4 = find(profiles, "prof-4");
+    ASSERT_LE(0, p1);
+    ASSERT_LE(0, p2);
+    ASSERT_LE(0, p3);
+    ASSERT_LE(0, p4);
+
+    /* Snapshot entries are in rule definition order. */
+    EXPECT_LT(p1, p2);
+    EXPECT_LT(p2, p3);
+    EXPECT_LT(p3, p4);
+    for (size_t n = 0; n < profiles.size(); ++n) {
+        EXPECT_EQ(n, profiles[n].rule->profile_index);
+    }
+
+    EXPECT_EQ(1UL, profiles[p1].invocations);
+    EXPECT_EQ(1UL, profiles[p1].targets);
+    EXPECT_EQ(1UL, profiles[p1].true_results);
+    EXPECT_EQ(0UL, profiles[p1].false_results);
+
+    EXPECT_EQ(1UL, profiles[p2].invocations);
+    EXPECT_EQ(0UL, profiles[p2].true_results);
+    EXPECT_EQ(1UL, profiles[p2].false_results);
+
+    EXPECT_EQ(1UL, profiles[p3].invocations);
+    EXPECT_EQ(2UL, profiles[p3].targets);
+    EXPECT_EQ(1UL, profiles[p3].true_results);
+
+    EXPECT_EQ(1UL, profiles[p4].invocations);
+
+    /* Counters accumulate across transactions. */
+    performTx();
+    profiles = snapshot();
+    EXPECT_EQ(2UL, profiles[p1].invocations);
+    EXPECT_EQ(2UL, profiles[p2].false_results);
+    EXPECT_EQ(4UL, profiles[p3].targets);
+
+    /* A short array gets the first rules only. */
+    ib_rule_profile_t first;
+    EXPECT_EQ(profiles.size(), ib_rule_profile_snapshot(ib_engine, &first, 1));
+    EXPECT_EQ(profiles[0].rule, first.rule);
+    EXPECT_EQ(profiles[0].invocations, first.invocations);
+}
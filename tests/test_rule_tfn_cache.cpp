@@ -0,0 +1,98 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee --- Rule transformation cache tests
+//////////////////////////////////////////////////////////////////////////////
+
+#include "gtest/gtest.h"
+#include "base_fixture.h"
+
+#include <ironbee/data.h>
+#include <ironbee/field.h>
+#include <ironbee/rule_engine.h>
+
+/**
+ * The config applies the same transformation chain to the same target in
+ * three rules, then replaces a field between rules that transform it.
+ */
+class RuleTfnCacheTest : public BaseTransactionFixture
+{
+public:
+    void SetUp()
+    {
+        BaseTransactionFixture::SetUp();
+        configureIronBee("RuleTfnCacheTest.test_cache.config");
+        performTx();
+    }
+
+    bool isSet(const char *name)
+    {
+        ib_field_t *f;
+
+        return ib_data_get(ib_tx->data, name, &f) == IB_OK;
+    }
+};
+
+TEST_F(RuleTfnCacheTest, test_cache)
+{
+    size_t entries;
+    size_t hits;
+    size_t misses;
+
+    ASSERT_TRUE(ib_tx->rule_exec != NULL);
+    ib_rule_tfn_cache_stats(ib_tx->rule_exec, &entries, &hits, &misses);
+
+    /* All rules ran. */
+    EXPECT_TRUE(isSet("h1"));
+    EXPECT_TRUE(isSet("h2"));
+    EXPECT_TRUE(isSet("h3"));
+    EXPECT_TRUE(isSet("a1"));
+    EXPECT_TRUE(isSet("a2"));
+
+    /* tc-7 saw the replaced value, not the cached result for "Foo". */
+    EXPECT_TRUE(isSet("a3"));
+
+    /*
+     * HOST: 2 misses (tc-1), 4 hits (tc-2, tc-3).
+     * A: 1 miss (tc-4), 1 hit (tc-5), 1 miss after replacement (tc-7).
+     */
+    EXPECT_EQ(5UL, hits);
+    EXPECT_EQ(4UL, misses);
+
+    /* The replacement flushed the cache; only tc-7's result remains. */
+    EXPECT_EQ(1UL, entries);
+}
+
+TEST_F(RuleTfnCacheTest, test_generation)
+{
+    ib_field_t *f;
+    size_t      generation = ib_data_generation(ib_tx->data);
+
+    /* Adding a new field does not change the generation. */
+    ASSERT_EQ(IB_OK, ib_data_add_num(ib_tx->data, "tfn_cache_new", 1, &f));
+    EXPECT_EQ(generation, ib_data_generation(ib_tx->data));
+
+    /* Replacing or removing one does. */
+    ASSERT_EQ(IB_OK, ib_data_add_num(ib_tx->data, "tfn_cache_new", 2, &f));
+    EXPECT_NE(generation, ib_data_generation(ib_tx->data));
+    generation = ib_data_generation(ib_tx->data);
+
+    ASSERT_EQ(IB_OK, ib_data_remove(ib_tx->data, "tfn_cache_new", NULL));
+    EXPECT_NE(generation, ib_data_generation(ib_tx->data));
+}
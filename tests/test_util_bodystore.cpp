@@ -0,0 +1,202 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee --- Body store tests
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ironbee_config_auto.h"
+
+#include "gtest/gtest.h"
+#include "simple_fixture.hpp"
+
+#include <ironbee/bodystore.h>
+
+#include <string>
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+class TestBodyStore : public SimpleFixture
+{
+public:
+    virtual void SetUp()
+    {
+        SimpleFixture::SetUp();
+        strcpy(m_dir, "/tmp/XXXXXX");
+        ASSERT_TRUE(mkdtemp(m_dir) != NULL)
+            << "mkdtemp() returned " << strerror(errno) << std::endl;
+    }
+
+    virtual void TearDown()
+    {
+        std::string cmd = std::string("/bin/rm -fr ") + m_dir;
+
+        SimpleFixture::TearDown();
+        if (system(cmd.c_str()) != 0) {
+            ADD_FAILURE() << "Failed to remove " << m_dir;
+        }
+    }
+
+    //! Read all data of a store back.
+    std::string Contents(const ib_bodystore_t *store)
+    {
+        ib_bodystore_iter_t iter;
+        const uint8_t *data;
+        size_t dlen;
+        std::string result;
+
+        ib_bodystore_iter_init(&iter, store);
+        while (ib_bodystore_iter_next(&iter, &data, &dlen) == IB_OK) {
+            result.append(reinterpret_cast<const char *>(data), dlen);
+        }
+        return result;
+    }
+
+    //! Number of entries in the spill directory.
+    size_t DirEntries()
+    {
+        DIR *dir = opendir(m_dir);
+        struct dirent *ent;
+        size_t n = 0;
+
+        while ((ent = readdir(dir)) != NULL) {
+            if (ent->d_name[0] != '.') {
+                ++n;
+            }
+        }
+        closedir(dir);
+        return n;
+    }
+
+    char m_dir[32];
+};
+
+TEST_F(TestBodyStore, memory)
+{
+    ib_bodystore_t *store;
+
+    ASSERT_EQ(IB_OK, ib_bodystore_create(&store, MemPool(), 0, 0, m_dir));
+    ASSERT_EQ(IB_OK, ib_bodystore_append(store, "foo", 3));
+    ASSERT_EQ(IB_OK, ib_bodystore_append(store, "bar", 3));
+
+    EXPECT_EQ(6UL, ib_bodystore_length(store));
+    EXPECT_EQ(0UL, ib_bodystore_spilled(store));
+    EXPECT_EQ(0UL, ib_bodystore_truncated(store));
+    EXPECT_EQ("foobar", Contents(store));
+    EXPECT_EQ(0UL, DirEntries());
+}
+
+TEST_F(TestBodyStore, empty)
+{
+    ib_bodystore_t *store;
+    ib_bodystore_iter_t iter;
+    const uint8_t *data;
+    size_t dlen;
+
+    ASSERT_EQ(IB_OK, ib_bodystore_create(&store, MemPool(), 4, 0, m_dir));
+    EXPECT_EQ(0UL, ib_bodystore_length(store));
+    ib_bodystore_iter_init(&iter, store);
+    EXPECT_EQ(IB_ENOENT, ib_bodystore_iter_next(&iter, &data, &dlen));
+}
+
+TEST_F(TestBodyStore, spill)
+{
+    ib_bodystore_t *store;
+    std::string big(3 * IB_BODYSTORE_READ_SIZE + 17, 'x');
+
+    ASSERT_EQ(IB_OK, ib_bodystore_create(&store, MemPool(), 4, 0, m_dir));
+    ASSERT_EQ(IB_OK, ib_bodystore_append(store, "abc", 3));
+    ASSERT_EQ(IB_OK, ib_bodystore_append(store, "defg", 4));
+    ASSERT_EQ(IB_OK, ib_bodystore_append(store, big.data(), big.length()));
+
+    EXPECT_EQ(7UL + big.length(), ib_bodystore_length(store));
+    EXPECT_EQ(3UL + big.length(), ib_bodystore_spilled(store));
+    EXPECT_EQ(0UL, ib_bodystore_truncated(store));
+    EXPECT_EQ("abcdefg" + big, Contents(store));
+
+    // Iterating twice gives the same data.
+    EXPECT_EQ("abcdefg" + big, Contents(store));
+
+    // The temporary file is unlinked as soon as it is created.
+    EXPECT_EQ(0UL, DirEntries());
+}
+
+TEST_F(TestBodyStore, limit)
+{
+    ib_bodystore_t *store;
+
+    ASSERT_EQ(IB_OK, ib_bodystore_create(&store, MemPool(), 2, 5, m_dir));
+    ASSERT_EQ(IB_OK, ib_bodystore_append(store, "abc", 3));
+    ASSERT_EQ(IB_OK, ib_bodystore_append(store, "defg", 4));
+    ASSERT_EQ(IB_OK, ib_bodystore_append(store, "hij", 3));
+
+    EXPECT_EQ(5UL, ib_bodystore_length(store));
+    EXPECT_EQ(3UL, ib_bodystore_spilled(store));
+    EXPECT_EQ(5UL, ib_bodystore_truncated(store));
+    EXPECT_EQ("abcde", Contents(store));
+}
+
+//! Release callback counting its calls.
+static void count_release(const uint8_t *data, size_t dlen, void *cbdata)
+{
+    ++*reinterpret_cast<int *>(cbdata);
+}
+
+TEST_F(TestBodyStore, slice)
+{
+    static const uint8_t data[] = "abcdefgh";
+    ib_bodystore_t *store;
+    ib_slice_t *slice;
+    ib_bodystore_iter_t iter;
+    const uint8_t *chunk;
+    size_t dlen;
+    int released = 0;
+
+    ASSERT_EQ(IB_OK, ib_bodystore_create(&store, MemPool(), 5, 0, m_dir));
+    ASSERT_EQ(IB_OK, ib_slice_create(&slice, data, 8,
+                                     count_release, &released));
+    ASSERT_EQ(IB_OK, ib_bodystore_append_slice(store, slice));
+    ib_slice_release(slice);
+    EXPECT_EQ(0, released);
+
+    // The part in memory is the slice's data, not a copy.
+    ib_bodystore_iter_init(&iter, store);
+    ASSERT_EQ(IB_OK, ib_bodystore_iter_next(&iter, &chunk, &dlen));
+    EXPECT_EQ(data, chunk);
+    EXPECT_EQ(5UL, dlen);
+    EXPECT_EQ(3UL, ib_bodystore_spilled(store));
+    EXPECT_EQ("abcdefgh", Contents(store));
+
+    DestroyMemPool();
+    EXPECT_EQ(1, released);
+}
+
+TEST_F(TestBodyStore, bad_dir)
+{
+    ib_bodystore_t *store;
+    std::string dir = std::string(m_dir) + "/missing";
+
+    ASSERT_EQ(IB_OK,
+              ib_bodystore_create(&store, MemPool(), 2, 0, dir.c_str()));
+    ASSERT_EQ(IB_OK, ib_bodystore_append(store, "ab", 2));
+    EXPECT_EQ(IB_EOTHER, ib_bodystore_append(store, "cd", 2));
+    EXPECT_EQ("ab", Contents(store));
+}
@@ -606,6 +606,89 @@ TEST(TestMpool, Multithreading)
     ib_mpool_destroy(mp);
 }
 
+namespace {
+
+void muck_with_pages(ib_mpool_t* parent)
+{
+    static const size_t num_mucks = (size_t)1e3;
+    ib_mpool_t* mp;
+
+    for (size_t i = 0; i < num_mucks; ++i) {
+        ASSERT_EQ(IB_OK, ib_mpool_create(&mp, "tx", parent));
+        for (size_t j = 0; j < 64; ++j) {
+            char* p = (char *)ib_mpool_alloc(mp, 1000);
+            ASSERT_TRUE(p);
+            memset(p, 'x', 1000);
+        }
+        ASSERT_TRUE(ib_mpool_alloc(mp, 10000));
+        ib_mpool_destroy(mp);
+    }
+}
+
+}
+
+TEST(TestMpool, MultithreadingPages)
+{
+    static const size_t num_threads = 4;
+
+    ib_mpool_t* mp = NULL;
+    ib_status_t rc = ib_mpool_create(&mp, NULL, NULL);
+
+    ASSERT_EQ(IB_OK, rc);
+    ASSERT_TRUE(mp);
+
+    boost::thread_group threads;
+    for (size_t i = 0; i < num_threads; ++i) {
+        threads.create_thread(boost::bind(muck_with_pages, mp));
+    }
+
+    threads.join_all();
+
+    EXPECT_VALID(mp);
+
+    ib_mpool_destroy(mp);
+}
+
+TEST(TestMpool, DestroyedChildReused)
+{
+    reset_test();
+
+    ib_mpool_t* mp = NULL;
+    ib_status_t rc =
+        ib_mpool_create_ex(&mp, "reuse", NULL, 0,
+            &test_malloc, &test_free);
+    ASSERT_EQ(IB_OK, rc);
+
+    ib_mpool_t* child = NULL;
+    rc = ib_mpool_create(&child, NULL, mp);
+    ASSERT_EQ(IB_OK, rc);
+    EXPECT_TRUE(ib_mpool_alloc(child, 100));
+
+    ib_mpool_t* first = child;
+    ib_mpool_destroy(child);
+    EXPECT_VALID(mp);
+
+    size_t saved_malloc_calls = g_malloc_calls;
+
+    // Different page size, but a destroyed child has no pages to keep.
+    rc = ib_mpool_create_ex(&child, NULL, mp, 8192, NULL, NULL);
+    ASSERT_EQ(IB_OK, rc);
+    EXPECT_EQ(first, child);
+    EXPECT_EQ(saved_malloc_calls, g_malloc_calls);
+    EXPECT_VALID(mp);
+
+    ib_mpool_t* second = NULL;
+    rc = ib_mpool_create(&second, NULL, mp);
+    ASSERT_EQ(IB_OK, rc);
+    EXPECT_NE(child, second);
+    EXPECT_VALID(mp);
+
+    ib_mpool_destroy(mp);
+
+    ASSERT_EQ(g_malloc_calls, g_free_calls);
+    ASSERT_EQ(g_malloc_bytes, g_free_bytes);
+}
+
 TEST(TestMpool, ZeroLength)
 {
     ib_mpool_t* mp = NULL;
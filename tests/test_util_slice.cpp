@@ -0,0 +1,94 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee --- Buffer slice tests
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ironbee_config_auto.h"
+
+#include "gtest/gtest.h"
+#include "simple_fixture.hpp"
+
+#include <ironbee/slice.h>
+
+namespace {
+
+//! Release callback counting its calls.
+void count_release(const uint8_t *data, size_t dlen, void *cbdata)
+{
+    ++*reinterpret_cast<int *>(cbdata);
+}
+
+const uint8_t c_data[] = "Hello World";
+
+}
+
+TEST(TestSlice, create_release)
+{
+    ib_slice_t *slice;
+    int released = 0;
+
+    ASSERT_EQ(IB_OK, ib_slice_create(&slice, c_data, 11,
+                                     count_release, &released));
+    EXPECT_EQ(c_data, ib_slice_data(slice));
+    EXPECT_EQ(11UL, ib_slice_length(slice));
+
+    ib_slice_ref(slice);
+    ib_slice_release(slice);
+    EXPECT_EQ(0, released);
+    ib_slice_release(slice);
+    EXPECT_EQ(1, released);
+}
+
+TEST(TestSlice, sub)
+{
+    ib_slice_t *slice;
+    ib_slice_t *sub;
+    int released = 0;
+
+    ASSERT_EQ(IB_OK, ib_slice_create(&slice, c_data, 11,
+                                     count_release, &released));
+    ASSERT_EQ(IB_OK, ib_slice_sub(&sub, slice, 6, 5));
+    EXPECT_EQ(c_data + 6, ib_slice_data(sub));
+    EXPECT_EQ(5UL, ib_slice_length(sub));
+
+    EXPECT_EQ(IB_EINVAL, ib_slice_sub(&sub, slice, 6, 6));
+    EXPECT_EQ(IB_EINVAL, ib_slice_sub(&sub, slice, 12, 0));
+
+    // The sub-slice keeps the slice alive.
+    ib_slice_release(slice);
+    EXPECT_EQ(0, released);
+    ib_slice_release(sub);
+    EXPECT_EQ(1, released);
+}
+
+TEST_F(SimpleFixture, slice_ref_mpool)
+{
+    ib_slice_t *slice;
+    int released = 0;
+
+    ASSERT_EQ(IB_OK, ib_slice_create(&slice, c_data, 11,
+                                     count_release, &released));
+    ASSERT_EQ(IB_OK, ib_slice_ref_mpool(slice, MemPool()));
+    ib_slice_release(slice);
+    EXPECT_EQ(0, released);
+
+    ib_mpool_clear(MemPool());
+    EXPECT_EQ(1, released);
+}
@@ -30,6 +30,7 @@
 #include "gtest/gtest.h"
 
 #include <stdexcept>
+#include <string>
 #include <math.h>
 
 class TestIBUtilStringToNum : public ::testing::Test
@@ -840,6 +841,87 @@ TEST_F(TestIBUtilStrStrEx, test_strstr_ex_nul2)
     RunTest(__LINE__, haystack, 5, "abc\0", 4, NULL);
 }
 
+TEST_F(TestIBUtilStrStrEx, test_strstr_ex_long)
+{
+    // Long enough for the vectorized search; the needle is placed at every
+    // position so that block boundaries and the tail are all covered.
+    const char *needle = "needle";
+    const size_t needle_len = strlen(needle);
+    std::string haystack(200, 'n');
+
+    RunTest(__LINE__, haystack.data(), haystack.size(), needle, NULL);
+    RunTest(__LINE__, haystack.data(), haystack.size(), "nnx", NULL);
+    for (size_t pos = 0; pos + needle_len <= haystack.size(); ++pos) {
+        std::string h(haystack);
+
+        h.replace(pos, needle_len, needle);
+        RunTest(__LINE__, h.data(), h.size(), needle, h.data() + pos);
+    }
+}
+
+class TestIBUtilStrCaseStrEx : public TestIBUtilStrEx
+{
+public:
+    void RunTestImpl(int line,
+                     const char *haystack,
+                     size_t haystack_len,
+                     const char *needle,
+                     size_t needle_len,
+                     const char *expected)
+    {
+        const char *result = ib_strcasestr_ex(haystack,
+                                              haystack_len,
+                                              needle,
+                                              needle_len);
+        const int blen = 256;
+        char b1[blen];
+        char b2[blen];
+        char b3[blen];
+
+        EXPECT_STREQ(expected, result)
+            << "Line " << line << ": "
+            << Stringize("strcasestr",
+                         haystack, haystack_len,
+                         needle, needle_len, b1, blen)
+            << " expected " << Stringize(expected, b3, blen)
+            << " returned " << Stringize(result, b2, blen);
+    }
+};
+
+/// @test Test util string library - strcasestr_ex()
+TEST_F(TestIBUtilStrCaseStrEx, test_strcasestr_ex_errors)
+{
+    RunTest(__LINE__, "", "", NULL);
+    RunTest(__LINE__, "abc", "", NULL);
+    RunTest(__LINE__, "", "abc", NULL);
+    RunTest(__LINE__, "a", "aaa", NULL);
+    RunTest(__LINE__, NULL, "abc", NULL);
+    RunTest(__LINE__, "abc", NULL, NULL);
+}
+
+TEST_F(TestIBUtilStrCaseStrEx, test_strcasestr_ex)
+{
+    const char *haystack;
+
+    haystack = "A";
+    RunTest(__LINE__, haystack, "a",   haystack+0);
+    haystack = "aB";
+    RunTest(__LINE__, haystack, "Ab",  haystack+0);
+    haystack = "aB";
+    RunTest(__LINE__, haystack, "b",   haystack+1);
+    haystack = "aBabC";
+    RunTest(__LINE__, haystack, "ABC", haystack+2);
+    haystack = "a@[c";
+    RunTest(__LINE__, haystack, "`{C", NULL);
+    haystack = "x\0Ab";
+    RunTest(__LINE__, haystack, 4, "aB", haystack+2);
+
+    haystack = "<html><body><SCRIPT>alert(1)</SCRIPT></body></html>";
+    RunTest(__LINE__, haystack, "<script>", haystack+12);
+    RunTest(__LINE__, haystack, "</Script>", haystack+28);
+    RunTest(__LINE__, haystack, "<scripts>", NULL);
+}
+
 class TestIBUtilStrRStrEx : public TestIBUtilStrEx
 {
 public:
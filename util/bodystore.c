@@ -0,0 +1,361 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee --- Body Store Routines
+ */
+
+#include "ironbee_config_auto.h"
+
+#include <ironbee/bodystore.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** A chunk of body data kept in memory */
+struct ib_bodystore_chunk_t {
+    const uint8_t              *data;      /**< Data */
+    size_t                      dlen;      /**< Data length */
+    ib_bodystore_chunk_t       *next;      /**< Next chunk */
+};
+
+/** Body store */
+struct ib_bodystore_t {
+    ib_mpool_t                 *mp;        /**< Memory pool */
+    size_t                      mem_limit; /**< Memory limit (0 = none) */
+    size_t                      limit;     /**< Overall limit (0 = none) */
+    const char                 *dir;       /**< Temporary file directory */
+    ib_bodystore_chunk_t       *first;     /**< First memory chunk */
+    ib_bodystore_chunk_t       *last;      /**< Last memory chunk */
+    size_t                      mem_len;   /**< Bytes in memory */
+    uint64_t                    spilled;   /**< Bytes in the file */
+    uint64_t                    truncated; /**< Bytes dropped */
+    int                         fd;        /**< Temporary file or -1 */
+    uint8_t                    *buf;       /**< Buffer to read the file */
+};
+
+/**
+ * Close the temporary file of a body store.
+ *
+ * @param[in] cbdata Body store
+ */
+static void bodystore_cleanup(void *cbdata)
+{
+    ib_bodystore_t *store = (ib_bodystore_t *)cbdata;
+
+    if (store->fd >= 0) {
+        close(store->fd);
+        store->fd = -1;
+    }
+}
+
+/**
+ * Create the temporary file of a body store.
+ *
+ * The file is unlinked right away, so it disappears when it is closed.
+ *
+ * @param[in,out] store Body store
+ *
+ * @returns IB_OK, IB_EALLOC or IB_EOTHER
+ */
+static ib_status_t bodystore_open(ib_bodystore_t *store)
+{
+    char *path;
+    size_t len;
+    int fd;
+
+    len = strlen(store->dir) + sizeof("/ironbee-body-XXXXXX");
+    path = malloc(len);
+    if (path == NULL) {
+        return IB_EALLOC;
+    }
+    snprintf(path, len, "%s/ironbee-body-XXXXXX", store->dir);
+
+    fd = mkstemp(path);
+    if (fd < 0) {
+        free(path);
+        return IB_EOTHER;
+    }
+    unlink(path);
+    free(path);
+
+    store->fd = fd;
+    return IB_OK;
+}
+
+/**
+ * Write data to the temporary file of a body store.
+ *
+ * @param[in,out] store Body store
+ * @param[in] data Data
+ * @param[in] dlen Length of @a data
+ *
+ * @returns IB_OK, IB_EALLOC or IB_EOTHER
+ */
+static ib_status_t bodystore_spill(ib_bodystore_t *store,
+                                   const uint8_t *data,
+                                   size_t dlen)
+{
+    ib_status_t rc;
+
+    if (store->fd < 0) {
+        rc = bodystore_open(store);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+
+    while (dlen > 0) {
+        ssize_t n = write(store->fd, data, dlen);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return IB_EOTHER;
+        }
+        data += n;
+        dlen -= n;
+        store->spilled += n;
+    }
+
+    return IB_OK;
+}
+
+ib_status_t ib_bodystore_create(ib_bodystore_t **pstore,
+                                ib_mpool_t *mp,
+                                size_t mem_limit,
+                                size_t limit,
+                                const char *dir)
+{
+    assert(pstore != NULL);
+    assert(mp != NULL);
+
+    ib_bodystore_t *store;
+    ib_status_t rc;
+
+    store = ib_mpool_calloc(mp, 1, sizeof(*store));
+    if (store == NULL) {
+        return IB_EALLOC;
+    }
+    store->mp = mp;
+    store->mem_limit = mem_limit;
+    store->limit = limit;
+    store->dir = (dir == NULL) ? "/tmp" : dir;
+    store->fd = -1;
+
+    rc = ib_mpool_cleanup_register(mp, bodystore_cleanup, store);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    *pstore = store;
+    return IB_OK;
+}
+
+/**
+ * Append data to a body store.
+ *
+ * @param[in,out] store Body store
+ * @param[in] p Data
+ * @param[in] dlen Length of @a p
+ * @param[in] slice Slice holding @a p, referenced instead of copying the
+ *            data kept in memory (or NULL to copy)
+ *
+ * @returns IB_OK, IB_EALLOC or IB_EOTHER
+ */
+static ib_status_t bodystore_append(ib_bodystore_t *store,
+                                    const uint8_t *p,
+                                    size_t dlen,
+                                    ib_slice_t *slice)
+{
+    uint64_t length = ib_bodystore_length(store);
+    size_t n;
+
+    /* Drop anything past the overall limit. */
+    if (store->limit > 0) {
+        uint64_t room = (length < store->limit) ? store->limit - length : 0;
+
+        if (dlen > room) {
+            store->truncated += dlen - room;
+            dlen = room;
+        }
+    }
+    if (dlen == 0) {
+        return IB_OK;
+    }
+
+    /* Keep what fits in memory, unless data has already been spilled. */
+    n = dlen;
+    if (store->spilled > 0) {
+        n = 0;
+    }
+    else if (store->mem_limit > 0) {
+        size_t room = store->mem_limit - store->mem_len;
+
+        if (n > room) {
+            n = room;
+        }
+    }
+    if (n > 0) {
+        ib_bodystore_chunk_t *chunk;
+
+        chunk = ib_mpool_alloc(store->mp, sizeof(*chunk));
+        if (chunk == NULL) {
+            return IB_EALLOC;
+        }
+        if (slice != NULL) {
+            ib_status_t rc = ib_slice_ref_mpool(slice, store->mp);
+
+            if (rc != IB_OK) {
+                return rc;
+            }
+            chunk->data = p;
+        }
+        else {
+            chunk->data = ib_mpool_memdup(store->mp, p, n);
+            if (chunk->data == NULL) {
+                return IB_EALLOC;
+            }
+        }
+        chunk->dlen = n;
+        chunk->next = NULL;
+        if (store->last == NULL) {
+            store->first = chunk;
+        }
+        else {
+            store->last->next = chunk;
+        }
+        store->last = chunk;
+        store->mem_len += n;
+        p += n;
+        dlen -= n;
+    }
+
+    if (dlen == 0) {
+        return IB_OK;
+    }
+    return bodystore_spill(store, p, dlen);
+}
+
+ib_status_t ib_bodystore_append(ib_bodystore_t *store,
+                                const void *data,
+                                size_t dlen)
+{
+    assert(store != NULL);
+    assert( (data != NULL) || (dlen == 0) );
+
+    return bodystore_append(store, (const uint8_t *)data, dlen, NULL);
+}
+
+ib_status_t ib_bodystore_append_slice(ib_bodystore_t *store,
+                                      ib_slice_t *slice)
+{
+    assert(store != NULL);
+    assert(slice != NULL);
+
+    return bodystore_append(store,
+                            ib_slice_data(slice), ib_slice_length(slice),
+                            slice);
+}
+
+uint64_t ib_bodystore_length(const ib_bodystore_t *store)
+{
+    assert(store != NULL);
+
+    return store->mem_len + store->spilled;
+}
+
+uint64_t ib_bodystore_spilled(const ib_bodystore_t *store)
+{
+    assert(store != NULL);
+
+    return store->spilled;
+}
+
+uint64_t ib_bodystore_truncated(const ib_bodystore_t *store)
+{
+    assert(store != NULL);
+
+    return store->truncated;
+}
+
+void ib_bodystore_iter_init(ib_bodystore_iter_t *iter,
+                            const ib_bodystore_t *store)
+{
+    assert(iter != NULL);
+    assert(store != NULL);
+
+    iter->store = store;
+    iter->chunk = store->first;
+    iter->offset = 0;
+}
+
+ib_status_t ib_bodystore_iter_next(ib_bodystore_iter_t *iter,
+                                   const uint8_t **data,
+                                   size_t *dlen)
+{
+    assert(iter != NULL);
+    assert(iter->store != NULL);
+    assert(data != NULL);
+    assert(dlen != NULL);
+
+    /* The store is not modified, only its read buffer. */
+    ib_bodystore_t *store = (ib_bodystore_t *)iter->store;
+    size_t want;
+    ssize_t n;
+
+    if (iter->chunk != NULL) {
+        *data = iter->chunk->data;
+        *dlen = iter->chunk->dlen;
+        iter->chunk = iter->chunk->next;
+        return IB_OK;
+    }
+
+    if (iter->offset >= store->spilled) {
+        return IB_ENOENT;
+    }
+
+    if (store->buf == NULL) {
+        store->buf = ib_mpool_alloc(store->mp, IB_BODYSTORE_READ_SIZE);
+        if (store->buf == NULL) {
+            return IB_EALLOC;
+        }
+    }
+
+    want = IB_BODYSTORE_READ_SIZE;
+    if (store->spilled - iter->offset < want) {
+        want = store->spilled - iter->offset;
+    }
+    do {
+        n = pread(store->fd, store->buf, want, (off_t)iter->offset);
+    } while ( (n < 0) && (errno == EINTR) );
+    if (n <= 0) {
+        return IB_EOTHER;
+    }
+
+    iter->offset += n;
+    *data = store->buf;
+    *dlen = n;
+
+    return IB_OK;
+}
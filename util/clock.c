@@ -85,6 +85,23 @@ ib_time_t ib_clock_get_time(void)
     return usec;
 }
 
+uint64_t ib_clock_get_time_ns(void)
+{
+#ifdef IB_CLOCK
+    struct timespec ts;
+
+    clock_gettime(IB_CLOCK, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return ((uint64_t)tv.tv_sec * 1000000000) + (tv.tv_usec * 1000);
+#endif
+}
+
 void ib_clock_gettimeofday(ib_timeval_t *tp)
 {
     assert(tp != NULL);
@@ -29,13 +29,12 @@
 
 #include <ironbee/mpool.h>
 
-#include <ironbee/lock.h>
-
 #ifdef IB_MPOOL_VALGRIND
 #include <valgrind/memcheck.h>
 #endif
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -142,6 +141,36 @@ static char s_zero_length_buffer[1];
  **/
 #define IB_MPOOL_TRACK_ZERO_SIZE 5
 
+/**
+ * Number of pages in a thread cache magazine.
+ *
+ * Destroying a pool that uses the default page size, malloc(), and free()
+ * does not free its pages but puts them in a magazine of the calling thread,
+ * from which pools of that thread take pages before calling malloc().  Full
+ * magazines move to a global depot shared by all threads.  Pointer pages are
+ * cached the same way in magazines of their own.
+ *
+ * Defining this as 0 disables the thread cache.  It is disabled when
+ * IB_MPOOL_VALGRIND is defined so that valgrind sees pages being freed.
+ *
+ * @sa IB_MPOOL_DEPOT_SIZE
+ **/
+#ifdef IB_MPOOL_VALGRIND
+#define IB_MPOOL_MAGAZINE_SIZE 0
+#else
+#define IB_MPOOL_MAGAZINE_SIZE 32
+#endif
+
+/**
+ * Number of full magazines the global depot can hold of each kind.
+ *
+ * Pages that fit in neither the thread magazine nor the depot are freed, so
+ * the depot bounds the memory cached beyond one magazine per thread.
+ *
+ * @sa IB_MPOOL_MAGAZINE_SIZE
+ **/
+#define IB_MPOOL_DEPOT_SIZE 64
+
 /**@}*/
 
 /* Basic Sanity Check -- Otherwise track number calculation fails. */
@@ -158,6 +187,23 @@ typedef struct ib_mpool_pointer_page_t ib_mpool_pointer_page_t;
 /** See struct ib_mpool_cleanup_t */
 typedef struct ib_mpool_cleanup_t ib_mpool_cleanup_t;
 
+/**
+ * State of a memory pool with respect to its parent.
+ *
+ * Children are never unlinked from the child list of their parent, so that
+ * children can be created and destroyed concurrently without a lock.
+ * Instead, a released or destroyed child is marked as such and its structure
+ * is claimed by a later ib_mpool_create() with the same parent.
+ *
+ * @sa ib_mpool_t
+ */
+typedef enum {
+    IB_MPOOL_STATE_LIVE,    /**< In use. */
+    IB_MPOOL_STATE_FREE,    /**< Released: cleared but keeps its pages. */
+    IB_MPOOL_STATE_DEAD,    /**< Destroyed: only the structure is left. */
+    IB_MPOOL_STATE_CLAIMED  /**< Being reused by ib_mpool_create(). */
+} ib_mpool_state_t;
+
 /**
  * A page to hold small allocations.
  *
@@ -277,8 +323,21 @@ struct ib_mpool_cleanup_t {
  * pool itself are freed.  In contrast, when a pool is cleared, the pages,
  * pointer pages, and cleanup nodes are moved to free lists for future reuse.
  * Release functions similar to destroy except that if there is a parent pool
- * the pool is cleared and added to the free children list of the parent
- * pool.
+ * the pool is cleared and marked free for reuse by the parent.
+ *
+ * Destroyed pages and pointer pages of pools using the default page size,
+ * malloc(), and free() go to a thread cache instead of free(), and such
+ * pools take their pages from the cache before calling malloc().  Each
+ * thread has one magazine of pages and one of pointer pages; full magazines
+ * are exchanged with a global depot by compare and swap.  Short lived pools,
+ * such as one per transaction, thus recycle pages without malloc(), free(),
+ * or a lock.  See IB_MPOOL_MAGAZINE_SIZE.
+ *
+ * Likewise, a child pool is never removed from the child list of its parent.
+ * Creating a child first tries to claim a released or destroyed child of
+ * the same parent (see ib_mpool_state_t) and otherwise pushes a new one onto
+ * the front of the list; both are single compare and swap operations.  The
+ * list thus never holds more children than were ever alive at once.
  *
  * Finally, cleanup functions can be registered with a pool to be called on
  * clear or destroy.  It is assumed that these are relatively rare.  They are
@@ -360,13 +419,24 @@ struct ib_mpool_t
     /**
      * The next sibling.
      *
-     * This pointer is considered to be part of the parent in terms of
-     * locking.  I.e., to modify this, the parent should be locked.
+     * Set before the pool is pushed onto the child list of its parent and
+     * never changed afterwards.
      **/
     ib_mpool_t *next;
 
     /**
-     * Singly linked list of all child pools.
+     * State; an ib_mpool_state_t.
+     *
+     * Once the pool is on the child list of its parent, this is only
+     * changed by compare and swap.
+     **/
+    int state;
+
+    /**
+     * Singly linked list of all child pools, in any state.
+     *
+     * Children are pushed onto the front by compare and swap and are only
+     * removed when this pool is destroyed.
      **/
     ib_mpool_t *children;
     /**
@@ -374,16 +444,6 @@ struct ib_mpool_t
      **/
     ib_mpool_t *children_end;
 
-    /**
-     * Lock for multithreading support.
-     *
-     * This lock is only used in creation and destruction to allow
-     * simultaneous creation/destruction of memory pools with a common
-     * parent.  Both operations must modify the parents children list and
-     * this lock protects it.
-     **/
-    ib_lock_t lock;
-
     /**
      * Tracks of pages.
      *
@@ -432,12 +492,6 @@ struct ib_mpool_t
      * @sa ib_mpool_t
      **/
     ib_mpool_cleanup_t      *free_cleanups;
-    /**
-     * Singly linked list of free children.
-     *
-     * @sa ib_mpool_t
-     **/
-    ib_mpool_t              *free_children;
 };
 
 /**
@@ -553,36 +607,446 @@ size_t ib_mpool_track_number(size_t size)
 }
 
 /**
- * Remove a child pool from a parent pools child list.
+ * Change the state of @a mp.
  *
- * The parent should usually be locked before calling this.
+ * This is a full memory barrier: all changes made to @a mp before are
+ * visible to the thread that claims it next.
  *
- * @param[in] child Child to remove from parent pool.
+ * @param[in] mp    Memory pool.
+ * @param[in] state New state.
  */
 static
-void ib_mpool_remove_child_from_parent(const ib_mpool_t *child)
+void ib_mpool_set_state(ib_mpool_t *mp, ib_mpool_state_t state)
+{
+    assert(mp != NULL);
+
+    int old;
+
+    do {
+        old = __atomic_load_n(&(mp->state), __ATOMIC_RELAXED);
+    } while (! __sync_bool_compare_and_swap(&(mp->state), old, state));
+
+    return;
+}
+
+/**
+ * Push a new child pool onto the front of its parent's child list.
+ *
+ * @param[in] child Child to add to its parent pool.
+ */
+static
+void ib_mpool_push_child(ib_mpool_t *child)
 {
     assert(child         != NULL);
     assert(child->parent != NULL);
 
-    if (child->parent->children == child) {
-        child->parent->children = child->next;
-        if (child->next == NULL) {
-            child->parent->children_end = NULL;
+    ib_mpool_t *parent = child->parent;
+
+    do {
+        child->next = __atomic_load_n(&(parent->children), __ATOMIC_ACQUIRE);
+    } while (! __sync_bool_compare_and_swap(&(parent->children),
+                                            child->next, child));
+
+    /* Children are never unlinked, so the first child stays the last. */
+    if (child->next == NULL) {
+        parent->children_end = child;
+    }
+
+    return;
+}
+
+/**
+ * Claim a released or destroyed child of @a parent for reuse.
+ *
+ * A released child is only reused if its parameters match, as it keeps its
+ * pages.  A destroyed child only needs matching allocation functions, as
+ * those allocated the structure.
+ *
+ * @param[in]  parent    Parent pool.
+ * @param[in]  pagesize  Page size of the new pool.
+ * @param[in]  malloc_fn Malloc function of the new pool.
+ * @param[in]  free_fn   Free function of the new pool.
+ * @param[out] prior     State of the child before it was claimed.
+ * @return Claimed child in state IB_MPOOL_STATE_CLAIMED or NULL if none is
+ *         available.
+ */
+static
+ib_mpool_t *ib_mpool_claim_child(
+    ib_mpool_t           *parent,
+    size_t                pagesize,
+    ib_mpool_malloc_fn_t  malloc_fn,
+    ib_mpool_free_fn_t    free_fn,
+    ib_mpool_state_t     *prior
+)
+{
+    assert(parent != NULL);
+    assert(prior  != NULL);
+
+    for (
+        ib_mpool_t *child =
+            __atomic_load_n(&(parent->children), __ATOMIC_ACQUIRE);
+        child != NULL;
+        child = child->next
+    ) {
+        int state = __atomic_load_n(&(child->state), __ATOMIC_RELAXED);
+
+        if (state != IB_MPOOL_STATE_FREE && state != IB_MPOOL_STATE_DEAD) {
+            continue;
+        }
+        if (! __sync_bool_compare_and_swap(
+                &(child->state), state, IB_MPOOL_STATE_CLAIMED))
+        {
+            continue;
+        }
+
+        /* Parameters can only be trusted once claimed. */
+        if (
+            child->malloc_fn == malloc_fn &&
+            child->free_fn   == free_fn &&
+            (state == IB_MPOOL_STATE_DEAD || child->pagesize == pagesize)
+        ) {
+            *prior = (ib_mpool_state_t)state;
+            return child;
         }
+        ib_mpool_set_state(child, (ib_mpool_state_t)state);
     }
-    else {
-        /* Find node whose next node is child. */
-        ib_mpool_t *before_child = child->parent->children;
-        while (before_child->next != child) {
-            before_child = before_child->next;
+
+    return NULL;
+}
+
+/**
+ * Reset @a mp to an empty pool, leaving its place in the child list.
+ *
+ * All memory of @a mp must have been freed already.
+ *
+ * @param[in] mp Memory pool to reset.
+ */
+static
+void ib_mpool_reset(ib_mpool_t *mp)
+{
+    assert(mp != NULL);
+
+    for (size_t track_num = 0; track_num < IB_MPOOL_NUM_TRACKS; ++track_num) {
+        mp->tracks[track_num]     = NULL;
+        mp->tracks_end[track_num] = NULL;
+    }
+    mp->name                   = NULL;
+    mp->inuse                  = 0;
+    mp->large_allocation_inuse = 0;
+    mp->children               = NULL;
+    mp->children_end           = NULL;
+    mp->large_allocations      = NULL;
+    mp->large_allocations_end  = NULL;
+    mp->cleanups               = NULL;
+    mp->cleanups_end           = NULL;
+    mp->free_pages             = NULL;
+    mp->free_pointer_pages     = NULL;
+    mp->free_cleanups          = NULL;
+
+    return;
+}
+
+/**@}*/
+
+/**
+ * @name Thread cache of pages and pointer pages.
+ *
+ * See IB_MPOOL_MAGAZINE_SIZE.
+ */
+/**@{*/
+
+/**
+ * Kinds of memory held by the thread cache.
+ */
+typedef enum {
+    IB_MPOOL_CACHE_PAGE,         /**< Pages of the default size. */
+    IB_MPOOL_CACHE_POINTER_PAGE, /**< Pointer pages. */
+    IB_MPOOL_CACHE_KINDS         /**< Number of kinds. */
+} ib_mpool_cache_kind_t;
+
+#if IB_MPOOL_MAGAZINE_SIZE > 0
+
+/** See struct ib_mpool_magazine_t */
+typedef struct ib_mpool_magazine_t ib_mpool_magazine_t;
+
+/**
+ * A magazine: a bounded stack of free pages or pointer pages.
+ */
+struct ib_mpool_magazine_t
+{
+    /** Number of items. */
+    size_t  count;
+    /** Free pages or pointer pages, allocated by malloc(). */
+    void   *items[IB_MPOOL_MAGAZINE_SIZE];
+};
+
+/**
+ * Global depot of full magazines.
+ *
+ * A slot is NULL or a full magazine.  Slots are only changed by compare and
+ * swap of the whole magazine pointer, so taking a magazine out is safe even
+ * if the same magazine was put back in the meantime.
+ */
+static ib_mpool_magazine_t *
+    s_depot[IB_MPOOL_CACHE_KINDS][IB_MPOOL_DEPOT_SIZE];
+
+/** Key of the magazines of each thread: ib_mpool_magazine_t *[kinds]. */
+static pthread_key_t  s_magazine_key;
+/** Was s_magazine_key created? */
+static bool           s_magazine_key_valid = false;
+/** Control for creating s_magazine_key. */
+static pthread_once_t s_magazine_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Free the magazines of a thread when it exits.
+ *
+ * @param[in] data Magazines of the thread (ib_mpool_magazine_t **).
+ */
+static
+void ib_mpool_magazines_destroy(void *data)
+{
+    ib_mpool_magazine_t **magazines = (ib_mpool_magazine_t **)data;
+
+    for (size_t kind = 0; kind < IB_MPOOL_CACHE_KINDS; ++kind) {
+        if (magazines[kind] != NULL) {
+            for (size_t i = 0; i < magazines[kind]->count; ++i) {
+                free(magazines[kind]->items[i]);
+            }
+            free(magazines[kind]);
+        }
+    }
+    free(magazines);
+
+    return;
+}
+
+/**
+ * Create s_magazine_key; called once.
+ */
+static
+void ib_mpool_magazine_key_create(void)
+{
+    s_magazine_key_valid =
+        (pthread_key_create(&s_magazine_key, ib_mpool_magazines_destroy) == 0);
+
+    return;
+}
+
+/**
+ * Magazines of the calling thread.
+ *
+ * @return Array of IB_MPOOL_CACHE_KINDS magazines, each possibly NULL, or
+ *         NULL if the thread cache is not available.
+ */
+static
+ib_mpool_magazine_t **ib_mpool_magazines(void)
+{
+    ib_mpool_magazine_t **magazines;
+
+    pthread_once(&s_magazine_once, ib_mpool_magazine_key_create);
+    if (! s_magazine_key_valid) {
+        return NULL;
+    }
+
+    magazines = (ib_mpool_magazine_t **)pthread_getspecific(s_magazine_key);
+    if (magazines == NULL) {
+        magazines = (ib_mpool_magazine_t **)
+            calloc(IB_MPOOL_CACHE_KINDS, sizeof(*magazines));
+        if (magazines == NULL) {
+            return NULL;
         }
-        before_child->next = child->next;
-        if (child->next == NULL) {
-            child->parent->children_end = before_child;
+        if (pthread_setspecific(s_magazine_key, magazines) != 0) {
+            free(magazines);
+            return NULL;
         }
     }
 
+    return magazines;
+}
+
+#endif /* IB_MPOOL_MAGAZINE_SIZE > 0 */
+
+/**
+ * Can memory of kind @a kind of @a mp go through the thread cache?
+ *
+ * @param[in] mp   Memory pool.
+ * @param[in] kind Kind of memory.
+ * @return true iff @a mp uses malloc(), free(), and, for pages, the default
+ *         page size.
+ */
+static
+bool ib_mpool_cacheable(const ib_mpool_t *mp, ib_mpool_cache_kind_t kind)
+{
+    assert(mp != NULL);
+
+    return
+        IB_MPOOL_MAGAZINE_SIZE > 0 &&
+        mp->malloc_fn == &malloc &&
+        mp->free_fn   == &free &&
+        (
+            kind != IB_MPOOL_CACHE_PAGE ||
+            mp->pagesize == IB_MPOOL_DEFAULT_PAGE_SIZE
+        );
+}
+
+/**
+ * Take a page or pointer page from the thread cache.
+ *
+ * If the magazine of the thread is empty, it is exchanged for a full one
+ * from the depot.
+ *
+ * @param[in] mp   Memory pool to take memory for.
+ * @param[in] kind Kind of memory.
+ * @return Uninitialized memory or NULL if the cache has none.
+ */
+static
+void *ib_mpool_cache_get(
+    const ib_mpool_t      *mp,
+    ib_mpool_cache_kind_t  kind
+)
+{
+    assert(mp != NULL);
+
+#if IB_MPOOL_MAGAZINE_SIZE > 0
+    ib_mpool_magazine_t **magazines;
+    ib_mpool_magazine_t  *magazine;
+
+    if (! ib_mpool_cacheable(mp, kind)) {
+        return NULL;
+    }
+    magazines = ib_mpool_magazines();
+    if (magazines == NULL) {
+        return NULL;
+    }
+
+    magazine = magazines[kind];
+    if (magazine == NULL || magazine->count == 0) {
+        ib_mpool_magazine_t *full = NULL;
+
+        for (size_t i = 0; i < IB_MPOOL_DEPOT_SIZE; ++i) {
+            ib_mpool_magazine_t *candidate =
+                __atomic_load_n(&(s_depot[kind][i]), __ATOMIC_ACQUIRE);
+
+            if (
+                candidate != NULL &&
+                __sync_bool_compare_and_swap(
+                    &(s_depot[kind][i]), candidate, NULL
+                )
+            ) {
+                full = candidate;
+                break;
+            }
+        }
+        if (full == NULL) {
+            return NULL;
+        }
+
+        free(magazine);
+        magazines[kind] = magazine = full;
+    }
+
+    return magazine->items[--magazine->count];
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Put a page or pointer page of @a mp in the thread cache.
+ *
+ * If the magazine of the thread is full, it is moved to the depot and
+ * replaced by an empty one.
+ *
+ * @param[in] mp   Memory pool the memory belonged to.
+ * @param[in] kind Kind of memory.
+ * @param[in] item Memory to cache.
+ * @return true iff @a item was cached; if false, the caller must free it.
+ */
+static
+bool ib_mpool_cache_put(
+    const ib_mpool_t      *mp,
+    ib_mpool_cache_kind_t  kind,
+    void                  *item
+)
+{
+    assert(mp   != NULL);
+    assert(item != NULL);
+
+#if IB_MPOOL_MAGAZINE_SIZE > 0
+    ib_mpool_magazine_t **magazines;
+    ib_mpool_magazine_t  *magazine;
+
+    if (! ib_mpool_cacheable(mp, kind)) {
+        return false;
+    }
+    magazines = ib_mpool_magazines();
+    if (magazines == NULL) {
+        return false;
+    }
+
+    magazine = magazines[kind];
+    if (magazine != NULL && magazine->count == IB_MPOOL_MAGAZINE_SIZE) {
+        bool deposited = false;
+
+        for (size_t i = 0; i < IB_MPOOL_DEPOT_SIZE; ++i) {
+            if (
+                __atomic_load_n(&(s_depot[kind][i]), __ATOMIC_RELAXED)
+                    == NULL &&
+                __sync_bool_compare_and_swap(
+                    &(s_depot[kind][i]), NULL, magazine
+                )
+            ) {
+                deposited = true;
+                break;
+            }
+        }
+        if (! deposited) {
+            /* Everything is full; keep the full magazine for reuse. */
+            return false;
+        }
+
+        magazines[kind] = magazine = NULL;
+    }
+
+    if (magazine == NULL) {
+        magazine = (ib_mpool_magazine_t *)malloc(sizeof(*magazine));
+        if (magazine == NULL) {
+            return false;
+        }
+        magazine->count = 0;
+        magazines[kind] = magazine;
+    }
+
+    magazine->items[magazine->count++] = item;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Free a page or pointer page of @a mp, through the thread cache if
+ * possible.
+ *
+ * @param[in] mp   Memory pool the memory belonged to.
+ * @param[in] kind Kind of memory.
+ * @param[in] item Memory to free.
+ */
+static
+void ib_mpool_cache_free(
+    const ib_mpool_t      *mp,
+    ib_mpool_cache_kind_t  kind,
+    void                  *item
+)
+{
+    assert(mp   != NULL);
+    assert(item != NULL);
+
+    if (! ib_mpool_cache_put(mp, kind, item)) {
+        mp->free_fn(item);
+    }
+
     return;
 }
 
@@ -596,8 +1060,9 @@ void ib_mpool_remove_child_from_parent(const ib_mpool_t *child)
 /**
  * Acquire a new page.
  *
- * Pops a page from the free list if available or allocates a new page if
- * not.  The page returned should be considered uninitialized.
+ * Pops a page from the free list if available, else takes one from the
+ * thread cache, or allocates a new page if neither has one.  The page
+ * returned should be considered uninitialized.
  *
  * @param[in] mp Memory pool to acquire page for.
  * @return Uninitialized page or NULL on allocation error.
@@ -616,7 +1081,11 @@ ib_mpool_page_t *ib_mpool_acquire_page(
         mp->free_pages = mp->free_pages->next;
     }
     else {
-        mpage = mp->malloc_fn(sizeof(ib_mpool_page_t) + mp->pagesize - 1);
+        mpage = ib_mpool_cache_get(mp, IB_MPOOL_CACHE_PAGE);
+        if (mpage == NULL) {
+            mpage =
+                mp->malloc_fn(sizeof(ib_mpool_page_t) + mp->pagesize - 1);
+        }
     }
 
 #ifdef IB_MPOOL_VALGRIND
@@ -632,9 +1101,9 @@ ib_mpool_page_t *ib_mpool_acquire_page(
 /**
  * Acquire a new pointer page.
  *
- * Pops a pointer page from the free list if available or allocates a new
- * pointer page if not.  The pointer page returned should be considered
- * uninitialized.
+ * Pops a pointer page from the free list if available, else takes one from
+ * the thread cache, or allocates a new pointer page if neither has one.  The
+ * pointer page returned should be considered uninitialized.
  *
  * @param[in] mp Memory pool to acquire pointer page for.
  * @return Uninitialized pointer page or NULL on allocation error.
@@ -653,7 +1122,10 @@ ib_mpool_pointer_page_t *ib_mpool_acquire_pointer_page(
         mp->free_pointer_pages = mp->free_pointer_pages->next;
     }
     else {
-        ppage = mp->malloc_fn(sizeof(*ppage));
+        ppage = ib_mpool_cache_get(mp, IB_MPOOL_CACHE_POINTER_PAGE);
+        if (ppage == NULL) {
+            ppage = mp->malloc_fn(sizeof(*ppage));
+        }
     }
 
     return ppage;
@@ -970,9 +1442,9 @@ bool ib_mpool_debug_report_helper(
     IMR_PRINTF("  large_allocation_inuse = %zd\n",
         mp->large_allocation_inuse);
     IMR_PRINTF("  next                   = %p\n",  mp->next);
+    IMR_PRINTF("  state                  = %d\n",  mp->state);
     IMR_PRINTF("  children               = %p\n",  mp->children);
     IMR_PRINTF("  children_end           = %p\n",  mp->children_end);
-    IMR_PRINTF("  lock                   = %p\n",  &(mp->lock));
     IMR_PRINTF("  tracks                 = %p\n",  mp->tracks);
     IMR_PRINTF("  large_allocations      = %p\n",  mp->large_allocations);
     IMR_PRINTF("  large_allocations_end  = %p\n",  mp->large_allocations_end);
@@ -981,7 +1453,6 @@ bool ib_mpool_debug_report_helper(
     IMR_PRINTF("  free_pages             = %p\n",  mp->free_pages);
     IMR_PRINTF("  free_pointer_pages     = %p\n",  mp->free_pointer_pages);
     IMR_PRINTF("  free_cleanups          = %p\n",  mp->free_cleanups);
-    IMR_PRINTF("  free_children          = %p\n",  mp->free_children);
 
     IMR_PRINTF("%s", "Tracks:\n");
     for (size_t track_num = 0; track_num < IB_MPOOL_NUM_TRACKS; ++track_num) {
@@ -1045,8 +1516,11 @@ bool ib_mpool_debug_report_helper(
 
     IB_MPOOL_FOREACH(
         const ib_mpool_t, free_child,
-        mp->free_children
+        mp->children
     ) {
+        if (free_child->state != IB_MPOOL_STATE_FREE) {
+            continue;
+        }
         bool result = ib_mpool_debug_report_helper(free_child, report);
         if (! result) {
             goto failure;
@@ -1059,6 +1533,9 @@ bool ib_mpool_debug_report_helper(
         const ib_mpool_t, child,
         mp->children
     ) {
+        if (child->state != IB_MPOOL_STATE_LIVE) {
+            continue;
+        }
         bool result = ib_mpool_debug_report_helper(child, report);
         if (! result) {
             goto failure;
@@ -1128,19 +1605,21 @@ bool ib_mpool_analyze_free_child(
 
     total_used += free_page + free_cleanup + free_pointer_page;
 
-    if (free_child->free_children != NULL) {
-        IMR_PRINTF("%s", " + [");
-        IB_MPOOL_FOREACH(
-            const ib_mpool_t, free_subchild,
-            free_child->free_children
-        ) {
-            size_t child_use = 0;
-            ib_mpool_analyze_free_child(free_subchild, report, &child_use);
-            total_used += child_use;
-            if (free_subchild->next != NULL) {
-                IMR_PRINTF("%s", " + ");
-            }
+    bool first = true;
+    IB_MPOOL_FOREACH(
+        const ib_mpool_t, free_subchild,
+        free_child->children
+    ) {
+        size_t child_use = 0;
+        if (free_subchild->state != IB_MPOOL_STATE_FREE) {
+            continue;
         }
+        IMR_PRINTF("%s", first ? " + [" : " + ");
+        first = false;
+        ib_mpool_analyze_free_child(free_subchild, report, &child_use);
+        total_used += child_use;
+    }
+    if (! first) {
         IMR_PRINTF("%s", "]");
     }
 
@@ -1294,15 +1773,19 @@ bool ib_mpool_analyze_helper(
         );
     }
 
-    if (mp->free_children != NULL) {
-        IMR_PRINTF("%s", "Free children: ");
-
+    {
         size_t total_free_child_use = 0;
+        bool   first = true;
         IB_MPOOL_FOREACH(
             const ib_mpool_t, free_child,
-            mp->free_children
+            mp->children
         ) {
             size_t free_child_use = 0;
+            if (free_child->state != IB_MPOOL_STATE_FREE) {
+                continue;
+            }
+            IMR_PRINTF("%s", first ? "Free children: " : " + ");
+            first = false;
             bool result = ib_mpool_analyze_free_child(
                 free_child,
                 report,
@@ -1312,11 +1795,10 @@ bool ib_mpool_analyze_helper(
                 goto failure;
             }
             total_free_child_use += free_child_use;
-            if (free_child->next != NULL) {
-                IMR_PRINTF("%s", " + ");
-            }
         }
-        IMR_PRINTF("\nTotal Free Child Use=%zd\n", total_free_child_use);
+        if (! first) {
+            IMR_PRINTF("\nTotal Free Child Use=%zd\n", total_free_child_use);
+        }
     }
 
     if (mp->children != NULL) {
@@ -1326,6 +1808,9 @@ bool ib_mpool_analyze_helper(
             const ib_mpool_t, child,
             mp->children
         ) {
+            if (child->state != IB_MPOOL_STATE_LIVE) {
+                continue;
+            }
             bool result = ib_mpool_analyze_helper(child, report);
             if (! result) {
                 goto failure;
@@ -1420,42 +1905,27 @@ ib_status_t ib_mpool_create_ex(
         }
     }
 
-    bool reacquired = false;
+    bool             is_new = false;
+    ib_mpool_state_t prior  = IB_MPOOL_STATE_DEAD;
     if (parent != NULL) {
-        rc = ib_lock_lock(&(parent->lock));
-        if (rc != IB_OK) {
-            goto failure;
-        }
-        if (
-            parent->free_children != NULL &&
-            parent->free_children->pagesize  == pagesize &&
-            parent->free_children->malloc_fn == malloc_fn &&
-            parent->free_children->free_fn   == free_fn
-        ) {
-            mp = parent->free_children;
-            parent->free_children = mp->next;
-
-            mp->next = NULL;
-            reacquired = true;
-            assert(mp->inuse                  == 0);
-            assert(mp->large_allocation_inuse == 0);
-        }
-        ib_lock_unlock(&(parent->lock));
+        mp = ib_mpool_claim_child(parent, pagesize, malloc_fn, free_fn,
+                                  &prior);
     }
-    if (! reacquired) {
+    if (mp != NULL) {
+        assert(mp->inuse                  == 0);
+        assert(mp->large_allocation_inuse == 0);
+    }
+    else {
         mp = (ib_mpool_t *)malloc_fn(sizeof(**pmp));
         if (mp == NULL) {
             return IB_EALLOC;
         }
         memset(mp, 0, sizeof(**pmp));
+        mp->state = IB_MPOOL_STATE_CLAIMED;
+        is_new = true;
     }
     *pmp = mp;
 
-    rc = ib_lock_init(&(mp->lock));
-    if (rc != IB_OK) {
-        goto failure;
-    }
-
     mp->pagesize               = pagesize;
     mp->malloc_fn              = malloc_fn;
     mp->free_fn                = free_fn;
@@ -1465,35 +1935,28 @@ ib_status_t ib_mpool_create_ex(
 
     rc = ib_mpool_setname(mp, name);
     if (rc != IB_OK) {
-        return rc;
-    }
-
-    if (parent != NULL) {
-        rc = ib_lock_lock(&(parent->lock));
-        if (rc != IB_OK) {
-            goto failure;
-        }
-        mp->next = parent->children;
-        if (parent->children == NULL) {
-            parent->children_end = mp;
-        }
-        parent->children = mp;
-        ib_lock_unlock(&(parent->lock));
+        goto failure;
     }
 
 #ifdef IB_MPOOL_VALGRIND
     VALGRIND_CREATE_MEMPOOL(mp, IB_MPOOL_REDZONE_SIZE, 0);
 #endif
 
+    ib_mpool_set_state(mp, IB_MPOOL_STATE_LIVE);
+    if (parent != NULL && is_new) {
+        ib_mpool_push_child(mp);
+    }
+
     return IB_OK;
 
 failure:
-    if (mp != NULL) {
-        if (mp->name != NULL) {
-            free_fn(mp->name);
-        }
+    if (is_new) {
         free_fn(mp);
     }
+    else {
+        /* Still on the parent's child list; leave it for the next claim. */
+        ib_mpool_set_state(mp, prior);
+    }
     *pmp = NULL;
 
     return rc;
@@ -1696,7 +2159,9 @@ void ib_mpool_clear(
     mp->large_allocation_inuse = 0;
 
     IB_MPOOL_FOREACH(ib_mpool_t, child, mp->children) {
-        ib_mpool_clear(child);
+        if (child->state == IB_MPOOL_STATE_LIVE) {
+            ib_mpool_clear(child);
+        }
     }
 
 #ifdef IB_MPOOL_VALGRIND
@@ -1716,12 +2181,12 @@ void ib_mpool_destroy(
 
     for (size_t track_num = 0; track_num < IB_MPOOL_NUM_TRACKS; ++track_num) {
         IB_MPOOL_FOREACH(ib_mpool_page_t, mpage, mp->tracks[track_num]) {
-            mp->free_fn(mpage);
+            ib_mpool_cache_free(mp, IB_MPOOL_CACHE_PAGE, mpage);
         }
     }
 
     IB_MPOOL_FOREACH(ib_mpool_pointer_page_t, ppage, mp->large_allocations) {
-        mp->free_fn(ppage);
+        ib_mpool_cache_free(mp, IB_MPOOL_CACHE_POINTER_PAGE, ppage);
     }
 
     IB_MPOOL_FOREACH(ib_mpool_cleanup_t, cleanup, mp->cleanups) {
@@ -1729,11 +2194,11 @@ void ib_mpool_destroy(
     }
 
     IB_MPOOL_FOREACH(ib_mpool_page_t, mpage, mp->free_pages) {
-        mp->free_fn(mpage);
+        ib_mpool_cache_free(mp, IB_MPOOL_CACHE_PAGE, mpage);
     }
 
     IB_MPOOL_FOREACH(ib_mpool_pointer_page_t, ppage, mp->free_pointer_pages) {
-        mp->free_fn(ppage);
+        ib_mpool_cache_free(mp, IB_MPOOL_CACHE_POINTER_PAGE, ppage);
     }
 
     IB_MPOOL_FOREACH(ib_mpool_cleanup_t, cleanup, mp->free_cleanups) {
@@ -1741,31 +2206,29 @@ void ib_mpool_destroy(
     }
 
    /* We remove the child's parent link so that the child does not
-    * worry about us as we also face imminent destruction.
+    * worry about us as we also face imminent destruction.  This frees
+    * released and destroyed children as well.
     */
 
-    IB_MPOOL_FOREACH(ib_mpool_t, free_child, mp->free_children) {
-        free_child->parent = NULL;
-        ib_mpool_destroy(free_child);
-    }
     IB_MPOOL_FOREACH(ib_mpool_t, child, mp->children) {
         child->parent = NULL;
         ib_mpool_destroy(child);
     }
 
-    if (mp->parent) {
-        /* We have no good options if lock or unlock fails, so we hope. */
-        ib_lock_lock(&(mp->parent->lock));
-
-        ib_mpool_remove_child_from_parent(mp);
-
-        ib_lock_unlock(&(mp->parent->lock));
-    }
-
     if (mp->name) {
         mp->free_fn(mp->name);
     }
 
+    if (mp->parent) {
+        /* Stay on the parent's child list for a later ib_mpool_create(). */
+        ib_mpool_reset(mp);
+#ifdef IB_MPOOL_VALGRIND
+        VALGRIND_DESTROY_MEMPOOL(mp);
+#endif
+        ib_mpool_set_state(mp, IB_MPOOL_STATE_DEAD);
+        return;
+    }
+
     mp->free_fn(mp);
 
 #ifdef IB_MPOOL_VALGRIND
@@ -1796,24 +2259,18 @@ void ib_mpool_release(
 
     /* Release all subpools. */
     IB_MPOOL_FOREACH(ib_mpool_t, child, mp->children) {
-        ib_mpool_release(child);
+        if (child->state == IB_MPOOL_STATE_LIVE) {
+            ib_mpool_release(child);
+        }
     }
 
-    ib_lock_lock(&(mp->parent->lock));
-
-    /* Remove from parent child list. */
-    ib_mpool_remove_child_from_parent(mp);
-
-    /* Add to parent free children list. */
-    mp->next = mp->parent->free_children;
-    mp->parent->free_children = mp;
-
-    ib_lock_unlock(&(mp->parent->lock));
-
 #ifdef IB_MPOOL_VALGRIND
     VALGRIND_DESTROY_MEMPOOL(mp);
 #endif
 
+    /* Mark free for reuse by the parent. */
+    ib_mpool_set_state(mp, IB_MPOOL_STATE_FREE);
+
     return;
 }
 
@@ -1988,12 +2445,6 @@ ib_status_t ib_mpool_validate(
         while (child != NULL && child != mp) {
             child = child->next;
         }
-        if (child == NULL) {
-            child = mp->parent->free_children;
-            while (child != NULL && child != mp) {
-                child = child->next;
-            }
-        }
         if (child == NULL) {
             VALIDATE_ERROR(
                 "Not a child or free child of my parent: %p",
@@ -2073,6 +2524,9 @@ ib_status_t ib_mpool_validate(
 
     /* Validate children */
     IB_MPOOL_FOREACH(ib_mpool_t, child, mp->children) {
+        if (child->state != IB_MPOOL_STATE_LIVE) {
+            continue;
+        }
         if (child->parent != mp) {
             VALIDATE_ERROR(
                 "Child does not consider me its parent: %p %p",
@@ -2089,7 +2543,10 @@ ib_status_t ib_mpool_validate(
     }
 
     /* Validate free children */
-    IB_MPOOL_FOREACH(ib_mpool_t, free_child, mp->free_children) {
+    IB_MPOOL_FOREACH(ib_mpool_t, free_child, mp->children) {
+        if (free_child->state != IB_MPOOL_STATE_FREE) {
+            continue;
+        }
         if (free_child->parent != mp) {
             VALIDATE_ERROR(
                 "Free Child does not consider me its parent: %p %p",
@@ -2097,11 +2554,13 @@ ib_status_t ib_mpool_validate(
             );
         }
         /* Free child specific checks. */
-        if (free_child->children != NULL) {
-            VALIDATE_ERROR(
-                "Free Child has children: %p",
-                free_child
-            );
+        IB_MPOOL_FOREACH(ib_mpool_t, grandchild, free_child->children) {
+            if (grandchild->state == IB_MPOOL_STATE_LIVE) {
+                VALIDATE_ERROR(
+                    "Free Child has children: %p",
+                    free_child
+                );
+            }
         }
         for (
             size_t track_num = 0;
@@ -0,0 +1,155 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee --- Buffer Slice Routines
+ */
+
+#include "ironbee_config_auto.h"
+
+#include <ironbee/slice.h>
+
+#include <assert.h>
+#include <stdlib.h>
+
+/** Buffer slice */
+struct ib_slice_t {
+    const uint8_t              *data;      /**< Data */
+    size_t                      dlen;      /**< Data length */
+    ib_slice_t                 *parent;    /**< Slice of a sub-slice */
+    ib_slice_release_fn_t       release;   /**< Release callback */
+    void                       *cbdata;    /**< Release callback data */
+    uint32_t                    refs;      /**< Reference count */
+};
+
+/**
+ * Release a slice reference taken by ib_slice_ref_mpool().
+ *
+ * @param[in] cbdata Slice
+ */
+static void slice_cleanup(void *cbdata)
+{
+    ib_slice_release((ib_slice_t *)cbdata);
+}
+
+ib_status_t ib_slice_create(ib_slice_t **pslice,
+                            const uint8_t *data,
+                            size_t dlen,
+                            ib_slice_release_fn_t release,
+                            void *cbdata)
+{
+    assert(pslice != NULL);
+    assert( (data != NULL) || (dlen == 0) );
+
+    ib_slice_t *slice;
+
+    slice = malloc(sizeof(*slice));
+    if (slice == NULL) {
+        return IB_EALLOC;
+    }
+    slice->data = data;
+    slice->dlen = dlen;
+    slice->parent = NULL;
+    slice->release = release;
+    slice->cbdata = cbdata;
+    slice->refs = 1;
+
+    *pslice = slice;
+    return IB_OK;
+}
+
+ib_status_t ib_slice_sub(ib_slice_t **psub,
+                         ib_slice_t *slice,
+                         size_t offset,
+                         size_t dlen)
+{
+    assert(psub != NULL);
+    assert(slice != NULL);
+
+    ib_slice_t *sub;
+    ib_status_t rc;
+
+    if ( (offset > slice->dlen) || (dlen > slice->dlen - offset) ) {
+        return IB_EINVAL;
+    }
+
+    rc = ib_slice_create(&sub, slice->data + offset, dlen, NULL, NULL);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    ib_slice_ref(slice);
+    sub->parent = slice;
+
+    *psub = sub;
+    return IB_OK;
+}
+
+void ib_slice_ref(ib_slice_t *slice)
+{
+    assert(slice != NULL);
+
+    __sync_fetch_and_add(&(slice->refs), 1);
+}
+
+void ib_slice_release(ib_slice_t *slice)
+{
+    assert(slice != NULL);
+
+    if (__sync_sub_and_fetch(&(slice->refs), 1) != 0) {
+        return;
+    }
+
+    if (slice->parent != NULL) {
+        ib_slice_release(slice->parent);
+    }
+    else if (slice->release != NULL) {
+        slice->release(slice->data, slice->dlen, slice->cbdata);
+    }
+    free(slice);
+}
+
+ib_status_t ib_slice_ref_mpool(ib_slice_t *slice,
+                               ib_mpool_t *mp)
+{
+    assert(slice != NULL);
+    assert(mp != NULL);
+
+    ib_status_t rc;
+
+    ib_slice_ref(slice);
+    rc = ib_mpool_cleanup_register(mp, slice_cleanup, slice);
+    if (rc != IB_OK) {
+        ib_slice_release(slice);
+    }
+
+    return rc;
+}
+
+const uint8_t *ib_slice_data(const ib_slice_t *slice)
+{
+    assert(slice != NULL);
+
+    return slice->data;
+}
+
+size_t ib_slice_length(const ib_slice_t *slice)
+{
+    assert(slice != NULL);
+
+    return slice->dlen;
+}
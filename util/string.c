@@ -173,45 +173,6 @@ ib_status_t ib_string_to_float(const char *s, ib_float_t *result)
 }
 
 
-/**
- * strstr() clone that works with non-NUL terminated strings
- */
-const char *ib_strstr_ex(const char *haystack,
-                         size_t      haystack_len,
-                         const char *needle,
-                         size_t      needle_len)
-{
-    size_t i = 0;
-    size_t imax;
-
-    /* If either pointer is NULL or either length is zero, done */
-    if ( (haystack == NULL) || (haystack_len == 0) ||
-         (needle == NULL) || (needle_len == 0) )
-    {
-        return NULL;
-    }
-
-    /* Search for the needle */
-    imax = haystack_len - (needle_len-1);
-    for (i = 0; i < imax; ++i) {
-        const char *hp = haystack + i;
-        bool found = true;
-        size_t j = 0;
-
-        for (j = 0; j < needle_len; ++j) {
-            if ( *(hp + j) != *(needle + j) ) {
-                found = false;
-                break;
-            }
-        }
-        if (found) {
-            return hp;
-        }
-    }
-
-    return NULL;
-}
-
 /**
  * Reverse strstr() clone that works with non-NUL terminated strings
  */
@@ -225,7 +186,8 @@ const char *ib_strrstr_ex(const char *haystack,
 
     /* If either pointer is NULL or either length is zero, done */
     if ( (haystack == NULL) || (haystack_len == 0) ||
-         (needle == NULL) || (needle_len == 0) )
+         (needle == NULL) || (needle_len == 0) ||
+         (needle_len > haystack_len) )
     {
         return NULL;
     }
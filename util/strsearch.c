@@ -0,0 +1,315 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee --- Substring search functions
+ *
+ * On x86 the search compares the first and last byte of the needle against
+ * 16 (SSE2) or 32 (AVX2) haystack positions at once and only verifies the
+ * positions where both match.  The implementation is chosen once, on first
+ * use, based on the features of the CPU.  Other platforms, and the tail of the
+ * haystack, use a scalar search.
+ */
+
+#include "ironbee_config_auto.h"
+
+#include <ironbee/string.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    ( defined(__clang__) || \
+      (defined(__GNUC__) && (__GNUC__ > 4 || \
+                             (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))) )
+#define STRSEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Substring search implementation.
+ *
+ * @param[in] haystack String to search.
+ * @param[in] haystack_len Length of @a haystack.
+ * @param[in] needle String to search for.
+ * @param[in] needle_len Length of @a needle (at least 1, at most
+ *            @a haystack_len).
+ * @param[in] nocase Ignore ASCII case?
+ *
+ * @returns Pointer to the first match in @a haystack, or NULL.
+ */
+typedef const char *(*strsearch_fn_t)(const char *haystack,
+                                      size_t      haystack_len,
+                                      const char *needle,
+                                      size_t      needle_len,
+                                      bool        nocase);
+
+/**
+ * ASCII lower case of a byte.
+ */
+static inline uint8_t fold(uint8_t c)
+{
+    return ( (c >= 'A') && (c <= 'Z') ) ? (c | 0x20) : c;
+}
+
+/**
+ * ASCII upper case of a byte.
+ */
+static inline uint8_t unfold(uint8_t c)
+{
+    return ( (c >= 'a') && (c <= 'z') ) ? (c & ~0x20) : c;
+}
+
+/**
+ * Compare two buffers, optionally ignoring ASCII case.
+ *
+ * @returns true if the first @a len bytes of @a a and @a b are equal.
+ */
+static inline bool equal(const char *a, const char *b, size_t len, bool nocase)
+{
+    if (! nocase) {
+        return memcmp(a, b, len) == 0;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        if (fold((uint8_t)a[i]) != fold((uint8_t)b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Scalar search; see strsearch_fn_t.
+ */
+static const char *strsearch_scalar(const char *haystack,
+                                    size_t      haystack_len,
+                                    const char *needle,
+                                    size_t      needle_len,
+                                    bool        nocase)
+{
+    const char *end = haystack + (haystack_len - needle_len) + 1;
+    const char *hp;
+
+    if (! nocase) {
+        /* memchr() is already vectorized by the C library. */
+        hp = haystack;
+        while ( (hp < end) &&
+                ((hp = memchr(hp, needle[0], end - hp)) != NULL) )
+        {
+            if (memcmp(hp + 1, needle + 1, needle_len - 1) == 0) {
+                return hp;
+            }
+            ++hp;
+        }
+        return NULL;
+    }
+
+    for (hp = haystack; hp < end; ++hp) {
+        if ( (fold((uint8_t)*hp) == fold((uint8_t)needle[0])) &&
+             equal(hp + 1, needle + 1, needle_len - 1, true) )
+        {
+            return hp;
+        }
+    }
+    return NULL;
+}
+
+#ifdef STRSEARCH_X86
+
+/**
+ * SSE2 search; see strsearch_fn_t.
+ */
+__attribute__((target("sse2")))
+static const char *strsearch_sse2(const char *haystack,
+                                  size_t      haystack_len,
+                                  const char *needle,
+                                  size_t      needle_len,
+                                  bool        nocase)
+{
+    const size_t  last = needle_len - 1;
+    const uint8_t f = (uint8_t)needle[0];
+    const uint8_t l = (uint8_t)needle[last];
+    const __m128i first_lo = _mm_set1_epi8(nocase ? fold(f) : f);
+    const __m128i first_hi = _mm_set1_epi8(nocase ? unfold(f) : f);
+    const __m128i last_lo = _mm_set1_epi8(nocase ? fold(l) : l);
+    const __m128i last_hi = _mm_set1_epi8(nocase ? unfold(l) : l);
+    size_t        i = 0;
+
+    for (i = 0; i + last + 16 <= haystack_len; i += 16) {
+        const __m128i bf =
+            _mm_loadu_si128((const __m128i *)(haystack + i));
+        const __m128i bl =
+            _mm_loadu_si128((const __m128i *)(haystack + i + last));
+        const __m128i ef = _mm_or_si128(_mm_cmpeq_epi8(bf, first_lo),
+                                        _mm_cmpeq_epi8(bf, first_hi));
+        const __m128i el = _mm_or_si128(_mm_cmpeq_epi8(bl, last_lo),
+                                        _mm_cmpeq_epi8(bl, last_hi));
+        unsigned int  mask = (unsigned int)_mm_movemask_epi8(
+            _mm_and_si128(ef, el));
+
+        while (mask != 0) {
+            const char *hp = haystack + i + __builtin_ctz(mask);
+
+            if ( (needle_len <= 2) ||
+                 equal(hp + 1, needle + 1, needle_len - 2, nocase) )
+            {
+                return hp;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    if (i + needle_len > haystack_len) {
+        return NULL;
+    }
+    return strsearch_scalar(haystack + i, haystack_len - i,
+                            needle, needle_len, nocase);
+}
+
+/**
+ * AVX2 search; see strsearch_fn_t.
+ */
+__attribute__((target("avx2")))
+static const char *strsearch_avx2(const char *haystack,
+                                  size_t      haystack_len,
+                                  const char *needle,
+                                  size_t      needle_len,
+                                  bool        nocase)
+{
+    const size_t  last = needle_len - 1;
+    const uint8_t f = (uint8_t)needle[0];
+    const uint8_t l = (uint8_t)needle[last];
+    const __m256i first_lo = _mm256_set1_epi8(nocase ? fold(f) : f);
+    const __m256i first_hi = _mm256_set1_epi8(nocase ? unfold(f) : f);
+    const __m256i last_lo = _mm256_set1_epi8(nocase ? fold(l) : l);
+    const __m256i last_hi = _mm256_set1_epi8(nocase ? unfold(l) : l);
+    size_t        i = 0;
+
+    for (i = 0; i + last + 32 <= haystack_len; i += 32) {
+        const __m256i bf =
+            _mm256_loadu_si256((const __m256i *)(haystack + i));
+        const __m256i bl =
+            _mm256_loadu_si256((const __m256i *)(haystack + i + last));
+        const __m256i ef = _mm256_or_si256(_mm256_cmpeq_epi8(bf, first_lo),
+                                           _mm256_cmpeq_epi8(bf, first_hi));
+        const __m256i el = _mm256_or_si256(_mm256_cmpeq_epi8(bl, last_lo),
+                                           _mm256_cmpeq_epi8(bl, last_hi));
+        unsigned int  mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(ef, el));
+
+        while (mask != 0) {
+            const char *hp = haystack + i + __builtin_ctz(mask);
+
+            if ( (needle_len <= 2) ||
+                 equal(hp + 1, needle + 1, needle_len - 2, nocase) )
+            {
+                return hp;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    /* Finish with 16 byte blocks and then the scalar search. */
+    if (i + needle_len > haystack_len) {
+        return NULL;
+    }
+    return strsearch_sse2(haystack + i, haystack_len - i,
+                          needle, needle_len, nocase);
+}
+
+#endif /* STRSEARCH_X86 */
+
+/**
+ * The selected implementation; set once by strsearch_select().
+ */
+static strsearch_fn_t strsearch_impl = strsearch_scalar;
+
+/**
+ * Guards strsearch_select().
+ */
+static pthread_once_t strsearch_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Select the best implementation for the CPU.
+ *
+ * Run exactly once, through pthread_once(), so concurrent first callers
+ * never see a partially selected implementation.
+ */
+static void strsearch_select(void)
+{
+    strsearch_fn_t fn = strsearch_scalar;
+
+#ifdef STRSEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        fn = strsearch_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+        fn = strsearch_sse2;
+    }
+#endif
+
+    strsearch_impl = fn;
+}
+
+/**
+ * Get the selected implementation, selecting it on first use.
+ *
+ * @returns Substring search implementation.
+ */
+static inline strsearch_fn_t strsearch_get(void)
+{
+    pthread_once(&strsearch_once, strsearch_select);
+    return strsearch_impl;
+}
+
+const char *ib_strstr_ex(const char *haystack,
+                         size_t      haystack_len,
+                         const char *needle,
+                         size_t      needle_len)
+{
+    /* If either pointer is NULL or either length is zero, done */
+    if ( (haystack == NULL) || (haystack_len == 0) ||
+         (needle == NULL) || (needle_len == 0) ||
+         (needle_len > haystack_len) )
+    {
+        return NULL;
+    }
+
+    return strsearch_get()(haystack, haystack_len, needle, needle_len, false);
+}
+
+const char *ib_strcasestr_ex(const char *haystack,
+                             size_t      haystack_len,
+                             const char *needle,
+                             size_t      needle_len)
+{
+    /* If either pointer is NULL or either length is zero, done */
+    if ( (haystack == NULL) || (haystack_len == 0) ||
+         (needle == NULL) || (needle_len == 0) ||
+         (needle_len > haystack_len) )
+    {
+        return NULL;
+    }
+
+    return strsearch_get()(haystack, haystack_len, needle, needle_len, true);
+}